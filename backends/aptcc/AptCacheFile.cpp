@@ -22,14 +22,43 @@
 #include "apt-utils.h"
 #include "apt-messages.h"
 #include "OpPackageKitProgress.h"
+#include "dpkg-file-index.h"
 
 #include <apt-pkg/algorithms.h>
+#include <apt-pkg/aptconfiguration.h>
+#include <apt-pkg/configuration.h>
+#include <sys/stat.h>
 #include <sstream>
 #include <cstdio>
+#include <cstring>
+
+// The cache shared by read-only transactions, and the state of
+// the files it was built from at the time it was opened
+static AptCacheFile *sharedCacheFile = 0;
+static struct stat sharedStatusStat;
+static struct stat sharedListsStat;
+
+static void stampFile(const std::string &path, struct stat &buf)
+{
+    if (stat(path.c_str(), &buf) != 0) {
+        memset(&buf, 0, sizeof(buf));
+    }
+}
+
+static bool stampChanged(const std::string &path, const struct stat &old)
+{
+    struct stat buf;
+    stampFile(path, buf);
+    return buf.st_ino != old.st_ino ||
+            buf.st_size != old.st_size ||
+            buf.st_mtim.tv_sec != old.st_mtim.tv_sec ||
+            buf.st_mtim.tv_nsec != old.st_mtim.tv_nsec;
+}
 
 AptCacheFile::AptCacheFile(PkBackendJob *job) :
     m_packageRecords(0),
-    m_job(job)
+    m_job(job),
+    m_shared(false)
 {
 }
 
@@ -38,6 +67,76 @@ AptCacheFile::~AptCacheFile()
     Close();
 }
 
+AptCacheFile* AptCacheFile::sharedCache(PkBackendJob *job)
+{
+    const std::string statusFile = _config->FindFile("Dir::State::status");
+    const std::string listsDir = _config->FindDir("Dir::State::Lists");
+
+    if (sharedCacheFile &&
+            (stampChanged(statusFile, sharedStatusStat) ||
+             stampChanged(listsDir, sharedListsStat))) {
+        g_debug("dpkg status or apt lists changed, reopening the package cache");
+        releaseSharedCache();
+    }
+
+    if (sharedCacheFile) {
+        sharedCacheFile->setJob(job);
+        return sharedCacheFile;
+    }
+
+    // Stamp the files before opening so that changes made
+    // while the cache is being built invalidate it
+    stampFile(statusFile, sharedStatusStat);
+    stampFile(listsDir, sharedListsStat);
+
+    AptCacheFile *cache = new AptCacheFile(job);
+    if (cache->Open(false) == false) {
+        show_errors(job, PK_ERROR_ENUM_CANNOT_GET_LOCK);
+        delete cache;
+        return 0;
+    }
+
+    // Check if there are half-installed packages, this only
+    // needs to be done once for the lifetime of the cache
+    if (cache->CheckDeps(false) == false) {
+        delete cache;
+        return 0;
+    }
+
+    cache->m_shared = true;
+    sharedCacheFile = cache;
+    return cache;
+}
+
+void AptCacheFile::releaseSharedCache()
+{
+    delete sharedCacheFile;
+    sharedCacheFile = 0;
+}
+
+bool AptCacheFile::isShared() const
+{
+    return m_shared;
+}
+
+std::string AptCacheFile::sharedGeneration()
+{
+    std::ostringstream generation;
+    const struct stat *stamps[] = { &sharedStatusStat, &sharedListsStat };
+    for (size_t i = 0; i < G_N_ELEMENTS(stamps); ++i) {
+        generation << stamps[i]->st_ino << ':'
+                   << stamps[i]->st_size << ':'
+                   << stamps[i]->st_mtim.tv_sec << '.'
+                   << stamps[i]->st_mtim.tv_nsec << ';';
+    }
+    return generation.str();
+}
+
+void AptCacheFile::setJob(PkBackendJob *job)
+{
+    m_job = job;
+}
+
 bool AptCacheFile::Open(bool withLock)
 {
     OpPackageKitProgress progress(m_job);
@@ -49,6 +148,7 @@ void AptCacheFile::Close()
     delete m_packageRecords;
 
     m_packageRecords = 0;
+    m_versionFlags.clear();
 
     pkgCacheFile::Close();
 
@@ -258,6 +358,108 @@ void AptCacheFile::buildPkgRecords()
     m_packageRecords = new pkgRecords(*this);
 }
 
+void AptCacheFile::buildVersionFlags()
+{
+    pkgCache *cache = GetPkgCache();
+    const std::string nativeArch = _config->Find("APT::Architecture");
+
+    m_versionFlags.assign(cache->Head().VersionCount, 0);
+    for (pkgCache::PkgIterator pkg = cache->PkgBegin(); !pkg.end(); ++pkg) {
+        const std::string pkgName = pkg.Name();
+        bool nameIsDevel = ends_with(pkgName, "-dev") || ends_with(pkgName, "-dbg");
+
+        for (pkgCache::VerIterator ver = pkg.VersionList(); !ver.end(); ++ver) {
+            unsigned short flags = 0;
+
+            if (pkg->CurrentState == pkgCache::State::Installed && pkg.CurrentVer() == ver) {
+                flags |= VerInstalled;
+            }
+
+            if (strcmp(ver.Arch(), "all") == 0 || nativeArch.compare(ver.Arch()) == 0) {
+                flags |= VerNativeArch;
+            }
+
+            std::string str = ver.Section() == NULL ? "" : ver.Section();
+            std::string section, component;
+            size_t found;
+            found = str.find_last_of("/");
+            section = str.substr(found + 1);
+            if (found == str.npos) {
+                component = "main";
+            } else {
+                component = str.substr(0, found);
+            }
+
+            if (nameIsDevel || section == "devel" || section == "libdevel") {
+                flags |= VerDevel;
+            }
+
+            if (section == "x11" || section == "gnome" ||
+                    section == "kde" || section == "graphics") {
+                flags |= VerGui;
+            }
+
+            // Must be in main and universe to be free
+            if (component == "main" || component == "universe") {
+                flags |= VerFree;
+            }
+
+            if (component == "metapackages") {
+                flags |= VerCollection;
+            }
+
+            // Officially supported by the current distribution
+            pkgCache::VerFileIterator vf = ver.FileList();
+            const char *origin = vf.end() ? NULL : vf.File().Origin();
+            if (origin != NULL &&
+                    (strcmp(origin, "Debian") == 0 || strcmp(origin, "Ubuntu") == 0) &&
+                    (component == "main" || component == "restricted" ||
+                     component == "unstable" || component == "testing")) {
+                flags |= VerSupported;
+            }
+
+            m_versionFlags[ver->ID] = flags;
+        }
+    }
+}
+
+unsigned int AptCacheFile::versionFlags(const pkgCache::VerIterator &ver, bool withApplication)
+{
+    if (m_versionFlags.empty()) {
+        buildVersionFlags();
+    }
+
+    unsigned short &flags = m_versionFlags[ver->ID];
+    if (withApplication && !(flags & VerApplicationKnown)) {
+        // We can only tell if an installed package is an application
+        if ((flags & VerInstalled) && isApplication(ver)) {
+            flags |= VerApplication;
+        }
+        flags |= VerApplicationKnown;
+    }
+
+    return flags;
+}
+
+bool AptCacheFile::isApplication(const pkgCache::VerIterator &ver)
+{
+    DpkgFileIndex *index = DpkgFileIndex::system();
+    if (index == 0) {
+        return false;
+    }
+
+    std::string listName = ver.ParentPkg().Name();
+    if (APT::Configuration::getArchitectures(false).size() > 1) {
+        // if the list was not found try without the arch field
+        std::string archListName = listName + ":" + ver.Arch();
+        if (index->hasPackage(archListName)) {
+            listName = archListName;
+        }
+    }
+
+    return index->isApplication(listName);
+}
+
 bool AptCacheFile::doAutomaticRemove()
 {
     pkgDepCache::ActionGroup group(*this);
@@ -382,6 +584,22 @@ pkgCache::VerIterator AptCacheFile::resolvePkgID(const gchar *packageId)
     return ver;
 }
 
+std::vector<pkgCache::PkgIterator> AptCacheFile::findPackagesByName(const std::string &name)
+{
+    std::vector<pkgCache::PkgIterator> ret;
+
+    pkgCache::GrpIterator grp = GetPkgCache()->FindGrp(name);
+    if (grp.end()) {
+        return ret;
+    }
+
+    for (pkgCache::PkgIterator pkg = grp.PackageList(); !pkg.end(); pkg = grp.NextPkg(pkg)) {
+        ret.push_back(pkg);
+    }
+
+    return ret;
+}
+
 pkgCache::VerIterator AptCacheFile::findVer(const pkgCache::PkgIterator &pkg)
 {
     // if the package is installed return the current version
@@ -426,7 +644,16 @@ std::string AptCacheFile::getShortDescription(const pkgCache::VerIterator &ver)
 
 std::string AptCacheFile::getLongDescription(const pkgCache::VerIterator &ver)
 {
-    if (ver.end() || ver.FileList().end() || GetPkgRecords() == 0) {
+    if (GetPkgRecords() == 0) {
+        return string();
+    }
+
+    return getLongDescription(ver, *m_packageRecords);
+}
+
+std::string AptCacheFile::getLongDescription(const pkgCache::VerIterator &ver, pkgRecords &records)
+{
+    if (ver.end() || ver.FileList().end()) {
         return string();
     }
 
@@ -439,7 +666,7 @@ std::string AptCacheFile::getLongDescription(const pkgCache::VerIterator &ver)
     if (df.end()) {
         return string();
     } else {
-        return m_packageRecords->Lookup(df).LongDesc();
+        return records.Lookup(df).LongDesc();
     }
 }
 
@@ -27,9 +27,56 @@ class pkgProblemResolver;
 class AptCacheFile : public pkgCacheFile
 {
 public:
+    /**
+      * Attributes of a package version used to filter query results
+      */
+    enum VersionFlag {
+        VerInstalled        = 1 << 0,
+        VerNativeArch       = 1 << 1,
+        VerDevel            = 1 << 2,
+        VerGui              = 1 << 3,
+        VerFree             = 1 << 4,
+        VerSupported        = 1 << 5,
+        VerCollection       = 1 << 6,
+        VerApplication      = 1 << 7,
+        // VerApplication needs disk access so it is only looked up on demand
+        VerApplicationKnown = 1 << 8
+    };
+
     AptCacheFile(PkBackendJob *job);
     ~AptCacheFile();
 
+    /**
+      * Returns the package cache kept open between read-only transactions,
+      * it is reopened when the dpkg status file or the apt lists changed
+      * since it was built
+      * @note this is only safe because the backend does not run jobs in parallel
+      * @returns 0 if the cache could not be opened
+      */
+    static AptCacheFile* sharedCache(PkBackendJob *job);
+
+    /**
+      * Drops the shared package cache, the next read-only
+      * transaction will open a fresh one
+      */
+    static void releaseSharedCache();
+
+    /**
+      * Returns true if this is the cache shared between transactions
+      */
+    bool isShared() const;
+
+    /**
+      * Describes the state of the dpkg status file and the apt lists
+      * the shared cache was built from, it changes whenever they do
+      */
+    static std::string sharedGeneration();
+
+    /**
+      * Sets the job used to report progress and errors
+      */
+    void setJob(PkBackendJob *job);
+
     /**
       * Inits the package cache returning false if it can't open
       */
@@ -97,6 +144,13 @@ public:
      */
     pkgCache::VerIterator resolvePkgID(const gchar *packageId);
 
+    /**
+     * Returns the packages of every architecture with the given name,
+     * looked up through the package group hash of the cache
+     * @returns an empty list if no package has this name
+     */
+    std::vector<pkgCache::PkgIterator> findPackagesByName(const std::string &name);
+
     /**
      * Tries to find the candidate version of a package
      * @returns pkgCache::VerIterator, if .end() is true the version could not be found
@@ -111,6 +165,18 @@ public:
      */
     pkgCache::VerIterator findVer(const pkgCache::PkgIterator &pkg);
 
+    /**
+     * Returns the VersionFlag attributes of the given version, they are
+     * computed for every version in the cache the first time this is called
+     * @param withApplication also find out if the version is an application
+     */
+    unsigned int versionFlags(const pkgCache::VerIterator &ver, bool withApplication = false);
+
+    /**
+     * Checks if an installed package ships a desktop file
+     */
+    bool isApplication(const pkgCache::VerIterator &ver);
+
     /** \return a short description string corresponding to the given
      *  version.
      */
@@ -121,6 +187,11 @@ public:
      */
     std::string getLongDescription(const pkgCache::VerIterator &ver);
 
+    /** \return the long description of the given version looked up
+     *  with \p records, so threads can use their own parser.
+     */
+    static std::string getLongDescription(const pkgCache::VerIterator &ver, pkgRecords &records);
+
     /** \return a short description string corresponding to the given
      *  version.
      */
@@ -135,10 +206,13 @@ public:
 
 private:
     void buildPkgRecords();
+    void buildVersionFlags();
     static std::string debParser(std::string descr);
 
     pkgRecords *m_packageRecords;
+    std::vector<unsigned short> m_versionFlags;
     PkBackendJob *m_job;
+    bool m_shared;
 };
 
 #endif // APTCACHEFILE_H
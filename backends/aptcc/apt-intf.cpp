@@ -26,6 +26,7 @@
 #include <apt-pkg/init.h>
 #include <apt-pkg/error.h>
 #include <apt-pkg/algorithms.h>
+#include <apt-pkg/aptconfiguration.h>
 #include <apt-pkg/pkgsystem.h>
 #include <apt-pkg/sptr.h>
 #include <apt-pkg/version.h>
@@ -34,9 +35,11 @@
 #include <sys/statfs.h>
 #include <sys/wait.h>
 #include <sys/fcntl.h>
+#include <poll.h>
 #include <pty.h>
 
 #include <fstream>
+#include <map>
 #include <dirent.h>
 
 #include "AptCacheFile.h"
@@ -47,15 +50,19 @@
 #include "acqpkitstatus.h"
 #include "pkg_acqfile.h"
 #include "deb-file.h"
+#include "dpkg-file-index.h"
+#include "search-index.h"
+#include "changelog-cache.h"
 
 #define RAMFS_MAGIC     0x858458f6
-#define APTCC_TMP_DIR   "/tmp/aptcc"
 
 AptIntf::AptIntf(PkBackendJob *job) :
     m_job(job),
     m_cancel(false),
     m_terminalTimeout(120),
     m_lastSubProgress(0),
+    m_lastPercentage(-1),
+    m_searchThreads(0),
     m_cache(0)
 {
     m_cancel = false;
@@ -127,24 +134,36 @@ bool AptIntf::init()
         withLock = !simulate;
     }
 
-    // Create the AptCacheFile class to search for packages
-    m_cache = new AptCacheFile(m_job);
-
-    int timeout = 10;
-    // TODO test this
-    while (m_cache->Open(withLock) == false) {
-        if (withLock == false || (timeout <= 0)) {
-            show_errors(m_job, PK_ERROR_ENUM_CANNOT_GET_LOCK);
+    if (isReadOnlyRole(role)) {
+        // Queries reuse the cache opened by a previous transaction
+        m_cache = AptCacheFile::sharedCache(m_job);
+        if (m_cache == 0) {
             return false;
-        } else {
-            _error->Discard();
-            pk_backend_job_set_status(m_job, PK_STATUS_ENUM_WAITING_FOR_LOCK);
-            sleep(1);
-            timeout--;
         }
+    } else {
+        // Any other role might change the system, so don't keep
+        // a stale cache around while it runs
+        AptCacheFile::releaseSharedCache();
+
+        // Create the AptCacheFile class to search for packages
+        m_cache = new AptCacheFile(m_job);
+
+        int timeout = 10;
+        // TODO test this
+        while (m_cache->Open(withLock) == false) {
+            if (withLock == false || (timeout <= 0)) {
+                show_errors(m_job, PK_ERROR_ENUM_CANNOT_GET_LOCK);
+                return false;
+            } else {
+                _error->Discard();
+                pk_backend_job_set_status(m_job, PK_STATUS_ENUM_WAITING_FOR_LOCK);
+                sleep(1);
+                timeout--;
+            }
 
-        // Close the cache if we are going to try again
-        m_cache->Close();
+            // Close the cache if we are going to try again
+            m_cache->Close();
+        }
     }
 
     m_interactive = pk_backend_job_get_interactive(m_job);
@@ -157,10 +176,35 @@ bool AptIntf::init()
         setenv("APT_LISTBUGS_FRONTEND", "none", 1);
     }
 
+    // The shared cache was already checked when it was opened
+    if (m_cache->isShared()) {
+        return true;
+    }
+
     // Check if there are half-installed packages and if we can fix them
     return m_cache->CheckDeps(AllowBroken);
 }
 
+bool AptIntf::isReadOnlyRole(PkRoleEnum role)
+{
+    switch (role) {
+    case PK_ROLE_ENUM_RESOLVE:
+    case PK_ROLE_ENUM_SEARCH_NAME:
+    case PK_ROLE_ENUM_SEARCH_DETAILS:
+    case PK_ROLE_ENUM_SEARCH_FILE:
+    case PK_ROLE_ENUM_SEARCH_GROUP:
+    case PK_ROLE_ENUM_GET_DETAILS:
+    case PK_ROLE_ENUM_GET_FILES:
+    case PK_ROLE_ENUM_GET_PACKAGES:
+    case PK_ROLE_ENUM_DEPENDS_ON:
+    case PK_ROLE_ENUM_REQUIRED_BY:
+    case PK_ROLE_ENUM_WHAT_PROVIDES:
+        return true;
+    default:
+        return false;
+    }
+}
+
 AptIntf::~AptIntf()
 {
     // Check the restart thing
@@ -182,7 +226,15 @@ AptIntf::~AptIntf()
         }
     }
 
-    delete m_cache;
+    if (m_cache && m_cache->isShared()) {
+        // The downloaded filter marks packages for install, don't
+        // hand a modified dependency cache to the next transaction
+        if ((*m_cache)->InstCount() != 0 || (*m_cache)->DelCount() != 0) {
+            AptCacheFile::releaseSharedCache();
+        }
+    } else {
+        delete m_cache;
+    }
 }
 
 void AptIntf::cancel()
@@ -202,146 +254,121 @@ bool AptIntf::cancelled() const
     return m_cancel;
 }
 
-bool AptIntf::matchPackage(const pkgCache::VerIterator &ver, PkBitfield filters)
+void AptIntf::setSearchThreads(guint threads)
 {
-    if (filters != 0) {
-        const pkgCache::PkgIterator &pkg = ver.ParentPkg();
-        bool installed = false;
-
-        // Check if the package is installed
-        if (pkg->CurrentState == pkgCache::State::Installed && pkg.CurrentVer() == ver) {
-            installed = true;
-        }
+    m_searchThreads = threads;
+}
 
-        // if we are on multiarch check also the arch filter
-        if (m_isMultiArch && pk_bitfield_contain(filters, PK_FILTER_ENUM_ARCH)/* && !installed*/) {
-            // don't emit the package if it does not match
-            // the native architecture
-            if (strcmp(ver.Arch(), "all") != 0 &&
-                    strcmp(ver.Arch(), _config->Find("APT::Architecture").c_str()) != 0) {
-                return false;
-            }
-        }
+bool AptIntf::filterFlags(PkBitfield filters, unsigned int &mask, unsigned int &want)
+{
+    mask = 0;
+    want = 0;
 
-        std::string str = ver.Section() == NULL ? "" : ver.Section();
-        std::string section, component;
+    if (pk_bitfield_contain(filters, PK_FILTER_ENUM_INSTALLED)) {
+        mask |= AptCacheFile::VerInstalled;
+        want |= AptCacheFile::VerInstalled;
+    } else if (pk_bitfield_contain(filters, PK_FILTER_ENUM_NOT_INSTALLED)) {
+        mask |= AptCacheFile::VerInstalled;
+    }
 
-        size_t found;
-        found = str.find_last_of("/");
-        section = str.substr(found + 1);
-        if(found == str.npos) {
-            component = "main";
-        } else {
-            component = str.substr(0, found);
-        }
+    // if we are on multiarch check also the arch filter, don't emit
+    // the package if it does not match the native architecture
+    if (m_isMultiArch && pk_bitfield_contain(filters, PK_FILTER_ENUM_ARCH)) {
+        mask |= AptCacheFile::VerNativeArch;
+        want |= AptCacheFile::VerNativeArch;
+    }
 
-        if (pk_bitfield_contain(filters, PK_FILTER_ENUM_NOT_INSTALLED) && installed) {
-            return false;
-        } else if (pk_bitfield_contain(filters, PK_FILTER_ENUM_INSTALLED) && !installed) {
-            return false;
-        }
+    if (pk_bitfield_contain(filters, PK_FILTER_ENUM_DEVELOPMENT)) {
+        mask |= AptCacheFile::VerDevel;
+        want |= AptCacheFile::VerDevel;
+    } else if (pk_bitfield_contain(filters, PK_FILTER_ENUM_NOT_DEVELOPMENT)) {
+        mask |= AptCacheFile::VerDevel;
+    }
 
-        if (pk_bitfield_contain(filters, PK_FILTER_ENUM_DEVELOPMENT)) {
-            // if ver.end() means unknow
-            // strcmp will be true when it's different than devel
-            std::string pkgName = pkg.Name();
-            if (!ends_with(pkgName, "-dev") &&
-                    !ends_with(pkgName, "-dbg") &&
-                    section.compare("devel") &&
-                    section.compare("libdevel")) {
-                return false;
-            }
-        } else if (pk_bitfield_contain(filters, PK_FILTER_ENUM_NOT_DEVELOPMENT)) {
-            std::string pkgName = pkg.Name();
-            if (ends_with(pkgName, "-dev") ||
-                    ends_with(pkgName, "-dbg") ||
-                    !section.compare("devel") ||
-                    !section.compare("libdevel")) {
-                return false;
-            }
-        }
+    if (pk_bitfield_contain(filters, PK_FILTER_ENUM_GUI)) {
+        mask |= AptCacheFile::VerGui;
+        want |= AptCacheFile::VerGui;
+    } else if (pk_bitfield_contain(filters, PK_FILTER_ENUM_NOT_GUI)) {
+        mask |= AptCacheFile::VerGui;
+    }
 
-        if (pk_bitfield_contain(filters, PK_FILTER_ENUM_GUI)) {
-            // if ver.end() means unknow
-            // strcmp will be true when it's different than x11
-            if (section.compare("x11") && section.compare("gnome") &&
-                    section.compare("kde") && section.compare("graphics")) {
-                return false;
-            }
-        } else if (pk_bitfield_contain(filters, PK_FILTER_ENUM_NOT_GUI)) {
-            if (!section.compare("x11") || !section.compare("gnome") ||
-                    !section.compare("kde") || !section.compare("graphics")) {
-                return false;
-            }
-        }
+    if (pk_bitfield_contain(filters, PK_FILTER_ENUM_FREE)) {
+        mask |= AptCacheFile::VerFree;
+        want |= AptCacheFile::VerFree;
+    } else if (pk_bitfield_contain(filters, PK_FILTER_ENUM_NOT_FREE)) {
+        mask |= AptCacheFile::VerFree;
+    }
 
-        if (pk_bitfield_contain(filters, PK_FILTER_ENUM_FREE)) {
-            if (component.compare("main") != 0 &&
-                    component.compare("universe") != 0) {
-                // Must be in main and universe to be free
-                return false;
-            }
-        } else if (pk_bitfield_contain(filters, PK_FILTER_ENUM_NOT_FREE)) {
-            if (component.compare("main") == 0 ||
-                    component.compare("universe") == 0) {
-                // Must not be in main or universe to be free
-                return false;
-            }
-        }
+    if (pk_bitfield_contain(filters, PK_FILTER_ENUM_SUPPORTED)) {
+        mask |= AptCacheFile::VerSupported;
+        want |= AptCacheFile::VerSupported;
+    } else if (pk_bitfield_contain(filters, PK_FILTER_ENUM_NOT_SUPPORTED)) {
+        mask |= AptCacheFile::VerSupported;
+    }
 
-        // Check for supported packages
-        if (pk_bitfield_contain(filters, PK_FILTER_ENUM_SUPPORTED)) {
-            if (!packageIsSupported(ver, component)) {
-                return false;
-            }
-        } else if (pk_bitfield_contain(filters, PK_FILTER_ENUM_NOT_SUPPORTED)) {
-            if (packageIsSupported(ver, component)) {
-                return false;
-            }
+    // We do not support checking if it is an Application if NOT installed
+    if (pk_bitfield_contain(filters, PK_FILTER_ENUM_APPLICATION)) {
+        if (pk_bitfield_contain(filters, PK_FILTER_ENUM_NOT_INSTALLED)) {
+            return false;
         }
-
-        // Check for applications, if they have files with .desktop
-        if (pk_bitfield_contain(filters, PK_FILTER_ENUM_APPLICATION)) {
-            // We do not support checking if it is an Application
-            // if NOT installed
-            if (!installed || !isApplication(ver)) {
-                return false;
-            }
-        } else if (pk_bitfield_contain(filters, PK_FILTER_ENUM_NOT_APPLICATION)) {
-            // We do not support checking if it is an Application
-            // if NOT installed
-            if (!installed || isApplication(ver)) {
-                return false;
-            }
+        mask |= AptCacheFile::VerInstalled | AptCacheFile::VerApplication;
+        want |= AptCacheFile::VerInstalled | AptCacheFile::VerApplication;
+    } else if (pk_bitfield_contain(filters, PK_FILTER_ENUM_NOT_APPLICATION)) {
+        if (pk_bitfield_contain(filters, PK_FILTER_ENUM_NOT_INSTALLED)) {
+            return false;
         }
+        mask |= AptCacheFile::VerInstalled | AptCacheFile::VerApplication;
+        want |= AptCacheFile::VerInstalled;
+    }
 
-        // TODO test this one..
+    // TODO test this one..
 #if 0
-        // I couldn'tfind any packages with the metapackages component, and I
-        // think the check is the wrong way around; PK_FILTER_ENUM_COLLECTIONS
-        // is for virtual group packages -- hughsie
-        if (pk_bitfield_contain(filters, PK_FILTER_ENUM_COLLECTIONS)) {
-            if (!component.compare("metapackages")) {
-                return false;
-            }
-        } else if (pk_bitfield_contain(filters, PK_FILTER_ENUM_NOT_COLLECTIONS)) {
-            if (component.compare("metapackages")) {
-                return false;
-            }
-        }
-#endif
+    // I couldn'tfind any packages with the metapackages component, and I
+    // think the check is the wrong way around; PK_FILTER_ENUM_COLLECTIONS
+    // is for virtual group packages -- hughsie
+    if (pk_bitfield_contain(filters, PK_FILTER_ENUM_COLLECTIONS)) {
+        mask |= AptCacheFile::VerCollection;
+    } else if (pk_bitfield_contain(filters, PK_FILTER_ENUM_NOT_COLLECTIONS)) {
+        mask |= AptCacheFile::VerCollection;
+        want |= AptCacheFile::VerCollection;
     }
+#endif
+
     return true;
 }
 
+bool AptIntf::matchPackage(const pkgCache::VerIterator &ver, PkBitfield filters)
+{
+    if (filters == 0) {
+        return true;
+    }
+
+    unsigned int mask;
+    unsigned int want;
+    if (!filterFlags(filters, mask, want)) {
+        return false;
+    }
+
+    bool withApplication = mask & AptCacheFile::VerApplication;
+    return (m_cache->versionFlags(ver, withApplication) & mask) == want;
+}
+
 PkgList AptIntf::filterPackages(const PkgList &packages, PkBitfield filters)
 {
     if (filters != 0) {
         PkgList ret;
+        unsigned int mask;
+        unsigned int want;
+        if (!filterFlags(filters, mask, want)) {
+            return ret;
+        }
         ret.reserve(packages.size());
 
+        // The attributes were computed once for the whole cache,
+        // so this is just a mask test per package
+        bool withApplication = mask & AptCacheFile::VerApplication;
         for (PkgList::const_iterator i = packages.begin(); i != packages.end(); ++i) {
-            if (matchPackage(*i, filters)) {
+            if ((m_cache->versionFlags(*i, withApplication) & mask) == want) {
                 ret.push_back(*i);
             }
         }
@@ -801,114 +828,88 @@ void AptIntf::emitUpdateDetail(const pkgCache::VerIterator &candver)
         srcpkg = rec.SourcePkg();
     }
 
-    // Create a random temp dir
-    if (!g_file_test(APTCC_TMP_DIR, G_FILE_TEST_IS_DIR))
-        g_mkdir(APTCC_TMP_DIR, 0700);
-    char dirName[] = APTCC_TMP_DIR "/XXXXXX";
-
-    char *tempDir = mkdtemp(dirName);
-    string filename = tempDir;
-    filename.append("/");
-    filename.append(pkg.Name());
-
-    PkBackend *backend = PK_BACKEND(pk_backend_job_get_backend(m_job));
-    if (pk_backend_is_online(backend)) {
-        // Create the download object
-        AcqPackageKitStatus Stat(this, m_job);
-
-        // get a fetcher
-        pkgAcquire fetcher;
-        fetcher.Setup(&Stat);
-
-        // fetch the changelog
-        pk_backend_job_set_status(m_job, PK_STATUS_ENUM_DOWNLOAD_CHANGELOG);
-        if (downloadChangelog(*m_cache, fetcher, candver, filename)) {
-            ifstream in(filename.c_str());
-            string line;
-            GRegex *regexVer;
-            regexVer = g_regex_new("(?'source'.+) \\((?'version'.*)\\) "
-                                "(?'dist'.+); urgency=(?'urgency'.+)",
-                                G_REGEX_CASELESS,
-                                G_REGEX_MATCH_ANCHORED,
-                                0);
-            GRegex *regexDate;
-            regexDate = g_regex_new("^ -- (?'maintainer'.+) (?'mail'<.+>)  (?'date'.+)$",
-                                    G_REGEX_CASELESS,
-                                    G_REGEX_MATCH_ANCHORED,
-                                    0);
-
-            while (getline(in, line)) {
-                // we don't want the additional whitespace, because it can confuse
-                // some markdown parsers used by client tools
-                if (starts_with(line, "  "))
-                    line.erase(0,1);
-                // no need to free str later, it is allocated in a static buffer
-                const char *str = utf8(line.c_str());
-                if (strcmp(str, "") == 0) {
-                    changelog.append("\n");
-                    continue;
-                } else {
-                    changelog.append(str);
-                    changelog.append("\n");
-                }
+    // The changelogs were downloaded by fetchChangelogs()
+    string filename = changelogFilename(candver);
+    if (ChangelogCache::system()->lookup(filename)) {
+        ifstream in(filename.c_str());
+        string line;
+        // compiled once, they are used for every update
+        static GRegex *regexVer = g_regex_new("(?'source'.+) \\((?'version'.*)\\) "
+                                              "(?'dist'.+); urgency=(?'urgency'.+)",
+                                              (GRegexCompileFlags) (G_REGEX_CASELESS | G_REGEX_OPTIMIZE),
+                                              G_REGEX_MATCH_ANCHORED,
+                                              0);
+        static GRegex *regexDate = g_regex_new("^ -- (?'maintainer'.+) (?'mail'<.+>)  (?'date'.+)$",
+                                               (GRegexCompileFlags) (G_REGEX_CASELESS | G_REGEX_OPTIMIZE),
+                                               G_REGEX_MATCH_ANCHORED,
+                                               0);
+
+        while (getline(in, line)) {
+            // we don't want the additional whitespace, because it can confuse
+            // some markdown parsers used by client tools
+            if (starts_with(line, "  "))
+                line.erase(0,1);
+            // no need to free str later, it is allocated in a static buffer
+            const char *str = utf8(line.c_str());
+            if (strcmp(str, "") == 0) {
+                changelog.append("\n");
+                continue;
+            } else {
+                changelog.append(str);
+                changelog.append("\n");
+            }
 
-                if (starts_with(str, srcpkg.c_str())) {
-                    // Check to see if the the text isn't about the current package,
-                    // otherwise add a == version ==
-                    GMatchInfo *match_info;
-                    if (g_regex_match(regexVer, str, G_REGEX_MATCH_ANCHORED, &match_info)) {
-                        gchar *version;
-                        version = g_match_info_fetch_named(match_info, "version");
-
-                        // Compare if the current version is shown in the changelog, to not
-                        // display old changelog information
-                        if (_system != 0  &&
-                                _system->VS->DoCmpVersion(version, version + strlen(version),
-                                                        currver.VerStr(), currver.VerStr() + strlen(currver.VerStr())) <= 0) {
-                            g_free (version);
-                            break;
-                        } else {
-                            if (!update_text.empty()) {
-                                update_text.append("\n\n");
-                            }
-                            update_text.append(" == ");
-                            update_text.append(version);
-                            update_text.append(" ==");
-                            g_free (version);
+            if (starts_with(str, srcpkg.c_str())) {
+                // Check to see if the the text isn't about the current package,
+                // otherwise add a == version ==
+                GMatchInfo *match_info;
+                if (g_regex_match(regexVer, str, G_REGEX_MATCH_ANCHORED, &match_info)) {
+                    gchar *version;
+                    version = g_match_info_fetch_named(match_info, "version");
+
+                    // Compare if the current version is shown in the changelog, to not
+                    // display old changelog information
+                    if (_system != 0  &&
+                            _system->VS->DoCmpVersion(version, version + strlen(version),
+                                                    currver.VerStr(), currver.VerStr() + strlen(currver.VerStr())) <= 0) {
+                        g_free (version);
+                        break;
+                    } else {
+                        if (!update_text.empty()) {
+                            update_text.append("\n\n");
                         }
+                        update_text.append(" == ");
+                        update_text.append(version);
+                        update_text.append(" ==");
+                        g_free (version);
                     }
-                    g_match_info_free (match_info);
-                } else if (starts_with(str, " ")) {
-                    // update descritption
-                    update_text.append("\n");
-                    update_text.append(str);
-                } else if (starts_with(str, " --")) {
-                    // Parse the text to know when the update was issued,
-                    // and when it got updated
-                    GMatchInfo *match_info;
-                    if (g_regex_match(regexDate, str, G_REGEX_MATCH_ANCHORED, &match_info)) {
-                        GTimeVal dateTime = {0, 0};
-                        gchar *date;
-                        date = g_match_info_fetch_named(match_info, "date");
-                        g_warn_if_fail(RFC1123StrToTime(date, dateTime.tv_sec));
-                        g_free(date);
-
-                        issued = g_time_val_to_iso8601(&dateTime);
-                        if (updated.empty()) {
-                            updated = g_time_val_to_iso8601(&dateTime);
-                        }
+                }
+                g_match_info_free (match_info);
+            } else if (starts_with(str, " ")) {
+                // update descritption
+                update_text.append("\n");
+                update_text.append(str);
+            } else if (starts_with(str, " --")) {
+                // Parse the text to know when the update was issued,
+                // and when it got updated
+                GMatchInfo *match_info;
+                if (g_regex_match(regexDate, str, G_REGEX_MATCH_ANCHORED, &match_info)) {
+                    GTimeVal dateTime = {0, 0};
+                    gchar *date;
+                    date = g_match_info_fetch_named(match_info, "date");
+                    g_warn_if_fail(RFC1123StrToTime(date, dateTime.tv_sec));
+                    g_free(date);
+
+                    issued = g_time_val_to_iso8601(&dateTime);
+                    if (updated.empty()) {
+                        updated = g_time_val_to_iso8601(&dateTime);
                     }
-                    g_match_info_free(match_info);
                 }
+                g_match_info_free(match_info);
             }
-            // Clean structures
-            g_regex_unref(regexVer);
-            g_regex_unref(regexDate);
-            unlink(filename.c_str());
-            rmdir(tempDir);
-        } else if (_error->PendingError()) {
-            _error->PopMessage(changelog);
         }
+    } else if (_error->PendingError()) {
+        _error->PopMessage(changelog);
     }
 
     // Check if the update was updates since it was issued
@@ -967,8 +968,89 @@ void AptIntf::emitUpdateDetail(const pkgCache::VerIterator &candver)
     g_ptr_array_unref(cve_urls);
 }
 
+string AptIntf::changelogFilename(const pkgCache::VerIterator &candver)
+{
+    // The changelog is the same for all the binaries of a source version
+    pkgRecords::Parser &rec = m_cache->GetPkgRecords()->Lookup(candver.FileList());
+    string srcpkg = rec.SourcePkg().empty() ? candver.ParentPkg().Name() : rec.SourcePkg();
+    string srcver = rec.SourceVer().empty() ? candver.VerStr() : rec.SourceVer();
+    return ChangelogCache::system()->filename(srcpkg, srcver);
+}
+
+void AptIntf::fetchChangelogs(const PkgList &pkgs)
+{
+    PkBackend *backend = PK_BACKEND(pk_backend_job_get_backend(m_job));
+    if (!pk_backend_is_online(backend)) {
+        return;
+    }
+
+    // Find the changelogs we don't have yet
+    ChangelogCache *cache = ChangelogCache::system();
+    std::map<string, pkgCache::VerIterator> missing;
+    for (PkgList::const_iterator it = pkgs.begin(); it != pkgs.end(); ++it) {
+        if (it->end()) {
+            continue;
+        }
+        string filename = changelogFilename(*it);
+        if (missing.find(filename) == missing.end() && !cache->lookup(filename)) {
+            missing[filename] = *it;
+        }
+    }
+    if (missing.empty()) {
+        return;
+    }
+
+    // Create the download object
+    AcqPackageKitStatus Stat(this, m_job);
+
+    // get a fetcher, all the changelogs are queued so they are
+    // downloaded in parallel
+    pkgAcquire fetcher;
+    fetcher.Setup(&Stat);
+    pk_backend_job_set_status(m_job, PK_STATUS_ENUM_DOWNLOAD_CHANGELOG);
+    for (std::map<string, pkgCache::VerIterator>::const_iterator it = missing.begin(); it != missing.end(); ++it) {
+        const pkgCache::PkgIterator &pkg = it->second.ParentPkg();
+        string uri = getChangelogUri(*m_cache, it->second);
+        string descr;
+        g_debug("Trying to fetch '%s'", uri.c_str());
+        strprintf(descr, "Changelog for %s", pkg.Name());
+        new pkgAcqFile(&fetcher, uri, "", 0, descr, pkg.Name(), "ignored", it->first + ".part");
+    }
+
+    // FIXME: Fetcher.Run() is "Continue" even if I get a 404?!?
+    fetcher.Run();
+
+    // try the third-party-changelogs location for the ones that failed
+    bool retry = false;
+    for (std::map<string, pkgCache::VerIterator>::const_iterator it = missing.begin(); it != missing.end(); ++it) {
+        if (FileExists(it->first + ".part")) {
+            continue;
+        }
+        const pkgCache::PkgIterator &pkg = it->second.ParentPkg();
+        string uri;
+        if (GuessThirdPartyChangelogUri(*m_cache, pkg, it->second, uri)) {
+            string descr;
+            g_debug("Trying to fetch '%s'", uri.c_str());
+            strprintf(descr, "Changelog for %s", pkg.Name());
+            new pkgAcqFile(&fetcher, uri, "", 0, descr, pkg.Name(), "ignored", it->first + ".part");
+            retry = true;
+        }
+    }
+    if (retry) {
+        fetcher.Run();
+    }
+
+    for (std::map<string, pkgCache::VerIterator>::const_iterator it = missing.begin(); it != missing.end(); ++it) {
+        cache->add(it->first + ".part", it->first);
+    }
+    cache->expire();
+}
+
 void AptIntf::emitUpdateDetails(const PkgList &pkgs)
 {
+    // Download the changelogs before emitting anything
+    fetchChangelogs(pkgs);
+
     for (PkgList::const_iterator it = pkgs.begin(); it != pkgs.end(); ++it) {
         if (m_cancel) {
             break;
@@ -1181,77 +1263,206 @@ PkgList AptIntf::getPackagesFromGroup(gchar **values)
     return output;
 }
 
+struct AptIntf::SearchTask
+{
+    AptIntf *apt;
+    const std::vector<pkgCache::PkgIterator> *pkgs;
+    size_t first;
+    size_t stride;
+    const gchar *search;
+    bool details;
+    bool error;
+    PkgList output;
+};
+
 PkgList AptIntf::searchPackageName(gchar *search)
+{
+    return searchPackages(search, false);
+}
+
+PkgList AptIntf::searchPackageDetails(gchar *search)
+{
+    return searchPackages(search, true);
+}
+
+PkgList AptIntf::searchPackages(gchar *search, bool details)
 {
     PkgList output;
 
-    Matcher *matcher = new Matcher(search);
-    if (matcher->hasError()) {
-        g_debug("Regex compilation error");
-        delete matcher;
-        return output;
+    // The package cache is an immutable mmap while we query it,
+    // so the packages can be split between threads
+    std::vector<pkgCache::PkgIterator> pkgs;
+    if (!details || !searchIndexCandidates(search, pkgs)) {
+        pkgs.reserve(m_cache->GetPkgCache()->HeaderP->PackageCount);
+        for (pkgCache::PkgIterator pkg = m_cache->GetPkgCache()->PkgBegin(); !pkg.end(); ++pkg) {
+            // Ignore packages that exist only due to dependencies.
+            if (pkg.VersionList().end() && pkg.ProvidesList().end()) {
+                continue;
+            }
+            pkgs.push_back(pkg);
+        }
     }
 
-    for (pkgCache::PkgIterator pkg = m_cache->GetPkgCache()->PkgBegin(); !pkg.end(); ++pkg) {
-        if (m_cancel) {
-            break;
+    size_t threads = m_searchThreads;
+    if (threads == 0) {
+        threads = MAX(sysconf(_SC_NPROCESSORS_ONLN), 1L);
+    }
+    // not worth starting threads for a handful of packages
+    threads = MAX(MIN(threads, pkgs.size() / 1000), (size_t) 1);
+
+    // Make sure the languages are set up before the threads look
+    // up translated descriptions, this is cached by apt
+    APT::Configuration::getLanguages();
+
+    std::vector<SearchTask> tasks(threads);
+    for (size_t i = 0; i < threads; ++i) {
+        tasks[i].apt = this;
+        tasks[i].pkgs = &pkgs;
+        tasks[i].first = i;
+        tasks[i].stride = threads;
+        tasks[i].search = search;
+        tasks[i].details = details;
+        tasks[i].error = false;
+    }
+
+    std::vector<GThread *> workers;
+    for (size_t i = 1; i < threads; ++i) {
+        workers.push_back(g_thread_new("aptcc-search", searchThread, &tasks[i]));
+    }
+    searchThread(&tasks[0]);
+    for (std::vector<GThread *>::const_iterator it = workers.begin(); it != workers.end(); ++it) {
+        g_thread_join(*it);
+    }
+
+    for (std::vector<SearchTask>::const_iterator it = tasks.begin(); it != tasks.end(); ++it) {
+        if (it->error) {
+            g_debug("Regex compilation error");
+            return PkgList();
         }
-        // Ignore packages that exist only due to dependencies.
-        if (pkg.VersionList().end() && pkg.ProvidesList().end()) {
+        output.insert(output.end(), it->output.begin(), it->output.end());
+    }
+    return output;
+}
+
+bool AptIntf::searchIndexCandidates(const gchar *search, std::vector<pkgCache::PkgIterator> &pkgs)
+{
+    // Only words can be looked up, anything the matcher would treat
+    // as a regular expression or a quoted string needs a full scan
+    std::vector<std::string> terms;
+    gchar **words = g_strsplit_set(search, " \t\n", -1);
+    for (gchar **word = words; *word; ++word) {
+        if (**word == '\0') {
             continue;
         }
+        if (!SearchIndex::isIndexable(*word)) {
+            g_strfreev(words);
+            return false;
+        }
+        terms.push_back(*word);
+    }
+    g_strfreev(words);
 
-        if (matcher->matches(pkg.Name())) {
-            // Don't insert virtual packages instead add what it provides
-            const pkgCache::VerIterator &ver = m_cache->findVer(pkg);
-            if (ver.end() == false) {
-                output.push_back(ver);
-            } else {
-                // iterate over the provides list
-                for (pkgCache::PrvIterator Prv = pkg.ProvidesList(); Prv.end() == false; ++Prv) {
-                    const pkgCache::VerIterator &ownerVer = m_cache->findVer(Prv.OwnerPkg());
+    if (terms.empty() || !m_cache->isShared() || !updateSearchIndex()) {
+        return false;
+    }
 
-                    // check to see if the provided package isn't virtual too
-                    if (ownerVer.end() == false) {
-                        // we add the package now because we will need to
-                        // remove duplicates later anyway
-                        output.push_back(ownerVer);
-                    }
-                }
-            }
+    std::vector<std::string> names;
+    SearchIndex::system()->search(terms, names);
+    pkgs.reserve(names.size());
+    for (std::vector<std::string>::const_iterator it = names.begin(); it != names.end(); ++it) {
+        const pkgCache::PkgIterator &pkg = m_cache->GetPkgCache()->FindPkg(*it);
+        if (!pkg.end()) {
+            pkgs.push_back(pkg);
         }
     }
-    return output;
+    g_debug("Search index returned %zu candidates", pkgs.size());
+    return true;
 }
 
-PkgList AptIntf::searchPackageDetails(gchar *search)
+bool AptIntf::updateSearchIndex()
 {
-    PkgList output;
+    // The index is stamped with the state of the shared cache, when
+    // called after a refresh this opens it on the new lists
+    AptCacheFile *cache = m_cache && m_cache->isShared() ? m_cache : AptCacheFile::sharedCache(m_job);
+    if (cache == 0) {
+        return false;
+    }
 
-    Matcher *matcher = new Matcher(search);
-    if (matcher->hasError()) {
-        g_debug("Regex compilation error");
-        delete matcher;
-        return output;
+    // Descriptions are translated, so the languages are part of the generation
+    std::string generation = AptCacheFile::sharedGeneration();
+    std::vector<std::string> languages = APT::Configuration::getLanguages();
+    for (std::vector<std::string>::const_iterator it = languages.begin(); it != languages.end(); ++it) {
+        generation += *it + ",";
     }
 
-    for (pkgCache::PkgIterator pkg = m_cache->GetPkgCache()->PkgBegin(); !pkg.end(); ++pkg) {
+    SearchIndex *index = SearchIndex::system();
+    if (index->isCurrent(generation)) {
+        return true;
+    }
+
+    g_debug("Building the search index");
+    SearchIndex::Builder builder;
+    for (pkgCache::PkgIterator pkg = cache->GetPkgCache()->PkgBegin(); !pkg.end(); ++pkg) {
         if (m_cancel) {
-            break;
+            return false;
         }
-        // Ignore packages that exist only due to dependencies.
+
+        // Same packages and versions as a full scan in searchPackagesRange()
         if (pkg.VersionList().end() && pkg.ProvidesList().end()) {
             continue;
         }
 
+        const pkgCache::VerIterator &ver = cache->findVer(pkg);
+        if (ver.end()) {
+            builder.addPackage(pkg.FullName(false), pkg.Name());
+        } else {
+            builder.addPackage(pkg.FullName(false),
+                               std::string(pkg.Name()) + " " + cache->getLongDescription(ver));
+        }
+    }
+
+    return index->build(builder, generation);
+}
+
+gpointer AptIntf::searchThread(gpointer data)
+{
+    SearchTask *task = static_cast<SearchTask*>(data);
+    task->apt->searchPackagesRange(*task);
+    return NULL;
+}
+
+void AptIntf::searchPackagesRange(SearchTask &task)
+{
+    // regexec serializes on the compiled pattern,
+    // so each thread needs its own matcher
+    Matcher matcher(task.search);
+    if (matcher.hasError()) {
+        task.error = true;
+        return;
+    }
+
+    // the record parsers are not thread safe either
+    pkgRecords *records = 0;
+    if (task.details) {
+        records = new pkgRecords(*m_cache);
+    }
+
+    const std::vector<pkgCache::PkgIterator> &pkgs = *task.pkgs;
+    for (size_t i = task.first; i < pkgs.size(); i += task.stride) {
+        if (m_cancel) {
+            break;
+        }
+
+        const pkgCache::PkgIterator &pkg = pkgs[i];
         const pkgCache::VerIterator &ver = m_cache->findVer(pkg);
         if (ver.end() == false) {
-            if (matcher->matches(pkg.Name()) ||
-                    matcher->matches((*m_cache).getLongDescription(ver))) {
+            if (matcher.matches(pkg.Name()) ||
+                    (task.details &&
+                     matcher.matches(AptCacheFile::getLongDescription(ver, *records)))) {
                 // The package matched
-                output.push_back(ver);
+                task.output.push_back(ver);
             }
-        } else if (matcher->matches(pkg.Name())) {
+        } else if (matcher.matches(pkg.Name())) {
             // The package is virtual and MATCHED the name
             // Don't insert virtual packages instead add what it provides
 
@@ -1263,65 +1474,81 @@ PkgList AptIntf::searchPackageDetails(gchar *search)
                 if (ownerVer.end() == false) {
                     // we add the package now because we will need to
                     // remove duplicates later anyway
-                    output.push_back(ownerVer);
+                    task.output.push_back(ownerVer);
                 }
             }
         }
     }
-    return output;
+
+    delete records;
 }
 
-// used to return files it reads, using the info from the files in /var/lib/dpkg/info/
+// escapes the characters that are special in a basic regular expression
+static string escapeRegex(const string &value)
+{
+    string ret;
+    for (string::const_iterator it = value.begin(); it != value.end(); ++it) {
+        if (strchr(".[]*^$\\", *it) != NULL) {
+            ret += '\\';
+        }
+        ret += *it;
+    }
+    return ret;
+}
+
+// used to return the packages owning files, using the index of the files in /var/lib/dpkg/info/
 PkgList AptIntf::searchPackageFiles(gchar **values)
 {
     PkgList output;
     vector<string> packages;
-    regex_t re;
-    gchar *search;
-    gchar *values_str;
+    vector<regex_t> patterns;
 
-    values_str = g_strjoinv("$|^", values);
-    search = g_strdup_printf("^%s$",
-                             values_str);
-    g_free(values_str);
-    if(regcomp(&re, search, REG_NOSUB) != 0) {
-        g_debug("Regex compilation error");
-        g_free(search);
+    DpkgFileIndex *index = DpkgFileIndex::system();
+    if (index == 0) {
         return output;
     }
-    g_free(search);
 
-    DIR *dp;
-    struct dirent *dirp;
-    if (!(dp = opendir("/var/lib/dpkg/info/"))) {
-        g_debug ("Error opening /var/lib/dpkg/info/\n");
-        regfree(&re);
-        return output;
-    }
+    for (uint i = 0; i < g_strv_length(values); ++i) {
+        const string value = values[i];
+        if (value.empty()) {
+            continue;
+        }
 
-    string line;
-    while ((dirp = readdir(dp)) != NULL) {
-        if (m_cancel) {
-            break;
+        // Patterns and relative paths can't use the sorted tables,
+        // they are matched against every path like before the index
+        string search;
+        if (value.find_first_of("[]*^$\\") != string::npos) {
+            search = "^" + value + "$";
+        } else if (value[0] != '/' && value.find('/') != string::npos) {
+            search = "/" + escapeRegex(value) + "$";
         }
-        if (ends_with(dirp->d_name, ".list")) {
-            string f = "/var/lib/dpkg/info/" + string(dirp->d_name);
-            ifstream in(f.c_str());
-            if (!in != 0) {
+        if (!search.empty()) {
+            regex_t re;
+            if (regcomp(&re, search.c_str(), REG_NOSUB) != 0) {
+                g_debug("Regex compilation error: %s", search.c_str());
                 continue;
             }
-            while (!in.eof()) {
-                getline(in, line);
-                if (regexec(&re, line.c_str(), (size_t)0, NULL, 0) == 0) {
-                    string file(dirp->d_name);
-                    packages.push_back(file.erase(file.size() - 5, file.size()));
-                    break;
-                }
-            }
+            patterns.push_back(re);
+            continue;
+        }
+
+        if (value[0] != '/') {
+            // just a file name
+            index->searchBasename(value, packages);
+        } else if (value.size() > 1 && value[value.size() - 1] == '/') {
+            // anything inside the directory
+            index->searchPrefix(value, packages);
+        } else {
+            index->searchPath(value, packages);
+        }
+    }
+
+    if (!patterns.empty()) {
+        index->searchRegex(patterns, packages);
+        for (size_t i = 0; i < patterns.size(); ++i) {
+            regfree(&patterns[i]);
         }
     }
-    closedir(dp);
-    regfree(&re);
 
     // Resolve the package names now
     for (vector<string>::const_iterator it = packages.begin();
@@ -1329,7 +1556,25 @@ PkgList AptIntf::searchPackageFiles(gchar **values)
         if (m_cancel) {
             break;
         }
-        const pkgCache::PkgIterator &pkg = (*m_cache)->FindPkg(*it);
+
+        pkgCache::PkgIterator pkg;
+        if (it->find(':') == string::npos) {
+            // The list file of a package that is not Multi-Arch: same
+            // has no arch qualifier, use whichever arch is installed
+            const std::vector<pkgCache::PkgIterator> &pkgs = m_cache->findPackagesByName(*it);
+            for (std::vector<pkgCache::PkgIterator>::const_iterator pit = pkgs.begin();
+                 pit != pkgs.end(); ++pit) {
+                if (pit->CurrentVer().end() == false) {
+                    pkg = *pit;
+                    break;
+                }
+            }
+        }
+
+        if (pkg.end() == true) {
+            pkg = (*m_cache)->FindPkg(*it);
+        }
+
         if (pkg.end() == true) {
             continue;
         }
@@ -1467,131 +1712,40 @@ void AptIntf::providesMimeType(PkgList &output, gchar **values)
     }
 }
 
-bool AptIntf::isApplication(const pkgCache::VerIterator &ver)
+// used to emit files it reads the info from the index of the dpkg list files
+void AptIntf::emitPackageFiles(const gchar *pi)
 {
-    bool ret = false;
-    gchar *fileName;
-    string line;
-
-    if (m_isMultiArch) {
-        fileName = g_strdup_printf("/var/lib/dpkg/info/%s:%s.list",
-                                   ver.ParentPkg().Name(),
-                                   ver.Arch());
-        if (!FileExists(fileName)) {
-            g_free(fileName);
-            // if the file was not found try without the arch field
-            fileName = g_strdup_printf("/var/lib/dpkg/info/%s.list",
-                                       ver.ParentPkg().Name());
-        }
-    } else {
-        fileName = g_strdup_printf("/var/lib/dpkg/info/%s.list",
-                                   ver.ParentPkg().Name());
-    }
-
-    if (FileExists(fileName)) {
-        ifstream in(fileName);
-        if (!in != 0) {
-            g_free(fileName);
-            return false;
-        }
-
-        while (in.eof() == false) {
-            getline(in, line);
-            if (ends_with(line, ".desktop")) {
-                ret = true;
-                break;
-            }
-        }
+    DpkgFileIndex *index = DpkgFileIndex::system();
+    if (index == 0) {
+        return;
     }
 
-    g_free(fileName);
-    return ret;
-}
-
-// used to emit files it reads the info directly from the files
-void AptIntf::emitPackageFiles(const gchar *pi)
-{
-    GPtrArray *files;
-    string line;
     gchar **parts;
-
     parts = pk_package_id_split(pi);
 
-    string fName;
+    string listName = parts[PK_PACKAGE_ID_NAME];
     if (m_isMultiArch) {
-        fName = "/var/lib/dpkg/info/" +
-                string(parts[PK_PACKAGE_ID_NAME]) +
-                ":" +
-                string(parts[PK_PACKAGE_ID_ARCH]) +
-                ".list";
-        if (!FileExists(fName)) {
-            // if the file was not found try without the arch field
-            fName = "/var/lib/dpkg/info/" +
-                    string(parts[PK_PACKAGE_ID_NAME]) +
-                    ".list";
+        // if the list was not found try without the arch field
+        string archListName = listName + ":" + parts[PK_PACKAGE_ID_ARCH];
+        if (index->hasPackage(archListName)) {
+            listName = archListName;
         }
-    } else {
-        fName = "/var/lib/dpkg/info/" +
-                string(parts[PK_PACKAGE_ID_NAME]) +
-                ".list";
     }
     g_strfreev (parts);
 
-    if (FileExists(fName)) {
-        ifstream in(fName.c_str());
-        if (!in != 0) {
-            return;
-        }
-
-        files = g_ptr_array_new_with_free_func(g_free);
-        while (in.eof() == false) {
-            getline(in, line);
-            if (!line.empty()) {
-                g_ptr_array_add(files, g_strdup(line.c_str()));
-            }
-        }
-
-        if (files->len) {
-            g_ptr_array_add(files, NULL);
-            pk_backend_job_files(m_job, pi, (gchar **) files->pdata);
-        }
-        g_ptr_array_unref(files);
-    }
-}
-
-/**
-  * Check if package is officially supported by the current distribution
-  */
-bool AptIntf::packageIsSupported(const pkgCache::VerIterator &verIter, string component)
-{
-    string origin;
-    if (!verIter.end()) {
-        pkgCache::VerFileIterator vf = verIter.FileList();
-        origin = vf.File().Origin() == NULL ? "" : vf.File().Origin();
-    }
-
-    if (component.empty()) {
-        component = "main";
+    vector<string> files;
+    if (!index->packageFiles(listName, files) || files.empty()) {
+        return;
     }
 
-    // Get a fetcher
-    AcqPackageKitStatus Stat(this, m_job);
-    pkgAcquire fetcher;
-    fetcher.Setup(&Stat);
-
-    PkBitfield flags = pk_backend_job_get_transaction_flags(m_job);
-    bool trusted = checkTrusted(fetcher, flags);
-
-    if ((origin.compare("Debian") == 0) || (origin.compare("Ubuntu") == 0))  {
-        if ((component.compare("main") == 0 ||
-             component.compare("restricted") == 0 ||
-             component.compare("unstable") == 0 ||
-             component.compare("testing") == 0) && trusted) {
-            return true;
-        }
+    GPtrArray *array;
+    array = g_ptr_array_new_with_free_func(g_free);
+    for (vector<string>::const_iterator it = files.begin(); it != files.end(); ++it) {
+        g_ptr_array_add(array, g_strdup(it->c_str()));
     }
-
-    return false;
+    g_ptr_array_add(array, NULL);
+    pk_backend_job_files(m_job, pi, (gchar **) array->pdata);
+    g_ptr_array_unref(array);
 }
 
 bool AptIntf::checkTrusted(pkgAcquire &fetcher, PkBitfield flags)
@@ -1711,10 +1865,9 @@ PkgList AptIntf::checkChangedPackages(bool emitChanged)
 
 pkgCache::VerIterator AptIntf::findTransactionPackage(const std::string &name)
 {
-    for (PkgList::const_iterator it = m_pkgs.begin(); it != m_pkgs.end(); ++it) {
-        if (it->ParentPkg().Name() == name) {
-            return *it;
-        }
+    std::map<std::string, pkgCache::VerIterator>::const_iterator found = m_pkgsByName.find(name);
+    if (found != m_pkgsByName.end()) {
+        return found->second;
     }
 
     const pkgCache::PkgIterator &pkg = (*m_cache)->FindPkg(name);
@@ -1736,142 +1889,133 @@ pkgCache::VerIterator AptIntf::findTransactionPackage(const std::string &name)
     return candidateVer;
 }
 
-void AptIntf::updateInterface(int fd, int writeFd)
+void AptIntf::processStatusLine(gchar *line, int writeFd)
 {
-    char buf[2];
-    static char line[1024] = "";
-
-    while (1) {
-        // This algorithm should be improved (it's the same as the rpm one ;)
-        int len = read(fd, buf, 1);
-
-        // nothing was read
-        if(len < 1) {
-            break;
+    //cout << "got line: " << line << endl;
+
+    // split "status:pkg:percent:message" in place, the message may
+    // contain colons itself
+    gchar *fields[4];
+    gchar *next = line;
+    for (int i = 0; i < 4; i++) {
+        fields[i] = next;
+        next = i < 3 ? strchr(next, ':') : NULL;
+        if (i < 3 && next == NULL) {
+            // major problem here, we got unexpected input. should _never_ happen
+            g_debug("ignoring incomplete status line");
+            return;
+        }
+        if (next != NULL) {
+            *next++ = '\0';
         }
+    }
+    gchar *status  = g_strstrip(fields[0]);
+    gchar *pkg     = g_strstrip(fields[1]);
+    gchar *percent = g_strstrip(fields[2]);
+    gchar *str     = g_strstrip(fields[3]);
 
-        // update the time we last saw some action
-        m_lastTermAction = time(NULL);
+    // Since PackageKit doesn't emulate finished anymore
+    // we need to manually do it here, as at this point
+    // dpkg doesn't process two packages at the same time
+    if (!m_lastPackage.empty() && m_lastPackage.compare(pkg) != 0) {
+        const pkgCache::VerIterator &ver = findTransactionPackage(m_lastPackage);
+        if (!ver.end()) {
+            emitPackage(ver, PK_INFO_ENUM_FINISHED);
+        }
+        m_lastSubProgress = 0;
+    }
 
-        if( buf[0] == '\n') {
-            if (m_cancel) {
-                kill(m_child_pid, SIGTERM);
-            }
-            //cout << "got line: " << line << endl;
+    // first check for errors and conf-file prompts
+    if (strstr(status, "pmerror") != NULL) {
+        // error from dpkg
+        pk_backend_job_error_code(m_job,
+                                  PK_ERROR_ENUM_PACKAGE_FAILED_TO_INSTALL,
+                                  "Error while installing package: %s",
+                                  str);
+    } else if (strstr(status, "pmconffile") != NULL) {
+        // conffile-request from dpkg, needs to be parsed different
+        int i=0;
+        int count=0;
+        string orig_file, new_file;
+
+        // go to first ' and read until the end
+        for(;str[i] != '\'' || str[i] == 0; i++)
+            /*nothing*/
+            ;
+        i++;
+        for(;str[i] != '\'' || str[i] == 0; i++)
+            orig_file.append(1, str[i]);
+        i++;
+
+        // same for second ' and read until the end
+        for(;str[i] != '\'' || str[i] == 0; i++)
+            /*nothing*/
+            ;
+        i++;
+        for(;str[i] != '\'' || str[i] == 0; i++)
+            new_file.append(1, str[i]);
+        i++;
+
+        gchar *filename;
+        filename = g_build_filename(DATADIR, "PackageKit", "helpers", "aptcc", "pkconffile", NULL);
+        gchar **argv;
+        gchar **envp;
+        GError *error = NULL;
+        argv = (gchar **) g_malloc(5 * sizeof(gchar *));
+        argv[0] = filename;
+        argv[1] = g_strdup(m_lastPackage.c_str());
+        argv[2] = g_strdup(orig_file.c_str());
+        argv[3] = g_strdup(new_file.c_str());
+        argv[4] = NULL;
 
-            gchar **split  = g_strsplit(line, ":",5);
-            gchar *status  = g_strstrip(split[0]);
-            gchar *pkg     = g_strstrip(split[1]);
-            gchar *percent = g_strstrip(split[2]);
-            gchar *str     = g_strdup(g_strstrip(split[3]));
+        gchar *socket;
+        if ((m_interactive) && (socket = pk_backend_job_get_frontend_socket(m_job))) {
+            envp = (gchar **) g_malloc(3 * sizeof(gchar *));
+            envp[0] = g_strdup("DEBIAN_FRONTEND=passthrough");
+            envp[1] = g_strdup_printf("DEBCONF_PIPE=%s", socket);
+            envp[2] = NULL;
+        } else {
+            // we don't have a socket set or are non-interactive. Use the noninteractive frontend.
+            envp = (gchar **) g_malloc(2 * sizeof(gchar *));
+            envp[0] = g_strdup("DEBIAN_FRONTEND=noninteractive");
+            envp[1] = NULL;
+        }
+        g_free(socket);
 
-            // major problem here, we got unexpected input. should _never_ happen
-            if(!(pkg && status)) {
-                continue;
+        gboolean ret;
+        gint exitStatus;
+        ret = g_spawn_sync(NULL, // working dir
+                           argv, // argv
+                           envp, // envp
+                           G_SPAWN_LEAVE_DESCRIPTORS_OPEN,
+                           NULL, // child_setup
+                           NULL, // user_data
+                           NULL, // standard_output
+                           NULL, // standard_error
+                           &exitStatus,
+                           &error);
+
+        int exit_code = WEXITSTATUS(exitStatus);
+        cout << filename << " " << exit_code << " ret: "<< ret << endl;
+
+        g_free(filename);
+        g_strfreev(argv);
+        g_strfreev(envp);
+
+        if (exit_code == 10) {
+            // 1 means the user wants the package config
+            if (write(writeFd, "Y\n", 2) != 2) {
+                // TODO we need a DPKG patch to use debconf
+                g_debug("Failed to write");
             }
-
-            // Since PackageKit doesn't emulate finished anymore
-            // we need to manually do it here, as at this point
-            // dpkg doesn't process two packages at the same time
-            if (!m_lastPackage.empty() && m_lastPackage.compare(pkg) != 0) {
-                const pkgCache::VerIterator &ver = findTransactionPackage(m_lastPackage);
-                if (!ver.end()) {
-                    emitPackage(ver, PK_INFO_ENUM_FINISHED);
-                }
-                m_lastSubProgress = 0;
+        } else if (exit_code == 20) {
+            // 2 means the user wants to keep the current config
+            if (write(writeFd, "N\n", 2) != 2) {
+                // TODO we need a DPKG patch to use debconf
+                g_debug("Failed to write");
             }
-
-            // first check for errors and conf-file prompts
-            if (strstr(status, "pmerror") != NULL) {
-                // error from dpkg
-                pk_backend_job_error_code(m_job,
-                                          PK_ERROR_ENUM_PACKAGE_FAILED_TO_INSTALL,
-                                          "Error while installing package: %s",
-                                          str);
-            } else if (strstr(status, "pmconffile") != NULL) {
-                // conffile-request from dpkg, needs to be parsed different
-                int i=0;
-                int count=0;
-                string orig_file, new_file;
-
-                // go to first ' and read until the end
-                for(;str[i] != '\'' || str[i] == 0; i++)
-                    /*nothing*/
-                    ;
-                i++;
-                for(;str[i] != '\'' || str[i] == 0; i++)
-                    orig_file.append(1, str[i]);
-                i++;
-
-                // same for second ' and read until the end
-                for(;str[i] != '\'' || str[i] == 0; i++)
-                    /*nothing*/
-                    ;
-                i++;
-                for(;str[i] != '\'' || str[i] == 0; i++)
-                    new_file.append(1, str[i]);
-                i++;
-
-                gchar *filename;
-                filename = g_build_filename(DATADIR, "PackageKit", "helpers", "aptcc", "pkconffile", NULL);
-                gchar **argv;
-                gchar **envp;
-                GError *error = NULL;
-                argv = (gchar **) g_malloc(5 * sizeof(gchar *));
-                argv[0] = filename;
-                argv[1] = g_strdup(m_lastPackage.c_str());
-                argv[2] = g_strdup(orig_file.c_str());
-                argv[3] = g_strdup(new_file.c_str());
-                argv[4] = NULL;
-
-                gchar *socket;
-                if ((m_interactive) && (socket = pk_backend_job_get_frontend_socket(m_job))) {
-                    envp = (gchar **) g_malloc(3 * sizeof(gchar *));
-                    envp[0] = g_strdup("DEBIAN_FRONTEND=passthrough");
-                    envp[1] = g_strdup_printf("DEBCONF_PIPE=%s", socket);
-                    envp[2] = NULL;
-                } else {
-                    // we don't have a socket set or are non-interactive. Use the noninteractive frontend.
-                    envp = (gchar **) g_malloc(2 * sizeof(gchar *));
-                    envp[0] = g_strdup("DEBIAN_FRONTEND=noninteractive");
-                    envp[1] = NULL;
-                }
-                g_free(socket);
-
-                gboolean ret;
-                gint exitStatus;
-                ret = g_spawn_sync(NULL, // working dir
-                                   argv, // argv
-                                   envp, // envp
-                                   G_SPAWN_LEAVE_DESCRIPTORS_OPEN,
-                                   NULL, // child_setup
-                                   NULL, // user_data
-                                   NULL, // standard_output
-                                   NULL, // standard_error
-                                   &exitStatus,
-                                   &error);
-
-                int exit_code = WEXITSTATUS(exitStatus);
-                cout << filename << " " << exit_code << " ret: "<< ret << endl;
-
-                g_free(filename);
-                g_strfreev(argv);
-                g_strfreev(envp);
-
-                if (exit_code == 10) {
-                    // 1 means the user wants the package config
-                    if (write(writeFd, "Y\n", 2) != 2) {
-                        // TODO we need a DPKG patch to use debconf
-                        g_debug("Failed to write");
-                    }
-                } else if (exit_code == 20) {
-                    // 2 means the user wants to keep the current config
-                    if (write(writeFd, "N\n", 2) != 2) {
-                        // TODO we need a DPKG patch to use debconf
-                        g_debug("Failed to write");
-                    }
-                } else {
-                    // either the user didn't choose an option or the front end failed'
+        } else {
+            // either the user didn't choose an option or the front end failed'
 //                     pk_backend_job_message(m_job,
 //                                            PK_MESSAGE_ENUM_CONFIG_FILES_CHANGED,
 //                                            "The configuration file '%s' "
@@ -1880,169 +2024,209 @@ void AptIntf::updateInterface(int fd, int writeFd)
 //                                            "Please verify your changes and update it manually.",
 //                                            orig_file.c_str(),
 //                                            new_file.c_str());
-                    // fall back to keep the current config file
-                    if (write(writeFd, "N\n", 2) != 2) {
-                        // TODO we need a DPKG patch to use debconf
-                        g_debug("Failed to write");
-                    }
+            // fall back to keep the current config file
+            if (write(writeFd, "N\n", 2) != 2) {
+                // TODO we need a DPKG patch to use debconf
+                g_debug("Failed to write");
+            }
+        }
+    } else if (strstr(status, "pmstatus") != NULL) {
+        // INSTALL & UPDATE
+        // - Running dpkg
+        // loops ALL
+        // -  0 Installing pkg (sometimes this is skiped)
+        // - 25 Preparing pkg
+        // - 50 Unpacking pkg
+        // - 75 Preparing to configure pkg
+        //   ** Some pkgs have
+        //   - Running post-installation
+        //   - Running dpkg
+        // reloops all
+        // -   0 Configuring pkg
+        // - +25 Configuring pkg (SOMETIMES)
+        // - 100 Installed pkg
+        // after all
+        // - Running post-installation
+
+        // REMOVE
+        // - Running dpkg
+        // loops
+        // - 25  Removing pkg
+        // - 50  Preparing for removal of pkg
+        // - 75  Removing pkg
+        // - 100 Removed pkg
+        // after all
+        // - Running post-installation
+
+        // Let's start parsing the status:
+        if (starts_with(str, "Preparing to configure")) {
+            // Preparing to Install/configure
+            // cout << "Found Preparing to configure! " << line << endl;
+            // The next item might be Configuring so better it be 100
+            m_lastSubProgress = 100;
+            const pkgCache::VerIterator &ver = findTransactionPackage(pkg);
+            if (!ver.end()) {
+                emitPackage(ver, PK_INFO_ENUM_PREPARING);
+                emitPackageProgress(ver, 75);
+            }
+        } else if (starts_with(str, "Preparing for removal")) {
+            // Preparing to Install/configure
+            // cout << "Found Preparing for removal! " << line << endl;
+            m_lastSubProgress = 50;
+            const pkgCache::VerIterator &ver = findTransactionPackage(pkg);
+            if (!ver.end()) {
+                emitPackage(ver, PK_INFO_ENUM_REMOVING);
+                emitPackageProgress(ver, m_lastSubProgress);
+            }
+        } else if (starts_with(str, "Preparing")) {
+            // Preparing to Install/configure
+            // cout << "Found Preparing! " << line << endl;
+            const pkgCache::VerIterator &ver = findTransactionPackage(pkg);
+            if (!ver.end()) {
+                emitPackage(ver, PK_INFO_ENUM_PREPARING);
+                emitPackageProgress(ver, 25);
+            }
+        } else if (starts_with(str, "Unpacking")) {
+            // cout << "Found Unpacking! " << line << endl;
+            const pkgCache::VerIterator &ver = findTransactionPackage(pkg);
+            if (!ver.end()) {
+                emitPackage(ver, PK_INFO_ENUM_DECOMPRESSING);
+                emitPackageProgress(ver, 50);
+            }
+        } else if (starts_with(str, "Configuring")) {
+            // Installing Package
+            // cout << "Found Configuring! " << line << endl;
+            if (m_lastSubProgress >= 100 && !m_lastPackage.empty()) {
+                // cout << "FINISH the last package: " << m_lastPackage << endl;
+                const pkgCache::VerIterator &ver = findTransactionPackage(m_lastPackage);
+                if (!ver.end()) {
+                    emitPackage(ver, PK_INFO_ENUM_FINISHED);
                 }
-            } else if (strstr(status, "pmstatus") != NULL) {
-                // INSTALL & UPDATE
-                // - Running dpkg
-                // loops ALL
-                // -  0 Installing pkg (sometimes this is skiped)
-                // - 25 Preparing pkg
-                // - 50 Unpacking pkg
-                // - 75 Preparing to configure pkg
-                //   ** Some pkgs have
-                //   - Running post-installation
-                //   - Running dpkg
-                // reloops all
-                // -   0 Configuring pkg
-                // - +25 Configuring pkg (SOMETIMES)
-                // - 100 Installed pkg
-                // after all
-                // - Running post-installation
-
-                // REMOVE
-                // - Running dpkg
-                // loops
-                // - 25  Removing pkg
-                // - 50  Preparing for removal of pkg
-                // - 75  Removing pkg
-                // - 100 Removed pkg
-                // after all
-                // - Running post-installation
-
-                // Let's start parsing the status:
-                if (starts_with(str, "Preparing to configure")) {
-                    // Preparing to Install/configure
-                    // cout << "Found Preparing to configure! " << line << endl;
-                    // The next item might be Configuring so better it be 100
-                    m_lastSubProgress = 100;
-                    const pkgCache::VerIterator &ver = findTransactionPackage(pkg);
-                    if (!ver.end()) {
-                        emitPackage(ver, PK_INFO_ENUM_PREPARING);
-                        emitPackageProgress(ver, 75);
-                    }
-                } else if (starts_with(str, "Preparing for removal")) {
-                    // Preparing to Install/configure
-                    // cout << "Found Preparing for removal! " << line << endl;
-                    m_lastSubProgress = 50;
-                    const pkgCache::VerIterator &ver = findTransactionPackage(pkg);
-                    if (!ver.end()) {
-                        emitPackage(ver, PK_INFO_ENUM_REMOVING);
-                        emitPackageProgress(ver, m_lastSubProgress);
-                    }
-                } else if (starts_with(str, "Preparing")) {
-                    // Preparing to Install/configure
-                    // cout << "Found Preparing! " << line << endl;
-                    const pkgCache::VerIterator &ver = findTransactionPackage(pkg);
-                    if (!ver.end()) {
-                        emitPackage(ver, PK_INFO_ENUM_PREPARING);
-                        emitPackageProgress(ver, 25);
-                    }
-                } else if (starts_with(str, "Unpacking")) {
-                    // cout << "Found Unpacking! " << line << endl;
-                    const pkgCache::VerIterator &ver = findTransactionPackage(pkg);
-                    if (!ver.end()) {
-                        emitPackage(ver, PK_INFO_ENUM_DECOMPRESSING);
-                        emitPackageProgress(ver, 50);
-                    }
-                } else if (starts_with(str, "Configuring")) {
-                    // Installing Package
-                    // cout << "Found Configuring! " << line << endl;
-                    if (m_lastSubProgress >= 100 && !m_lastPackage.empty()) {
-                        // cout << "FINISH the last package: " << m_lastPackage << endl;
-                        const pkgCache::VerIterator &ver = findTransactionPackage(m_lastPackage);
-                        if (!ver.end()) {
-                            emitPackage(ver, PK_INFO_ENUM_FINISHED);
-                        }
-                        m_lastSubProgress = 0;
-                    }
-
-                    const pkgCache::VerIterator &ver = findTransactionPackage(pkg);
-                    if (!ver.end()) {
-                        emitPackage(ver, PK_INFO_ENUM_INSTALLING);
-                        emitPackageProgress(ver, m_lastSubProgress);
-                    }
-                    m_lastSubProgress += 25;
-                } else if (starts_with(str, "Running dpkg")) {
-                    // cout << "Found Running dpkg! " << line << endl;
-                } else if (starts_with(str, "Running")) {
-                    // cout << "Found Running! " << line << endl;
-                    pk_backend_job_set_status (m_job, PK_STATUS_ENUM_COMMIT);
-                } else if (starts_with(str, "Installing")) {
-                    // cout << "Found Installing! " << line << endl;
-                    // FINISH the last package
-                    if (!m_lastPackage.empty()) {
-                        // cout << "FINISH the last package: " << m_lastPackage << endl;
-                        const pkgCache::VerIterator &ver = findTransactionPackage(m_lastPackage);
-                        if (!ver.end()) {
-                            emitPackage(ver, PK_INFO_ENUM_FINISHED);
-                        }
-                    }
-                    m_lastSubProgress = 0;
-                    const pkgCache::VerIterator &ver = findTransactionPackage(pkg);
-                    if (!ver.end()) {
-                        emitPackage(ver, PK_INFO_ENUM_INSTALLING);
-                        emitPackageProgress(ver, m_lastSubProgress);
-                    }
-                } else if (starts_with(str, "Removing")) {
-                    // cout << "Found Removing! " << line << endl;
-                    if (m_lastSubProgress >= 100 && !m_lastPackage.empty()) {
-                        // cout << "FINISH the last package: " << m_lastPackage << endl;
-                        const pkgCache::VerIterator &ver = findTransactionPackage(m_lastPackage);
-                        if (!ver.end()) {
-                            emitPackage(ver, PK_INFO_ENUM_FINISHED);
-                        }
-                    }
-                    m_lastSubProgress += 25;
+                m_lastSubProgress = 0;
+            }
 
-                    const pkgCache::VerIterator &ver = findTransactionPackage(pkg);
-                    if (!ver.end()) {
-                        emitPackage(ver, PK_INFO_ENUM_REMOVING);
-                        emitPackageProgress(ver, m_lastSubProgress);
-                    }
-                } else if (starts_with(str, "Installed") ||
-                           starts_with(str, "Removed")) {
-                    // cout << "Found FINISHED! " << line << endl;
-                    m_lastSubProgress = 100;
-                    const pkgCache::VerIterator &ver = findTransactionPackage(pkg);
-                    if (!ver.end()) {
-                        emitPackage(ver, PK_INFO_ENUM_FINISHED);
-//                         emitPackageProgress(ver, m_lastSubProgress);
-                    }
-                } else {
-                    cout << ">>>Unmaped value<<< :" << line << endl;
+            const pkgCache::VerIterator &ver = findTransactionPackage(pkg);
+            if (!ver.end()) {
+                emitPackage(ver, PK_INFO_ENUM_INSTALLING);
+                emitPackageProgress(ver, m_lastSubProgress);
+            }
+            m_lastSubProgress += 25;
+        } else if (starts_with(str, "Running dpkg")) {
+            // cout << "Found Running dpkg! " << line << endl;
+        } else if (starts_with(str, "Running")) {
+            // cout << "Found Running! " << line << endl;
+            pk_backend_job_set_status (m_job, PK_STATUS_ENUM_COMMIT);
+        } else if (starts_with(str, "Installing")) {
+            // cout << "Found Installing! " << line << endl;
+            // FINISH the last package
+            if (!m_lastPackage.empty()) {
+                // cout << "FINISH the last package: " << m_lastPackage << endl;
+                const pkgCache::VerIterator &ver = findTransactionPackage(m_lastPackage);
+                if (!ver.end()) {
+                    emitPackage(ver, PK_INFO_ENUM_FINISHED);
                 }
-
-                if (!starts_with(str, "Running")) {
-                    m_lastPackage = pkg;
+            }
+            m_lastSubProgress = 0;
+            const pkgCache::VerIterator &ver = findTransactionPackage(pkg);
+            if (!ver.end()) {
+                emitPackage(ver, PK_INFO_ENUM_INSTALLING);
+                emitPackageProgress(ver, m_lastSubProgress);
+            }
+        } else if (starts_with(str, "Removing")) {
+            // cout << "Found Removing! " << line << endl;
+            if (m_lastSubProgress >= 100 && !m_lastPackage.empty()) {
+                // cout << "FINISH the last package: " << m_lastPackage << endl;
+                const pkgCache::VerIterator &ver = findTransactionPackage(m_lastPackage);
+                if (!ver.end()) {
+                    emitPackage(ver, PK_INFO_ENUM_FINISHED);
                 }
-                m_startCounting = true;
-            } else {
-                m_startCounting = true;
             }
+            m_lastSubProgress += 25;
 
-            int val = atoi(percent);
-            //cout << "progress: " << val << endl;
-            pk_backend_job_set_percentage(m_job, val);
-
-            // clean-up
-            g_strfreev(split);
-            g_free(str);
-            line[0] = 0;
+            const pkgCache::VerIterator &ver = findTransactionPackage(pkg);
+            if (!ver.end()) {
+                emitPackage(ver, PK_INFO_ENUM_REMOVING);
+                emitPackageProgress(ver, m_lastSubProgress);
+            }
+        } else if (starts_with(str, "Installed") ||
+                   starts_with(str, "Removed")) {
+            // cout << "Found FINISHED! " << line << endl;
+            m_lastSubProgress = 100;
+            const pkgCache::VerIterator &ver = findTransactionPackage(pkg);
+            if (!ver.end()) {
+                emitPackage(ver, PK_INFO_ENUM_FINISHED);
+//                         emitPackageProgress(ver, m_lastSubProgress);
+            }
         } else {
-            buf[1] = 0;
-            strcat(line, buf);
+            cout << ">>>Unmaped value<<< :" << str << endl;
+        }
+
+        if (!starts_with(str, "Running")) {
+            m_lastPackage = pkg;
+        }
+        m_startCounting = true;
+    } else {
+        m_startCounting = true;
+    }
+
+    // the job only sends the latest percentage to the clients at the
+    // progress update rate, don't bother it with the same one
+    int val = atoi(percent);
+    //cout << "progress: " << val << endl;
+    if (val != m_lastPercentage) {
+        m_lastPercentage = val;
+        pk_backend_job_set_percentage(m_job, val);
+    }
+}
+
+void AptIntf::updateInterface(int fd, int writeFd)
+{
+    struct pollfd fds[2];
+    char buf[4096];
+    ssize_t len;
+    size_t start;
+    size_t end;
+
+    // wait for dpkg to report something, or to write to the terminal,
+    // rather than sleeping and reading byte by byte
+    fds[0].fd = fd;
+    fds[0].events = POLLIN;
+    fds[0].revents = 0;
+    fds[1].fd = writeFd;
+    fds[1].events = POLLIN;
+    fds[1].revents = 0;
+    if (poll(fds, 2, 100) > 0) {
+        // TODO: This is dpkg's raw output. Maybe save it for error-solving?
+        if (fds[1].revents & POLLIN) {
+            while (read(writeFd, buf, sizeof(buf)) > 0);
+        }
+
+        // take everything there is, the lines are parsed below
+        if (fds[0].revents & POLLIN) {
+            while ((len = read(fd, buf, sizeof(buf))) > 0) {
+                m_statusBuffer.append(buf, len);
+            }
+        }
+    }
+
+    // parse the complete lines, keeping any partial one for next time
+    start = 0;
+    while ((end = m_statusBuffer.find('\n', start)) != string::npos) {
+        // update the time we last saw some action
+        m_lastTermAction = time(NULL);
+        if (m_cancel) {
+            kill(m_child_pid, SIGTERM);
         }
+
+        m_statusBuffer[end] = '\0';
+        processStatusLine(&m_statusBuffer[start], writeFd);
+        start = end + 1;
     }
+    m_statusBuffer.erase(0, start);
 
     time_t now = time(NULL);
 
     if(!m_startCounting) {
-        usleep(100000);
         // wait until we get the first message from apt
         m_lastTermAction = now;
     }
@@ -2053,9 +2237,6 @@ void AptIntf::updateInterface(int fd, int writeFd)
                   " seconds",m_terminalTimeout);
         m_lastTermAction = time(NULL);
     }
-
-    // sleep for a while to don't obcess over it
-    usleep(5000);
 }
 
 PkgList AptIntf::resolvePackageIds(gchar **package_ids, PkBitfield filters)
@@ -2083,20 +2264,14 @@ PkgList AptIntf::resolvePackageIds(gchar **package_ids, PkBitfield filters)
             if (m_isMultiArch && strstr(pi, ":") == NULL) {
                 // OK FindPkg is not suitable on muitarch without ":arch"
                 // it can only return one package in this case we need to
-                // search the whole package cache and match the package
-                // name manually
-                for (pkgCache::PkgIterator pkg = m_cache->GetPkgCache()->PkgBegin(); !pkg.end(); ++pkg) {
-                    if (m_cancel) {
-                        break;
-                    }
-
-                    // check if this is the package we want
-                    if (strcmp(pkg.Name(), pi) != 0) {
-                        continue;
-                    }
-
-                    // Ignore packages that could not be found or that exist only due to dependencies.
-                    if ((pkg.end() == true || (pkg.VersionList().end() && pkg.ProvidesList().end()))) {
+                // get the packages of all architectures with that name
+                const std::vector<pkgCache::PkgIterator> &pkgs = m_cache->findPackagesByName(pi);
+                for (std::vector<pkgCache::PkgIterator>::const_iterator it = pkgs.begin();
+                     it != pkgs.end(); ++it) {
+                    const pkgCache::PkgIterator &pkg = *it;
+
+                    // Ignore packages that exist only due to dependencies.
+                    if (pkg.VersionList().end() && pkg.ProvidesList().end()) {
                         continue;
                     }
 
@@ -2168,6 +2343,11 @@ void AptIntf::refreshCache()
         // TODO this shouldn't
         show_errors(m_job, PK_ERROR_ENUM_GPG_FAILURE);
     }
+
+    // Index the new lists so the first SearchDetails does not have to
+    if (_error->PendingError() == false && !updateSearchIndex()) {
+        g_debug("Failed to update the search index");
+    }
 }
 
 void AptIntf::markAutoInstalled(const PkgList &pkgs)
@@ -2575,6 +2755,12 @@ bool AptIntf::installPackages(PkBitfield flags, bool autoremove)
         // Store the packages that are going to change
         // so we can emit them as we process it
         m_pkgs = checkChangedPackages(false);
+
+        // dpkg reports packages by name, the first one in the list wins
+        m_pkgsByName.clear();
+        for (PkgList::const_iterator it = m_pkgs.begin(); it != m_pkgs.end(); ++it) {
+            m_pkgsByName.insert(std::make_pair(std::string(it->ParentPkg().Name()), *it));
+        }
     }
 
     // Download and check if we can continue
@@ -2680,16 +2866,18 @@ bool AptIntf::installPackages(PkBitfield flags, bool autoremove)
     // init the timer
     m_lastTermAction = time(NULL);
     m_startCounting = false;
+    m_lastPercentage = -1;
+    m_statusBuffer.clear();
 
     // Check if the child died
     int ret;
-    char masterbuf[1024];
     while (waitpid(m_child_pid, &ret, WNOHANG) == 0) {
-        // TODO: This is dpkg's raw output. Maybe save it for error-solving?
-        while(read(pty_master, masterbuf, sizeof(masterbuf)) > 0);
         updateInterface(readFromChildFD[0], pty_master);
     }
 
+    // the last lines may have been written just before it exited
+    updateInterface(readFromChildFD[0], pty_master);
+
     close(readFromChildFD[0]);
     close(readFromChildFD[1]);
     close(pty_master);
@@ -26,6 +26,8 @@
 #include <glib.h>
 #include <glib/gstdio.h>
 
+#include <map>
+
 #include <apt-pkg/depcache.h>
 #include <apt-pkg/acquire.h>
 
@@ -51,6 +53,11 @@ public:
     void cancel();
     bool cancelled() const;
 
+    /**
+     * Sets how many threads search the package cache, 0 means one per CPU
+     */
+    void setSearchThreads(guint threads);
+
     /**
      * Tries to find a package with the given packageId
      * @returns pkgCache::VerIterator, if .end() is true the package could not be found
@@ -68,6 +75,13 @@ public:
       */
     void refreshCache();
 
+    /**
+      * Rebuilds the index of the words of the package names and
+      * descriptions if the package cache changed since it was built
+      * @returns false if no up to date index is available
+      */
+    bool updateSearchIndex();
+
     /**
       * Tries to resolve a pkg file installation of the given \sa file
       * @param install is where the packages to be installed will be stored
@@ -244,14 +258,53 @@ public:
     AptCacheFile* aptCacheFile() const;
 
 private:
+    struct SearchTask;
+
+    static bool isReadOnlyRole(PkRoleEnum role);
+
+    /**
+     *  Splits the package cache between threads and returns the packages
+     *  matching \p search by name, or by name and description if \p details
+     */
+    PkgList searchPackages(gchar *search, bool details);
+
+    /**
+     *  Returns the changelog cache file of the source version \p candver
+     *  was built from
+     */
+    std::string changelogFilename(const pkgCache::VerIterator &candver);
+
+    /**
+     *  Downloads in one go the changelogs of \p pkgs which are not cached
+     */
+    void fetchChangelogs(const PkgList &pkgs);
+
+    /**
+     *  Looks up in the search index the packages that may match \p search
+     *  by name or description, the matcher must still be run on them
+     *  @returns false if the index can't be used for this search
+     */
+    bool searchIndexCandidates(const gchar *search, std::vector<pkgCache::PkgIterator> &pkgs);
+    static gpointer searchThread(gpointer data);
+    void searchPackagesRange(SearchTask &task);
     bool checkTrusted(pkgAcquire &fetcher, PkBitfield flags);
-    bool packageIsSupported(const pkgCache::VerIterator &verIter, string component);
-    bool isApplication(const pkgCache::VerIterator &verIter);
+
+    /**
+     *  Converts the filters into the AptCacheFile::VersionFlag bits to test
+     *  and the values they must have
+     *  @returns false if no package can match the filters
+     */
+    bool filterFlags(PkBitfield filters, unsigned int &mask, unsigned int &want);
 
     /**
      *  interprets dpkg status fd
      */
     void updateInterface(int readFd, int writeFd);
+
+    /**
+     *  handles one line of the dpkg status fd, \p line is split in place
+     */
+    void processStatusLine(gchar *line, int writeFd);
     PkgList checkChangedPackages(bool emitChanged);
     pkgCache::VerIterator findTransactionPackage(const std::string &name);
 
@@ -262,17 +315,23 @@ private:
 
     bool m_isMultiArch;
     PkgList m_pkgs;
+    std::map<std::string, pkgCache::VerIterator> m_pkgsByName;
     PkgList m_restartPackages;
 
     time_t     m_lastTermAction;
     string     m_lastPackage;
     uint       m_lastSubProgress;
+    int        m_lastPercentage;
+    // status fd output not parsed yet, a line may arrive in pieces
+    string     m_statusBuffer;
     bool       m_startCounting;
     bool       m_interactive;
 
     // when the internal terminal timesout after no activity
     int m_terminalTimeout;
     pid_t m_child_pid;
+
+    guint m_searchThreads;
 };
 
 #endif
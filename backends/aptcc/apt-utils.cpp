@@ -185,19 +185,16 @@ bool GuessThirdPartyChangelogUri(AptCacheFile &Cache,
    return true;
 }
 
-bool downloadChangelog(AptCacheFile &CacheFile,
-                       pkgAcquire &Fetcher,
-                       pkgCache::VerIterator Ver,
-                       string targetfile)
-/* Download a changelog file for the given package version to
- * targetfile. This will first try the server from Apt::Changelogs::Server
- * (http://metadata.ftp-master.debian.org/changelogs by default) and if that gives
- * a 404 tries to get it from the archive directly (see
+string getChangelogUri(AptCacheFile &CacheFile,
+                       pkgCache::VerIterator Ver)
+/* Returns the URI of the changelog of the given package version on the
+ * server from Apt::Changelogs::Server
+ * (http://metadata.ftp-master.debian.org/changelogs by default), if that
+ * gives a 404 it can be fetched from the archive directly (see
  * GuessThirdPartyChangelogUri for details how)
  */
 {
    string path;
-   string descr;
    string server;
    string changelog_uri;
    string origin;
@@ -219,35 +216,7 @@ bool downloadChangelog(AptCacheFile &CacheFile,
        strprintf(changelog_uri, "%s/%s/%s/changelog", server.c_str(), "pool", path.c_str());
    else
        strprintf(changelog_uri, "%s/%s_changelog", server.c_str(), path.c_str());
-
-   g_debug("Trying to fetch '%s'", changelog_uri.c_str());
-   strprintf(descr, "Changelog for %s", Pkg.Name());
-   // queue it
-   new pkgAcqFile(&Fetcher, changelog_uri, "", 0, descr, Pkg.Name(), "ignored", targetfile);
-
-   // try downloading it, if that fails, try third-party-changelogs location
-   // FIXME: Fetcher.Run() is "Continue" even if I get a 404?!?
-   Fetcher.Run();
-   if (!FileExists(targetfile)) {
-        string third_party_uri;
-        if (GuessThirdPartyChangelogUri(CacheFile, Pkg, Ver, third_party_uri)) {
-            g_debug("Trying to fetch '%s'", third_party_uri.c_str());
-            strprintf(descr, "Changelog for %s", Pkg.Name());
-            new pkgAcqFile(&Fetcher, third_party_uri, "", 0, descr, Pkg.Name(), "ignored", targetfile);
-            Fetcher.Run();
-        }
-   }
-
-   if (FileExists(targetfile)) {
-        return true;
-   }
-
-   // error
-   pkgRecords Recs(CacheFile);
-   pkgRecords::Parser &rec=Recs.Lookup(Ver.FileList());
-   string srcpkg = rec.SourcePkg().empty() ? Pkg.Name() : rec.SourcePkg();
-   strprintf(descr, "Changelog for this version is not yet available");
-   return false;
+   return changelog_uri;
 }
 
 void getChangelogFile(const string &filename,
@@ -293,13 +262,12 @@ GPtrArray* getCVEUrls(const string &changelog)
 {
     GPtrArray *cve_urls = g_ptr_array_new();
 
-    // Regular expression to find cve references
-    GRegex *regex;
+    // Regular expression to find cve references, compiled once
+    static GRegex *regex = g_regex_new("CVE-\\d{4}-\\d{4,}",
+                                       (GRegexCompileFlags) (G_REGEX_CASELESS | G_REGEX_OPTIMIZE),
+                                       G_REGEX_MATCH_NEWLINE_ANY,
+                                       0);
     GMatchInfo *match_info;
-    regex = g_regex_new("CVE-\\d{4}-\\d{4,}",
-                        G_REGEX_CASELESS,
-                        G_REGEX_MATCH_NEWLINE_ANY,
-                        0);
     g_regex_match (regex, changelog.c_str(), G_REGEX_MATCH_NEWLINE_ANY, &match_info);
     while (g_match_info_matches(match_info)) {
         gchar *cve = g_match_info_fetch (match_info, 0);
@@ -312,7 +280,6 @@ GPtrArray* getCVEUrls(const string &changelog)
         g_match_info_next(match_info, NULL);
     }
     g_match_info_free(match_info);
-    g_regex_unref(regex);
 
     // NULL terminate
     g_ptr_array_add(cve_urls, NULL);
@@ -324,14 +291,13 @@ GPtrArray* getBugzillaUrls(const string &changelog)
 {
     GPtrArray *bugzilla_urls = g_ptr_array_new();
 
-    // Matches Ubuntu bugs
-    GRegex *regex;
+    // Matches Ubuntu bugs, the expressions are compiled once
+    static GRegex *regexLaunchpad = g_regex_new("LP:\\s+(?:[,\\s*]?#(?'bug'\\d+))*",
+                                                (GRegexCompileFlags) (G_REGEX_CASELESS | G_REGEX_OPTIMIZE),
+                                                G_REGEX_MATCH_NEWLINE_ANY,
+                                                0);
     GMatchInfo *match_info;
-    regex = g_regex_new("LP:\\s+(?:[,\\s*]?#(?'bug'\\d+))*",
-                        G_REGEX_CASELESS,
-                        G_REGEX_MATCH_NEWLINE_ANY,
-                        0);
-    g_regex_match (regex, changelog.c_str(), G_REGEX_MATCH_NEWLINE_ANY, &match_info);
+    g_regex_match (regexLaunchpad, changelog.c_str(), G_REGEX_MATCH_NEWLINE_ANY, &match_info);
     while (g_match_info_matches(match_info)) {
         gchar *bug = g_match_info_fetch_named(match_info, "bug");
         gchar *bugLink;
@@ -343,18 +309,17 @@ GPtrArray* getBugzillaUrls(const string &changelog)
         g_match_info_next(match_info, NULL);
     }
     g_match_info_free(match_info);
-    g_regex_unref(regex);
 
     // Debian bugs
     // Regular expressions to detect bug numbers in changelogs according to the
     // Debian Policy Chapter 4.4. For details see the footnote 15:
     // http://www.debian.org/doc/debian-policy/footnotes.html#f15
     // /closes:\s*(?:bug)?\#?\s?\d+(?:,\s*(?:bug)?\#?\s?\d+)*/i
-    regex = g_regex_new("closes:\\s*(?:bug)?\\#?\\s?(?'bug1'\\d+)(?:,\\s*(?:bug)?\\#?\\s?(?'bug2'\\d+))*",
-                        G_REGEX_CASELESS,
-                        G_REGEX_MATCH_NEWLINE_ANY,
-                        0);
-    g_regex_match (regex, changelog.c_str(), G_REGEX_MATCH_NEWLINE_ANY, &match_info);
+    static GRegex *regexDebian = g_regex_new("closes:\\s*(?:bug)?\\#?\\s?(?'bug1'\\d+)(?:,\\s*(?:bug)?\\#?\\s?(?'bug2'\\d+))*",
+                                             (GRegexCompileFlags) (G_REGEX_CASELESS | G_REGEX_OPTIMIZE),
+                                             G_REGEX_MATCH_NEWLINE_ANY,
+                                             0);
+    g_regex_match (regexDebian, changelog.c_str(), G_REGEX_MATCH_NEWLINE_ANY, &match_info);
     while (g_match_info_matches(match_info)) {
         gchar *bug1 = g_match_info_fetch_named(match_info, "bug1");
         gchar *bugLink1;
@@ -377,7 +342,6 @@ GPtrArray* getBugzillaUrls(const string &changelog)
         g_match_info_next(match_info, NULL);
     }
     g_match_info_free(match_info);
-    g_regex_unref(regex);
 
     // NULL terminate
     g_ptr_array_add(bugzilla_urls, NULL);
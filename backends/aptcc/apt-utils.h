@@ -49,10 +49,20 @@ void getChangelogFile(const string &filename,
                       const string &uri,
                       pkgAcquire *fetcher);
 
-bool downloadChangelog(AptCacheFile &CacheFile,
-                       pkgAcquire &Fetcher, 
-                       pkgCache::VerIterator Ver,
-                       string targetfile);
+/**
+  * Return the URI of the changelog on the Apt::Changelogs::Server
+  */
+string getChangelogUri(AptCacheFile &CacheFile,
+                       pkgCache::VerIterator Ver);
+
+/**
+  * Return the URI of the changelog in the archive of the package, for
+  * the third party archives which are not on the changelogs server
+  */
+bool GuessThirdPartyChangelogUri(AptCacheFile &Cache,
+                                 pkgCache::PkgIterator Pkg,
+                                 pkgCache::VerIterator Ver,
+                                 string &out_uri);
 
 /**
   * Returns a list of links pairs url;description for CVEs
@@ -0,0 +1,113 @@
+/* aptcc-self-test.cpp
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include <utime.h>
+
+#include "changelog-cache.h"
+
+static void
+aptcc_test_write_changelog(const std::string &filename, time_t mtime)
+{
+    struct utimbuf times;
+    GError *error = NULL;
+    gboolean ret;
+
+    // 100 bytes each
+    const std::string data(100, 'x');
+    ret = g_file_set_contents(filename.c_str(), data.c_str(), data.size(), &error);
+    g_assert_no_error(error);
+    g_assert(ret);
+
+    times.actime = mtime;
+    times.modtime = mtime;
+    g_assert_cmpint(utime(filename.c_str(), &times), ==, 0);
+}
+
+static void
+aptcc_test_changelog_cache_func(void)
+{
+    GError *error = NULL;
+    gchar *directory;
+
+    directory = g_dir_make_tmp("aptcc-changelogs-XXXXXX", &error);
+    g_assert_no_error(error);
+    g_assert(directory != NULL);
+
+    // room for two changelogs
+    ChangelogCache cache(directory, 200);
+
+    // the epoch separator is quoted
+    const std::string a = cache.filename("pk-a", "1:1.0");
+    const std::string b = cache.filename("pk-b", "1.0");
+    const std::string c = cache.filename("pk-c", "1.0");
+    g_assert_cmpstr(a.c_str(), ==, (std::string(directory) + "/pk-a_1%3a1.0.changelog").c_str());
+
+    // not downloaded yet
+    g_assert(!cache.lookup(a));
+
+    // an empty download is not kept
+    const std::string empty = std::string(directory) + "/empty.part";
+    g_assert(g_file_set_contents(empty.c_str(), "", 0, NULL));
+    g_assert(!cache.add(empty, a));
+    g_assert(!g_file_test(empty.c_str(), G_FILE_TEST_EXISTS));
+    g_assert(!cache.lookup(a));
+
+    // add, oldest first
+    const std::string part = std::string(directory) + "/pk.part";
+    aptcc_test_write_changelog(part, 1000);
+    g_assert(cache.add(part, a));
+    g_assert(!g_file_test(part.c_str(), G_FILE_TEST_EXISTS));
+    aptcc_test_write_changelog(part, 2000);
+    g_assert(cache.add(part, b));
+    aptcc_test_write_changelog(part, 3000);
+    g_assert(cache.add(part, c));
+
+    // looking up a makes it the most recently used
+    g_assert(cache.lookup(a));
+
+    // so b is removed to fit the limit
+    cache.expire();
+    g_assert(g_file_test(a.c_str(), G_FILE_TEST_EXISTS));
+    g_assert(!g_file_test(b.c_str(), G_FILE_TEST_EXISTS));
+    g_assert(g_file_test(c.c_str(), G_FILE_TEST_EXISTS));
+    g_assert(!cache.lookup(b));
+
+    // nothing else to remove
+    cache.expire();
+    g_assert(cache.lookup(a));
+    g_assert(cache.lookup(c));
+
+    g_unlink(a.c_str());
+    g_unlink(c.c_str());
+    g_rmdir(directory);
+    g_free(directory);
+}
+
+int
+main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/aptcc/changelog-cache", aptcc_test_changelog_cache_func);
+
+    return g_test_run();
+}
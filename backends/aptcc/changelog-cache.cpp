@@ -0,0 +1,154 @@
+/* changelog-cache.cpp
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "changelog-cache.h"
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include <sys/stat.h>
+#include <dirent.h>
+#include <utime.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+
+#include <algorithm>
+#include <vector>
+
+#define APTCC_CHANGELOG_CACHE       LOCALSTATEDIR "/cache/PackageKit/aptcc-changelogs"
+#define APTCC_CHANGELOG_CACHE_SIZE  (16 * 1024 * 1024)
+
+namespace {
+
+struct CachedFile {
+    time_t mtime;
+    off_t size;
+    std::string path;
+
+    bool operator<(const CachedFile &other) const {
+        return mtime < other.mtime;
+    }
+};
+
+}
+
+ChangelogCache::ChangelogCache(const std::string &directory, off_t maxSize) :
+    m_directory(directory),
+    m_maxSize(maxSize)
+{
+    if (g_mkdir_with_parents(m_directory.c_str(), 0755) != 0) {
+        g_warning("Failed to create %s: %s", m_directory.c_str(), g_strerror(errno));
+    }
+}
+
+ChangelogCache* ChangelogCache::system()
+{
+    static ChangelogCache *cache = 0;
+    if (cache == 0) {
+        cache = new ChangelogCache(APTCC_CHANGELOG_CACHE, APTCC_CHANGELOG_CACHE_SIZE);
+    }
+    return cache;
+}
+
+std::string ChangelogCache::filename(const std::string &srcPkg, const std::string &version) const
+{
+    // the epoch separator is quoted like in the names of the debs
+    std::string name = srcPkg;
+    name.append("_");
+    for (std::string::const_iterator it = version.begin(); it != version.end(); ++it) {
+        if (*it == ':') {
+            name.append("%3a");
+        } else if (*it == '/') {
+            name.append("_");
+        } else {
+            name.append(1, *it);
+        }
+    }
+    name.append(".changelog");
+    return m_directory + "/" + name;
+}
+
+bool ChangelogCache::lookup(const std::string &filename)
+{
+    struct stat buf;
+    if (stat(filename.c_str(), &buf) != 0 || buf.st_size == 0) {
+        return false;
+    }
+
+    // the modification time is when it was last used
+    utime(filename.c_str(), NULL);
+    return true;
+}
+
+bool ChangelogCache::add(const std::string &downloaded, const std::string &filename)
+{
+    struct stat buf;
+    if (stat(downloaded.c_str(), &buf) != 0 || buf.st_size == 0) {
+        // the server had nothing for it
+        unlink(downloaded.c_str());
+        return false;
+    }
+
+    if (rename(downloaded.c_str(), filename.c_str()) != 0) {
+        g_warning("Failed to cache changelog %s: %s", filename.c_str(), g_strerror(errno));
+        unlink(downloaded.c_str());
+        return false;
+    }
+    return true;
+}
+
+void ChangelogCache::expire()
+{
+    DIR *dir = opendir(m_directory.c_str());
+    if (dir == NULL) {
+        return;
+    }
+
+    std::vector<CachedFile> files;
+    off_t total = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        CachedFile file;
+        struct stat buf;
+        // still being downloaded
+        if (g_str_has_suffix(entry->d_name, ".part")) {
+            continue;
+        }
+        file.path = m_directory + "/" + entry->d_name;
+        if (stat(file.path.c_str(), &buf) != 0 || !S_ISREG(buf.st_mode)) {
+            continue;
+        }
+        file.mtime = buf.st_mtime;
+        file.size = buf.st_size;
+        total += file.size;
+        files.push_back(file);
+    }
+    closedir(dir);
+
+    // remove the least recently used first
+    std::sort(files.begin(), files.end());
+    for (std::vector<CachedFile>::const_iterator it = files.begin();
+         it != files.end() && total > m_maxSize;
+         ++it) {
+        g_debug("Removing cached changelog %s", it->path.c_str());
+        unlink(it->path.c_str());
+        total -= it->size;
+    }
+}
@@ -0,0 +1,73 @@
+/* changelog-cache.h
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef CHANGELOG_CACHE_H
+#define CHANGELOG_CACHE_H
+
+#include <sys/types.h>
+
+#include <string>
+
+/**
+ * Keeps the downloaded changelogs, one file per source package version
+ *
+ * The changelog of a version never changes, so it is only downloaded
+ * once for all the binary packages built from it. When the files take
+ * more than the size limit the least recently used ones are removed.
+ */
+class ChangelogCache
+{
+public:
+    ChangelogCache(const std::string &directory, off_t maxSize);
+
+    /**
+     * Returns the cache of the system, in the PackageKit cache directory
+     */
+    static ChangelogCache* system();
+
+    /**
+     * Returns the file holding the changelog of \p srcPkg at \p version,
+     * the file does not have to exist
+     */
+    std::string filename(const std::string &srcPkg, const std::string &version) const;
+
+    /**
+     * Returns true if the changelog in \p filename is cached, and marks
+     * it as recently used
+     */
+    bool lookup(const std::string &filename);
+
+    /**
+     * Moves the downloaded changelog \p downloaded, which must be in the
+     * cache directory, to \p filename
+     */
+    bool add(const std::string &downloaded, const std::string &filename);
+
+    /**
+     * Removes the least recently used changelogs until the cache fits
+     * in its size limit
+     */
+    void expire();
+
+private:
+    std::string m_directory;
+    off_t m_maxSize;
+};
+
+#endif
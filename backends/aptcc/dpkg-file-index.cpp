@@ -0,0 +1,556 @@
+/* dpkg-file-index.cpp
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "dpkg-file-index.h"
+
+#include <glib.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+#include <cstdio>
+
+#include <algorithm>
+#include <fstream>
+
+#define APTCC_FILE_INDEX        LOCALSTATEDIR "/cache/PackageKit/aptcc-files.idx"
+#define FILE_INDEX_MAGIC        "PKFI"
+#define FILE_INDEX_VERSION      1
+
+// The package ships a desktop file
+#define PACKAGE_FLAG_APPLICATION    (1 << 0)
+
+struct DpkgFileIndex::Header {
+    char     magic[4];
+    uint32_t version;
+    uint32_t nPackages;
+    uint32_t nFiles;
+    uint32_t poolSize;
+    uint32_t reserved;
+    // mtime of the dpkg info directory when the index was built
+    int64_t  dirSec;
+    int64_t  dirNsec;
+};
+
+struct DpkgFileIndex::Package {
+    uint32_t name;
+    uint32_t firstFile;
+    uint32_t nFiles;
+    uint32_t flags;
+    // state of the .list file the entries were read from
+    int64_t  mtimeSec;
+    int64_t  mtimeNsec;
+    int64_t  size;
+};
+
+struct DpkgFileIndex::File {
+    uint32_t path;
+    uint32_t basename;
+    uint32_t package;
+};
+
+/**
+ * Orders file entries by the pool string at the given offsets
+ */
+struct PoolOffsetLess
+{
+    PoolOffsetLess(const char *pool, const std::vector<uint32_t> &offsets) :
+        m_pool(pool),
+        m_offsets(offsets)
+    {
+    }
+
+    bool operator()(uint32_t a, uint32_t b) const
+    {
+        return strcmp(m_pool + m_offsets[a], m_pool + m_offsets[b]) < 0;
+    }
+
+    const char *m_pool;
+    const std::vector<uint32_t> &m_offsets;
+};
+
+template <typename T>
+static void appendData(std::vector<char> &image, const T *data, size_t count)
+{
+    const char *begin = reinterpret_cast<const char *>(data);
+    image.insert(image.end(), begin, begin + count * sizeof(T));
+}
+
+DpkgFileIndex::DpkgFileIndex(const std::string &infoDir, const std::string &indexFile) :
+    m_infoDir(infoDir),
+    m_indexFile(indexFile),
+    m_map(0),
+    m_mapSize(0),
+    m_header(0),
+    m_packages(0),
+    m_files(0),
+    m_byPath(0),
+    m_byBasename(0),
+    m_pool(0)
+{
+}
+
+DpkgFileIndex::~DpkgFileIndex()
+{
+    unload();
+}
+
+DpkgFileIndex* DpkgFileIndex::system()
+{
+    static DpkgFileIndex *index = 0;
+    if (index == 0) {
+        index = new DpkgFileIndex(DPKG_INFO_DIR, APTCC_FILE_INDEX);
+    }
+
+    if (!index->update()) {
+        return 0;
+    }
+    return index;
+}
+
+bool DpkgFileIndex::update()
+{
+    struct stat dirStat;
+    if (stat(m_infoDir.c_str(), &dirStat) != 0) {
+        g_debug("Error opening %s", m_infoDir.c_str());
+        return false;
+    }
+
+    // dpkg replaces the .list files by renaming them, so
+    // any change shows up in the mtime of the directory
+    if (m_header == 0) {
+        load();
+    }
+    if (m_header &&
+            m_header->dirSec == dirStat.st_mtim.tv_sec &&
+            m_header->dirNsec == dirStat.st_mtim.tv_nsec) {
+        return true;
+    }
+
+    return build(dirStat.st_mtim.tv_sec, dirStat.st_mtim.tv_nsec);
+}
+
+bool DpkgFileIndex::load()
+{
+    int fd = open(m_indexFile.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat buf;
+    if (fstat(fd, &buf) != 0 || (size_t) buf.st_size < sizeof(Header)) {
+        close(fd);
+        return false;
+    }
+
+    void *map = mmap(0, buf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+
+    m_map = map;
+    m_mapSize = buf.st_size;
+    if (!setData(static_cast<const char *>(map), m_mapSize)) {
+        g_debug("Ignoring invalid file index %s", m_indexFile.c_str());
+        unload();
+        return false;
+    }
+
+    return true;
+}
+
+void DpkgFileIndex::unload()
+{
+    if (m_map) {
+        munmap(m_map, m_mapSize);
+    }
+    m_map = 0;
+    m_mapSize = 0;
+    m_buffer.clear();
+
+    m_header = 0;
+    m_packages = 0;
+    m_files = 0;
+    m_byPath = 0;
+    m_byBasename = 0;
+    m_pool = 0;
+}
+
+bool DpkgFileIndex::setData(const char *data, size_t size)
+{
+    const Header *header = reinterpret_cast<const Header *>(data);
+    if (size < sizeof(Header) ||
+            memcmp(header->magic, FILE_INDEX_MAGIC, 4) != 0 ||
+            header->version != FILE_INDEX_VERSION) {
+        return false;
+    }
+
+    // the counts come from the file, so they are checked against its
+    // size before they are multiplied
+    if (header->nPackages > size / sizeof(Package) ||
+            header->nFiles > size / (sizeof(File) + 2 * sizeof(uint32_t)) ||
+            header->poolSize > size) {
+        return false;
+    }
+
+    size_t expected = sizeof(Header) +
+            (size_t) header->nPackages * sizeof(Package) +
+            (size_t) header->nFiles * (sizeof(File) + 2 * sizeof(uint32_t)) +
+            header->poolSize;
+    if (size != expected || header->poolSize == 0 || data[size - 1] != '\0') {
+        return false;
+    }
+
+    const char *pos = data + sizeof(Header);
+    const Package *packages = reinterpret_cast<const Package *>(pos);
+    pos += header->nPackages * sizeof(Package);
+    const File *files = reinterpret_cast<const File *>(pos);
+    pos += header->nFiles * sizeof(File);
+    const uint32_t *byPath = reinterpret_cast<const uint32_t *>(pos);
+    pos += header->nFiles * sizeof(uint32_t);
+    const uint32_t *byBasename = reinterpret_cast<const uint32_t *>(pos);
+    pos += header->nFiles * sizeof(uint32_t);
+
+    // a truncated or corrupt file must not make the lookups read outside
+    // of the mapping, the pool ends with a '\0' so every string that
+    // starts inside it is terminated
+    for (uint32_t i = 0; i < header->nPackages; ++i) {
+        const Package &pkg = packages[i];
+        if (pkg.name >= header->poolSize ||
+                pkg.firstFile > header->nFiles ||
+                pkg.nFiles > header->nFiles - pkg.firstFile) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < header->nFiles; ++i) {
+        const File &file = files[i];
+        if (file.path >= header->poolSize ||
+                file.basename >= header->poolSize ||
+                file.package >= header->nPackages ||
+                byPath[i] >= header->nFiles ||
+                byBasename[i] >= header->nFiles) {
+            return false;
+        }
+    }
+
+    m_header = header;
+    m_packages = packages;
+    m_files = files;
+    m_byPath = byPath;
+    m_byBasename = byBasename;
+    m_pool = pos;
+
+    return true;
+}
+
+bool DpkgFileIndex::build(int64_t dirSec, int64_t dirNsec)
+{
+    DIR *dp;
+    struct dirent *dirp;
+    if (!(dp = opendir(m_infoDir.c_str()))) {
+        g_debug("Error opening %s", m_infoDir.c_str());
+        return false;
+    }
+
+    std::vector<std::string> names;
+    while ((dirp = readdir(dp)) != NULL) {
+        size_t len = strlen(dirp->d_name);
+        if (len > 5 && strcmp(dirp->d_name + len - 5, ".list") == 0) {
+            names.push_back(std::string(dirp->d_name, len - 5));
+        }
+    }
+    closedir(dp);
+
+    // packages are looked up by a binary search on the list name
+    std::sort(names.begin(), names.end());
+
+    // offset 0 of the pool is the empty string
+    std::string pool(1, '\0');
+    std::vector<Package> packages;
+    std::vector<File> files;
+    std::vector<uint32_t> paths;
+    std::vector<uint32_t> basenames;
+    packages.reserve(names.size());
+    guint reused = 0;
+
+    std::string line;
+    for (std::vector<std::string>::const_iterator it = names.begin(); it != names.end(); ++it) {
+        const std::string fileName = m_infoDir + "/" + *it + ".list";
+        struct stat listStat;
+        if (stat(fileName.c_str(), &listStat) != 0) {
+            continue;
+        }
+
+        Package pkg;
+        memset(&pkg, 0, sizeof(pkg));
+        pkg.name = pool.size();
+        pool.append(*it);
+        pool.push_back('\0');
+        pkg.firstFile = files.size();
+        pkg.mtimeSec = listStat.st_mtim.tv_sec;
+        pkg.mtimeNsec = listStat.st_mtim.tv_nsec;
+        pkg.size = listStat.st_size;
+
+        std::vector<std::string> lines;
+        const Package *old = findPackage(*it);
+        if (old &&
+                old->mtimeSec == pkg.mtimeSec &&
+                old->mtimeNsec == pkg.mtimeNsec &&
+                old->size == pkg.size) {
+            // The list did not change, copy the entries of the old index
+            for (uint32_t i = old->firstFile; i < old->firstFile + old->nFiles; ++i) {
+                lines.push_back(poolString(m_files[i].path));
+            }
+            ++reused;
+        } else {
+            std::ifstream in(fileName.c_str());
+            if (!in != 0) {
+                continue;
+            }
+            while (getline(in, line)) {
+                if (!line.empty()) {
+                    lines.push_back(line);
+                }
+            }
+        }
+
+        for (std::vector<std::string>::const_iterator lit = lines.begin(); lit != lines.end(); ++lit) {
+            File file;
+            size_t slash = lit->find_last_of('/');
+            file.path = pool.size();
+            file.basename = file.path + (slash == std::string::npos ? 0 : slash + 1);
+            file.package = packages.size();
+            pool.append(*lit);
+            pool.push_back('\0');
+
+            if (lit->size() > 8 && lit->compare(lit->size() - 8, 8, ".desktop") == 0) {
+                pkg.flags |= PACKAGE_FLAG_APPLICATION;
+            }
+
+            files.push_back(file);
+            paths.push_back(file.path);
+            basenames.push_back(file.basename);
+        }
+
+        pkg.nFiles = files.size() - pkg.firstFile;
+        packages.push_back(pkg);
+    }
+
+    if (pool.size() > G_MAXUINT32) {
+        g_warning("Too many files to index in %s", m_infoDir.c_str());
+        return false;
+    }
+
+    std::vector<uint32_t> byPath(files.size());
+    std::vector<uint32_t> byBasename(files.size());
+    for (uint32_t i = 0; i < files.size(); ++i) {
+        byPath[i] = i;
+        byBasename[i] = i;
+    }
+    std::sort(byPath.begin(), byPath.end(), PoolOffsetLess(pool.c_str(), paths));
+    std::sort(byBasename.begin(), byBasename.end(), PoolOffsetLess(pool.c_str(), basenames));
+
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, FILE_INDEX_MAGIC, 4);
+    header.version = FILE_INDEX_VERSION;
+    header.nPackages = packages.size();
+    header.nFiles = files.size();
+    header.poolSize = pool.size();
+    header.dirSec = dirSec;
+    header.dirNsec = dirNsec;
+
+    std::vector<char> image;
+    image.reserve(sizeof(Header) +
+                  packages.size() * sizeof(Package) +
+                  files.size() * (sizeof(File) + 2 * sizeof(uint32_t)) +
+                  pool.size());
+    appendData(image, &header, 1);
+    appendData(image, packages.data(), packages.size());
+    appendData(image, files.data(), files.size());
+    appendData(image, byPath.data(), byPath.size());
+    appendData(image, byBasename.data(), byBasename.size());
+    appendData(image, pool.data(), pool.size());
+
+    g_debug("Indexed %zu files of %zu packages, %u lists unchanged",
+            files.size(), packages.size(), reused);
+
+    // The old entries are not needed anymore
+    unload();
+
+    // Save the index so the next start only has to read the lists that
+    // changed, and keep it in memory if that is not possible
+    std::string tmpFile = m_indexFile + ".new";
+    FILE *out = fopen(tmpFile.c_str(), "w");
+    bool saved = false;
+    if (out) {
+        saved = fwrite(image.data(), 1, image.size(), out) == image.size();
+        saved = (fclose(out) == 0) && saved;
+        saved = saved && rename(tmpFile.c_str(), m_indexFile.c_str()) == 0;
+        if (!saved) {
+            unlink(tmpFile.c_str());
+        }
+    }
+
+    if (saved && load()) {
+        return true;
+    }
+
+    g_debug("Failed to save file index %s, keeping it in memory", m_indexFile.c_str());
+    m_buffer.swap(image);
+    return setData(m_buffer.data(), m_buffer.size());
+}
+
+const char* DpkgFileIndex::poolString(uint32_t offset) const
+{
+    return m_pool + offset;
+}
+
+const DpkgFileIndex::Package* DpkgFileIndex::findPackage(const std::string &listName) const
+{
+    if (m_header == 0) {
+        return 0;
+    }
+
+    size_t lo = 0;
+    size_t hi = m_header->nPackages;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        int cmp = listName.compare(poolString(m_packages[mid].name));
+        if (cmp == 0) {
+            return &m_packages[mid];
+        } else if (cmp < 0) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return 0;
+}
+
+const uint32_t* DpkgFileIndex::lowerBound(const uint32_t *table, bool basename, const char *key) const
+{
+    size_t lo = 0;
+    size_t hi = m_header->nFiles;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        const File &file = m_files[table[mid]];
+        if (strcmp(poolString(basename ? file.basename : file.path), key) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return table + lo;
+}
+
+void DpkgFileIndex::appendOwners(const uint32_t *table,
+                                 bool basename,
+                                 const std::string &key,
+                                 bool prefix,
+                                 std::vector<std::string> &output) const
+{
+    if (m_header == 0) {
+        return;
+    }
+
+    // the same package usually owns many of the matching paths
+    std::vector<bool> seen(m_header->nPackages, false);
+    const uint32_t *end = table + m_header->nFiles;
+    for (const uint32_t *it = lowerBound(table, basename, key.c_str()); it != end; ++it) {
+        const File &file = m_files[*it];
+        const char *str = poolString(basename ? file.basename : file.path);
+        if (prefix) {
+            if (strncmp(str, key.c_str(), key.size()) != 0) {
+                break;
+            }
+        } else if (key.compare(str) != 0) {
+            break;
+        }
+
+        if (!seen[file.package]) {
+            seen[file.package] = true;
+            output.push_back(poolString(m_packages[file.package].name));
+        }
+    }
+}
+
+void DpkgFileIndex::searchPath(const std::string &path, std::vector<std::string> &output) const
+{
+    appendOwners(m_byPath, false, path, false, output);
+}
+
+void DpkgFileIndex::searchBasename(const std::string &name, std::vector<std::string> &output) const
+{
+    appendOwners(m_byBasename, true, name, false, output);
+}
+
+void DpkgFileIndex::searchPrefix(const std::string &prefix, std::vector<std::string> &output) const
+{
+    appendOwners(m_byPath, false, prefix, true, output);
+}
+
+void DpkgFileIndex::searchRegex(const std::vector<regex_t> &patterns, std::vector<std::string> &output) const
+{
+    if (m_header == 0 || patterns.empty()) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < m_header->nPackages; ++i) {
+        const Package &pkg = m_packages[i];
+        bool matched = false;
+        for (uint32_t j = pkg.firstFile; j < pkg.firstFile + pkg.nFiles && !matched; ++j) {
+            const char *path = poolString(m_files[j].path);
+            for (size_t k = 0; k < patterns.size() && !matched; ++k) {
+                matched = regexec(&patterns[k], path, 0, NULL, 0) == 0;
+            }
+        }
+        if (matched) {
+            output.push_back(poolString(pkg.name));
+        }
+    }
+}
+
+bool DpkgFileIndex::packageFiles(const std::string &listName, std::vector<std::string> &files) const
+{
+    const Package *pkg = findPackage(listName);
+    if (pkg == 0) {
+        return false;
+    }
+
+    for (uint32_t i = pkg->firstFile; i < pkg->firstFile + pkg->nFiles; ++i) {
+        files.push_back(poolString(m_files[i].path));
+    }
+    return true;
+}
+
+bool DpkgFileIndex::hasPackage(const std::string &listName) const
+{
+    return findPackage(listName) != 0;
+}
+
+bool DpkgFileIndex::isApplication(const std::string &listName) const
+{
+    const Package *pkg = findPackage(listName);
+    return pkg && (pkg->flags & PACKAGE_FLAG_APPLICATION);
+}
@@ -0,0 +1,132 @@
+/* dpkg-file-index.h
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef DPKG_FILE_INDEX_H
+#define DPKG_FILE_INDEX_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <regex.h>
+
+#include <string>
+#include <vector>
+
+#define DPKG_INFO_DIR "/var/lib/dpkg/info"
+
+/**
+ * Maps the paths listed in the dpkg .list files to the packages owning them
+ *
+ * The index is a single file holding a package table sorted by list name,
+ * the files of every package, two tables of file entries sorted by path
+ * and by basename, and a string pool. It is mmap'ed when loaded and only
+ * the .list files that changed since it was written are read again.
+ */
+class DpkgFileIndex
+{
+public:
+    DpkgFileIndex(const std::string &infoDir, const std::string &indexFile);
+    ~DpkgFileIndex();
+
+    /**
+     * Returns the index of the installed packages, updated if
+     * the dpkg database changed since the last call
+     * @returns 0 if the dpkg database could not be read
+     */
+    static DpkgFileIndex* system();
+
+    /**
+     * Makes sure the index matches the .list files, only the
+     * packages whose list changed are read again
+     */
+    bool update();
+
+    /**
+     * Appends the list names of the packages owning exactly this path
+     */
+    void searchPath(const std::string &path, std::vector<std::string> &output) const;
+
+    /**
+     * Appends the list names of the packages owning a file with this basename
+     */
+    void searchBasename(const std::string &name, std::vector<std::string> &output) const;
+
+    /**
+     * Appends the list names of the packages owning a path starting with \p prefix
+     */
+    void searchPrefix(const std::string &prefix, std::vector<std::string> &output) const;
+
+    /**
+     * Appends the list names of the packages owning a path matched by any
+     * of \p patterns, this reads every path in the index
+     */
+    void searchRegex(const std::vector<regex_t> &patterns, std::vector<std::string> &output) const;
+
+    /**
+     * Gets the files of a package, \p listName is the name of the list file
+     * without the extension, "pkg" or "pkg:arch" on multiarch systems
+     * @returns false if the package is not in the index
+     */
+    bool packageFiles(const std::string &listName, std::vector<std::string> &files) const;
+
+    /**
+     * Returns true if the package is in the index
+     */
+    bool hasPackage(const std::string &listName) const;
+
+    /**
+     * Returns true if the package ships a desktop file
+     */
+    bool isApplication(const std::string &listName) const;
+
+private:
+    struct Header;
+    struct Package;
+    struct File;
+
+    bool load();
+    void unload();
+    bool build(int64_t dirSec, int64_t dirNsec);
+    bool setData(const char *data, size_t size);
+
+    const Package* findPackage(const std::string &listName) const;
+    const char* poolString(uint32_t offset) const;
+    const uint32_t* lowerBound(const uint32_t *table, bool basename, const char *key) const;
+    void appendOwners(const uint32_t *table,
+                      bool basename,
+                      const std::string &key,
+                      bool prefix,
+                      std::vector<std::string> &output) const;
+
+    std::string m_infoDir;
+    std::string m_indexFile;
+
+    // Either the mmap'ed index file or m_buffer when it could not be saved
+    void *m_map;
+    size_t m_mapSize;
+    std::vector<char> m_buffer;
+
+    const Header *m_header;
+    const Package *m_packages;
+    const File *m_files;
+    const uint32_t *m_byPath;
+    const uint32_t *m_byBasename;
+    const char *m_pool;
+};
+
+#endif
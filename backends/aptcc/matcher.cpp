@@ -22,6 +22,7 @@
 
 #include "matcher.h"
 #include <stdio.h>
+#include <string.h>
 #include <iostream>
 
 Matcher::Matcher(const string &matchers) :
@@ -54,8 +55,46 @@ bool string_matches(const char *s, regex_t &pattern_nogroup)
     return !regexec(&pattern_nogroup, s, 0, NULL, 0);
 }
 
+// A term is matched as a plain string when regcomp() would not
+// treat any of its characters specially, non ASCII characters go
+// through regcomp() too as REG_ICASE folds them according to the locale
+static bool is_literal(const string &pattern)
+{
+    for (string::const_iterator i = pattern.begin(); i != pattern.end(); ++i) {
+        const unsigned char c = *i;
+        if (c == '\0' || c >= 0x80 || strchr(".[]()*+?{}|^$\\", c) != NULL) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static inline char ascii_tolower(char c)
+{
+    return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+static void lower_into(const string &s, string &output)
+{
+    output.resize(s.size());
+    for (size_t i = 0; i < s.size(); ++i) {
+        output[i] = ascii_tolower(s[i]);
+    }
+}
+
 bool Matcher::matches(const string &s)
 {
+    if (!m_literals.empty()) {
+        lower_into(s, m_lowered);
+
+        for (vector<string>::const_iterator i = m_literals.begin();
+             i != m_literals.end(); ++i) {
+            if (memmem(m_lowered.data(), m_lowered.size(), i->data(), i->size()) == NULL) {
+                return false;
+            }
+        }
+    }
+
     int matchesCount = 0;
     for (vector<regex_t>::iterator i=m_matches.begin();
          i != m_matches.end(); ++i) {
@@ -85,7 +124,19 @@ bool Matcher::matchesFile(const string &s, map<int, bool> &matchers_used)
         }
     }
 
-    return m_matches.size() == matchers_used.size();
+    // the literal terms are numbered after the regular expressions
+    if (!m_literals.empty()) {
+        lower_into(s, m_lowered);
+
+        for (size_t i = 0; i < m_literals.size(); ++i) {
+            const string &literal = m_literals[i];
+            if (memmem(m_lowered.data(), m_lowered.size(), literal.data(), literal.size()) != NULL) {
+                matchers_used[m_matches.size() + i] = true;
+            }
+        }
+    }
+
+    return m_matches.size() + m_literals.size() == matchers_used.size();
 }
 
 bool Matcher::parse_pattern(string::const_iterator &start,
@@ -107,6 +158,14 @@ bool Matcher::parse_pattern(string::const_iterator &start,
             continue;
         }
 
+        if (is_literal(subString)) {
+            for (string::iterator i = subString.begin(); i != subString.end(); ++i) {
+                *i = ascii_tolower(*i);
+            }
+            m_literals.push_back(subString);
+            continue;
+        }
+
         regex_t pattern_nogroup;
         if (do_compile(subString, pattern_nogroup, REG_ICASE|REG_EXTENDED|REG_NOSUB)) {
             m_matches.push_back(pattern_nogroup);
@@ -50,6 +50,11 @@ private:
     string parse_literal_string_tail(string::const_iterator &start,
                                      const string::const_iterator end);
     vector<regex_t> m_matches;
+
+    // Terms without regex metacharacters, lower cased, they are
+    // searched as plain substrings of the lower cased subject
+    vector<string> m_literals;
+    string m_lowered;
 };
 
 #endif
@@ -36,6 +36,7 @@
 
 /* static bodges */
 static PkBackendSpawn *spawn;
+static guint searchThreads = 0;
 
 /**
  * pk_backend_get_description:
@@ -89,6 +90,9 @@ void pk_backend_initialize(GKeyFile *conf, PkBackend *backend)
         g_debug("ERROR initializing backend system");
     }
 
+    // How many threads may search the package cache, 0 means one per CPU
+    searchThreads = MAX(g_key_file_get_integer(conf, "Daemon", "SearchThreads", NULL), 0);
+
     spawn = pk_backend_spawn_new(conf);
 //     pk_backend_spawn_set_job(spawn, backend);
     pk_backend_spawn_set_name(spawn, "aptcc");
@@ -100,6 +104,8 @@ void pk_backend_initialize(GKeyFile *conf, PkBackend *backend)
 void pk_backend_destroy(PkBackend *backend)
 {
     g_debug("APTcc being destroyed");
+
+    AptCacheFile::releaseSharedCache();
 }
 
 /**
@@ -172,6 +178,7 @@ void pk_backend_start_job(PkBackend *backend, PkBackendJob *job)
 {
     /* create private state for this job */
     AptIntf *apt = new AptIntf(job);
+    apt->setSearchThreads(searchThreads);
     pk_backend_job_set_user_data(job, apt);
 }
 
@@ -0,0 +1,386 @@
+/* search-index.cpp
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "search-index.h"
+
+#include <glib.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+#include <cstdio>
+
+#define APTCC_SEARCH_INDEX      LOCALSTATEDIR "/cache/PackageKit/aptcc-search.idx"
+#define SEARCH_INDEX_MAGIC      "PKSI"
+#define SEARCH_INDEX_VERSION    1
+
+struct SearchIndex::Header {
+    char     magic[4];
+    uint32_t version;
+    uint32_t nPackages;
+    uint32_t nWords;
+    uint32_t nPostings;
+    uint32_t poolSize;
+    // pool offset of the generation of the cache the index was built from
+    uint32_t generation;
+    uint32_t reserved;
+};
+
+struct SearchIndex::Word {
+    uint32_t text;
+    uint32_t length;
+    uint32_t firstPosting;
+    uint32_t nPostings;
+};
+
+static inline bool is_word_char(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9');
+}
+
+static inline char ascii_tolower(char c)
+{
+    return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+template <typename T>
+static void appendData(std::vector<char> &image, const T *data, size_t count)
+{
+    const char *begin = reinterpret_cast<const char *>(data);
+    image.insert(image.end(), begin, begin + count * sizeof(T));
+}
+
+void SearchIndex::Builder::addPackage(const std::string &name, const std::string &text)
+{
+    const uint32_t id = m_names.size();
+    m_names.push_back(name);
+
+    std::string word;
+    for (size_t i = 0; i <= text.size(); ++i) {
+        if (i < text.size() && is_word_char(text[i])) {
+            word += ascii_tolower(text[i]);
+            continue;
+        }
+        if (word.empty()) {
+            continue;
+        }
+
+        // the packages are added in order, so each list stays
+        // sorted and only needs to be checked for its last entry
+        std::vector<uint32_t> &postings = m_words[word];
+        if (postings.empty() || postings.back() != id) {
+            postings.push_back(id);
+        }
+        word.clear();
+    }
+}
+
+SearchIndex::SearchIndex(const std::string &indexFile) :
+    m_indexFile(indexFile),
+    m_map(0),
+    m_mapSize(0),
+    m_header(0),
+    m_packages(0),
+    m_words(0),
+    m_postings(0),
+    m_pool(0)
+{
+}
+
+SearchIndex::~SearchIndex()
+{
+    unload();
+}
+
+SearchIndex* SearchIndex::system()
+{
+    static SearchIndex *index = 0;
+    if (index == 0) {
+        index = new SearchIndex(APTCC_SEARCH_INDEX);
+    }
+    return index;
+}
+
+bool SearchIndex::isCurrent(const std::string &generation)
+{
+    if (m_header == 0) {
+        load();
+    }
+    return m_header && generation.compare(m_pool + m_header->generation) == 0;
+}
+
+bool SearchIndex::isIndexable(const std::string &term)
+{
+    if (term.empty()) {
+        return false;
+    }
+    for (std::string::const_iterator it = term.begin(); it != term.end(); ++it) {
+        if (!is_word_char(*it)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SearchIndex::load()
+{
+    int fd = open(m_indexFile.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat buf;
+    if (fstat(fd, &buf) != 0 || (size_t) buf.st_size < sizeof(Header)) {
+        close(fd);
+        return false;
+    }
+
+    void *map = mmap(0, buf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+
+    m_map = map;
+    m_mapSize = buf.st_size;
+    if (!setData(static_cast<const char *>(map), m_mapSize)) {
+        g_debug("Ignoring invalid search index %s", m_indexFile.c_str());
+        unload();
+        return false;
+    }
+
+    return true;
+}
+
+void SearchIndex::unload()
+{
+    if (m_map) {
+        munmap(m_map, m_mapSize);
+    }
+    m_map = 0;
+    m_mapSize = 0;
+    m_buffer.clear();
+
+    m_header = 0;
+    m_packages = 0;
+    m_words = 0;
+    m_postings = 0;
+    m_pool = 0;
+}
+
+bool SearchIndex::setData(const char *data, size_t size)
+{
+    const Header *header = reinterpret_cast<const Header *>(data);
+    if (size < sizeof(Header) ||
+            memcmp(header->magic, SEARCH_INDEX_MAGIC, 4) != 0 ||
+            header->version != SEARCH_INDEX_VERSION) {
+        return false;
+    }
+
+    // the counts come from the file, so they are checked against its
+    // size before they are multiplied
+    if (header->nPackages > size / sizeof(uint32_t) ||
+            header->nWords > size / sizeof(Word) ||
+            header->nPostings > size / sizeof(uint32_t) ||
+            header->poolSize > size) {
+        return false;
+    }
+
+    size_t expected = sizeof(Header) +
+            (size_t) header->nPackages * sizeof(uint32_t) +
+            (size_t) header->nWords * sizeof(Word) +
+            (size_t) header->nPostings * sizeof(uint32_t) +
+            header->poolSize;
+    if (size != expected || header->poolSize == 0 || data[size - 1] != '\0' ||
+            header->generation >= header->poolSize) {
+        return false;
+    }
+
+    const char *pos = data + sizeof(Header);
+    const uint32_t *packages = reinterpret_cast<const uint32_t *>(pos);
+    pos += header->nPackages * sizeof(uint32_t);
+    const Word *words = reinterpret_cast<const Word *>(pos);
+    pos += header->nWords * sizeof(Word);
+    const uint32_t *postings = reinterpret_cast<const uint32_t *>(pos);
+    pos += header->nPostings * sizeof(uint32_t);
+
+    // a truncated or corrupt file must not make search() read or write
+    // outside of the mapping, the pool ends with a '\0' so every name
+    // that starts inside it is terminated
+    for (uint32_t i = 0; i < header->nPackages; ++i) {
+        if (packages[i] >= header->poolSize) {
+            return false;
+        }
+    }
+    for (uint32_t w = 0; w < header->nWords; ++w) {
+        const Word &word = words[w];
+        if (word.text >= header->poolSize ||
+                word.length > header->poolSize - word.text ||
+                word.firstPosting > header->nPostings ||
+                word.nPostings > header->nPostings - word.firstPosting) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < header->nPostings; ++i) {
+        if (postings[i] >= header->nPackages) {
+            return false;
+        }
+    }
+
+    m_header = header;
+    m_packages = packages;
+    m_words = words;
+    m_postings = postings;
+    m_pool = pos;
+
+    return true;
+}
+
+bool SearchIndex::build(const Builder &builder, const std::string &generation)
+{
+    // offset 0 of the pool is the empty string
+    std::string pool(1, '\0');
+    std::vector<uint32_t> packages;
+    std::vector<Word> words;
+    std::vector<uint32_t> postings;
+    packages.reserve(builder.m_names.size());
+    words.reserve(builder.m_words.size());
+
+    for (std::vector<std::string>::const_iterator it = builder.m_names.begin();
+         it != builder.m_names.end(); ++it) {
+        packages.push_back(pool.size());
+        pool.append(*it);
+        pool.push_back('\0');
+    }
+
+    // std::map already keeps the words sorted
+    for (std::map<std::string, std::vector<uint32_t> >::const_iterator it = builder.m_words.begin();
+         it != builder.m_words.end(); ++it) {
+        Word word;
+        word.text = pool.size();
+        word.length = it->first.size();
+        word.firstPosting = postings.size();
+        word.nPostings = it->second.size();
+        pool.append(it->first);
+        pool.push_back('\0');
+        postings.insert(postings.end(), it->second.begin(), it->second.end());
+        words.push_back(word);
+    }
+
+    Header header;
+    memset(&header, 0, sizeof(header));
+    header.generation = pool.size();
+    pool.append(generation);
+    pool.push_back('\0');
+
+    if (pool.size() > G_MAXUINT32 || postings.size() > G_MAXUINT32) {
+        g_warning("Too many words to index in %s", m_indexFile.c_str());
+        return false;
+    }
+
+    memcpy(header.magic, SEARCH_INDEX_MAGIC, 4);
+    header.version = SEARCH_INDEX_VERSION;
+    header.nPackages = packages.size();
+    header.nWords = words.size();
+    header.nPostings = postings.size();
+    header.poolSize = pool.size();
+
+    std::vector<char> image;
+    image.reserve(sizeof(Header) +
+                  packages.size() * sizeof(uint32_t) +
+                  words.size() * sizeof(Word) +
+                  postings.size() * sizeof(uint32_t) +
+                  pool.size());
+    appendData(image, &header, 1);
+    appendData(image, packages.data(), packages.size());
+    appendData(image, words.data(), words.size());
+    appendData(image, postings.data(), postings.size());
+    appendData(image, pool.data(), pool.size());
+
+    g_debug("Indexed %zu words of %zu packages", words.size(), packages.size());
+
+    unload();
+
+    std::string tmpFile = m_indexFile + ".new";
+    FILE *out = fopen(tmpFile.c_str(), "w");
+    bool saved = false;
+    if (out) {
+        saved = fwrite(image.data(), 1, image.size(), out) == image.size();
+        saved = (fclose(out) == 0) && saved;
+        saved = saved && rename(tmpFile.c_str(), m_indexFile.c_str()) == 0;
+        if (!saved) {
+            unlink(tmpFile.c_str());
+        }
+    }
+
+    if (saved && load()) {
+        return true;
+    }
+
+    g_debug("Failed to save search index %s, keeping it in memory", m_indexFile.c_str());
+    m_buffer.swap(image);
+    return setData(m_buffer.data(), m_buffer.size());
+}
+
+void SearchIndex::search(const std::vector<std::string> &terms, std::vector<std::string> &output) const
+{
+    if (m_header == 0 || terms.empty()) {
+        return;
+    }
+
+    // matched[i] is the number of terms package i matched so far,
+    // a package is only counted once per term even if several of
+    // its words contain it
+    std::vector<uint32_t> matched(m_header->nPackages, 0);
+    for (uint32_t t = 0; t < terms.size(); ++t) {
+        std::string term(terms[t]);
+        for (std::string::iterator it = term.begin(); it != term.end(); ++it) {
+            *it = ascii_tolower(*it);
+        }
+
+        bool found = false;
+        for (uint32_t w = 0; w < m_header->nWords; ++w) {
+            const Word &word = m_words[w];
+            if (word.length < term.size() ||
+                    memmem(m_pool + word.text, word.length, term.data(), term.size()) == NULL) {
+                continue;
+            }
+
+            found = true;
+            const uint32_t *end = m_postings + word.firstPosting + word.nPostings;
+            for (const uint32_t *it = m_postings + word.firstPosting; it != end; ++it) {
+                if (matched[*it] == t) {
+                    matched[*it] = t + 1;
+                }
+            }
+        }
+
+        if (!found) {
+            return;
+        }
+    }
+
+    for (uint32_t i = 0; i < m_header->nPackages; ++i) {
+        if (matched[i] == terms.size()) {
+            output.push_back(m_pool + m_packages[i]);
+        }
+    }
+}
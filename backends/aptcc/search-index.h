@@ -0,0 +1,113 @@
+/* search-index.h
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef SEARCH_INDEX_H
+#define SEARCH_INDEX_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * Maps the words of the package names and descriptions to the
+ * packages using them
+ *
+ * Words are the runs of ASCII letters and digits, lower cased. The
+ * index is a single file holding the package names, the words sorted
+ * with the list of packages using each of them, and a string pool.
+ * It is mmap'ed when loaded and carries the generation of the package
+ * cache it was built from.
+ */
+class SearchIndex
+{
+public:
+    /**
+     * Collects the words of the packages before they are written
+     */
+    class Builder
+    {
+    public:
+        /**
+         * Adds a package, \p name is what search() returns for it
+         */
+        void addPackage(const std::string &name, const std::string &text);
+
+    private:
+        friend class SearchIndex;
+
+        std::vector<std::string> m_names;
+        std::map<std::string, std::vector<uint32_t> > m_words;
+    };
+
+    SearchIndex(const std::string &indexFile);
+    ~SearchIndex();
+
+    /**
+     * Returns the index of the package cache, loaded on first use
+     */
+    static SearchIndex* system();
+
+    /**
+     * Returns true if the index was built from this cache generation
+     */
+    bool isCurrent(const std::string &generation);
+
+    /**
+     * Replaces the index by the packages of \p builder
+     */
+    bool build(const Builder &builder, const std::string &generation);
+
+    /**
+     * Returns true if the term only holds characters words are made of,
+     * only these can be looked up in the index
+     */
+    static bool isIndexable(const std::string &term);
+
+    /**
+     * Appends the names of the packages having every term as a part of
+     * one of their words, the terms must be indexable
+     */
+    void search(const std::vector<std::string> &terms, std::vector<std::string> &output) const;
+
+private:
+    struct Header;
+    struct Word;
+
+    bool load();
+    void unload();
+    bool setData(const char *data, size_t size);
+
+    std::string m_indexFile;
+
+    // Either the mmap'ed index file or m_buffer when it could not be saved
+    void *m_map;
+    size_t m_mapSize;
+    std::vector<char> m_buffer;
+
+    const Header *m_header;
+    const uint32_t *m_packages;
+    const Word *m_words;
+    const uint32_t *m_postings;
+    const char *m_pool;
+};
+
+#endif
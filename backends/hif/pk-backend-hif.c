@@ -65,6 +65,9 @@ typedef struct {
 	GMutex		 sack_mutex;
 	HifRepos	*repos;
 	GTimer		*repos_timer;
+	guint		 parallel_refresh;
+	GMutex		 refresh_mutex;
+	GHashTable	*pubkeys_imported;	/* source id */
 } PkBackendHifPrivate;
 
 typedef struct {
@@ -76,6 +79,25 @@ typedef struct {
 	HyGoal		 goal;
 } PkBackendHifJobData;
 
+/* the number of sources refreshed at the same time by default */
+#define PK_BACKEND_HIF_PARALLEL_REFRESH_DEFAULT		4
+
+typedef struct {
+	PkBackendJob	*job;
+	HifSource	*src;
+	HifState	*state;
+	gint		 percentage;	/* atomic */
+	gint		 speed;		/* atomic */
+	GError		*error;
+} PkBackendHifRefreshItem;
+
+typedef struct {
+	GMutex		 mutex;
+	GCond		 cond;
+	guint		 pending;
+	gint		 failed;	/* atomic */
+} PkBackendHifRefreshHelper;
+
 /**
  * pk_backend_get_description:
  */
@@ -133,8 +155,15 @@ pk_backend_sack_cache_invalidate (PkBackend *backend, const gchar *why)
 static void
 pk_backend_hif_repos_changed_cb (HifRepos *self, PkBackend *backend)
 {
+	PkBackendHifPrivate *priv = pk_backend_get_user_data (backend);
+
 	pk_backend_sack_cache_invalidate (backend, "yum.repos.d changed");
 	pk_backend_repo_list_changed (backend);
+
+	/* the GPG key of a source may have changed too */
+	g_mutex_lock (&priv->refresh_mutex);
+	g_hash_table_remove_all (priv->pubkeys_imported);
+	g_mutex_unlock (&priv->refresh_mutex);
 }
 
 /**
@@ -238,6 +267,16 @@ pk_backend_initialize (GKeyFile *conf, PkBackend *backend)
 	ret = g_key_file_get_boolean (conf, "Daemon", "KeepCache", NULL);
 	hif_context_set_keep_cache (priv->context, ret);
 
+	/* how many sources to refresh at the same time */
+	priv->parallel_refresh = MAX (g_key_file_get_integer (conf, "Daemon", "ParallelRepoRefresh", NULL), 0);
+	if (priv->parallel_refresh == 0)
+		priv->parallel_refresh = PK_BACKEND_HIF_PARALLEL_REFRESH_DEFAULT;
+
+	/* what the sources refreshed in parallel can't do at the same time */
+	g_mutex_init (&priv->refresh_mutex);
+	priv->pubkeys_imported = g_hash_table_new_full (g_str_hash, g_str_equal,
+							g_free, NULL);
+
 	/* set up context */
 	ret = hif_context_setup (priv->context, NULL, &error);
 	if (!ret)
@@ -264,6 +303,8 @@ pk_backend_destroy (PkBackend *backend)
 	g_timer_destroy (priv->repos_timer);
 	g_mutex_clear (&priv->sack_mutex);
 	g_hash_table_unref (priv->sack_cache);
+	g_mutex_clear (&priv->refresh_mutex);
+	g_hash_table_unref (priv->pubkeys_imported);
 	g_free (priv);
 }
 
@@ -1354,6 +1395,66 @@ pk_backend_get_mime_types (PkBackend *backend)
 	return g_strdupv ((gchar **) mime_types);
 }
 
+/**
+ * pk_backend_refresh_source_import_pubkeys:
+ *
+ * Imports the local GPG keys of a source into the keyring libhif checks the
+ * metadata against, so the metadata can be downloaded without the import
+ * flag. Returns %FALSE if any key is remote or can't be imported here.
+ */
+static gboolean
+pk_backend_refresh_source_import_pubkeys (HifSource *src)
+{
+	const gchar *location;
+	guint i;
+	_cleanup_error_free_ GError *error = NULL;
+	_cleanup_free_ gchar *gpgkey = NULL;
+	_cleanup_free_ gchar *keyring = NULL;
+	_cleanup_keyfile_unref_ GKeyFile *kf = NULL;
+	_cleanup_strv_free_ gchar **gpgkeys = NULL;
+
+	location = hif_source_get_location (src);
+	if (location == NULL || hif_source_get_filename (src) == NULL)
+		return FALSE;
+
+	/* the key is only set in the .repo file */
+	kf = g_key_file_new ();
+	if (!g_key_file_load_from_file (kf, hif_source_get_filename (src),
+					G_KEY_FILE_NONE, &error)) {
+		g_debug ("failed to load %s: %s",
+			 hif_source_get_filename (src), error->message);
+		return FALSE;
+	}
+	gpgkey = g_key_file_get_string (kf, hif_source_get_id (src),
+					"gpgkey", NULL);
+	if (gpgkey == NULL)
+		return FALSE;
+	gpgkeys = g_strsplit_set (gpgkey, " ,\t\n", -1);
+
+	/* same layout as libhif uses for the source keyring */
+	keyring = g_build_filename (location, "gpgdir", NULL);
+	if (g_mkdir_with_parents (keyring, 0755) != 0) {
+		g_debug ("failed to create %s", keyring);
+		return FALSE;
+	}
+	for (i = 0; gpgkeys[i] != NULL; i++) {
+		const gchar *fn;
+		if (gpgkeys[i][0] == '\0')
+			continue;
+
+		/* leave remote and templated keys to libhif */
+		if (!g_str_has_prefix (gpgkeys[i], "file://") ||
+		    strchr (gpgkeys[i], '$') != NULL)
+			return FALSE;
+		fn = gpgkeys[i] + strlen ("file://");
+		if (!lr_gpg_import_key (fn, keyring, &error)) {
+			g_debug ("failed to import %s: %s", fn, error->message);
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
 /**
  * pk_backend_refresh_source:
  */
@@ -1363,10 +1464,12 @@ pk_backend_refresh_source (PkBackendJob *job,
 			   HifState *state,
 			   GError **error)
 {
+	gboolean import_pubkey;
 	gboolean ret;
 	gboolean src_okay;
 	HifState *state_local;
 	GError *error_local = NULL;
+	PkBackendHifPrivate *priv = pk_backend_get_user_data (pk_backend_job_get_backend (job));
 	const gchar *as_basenames[] = { "appstream", "appstream-icons", NULL };
 	const gchar *tmp;
 	guint i;
@@ -1399,11 +1502,36 @@ pk_backend_refresh_source (PkBackendJob *job,
 
 	/* update repo, TODO: if we have network access */
 	if (!src_okay) {
+		/* importing can't run in several threads at once, so import
+		 * local keys with the lock held and then download in parallel
+		 * against the source keyring; libhif only imports remote keys
+		 * in the same call that downloads the metadata, so those
+		 * sources keep the lock for the first update */
+		g_mutex_lock (&priv->refresh_mutex);
+		import_pubkey = hif_source_get_gpgcheck (src) &&
+				!g_hash_table_contains (priv->pubkeys_imported,
+							hif_source_get_id (src));
+		if (import_pubkey &&
+		    pk_backend_refresh_source_import_pubkeys (src)) {
+			g_hash_table_add (priv->pubkeys_imported,
+					  g_strdup (hif_source_get_id (src)));
+			import_pubkey = FALSE;
+		}
+		if (!import_pubkey)
+			g_mutex_unlock (&priv->refresh_mutex);
 		state_local = hif_state_get_child (state);
 		ret = hif_source_update (src,
-					 HIF_SOURCE_UPDATE_FLAG_IMPORT_PUBKEY,
+					 import_pubkey ? HIF_SOURCE_UPDATE_FLAG_IMPORT_PUBKEY :
+							 HIF_SOURCE_UPDATE_FLAG_NONE,
 					 state_local,
 					 &error_local);
+		if (import_pubkey) {
+			if (ret) {
+				g_hash_table_add (priv->pubkeys_imported,
+						  g_strdup (hif_source_get_id (src)));
+			}
+			g_mutex_unlock (&priv->refresh_mutex);
+		}
 		if (!ret) {
 			if (g_error_matches (error_local,
 					     HIF_ERROR,
@@ -1421,7 +1549,9 @@ pk_backend_refresh_source (PkBackendJob *job,
 		}
 	}
 
-	/* copy the appstream files somewhere that the GUI will pick them up */
+	/* copy the appstream files somewhere that the GUI will pick them up,
+	 * one source at a time as they share the destination directory */
+	g_mutex_lock (&priv->refresh_mutex);
 	for (i = 0; as_basenames[i] != NULL; i++) {
 		tmp = hif_source_get_filename_md (src, as_basenames[i]);
 		if (tmp != NULL) {
@@ -1431,6 +1561,7 @@ pk_backend_refresh_source (PkBackendJob *job,
 							hif_source_get_id (src),
 							NULL,
 							error)) {
+				g_mutex_unlock (&priv->refresh_mutex);
 				return FALSE;
 			}
 #else
@@ -1438,11 +1569,180 @@ pk_backend_refresh_source (PkBackendJob *job,
 #endif
 		}
 	}
+	g_mutex_unlock (&priv->refresh_mutex);
 
 	/* done */
 	return hif_state_done (state, error);
 }
 
+/**
+ * pk_backend_refresh_item_percentage_changed_cb:
+ */
+static void
+pk_backend_refresh_item_percentage_changed_cb (HifState *state,
+					       guint percentage,
+					       PkBackendHifRefreshItem *item)
+{
+	g_atomic_int_set (&item->percentage, percentage);
+}
+
+/**
+ * pk_backend_refresh_item_speed_changed_cb:
+ */
+static void
+pk_backend_refresh_item_speed_changed_cb (HifState *state,
+					  GParamSpec *pspec,
+					  PkBackendHifRefreshItem *item)
+{
+	g_atomic_int_set (&item->speed, (gint) MIN (hif_state_get_speed (state), G_MAXINT));
+}
+
+/**
+ * pk_backend_refresh_item_free:
+ */
+static void
+pk_backend_refresh_item_free (PkBackendHifRefreshItem *item)
+{
+	g_object_unref (item->state);
+	if (item->error != NULL)
+		g_error_free (item->error);
+	g_free (item);
+}
+
+/**
+ * pk_backend_refresh_item_thread:
+ *
+ * Runs in the thread pool, one source at a time.
+ */
+static void
+pk_backend_refresh_item_thread (PkBackendHifRefreshItem *item,
+				PkBackendHifRefreshHelper *helper)
+{
+	_cleanup_timer_destroy_ GTimer *timer = g_timer_new ();
+
+	/* another source already failed */
+	if (g_atomic_int_get (&helper->failed) == 0) {
+		if (!pk_backend_refresh_source (item->job, item->src,
+						item->state, &item->error)) {
+			g_atomic_int_set (&helper->failed, 1);
+		}
+		g_debug ("refreshing %s took %.0fms",
+			 hif_source_get_id (item->src),
+			 g_timer_elapsed (timer, NULL) * 1000);
+	}
+	g_atomic_int_set (&item->percentage, 100);
+	g_atomic_int_set (&item->speed, 0);
+
+	/* wake up the job thread */
+	g_mutex_lock (&helper->mutex);
+	helper->pending--;
+	g_cond_signal (&helper->cond);
+	g_mutex_unlock (&helper->mutex);
+}
+
+/**
+ * pk_backend_refresh_sources:
+ *
+ * Checks and downloads the sources in a pool of threads, as most of the
+ * time is spent waiting for the mirrors.
+ */
+static gboolean
+pk_backend_refresh_sources (PkBackendJob *job,
+			    GPtrArray *sources,
+			    HifState *state,
+			    GError **error)
+{
+	GThreadPool *pool;
+	PkBackendHifPrivate *priv = pk_backend_get_user_data (pk_backend_job_get_backend (job));
+	PkBackendHifRefreshHelper helper;
+	PkBackendHifRefreshItem *item;
+	guint i;
+	guint percentage;
+	guint64 speed;
+	guint64 speed_last = 0;
+	_cleanup_ptrarray_unref_ GPtrArray *items = NULL;
+	_cleanup_timer_destroy_ GTimer *timer = g_timer_new ();
+
+	/* nothing to do */
+	if (sources->len == 0)
+		return hif_state_finished (state, error);
+
+	memset (&helper, 0, sizeof (helper));
+	g_mutex_init (&helper.mutex);
+	g_cond_init (&helper.cond);
+	pool = g_thread_pool_new ((GFunc) pk_backend_refresh_item_thread,
+				  &helper,
+				  MIN (priv->parallel_refresh, sources->len),
+				  FALSE, error);
+	if (pool == NULL) {
+		g_mutex_clear (&helper.mutex);
+		g_cond_clear (&helper.cond);
+		return FALSE;
+	}
+
+	/* each source reports its own progress */
+	items = g_ptr_array_new_with_free_func ((GDestroyNotify) pk_backend_refresh_item_free);
+	for (i = 0; i < sources->len; i++) {
+		item = g_new0 (PkBackendHifRefreshItem, 1);
+		item->job = job;
+		item->src = g_ptr_array_index (sources, i);
+		item->state = hif_state_new ();
+		hif_state_set_cancellable (item->state,
+					   pk_backend_job_get_cancellable (job));
+		g_signal_connect (item->state, "percentage-changed",
+				  G_CALLBACK (pk_backend_refresh_item_percentage_changed_cb),
+				  item);
+		g_signal_connect (item->state, "action-changed",
+				  G_CALLBACK (pk_backend_state_action_changed_cb),
+				  job);
+		g_signal_connect (item->state, "notify::speed",
+				  G_CALLBACK (pk_backend_refresh_item_speed_changed_cb),
+				  item);
+		g_ptr_array_add (items, item);
+	}
+	g_mutex_lock (&helper.mutex);
+	helper.pending = items->len;
+	for (i = 0; i < items->len; i++)
+		g_thread_pool_push (pool, g_ptr_array_index (items, i), NULL);
+
+	/* the overall progress is the average of all the sources, and
+	 * the speed is the sum of the ones downloading */
+	while (helper.pending > 0) {
+		g_cond_wait_until (&helper.cond, &helper.mutex,
+				   g_get_monotonic_time () + G_USEC_PER_SEC / 10);
+		percentage = 0;
+		speed = 0;
+		for (i = 0; i < items->len; i++) {
+			item = g_ptr_array_index (items, i);
+			percentage += g_atomic_int_get (&item->percentage);
+			speed += g_atomic_int_get (&item->speed);
+		}
+		hif_state_set_percentage (state, percentage / items->len);
+		if (speed != speed_last) {
+			pk_backend_job_set_speed (job, MIN (speed, G_MAXUINT));
+			speed_last = speed;
+		}
+	}
+	g_mutex_unlock (&helper.mutex);
+	g_thread_pool_free (pool, FALSE, TRUE);
+	g_mutex_clear (&helper.mutex);
+	g_cond_clear (&helper.cond);
+	g_debug ("refreshing %u sources %u at a time took %.0fms",
+		 items->len, MIN (priv->parallel_refresh, items->len),
+		 g_timer_elapsed (timer, NULL) * 1000);
+
+	/* report the first failure */
+	for (i = 0; i < items->len; i++) {
+		item = g_ptr_array_index (items, i);
+		if (item->error != NULL) {
+			g_propagate_error (error, item->error);
+			item->error = NULL;
+			return FALSE;
+		}
+	}
+	return hif_state_finished (state, error);
+}
+
 /**
  * pk_backend_refresh_cache_thread:
  */
@@ -1453,14 +1753,13 @@ pk_backend_refresh_cache_thread (PkBackendJob *job,
 {
 	HifSource *src;
 	HifState *state_local;
-	HifState *state_loop;
 	HySack sack = NULL;
 	PkBackendHifJobData *job_data = pk_backend_job_get_user_data (job);
 	gboolean force;
 	gboolean ret;
-	guint cnt = 0;
 	guint i;
 	_cleanup_error_free_ GError *error = NULL;
+	_cleanup_ptrarray_unref_ GPtrArray *sources = NULL;
 
 	/* set state */
 	hif_state_set_steps (job_data->state, NULL,
@@ -1477,21 +1776,8 @@ pk_backend_refresh_cache_thread (PkBackendJob *job,
 		return;
 	}
 
-	/* count the enabled sources */
-	for (i = 0; i < job_data->sources->len; i++) {
-		src = g_ptr_array_index (job_data->sources, i);
-		if (hif_source_get_enabled (src) == HIF_SOURCE_ENABLED_NONE)
-			continue;
-		if (hif_source_get_kind (src) == HIF_SOURCE_KIND_MEDIA)
-			continue;
-		if (hif_source_get_kind (src) == HIF_SOURCE_KIND_LOCAL)
-			continue;
-		cnt++;
-	}
-
-	/* refresh each repo */
-	state_local = hif_state_get_child (job_data->state);
-	hif_state_set_number_steps (state_local, cnt);
+	/* find the enabled remote sources */
+	sources = g_ptr_array_new ();
 	for (i = 0; i < job_data->sources->len; i++) {
 		src = g_ptr_array_index (job_data->sources, i);
 		if (hif_source_get_enabled (src) == HIF_SOURCE_ENABLED_NONE)
@@ -1510,21 +1796,15 @@ pk_backend_refresh_cache_thread (PkBackendJob *job,
 				return;
 			}
 		}
+		g_ptr_array_add (sources, src);
+	}
 
-		/* check and download */
-		state_loop = hif_state_get_child (state_local);
-		ret = pk_backend_refresh_source (job, src, state_loop, &error);
-		if (!ret) {
-			pk_backend_job_error_code (job, error->code, "%s", error->message);
-			return;
-		}
-
-		/* done */
-		ret = hif_state_done (state_local, &error);
-		if (!ret) {
-			pk_backend_job_error_code (job, error->code, "%s", error->message);
-			return;
-		}
+	/* check and download each repo */
+	state_local = hif_state_get_child (job_data->state);
+	ret = pk_backend_refresh_sources (job, sources, state_local, &error);
+	if (!ret) {
+		pk_backend_job_error_code (job, error->code, "%s", error->message);
+		return;
 	}
 
 	/* done */
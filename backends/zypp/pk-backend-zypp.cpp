@@ -1682,6 +1682,12 @@ zypp_backend_finished_error (PkBackendJob  *job, PkErrorEnum err_code,
 
 /**
  * We do not pretend we're thread safe when all we do is having a huge mutex
+ *
+ * Read-only queries can't share it either: libzypp has a single ResPool,
+ * and even a search uses the temporary space of the libsolv pool and the
+ * status bits of its items, so two queries at once corrupt each other.
+ * Sharing reads would need a pool snapshot per query, which libzypp has
+ * no API for.
  */
 gboolean
 pk_backend_supports_parallelization (PkBackend *backend)
@@ -25,6 +25,7 @@
 #include <signal.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <glib/gi18n.h>
 #include <glib-unix.h>
 #include <packagekit-glib2/packagekit.h>
@@ -865,50 +866,20 @@ out:
 }
 
 /**
- * pk_console_resolve_package:
+ * pk_console_resolve_choose:
+ *
+ * Picks the package_id for @package_name from the packages it resolved to.
  **/
 static gchar *
-pk_console_resolve_package (PkConsoleCtx *ctx, const gchar *package_name, GError **error)
+pk_console_resolve_choose (const gchar *package_name,
+			   GPtrArray *array,
+			   GError **error)
 {
 	const gchar *package_id_tmp;
-	gchar *package_id = NULL;
-	gboolean valid;
 	guint i;
 	PkPackage *package;
-	_cleanup_ptrarray_unref_ GPtrArray *array = NULL;
-	_cleanup_object_unref_ PkError *error_code = NULL;
-	_cleanup_object_unref_ PkResults *results = NULL;
-	_cleanup_strv_free_ gchar **tmp = NULL;
-
-	/* have we passed a complete package_id? */
-	valid = pk_package_id_check (package_name);
-	if (valid)
-		return g_strdup (package_name);
-
-	/* split */
-	tmp = g_strsplit (package_name, ",", -1);
-
-	/* get the list of possibles */
-	results = pk_client_resolve (PK_CLIENT (ctx->task),
-				     ctx->filters, tmp,
-				     ctx->cancellable,
-				     pk_console_progress_cb, ctx,
-				     error);
-	if (results == NULL)
-		return NULL;
-
-	/* check error code */
-	error_code = pk_results_get_error_code (results);
-	if (error_code != NULL) {
-		g_set_error_literal (error,
-				     PK_CONSOLE_ERROR,
-				     pk_error_get_code (error_code),
-				     pk_error_get_details (error_code));
-		return NULL;
-	}
 
 	/* nothing found */
-	array = pk_results_get_package_array (results);
 	if (array->len == 0) {
 		g_set_error (error,
 			     PK_CONSOLE_ERROR,
@@ -920,9 +891,6 @@ pk_console_resolve_package (PkConsoleCtx *ctx, const gchar *package_name, GError
 	/* just one thing found */
 	if (array->len == 1) {
 		package = g_ptr_array_index (array, 0);
-		g_object_get (package,
-			      "package-id", &package_id,
-			      NULL);
 		return g_strdup (pk_package_get_id (package));
 	}
 
@@ -952,6 +920,140 @@ pk_console_resolve_package (PkConsoleCtx *ctx, const gchar *package_name, GError
 	return g_strdup (pk_package_get_id (package));
 }
 
+/**
+ * pk_console_resolve_package:
+ **/
+static gchar *
+pk_console_resolve_package (PkConsoleCtx *ctx, const gchar *package_name, GError **error)
+{
+	gboolean valid;
+	_cleanup_ptrarray_unref_ GPtrArray *array = NULL;
+	_cleanup_object_unref_ PkError *error_code = NULL;
+	_cleanup_object_unref_ PkResults *results = NULL;
+	_cleanup_strv_free_ gchar **tmp = NULL;
+
+	/* have we passed a complete package_id? */
+	valid = pk_package_id_check (package_name);
+	if (valid)
+		return g_strdup (package_name);
+
+	/* split */
+	tmp = g_strsplit (package_name, ",", -1);
+
+	/* get the list of possibles */
+	results = pk_client_resolve (PK_CLIENT (ctx->task),
+				     ctx->filters, tmp,
+				     ctx->cancellable,
+				     pk_console_progress_cb, ctx,
+				     error);
+	if (results == NULL)
+		return NULL;
+
+	/* check error code */
+	error_code = pk_results_get_error_code (results);
+	if (error_code != NULL) {
+		g_set_error_literal (error,
+				     PK_CONSOLE_ERROR,
+				     pk_error_get_code (error_code),
+				     pk_error_get_details (error_code));
+		return NULL;
+	}
+
+	array = pk_results_get_package_array (results);
+	return pk_console_resolve_choose (package_name, array, error);
+}
+
+/**
+ * pk_console_resolve_package_matches:
+ *
+ * Return value: %TRUE if @package is what the user meant by @name,
+ * which may be "name" or "name.arch"
+ **/
+static gboolean
+pk_console_resolve_package_matches (PkPackage *package, const gchar *name)
+{
+	const gchar *arch;
+	const gchar *package_name;
+	gsize len;
+
+	package_name = pk_package_get_name (package);
+	if (g_strcmp0 (package_name, name) == 0)
+		return TRUE;
+	arch = pk_package_get_arch (package);
+	if (package_name == NULL || arch == NULL)
+		return FALSE;
+	len = strlen (package_name);
+	return strncmp (name, package_name, len) == 0 &&
+	       name[len] == '.' &&
+	       g_strcmp0 (name + len + 1, arch) == 0;
+}
+
+/**
+ * pk_console_resolve_packages_batch:
+ *
+ * Resolves all the names in one transaction, rather than one transaction
+ * (and one backend cache load) per name.
+ *
+ * Return value: the results for all of @packages, or %NULL if they have
+ * to be resolved one by one
+ **/
+static PkResults *
+pk_console_resolve_packages_batch (PkConsoleCtx *ctx, gchar **packages, GError **error)
+{
+	guint i;
+	guint j;
+	GError *error_local = NULL;
+	PkResults *results;
+	_cleanup_hashtable_unref_ GHashTable *names = NULL;
+	_cleanup_ptrarray_unref_ GPtrArray *array = NULL;
+
+	/* every name only once */
+	names = g_hash_table_new (g_str_hash, g_str_equal);
+	array = g_ptr_array_new_with_free_func (g_free);
+	for (i = 0; packages[i] != NULL; i++) {
+		_cleanup_strv_free_ gchar **tmp = NULL;
+		if (pk_package_id_check (packages[i]))
+			continue;
+		tmp = g_strsplit (packages[i], ",", -1);
+		for (j = 0; tmp[j] != NULL; j++) {
+			if (g_hash_table_contains (names, tmp[j]))
+				continue;
+			g_ptr_array_add (array, g_strdup (tmp[j]));
+			g_hash_table_add (names, g_ptr_array_index (array, array->len - 1));
+		}
+	}
+
+	/* nothing to resolve, or nothing to gain */
+	if (array->len < 2)
+		return NULL;
+	g_ptr_array_add (array, NULL);
+
+	results = pk_client_resolve (PK_CLIENT (ctx->task),
+				     ctx->filters,
+				     (gchar **) array->pdata,
+				     ctx->cancellable,
+				     pk_console_progress_cb, ctx,
+				     &error_local);
+	if (results == NULL) {
+		/* the user does not want to resolve them one by one either */
+		if (g_cancellable_is_cancelled (ctx->cancellable) ||
+		    g_error_matches (error_local, G_IO_ERROR, G_IO_ERROR_CANCELLED) ||
+		    g_error_matches (error_local, PK_CLIENT_ERROR,
+				     0xff + PK_ERROR_ENUM_TRANSACTION_CANCELLED)) {
+			g_propagate_error (error, error_local);
+			return NULL;
+		}
+
+		/* some backends fail the whole transaction if one name is
+		 * unknown, so find out which one it was by asking separately */
+		g_debug ("failed to resolve all packages at once: %s",
+			 error_local->message);
+		g_error_free (error_local);
+		return NULL;
+	}
+	return results;
+}
+
 /**
  * pk_console_resolve_packages:
  **/
@@ -959,21 +1061,66 @@ static gchar **
 pk_console_resolve_packages (PkConsoleCtx *ctx, gchar **packages, GError **error)
 {
 	guint i;
+	guint j;
+	guint k;
 	guint len;
 	gchar *package_id;
 	GError *error_local = NULL;
+	PkPackage *package;
+	_cleanup_object_unref_ PkResults *results = NULL;
 	_cleanup_ptrarray_unref_ GPtrArray *array = NULL;
+	_cleanup_ptrarray_unref_ GPtrArray *resolved = NULL;
 
 	/* get length */
 	len = g_strv_length (packages);
 	g_debug ("resolving %i packages", len);
 
-	/* resolve each package */
-	array = g_ptr_array_new ();
+	/* resolve all the packages at once */
+	results = pk_console_resolve_packages_batch (ctx, packages, &error_local);
+	if (results == NULL && error_local != NULL) {
+		g_propagate_error (error, error_local);
+		return NULL;
+	}
+	if (results != NULL)
+		resolved = pk_results_get_package_array (results);
+
+	/* find what each name resolved to */
+	array = g_ptr_array_new_with_free_func (g_free);
 	for (i = 0; i < len; i++) {
-		package_id = pk_console_resolve_package (ctx,
-							 packages[i],
-							 &error_local);
+		package_id = NULL;
+		if (resolved != NULL && !pk_package_id_check (packages[i])) {
+			_cleanup_ptrarray_unref_ GPtrArray *matches = NULL;
+			_cleanup_strv_free_ gchar **tmp = NULL;
+			tmp = g_strsplit (packages[i], ",", -1);
+			matches = g_ptr_array_new ();
+			for (k = 0; k < resolved->len; k++) {
+				package = g_ptr_array_index (resolved, k);
+				for (j = 0; tmp[j] != NULL; j++) {
+					if (pk_console_resolve_package_matches (package, tmp[j])) {
+						g_ptr_array_add (matches, package);
+						break;
+					}
+				}
+			}
+
+			/* the backend may resolve names in ways we don't
+			 * know about, e.g. by what they provide, so ask for
+			 * the ones we can't find separately */
+			if (matches->len > 0) {
+				package_id = pk_console_resolve_choose (packages[i],
+									matches,
+									&error_local);
+				if (package_id == NULL) {
+					g_propagate_error (error, error_local);
+					return NULL;
+				}
+			}
+		}
+		if (package_id == NULL) {
+			package_id = pk_console_resolve_package (ctx,
+								 packages[i],
+								 &error_local);
+		}
 		if (package_id == NULL) {
 			if (g_error_matches (error_local,
 					     PK_CONSOLE_ERROR,
@@ -0,0 +1,13 @@
+#!/bin/sh
+# Licensed under the GNU General Public License Version 2
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+
+# one line on its own to see how long it takes to arrive
+echo -e "percentage\t0"
+sleep 0.2
+
+# then as many packages as a large search
+seq 1 100000 | awk '{ printf "package\tavailable\tpackage%d;0.0.1;i386;data\tSummary of package %d\n", $1, $1 }'
@@ -32,6 +32,7 @@
 #include "config.h"
 
 #include <gio/gio.h>
+#include <gio/gunixfdlist.h>
 #include <glib-object.h>
 #include <locale.h>
 #include <stdlib.h>
@@ -42,10 +43,13 @@
 #include <packagekit-glib2/pk-client-helper.h>
 #include <packagekit-glib2/pk-common.h>
 #include <packagekit-glib2/pk-control.h>
+#include <packagekit-glib2/pk-control-private.h>
 #include <packagekit-glib2/pk-debug.h>
 #include <packagekit-glib2/pk-enum.h>
 #include <packagekit-glib2/pk-package-id.h>
 #include <packagekit-glib2/pk-package-ids.h>
+#include <packagekit-glib2/pk-package-private.h>
+#include <packagekit-glib2/pk-results-private.h>
 
 static void     pk_client_finalize	(GObject     *object);
 
@@ -68,6 +72,7 @@ struct _PkClientPrivate
 	gboolean		 interactive;
 	gboolean		 idle;
 	guint			 cache_age;
+	gboolean		 results_fd;
 };
 
 enum {
@@ -77,6 +82,7 @@ enum {
 	PROP_INTERACTIVE,
 	PROP_IDLE,
 	PROP_CACHE_AGE,
+	PROP_RESULTS_FD,
 	PROP_LAST
 };
 
@@ -89,6 +95,7 @@ typedef struct {
 	gboolean			 force;
 	PkBitfield			 transaction_flags;
 	gboolean			 recursive;
+	gboolean			 results_fd;
 	gboolean			 ret;
 	gchar				*directory;
 	gchar				*eula_id;
@@ -120,6 +127,7 @@ typedef struct {
 	PkRoleEnum			 role;
 	PkSigTypeEnum			 type;
 	guint				 refcount;
+	guint				 properties_changed_id;
 	PkClientHelper			*client_helper;
 } PkClientState;
 
@@ -176,6 +184,9 @@ pk_client_get_property (GObject *object, guint prop_id, GValue *value, GParamSpe
 	case PROP_CACHE_AGE:
 		g_value_set_uint (value, priv->cache_age);
 		break;
+	case PROP_RESULTS_FD:
+		g_value_set_boolean (value, priv->results_fd);
+		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 		break;
@@ -205,6 +216,9 @@ pk_client_set_property (GObject *object, guint prop_id, const GValue *value, GPa
 	case PROP_CACHE_AGE:
 		priv->cache_age = g_value_get_uint (value);
 		break;
+	case PROP_RESULTS_FD:
+		priv->results_fd = g_value_get_boolean (value);
+		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 		break;
@@ -666,6 +680,10 @@ pk_client_state_finish (PkClientState *state, const GError *error)
 		g_object_unref (state->cancellable);
 
 	if (state->proxy != NULL) {
+		if (state->properties_changed_id != 0) {
+			g_dbus_connection_signal_unsubscribe (g_dbus_proxy_get_connection (state->proxy),
+							      state->properties_changed_id);
+		}
 		g_signal_handlers_disconnect_by_func (state->proxy,
 						      G_CALLBACK (pk_client_properties_changed_cb),
 						      state);
@@ -746,6 +764,27 @@ pk_client_properties_changed_cb (GDBusProxy *proxy,
 	}
 }
 
+/**
+ * pk_client_properties_changed_signal_cb:
+ *
+ * Used when the proxy was created without loading the properties, as
+ * it then does not watch for changes itself.
+ **/
+static void
+pk_client_properties_changed_signal_cb (GDBusConnection *connection,
+					const gchar *sender_name,
+					const gchar *object_path,
+					const gchar *interface_name,
+					const gchar *signal_name,
+					GVariant *parameters,
+					gpointer user_data)
+{
+	_cleanup_variant_unref_ GVariant *changed_properties = NULL;
+
+	changed_properties = g_variant_get_child_value (parameters, 1);
+	pk_client_properties_changed_cb (NULL, changed_properties, NULL, user_data);
+}
+
 /**
  * pk_client_signal_package:
  */
@@ -760,14 +799,12 @@ pk_client_signal_package (PkClientState *state,
 	_cleanup_object_unref_ PkPackage *package = NULL;
 
 	/* create virtual package */
-	package = pk_package_new ();
-	if (!pk_package_set_id (package, package_id, &error)) {
+	package = pk_package_new_from_data (info_enum, package_id, summary, &error);
+	if (package == NULL) {
 		g_warning ("failed to set package id for %s", package_id);
 		return;
 	}
 	g_object_set (package,
-		      "info", info_enum,
-		      "summary", summary,
 		      "role", state->role,
 		      "transaction-id", state->transaction_id,
 		      NULL);
@@ -999,6 +1036,60 @@ pk_client_copy_downloaded (PkClientState *state)
 	}
 }
 
+/**
+ * pk_client_get_results_fd_cb:
+ **/
+static void
+pk_client_get_results_fd_cb (GObject *source_object,
+			     GAsyncResult *res,
+			     gpointer user_data)
+{
+	GDBusProxy *proxy = G_DBUS_PROXY (source_object);
+	PkClientState *state = (PkClientState *) user_data;
+	_cleanup_error_free_ GError *error = NULL;
+	_cleanup_object_unref_ GUnixFDList *fd_list = NULL;
+	_cleanup_variant_unref_ GVariant *value = NULL;
+	const gint *fds = NULL;
+	gint fd_index;
+	gint n_fds = 0;
+
+	value = g_dbus_proxy_call_with_unix_fd_list_finish (proxy,
+							    &fd_list,
+							    res,
+							    &error);
+	if (value == NULL) {
+		/* the daemon could not write the results and already
+		 * sent them as signals */
+		g_debug ("no results fd: %s", error->message);
+		state->ret = TRUE;
+		pk_client_state_finish (state, NULL);
+		return;
+	}
+
+	g_variant_get (value, "(h)", &fd_index);
+	if (fd_list != NULL)
+		fds = g_unix_fd_list_peek_fds (fd_list, &n_fds);
+	if (fd_index < 0 || fd_index >= n_fds) {
+		error = g_error_new (PK_CLIENT_ERROR,
+				     PK_CLIENT_ERROR_FAILED,
+				     "no results fd sent by the daemon");
+		pk_client_state_finish (state, error);
+		return;
+	}
+	if (!pk_results_fd_read (state->results,
+				 fds[fd_index],
+				 state->role,
+				 state->transaction_id,
+				 &error)) {
+		pk_client_state_finish (state, error);
+		return;
+	}
+
+	/* we're done */
+	state->ret = TRUE;
+	pk_client_state_finish (state, NULL);
+}
+
 /**
  * pk_client_signal_finished:
  */
@@ -1042,6 +1133,20 @@ pk_client_signal_finished (PkClientState *state,
 		return;
 	}
 
+	/* the results were left in a memfd rather than sent as signals */
+	if (state->results_fd && exit_enum == PK_EXIT_ENUM_SUCCESS) {
+		g_dbus_proxy_call_with_unix_fd_list (state->proxy,
+						     "GetResultsFd",
+						     NULL,
+						     G_DBUS_CALL_FLAGS_NONE,
+						     PK_CLIENT_DBUS_METHOD_TIMEOUT,
+						     NULL,
+						     state->cancellable,
+						     pk_client_get_results_fd_cb,
+						     state);
+		return;
+	}
+
 	/* we're done */
 	state->ret = TRUE;
 	pk_client_state_finish (state, NULL);
@@ -1088,6 +1193,21 @@ pk_client_signal_cb (GDBusProxy *proxy,
 					  tmp_str[2]);
 		return;
 	}
+	if (g_strcmp0 (signal_name, "Packages") == 0) {
+		GVariantIter *iter;
+		g_variant_get (parameters, "(a(uss))", &iter);
+		while (g_variant_iter_loop (iter, "(u&s&s)",
+					    &tmp_uint,
+					    &tmp_str[1],
+					    &tmp_str[2])) {
+			pk_client_signal_package (state,
+						  tmp_uint,
+						  tmp_str[1],
+						  tmp_str[2]);
+		}
+		g_variant_iter_free (iter);
+		return;
+	}
 	if (g_strcmp0 (signal_name, "Details") == 0) {
 		gchar *key;
 		GVariantIter *dictionary;
@@ -1467,27 +1587,11 @@ pk_client_set_role (PkClientState *state, PkRoleEnum role)
 }
 
 /**
- * pk_client_set_hints_cb:
+ * pk_client_call_role:
  **/
 static void
-pk_client_set_hints_cb (GObject *source_object,
-			GAsyncResult *res,
-			gpointer user_data)
+pk_client_call_role (PkClientState *state)
 {
-	GDBusProxy *proxy = G_DBUS_PROXY (source_object);
-	PkClientState *state = (PkClientState *) user_data;
-	_cleanup_error_free_ GError *error = NULL;
-	_cleanup_variant_unref_ GVariant *value = NULL;
-
-	/* get the result */
-	value = g_dbus_proxy_call_finish (proxy, res, &error);
-	if (value == NULL) {
-		/* fix up the D-Bus error */
-		pk_client_fixup_dbus_error (error);
-		pk_client_state_finish (state, error);
-		return;
-	}
-
 	/* we'll have results from now on */
 	state->results = pk_results_new ();
 	g_object_set (state->results,
@@ -1843,6 +1947,32 @@ pk_client_set_hints_cb (GObject *source_object,
 	}
 }
 
+/**
+ * pk_client_set_hints_cb:
+ **/
+static void
+pk_client_set_hints_cb (GObject *source_object,
+			GAsyncResult *res,
+			gpointer user_data)
+{
+	GDBusProxy *proxy = G_DBUS_PROXY (source_object);
+	PkClientState *state = (PkClientState *) user_data;
+	_cleanup_error_free_ GError *error = NULL;
+	_cleanup_variant_unref_ GVariant *value = NULL;
+
+	/* get the result */
+	value = g_dbus_proxy_call_finish (proxy, res, &error);
+	if (value == NULL) {
+		/* fix up the D-Bus error */
+		pk_client_fixup_dbus_error (error);
+		pk_client_state_finish (state, error);
+		return;
+	}
+
+	/* run the method */
+	pk_client_call_role (state);
+}
+
 /**
  * pk_client_bool_to_string:
  **/
@@ -1987,26 +2117,29 @@ pk_client_create_helper_socket (PkClientState *state)
 }
 
 /**
- * pk_client_get_proxy_cb:
+ * pk_client_role_needs_helper:
+ *
+ * Roles that may need interaction get a frontend socket, which is
+ * named after the transaction ID.
  **/
-static void
-pk_client_get_proxy_cb (GObject *object,
-			GAsyncResult *res,
-			gpointer user_data)
+static gboolean
+pk_client_role_needs_helper (PkRoleEnum role)
 {
-	gchar *hint;
-	PkClientState *state = (PkClientState *) user_data;
-	_cleanup_error_free_ GError *error = NULL;
-	_cleanup_ptrarray_unref_ GPtrArray *array = NULL;
-
-	state->proxy = g_dbus_proxy_new_for_bus_finish (res, &error);
-	if (state->proxy == NULL)
-		g_error ("Cannot connect to PackageKit on %s", state->tid);
+	return role == PK_ROLE_ENUM_INSTALL_FILES ||
+	       role == PK_ROLE_ENUM_INSTALL_PACKAGES ||
+	       role == PK_ROLE_ENUM_REMOVE_PACKAGES ||
+	       role == PK_ROLE_ENUM_UPDATE_PACKAGES;
+}
 
-	/* connect */
-	pk_client_proxy_connect (state);
+/**
+ * pk_client_get_hints:
+ **/
+static GPtrArray *
+pk_client_get_hints (PkClientState *state)
+{
+	gchar *hint;
+	GPtrArray *array;
 
-	/* get hints */
 	array = g_ptr_array_new_with_free_func (g_free);
 
 	/* locale */
@@ -2025,6 +2158,20 @@ pk_client_get_proxy_cb (GObject *object,
 				pk_client_bool_to_string (state->client->priv->interactive));
 	g_ptr_array_add (array, hint);
 
+	/* we handle the batched Packages signal */
+	hint = g_strdup ("packages-signal=true");
+	g_ptr_array_add (array, hint);
+
+	/* large results can be read from a sealed memfd, but then the
+	 * packages are not sent as signals while the query runs */
+	if (state->client->priv->results_fd &&
+	    pk_results_fd_supported () &&
+	    pk_results_fd_role_supported (state->role)) {
+		hint = g_strdup ("results-fd=true");
+		g_ptr_array_add (array, hint);
+		state->results_fd = TRUE;
+	}
+
 	/* cache-age */
 	if (state->client->priv->cache_age > 0) {
 		hint = g_strdup_printf ("cache-age=%u",
@@ -2033,16 +2180,35 @@ pk_client_get_proxy_cb (GObject *object,
 	}
 
 	/* create socket for roles that need interaction */
-	if (state->role == PK_ROLE_ENUM_INSTALL_FILES ||
-	    state->role == PK_ROLE_ENUM_INSTALL_PACKAGES ||
-	    state->role == PK_ROLE_ENUM_REMOVE_PACKAGES ||
-	    state->role == PK_ROLE_ENUM_UPDATE_PACKAGES) {
+	if (pk_client_role_needs_helper (state->role)) {
 		hint = pk_client_create_helper_socket (state);
 		if (hint != NULL)
 			g_ptr_array_add (array, hint);
 	}
+	return array;
+}
+
+/**
+ * pk_client_get_proxy_cb:
+ **/
+static void
+pk_client_get_proxy_cb (GObject *object,
+			GAsyncResult *res,
+			gpointer user_data)
+{
+	PkClientState *state = (PkClientState *) user_data;
+	_cleanup_error_free_ GError *error = NULL;
+	_cleanup_ptrarray_unref_ GPtrArray *array = NULL;
+
+	state->proxy = g_dbus_proxy_new_for_bus_finish (res, &error);
+	if (state->proxy == NULL)
+		g_error ("Cannot connect to PackageKit on %s", state->tid);
+
+	/* connect */
+	pk_client_proxy_connect (state);
 
 	/* set hints */
+	array = pk_client_get_hints (state);
 	g_ptr_array_add (array, NULL);
 	g_dbus_proxy_call (state->proxy, "SetHints",
 			   g_variant_new ("(^a&s)",
@@ -2086,6 +2252,107 @@ pk_client_get_tid_cb (GObject *object, GAsyncResult *res, PkClientState *state)
 				  state);
 }
 
+/**
+ * pk_client_get_proxy_with_hints_cb:
+ **/
+static void
+pk_client_get_proxy_with_hints_cb (GObject *object,
+				   GAsyncResult *res,
+				   gpointer user_data)
+{
+	PkClientState *state = (PkClientState *) user_data;
+	_cleanup_error_free_ GError *error = NULL;
+
+	state->proxy = g_dbus_proxy_new_for_bus_finish (res, &error);
+	if (state->proxy == NULL)
+		g_error ("Cannot connect to PackageKit on %s", state->tid);
+
+	/* the proxy did not load the properties, so it does not watch
+	 * them either */
+	state->properties_changed_id =
+		g_dbus_connection_signal_subscribe (g_dbus_proxy_get_connection (state->proxy),
+						    g_dbus_proxy_get_name (state->proxy),
+						    "org.freedesktop.DBus.Properties",
+						    "PropertiesChanged",
+						    state->tid,
+						    PK_DBUS_INTERFACE_TRANSACTION,
+						    G_DBUS_SIGNAL_FLAGS_NONE,
+						    pk_client_properties_changed_signal_cb,
+						    state,
+						    NULL);
+
+	/* connect */
+	pk_client_proxy_connect (state);
+
+	/* track state */
+	g_ptr_array_add (state->client->priv->calls, state);
+
+	/* the hints are already set, so run the method straight away */
+	pk_client_call_role (state);
+}
+
+/**
+ * pk_client_get_tid_with_hints_cb:
+ **/
+static void
+pk_client_get_tid_with_hints_cb (GObject *object, GAsyncResult *res, PkClientState *state)
+{
+	PkControl *control = PK_CONTROL (object);
+	_cleanup_error_free_ GError *error = NULL;
+	_cleanup_free_ gchar *name_owner = NULL;
+
+	state->tid = pk_control_get_tid_finish (control, res, &error);
+	if (state->tid == NULL) {
+		pk_client_state_finish (state, error);
+		return;
+	}
+
+	pk_progress_set_transaction_id (state->progress, state->tid);
+
+	/* with the unique name the proxy does not have to ask the bus for
+	 * the owner, and without the properties it is ready straight away */
+	name_owner = pk_control_get_name_owner (control);
+	g_dbus_proxy_new_for_bus (G_BUS_TYPE_SYSTEM,
+				  G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES,
+				  NULL,
+				  name_owner != NULL ? name_owner : PK_DBUS_SERVICE,
+				  state->tid,
+				  PK_DBUS_INTERFACE_TRANSACTION,
+				  state->cancellable,
+				  pk_client_get_proxy_with_hints_cb,
+				  state);
+}
+
+/**
+ * pk_client_create_transaction:
+ *
+ * Gets a transaction ID from the daemon, and then runs the method of
+ * the state role on it.
+ **/
+static void
+pk_client_create_transaction (PkClientState *state, GCancellable *cancellable)
+{
+	_cleanup_ptrarray_unref_ GPtrArray *array = NULL;
+
+	/* the frontend socket hint needs the transaction ID */
+	if (pk_client_role_needs_helper (state->role)) {
+		pk_control_get_tid_async (state->client->priv->control,
+					  cancellable,
+					  (GAsyncReadyCallback) pk_client_get_tid_cb,
+					  state);
+		return;
+	}
+
+	/* create the transaction with the hints already set */
+	array = pk_client_get_hints (state);
+	g_ptr_array_add (array, NULL);
+	pk_control_get_tid_with_hints_async (state->client->priv->control,
+					     (gchar **) array->pdata,
+					     cancellable,
+					     (GAsyncReadyCallback) pk_client_get_tid_with_hints_cb,
+					     state);
+}
+
 /**
  * pk_client_generic_finish:
  * @client: a valid #PkClient instance
@@ -2176,10 +2443,7 @@ pk_client_resolve_async (PkClient *client, PkBitfield filters, gchar **packages,
 	pk_client_set_role (state, state->role);
 
 	/* get tid */
-	pk_control_get_tid_async (client->priv->control,
-				  cancellable,
-				  (GAsyncReadyCallback) pk_client_get_tid_cb,
-				  state);
+	pk_client_create_transaction (state, cancellable);
 }
 
 /**
@@ -2243,10 +2507,7 @@ pk_client_search_names_async (PkClient *client, PkBitfield filters, gchar **valu
 	pk_client_set_role (state, state->role);
 
 	/* get tid */
-	pk_control_get_tid_async (client->priv->control,
-				  cancellable,
-				  (GAsyncReadyCallback) pk_client_get_tid_cb,
-				  state);
+	pk_client_create_transaction (state, cancellable);
 }
 
 /**
@@ -2311,10 +2572,7 @@ pk_client_search_details_async (PkClient *client, PkBitfield filters, gchar **va
 	pk_client_set_role (state, state->role);
 
 	/* get tid */
-	pk_control_get_tid_async (client->priv->control,
-				  cancellable,
-				  (GAsyncReadyCallback) pk_client_get_tid_cb,
-				  state);
+	pk_client_create_transaction (state, cancellable);
 }
 
 /**
@@ -2377,10 +2635,7 @@ pk_client_search_groups_async (PkClient *client, PkBitfield filters, gchar **val
 	pk_client_set_role (state, state->role);
 
 	/* get tid */
-	pk_control_get_tid_async (client->priv->control,
-				  cancellable,
-				  (GAsyncReadyCallback) pk_client_get_tid_cb,
-				  state);
+	pk_client_create_transaction (state, cancellable);
 }
 
 /**
@@ -2443,10 +2698,7 @@ pk_client_search_files_async (PkClient *client, PkBitfield filters, gchar **valu
 	pk_client_set_role (state, state->role);
 
 	/* get tid */
-	pk_control_get_tid_async (client->priv->control,
-				  cancellable,
-				  (GAsyncReadyCallback) pk_client_get_tid_cb,
-				  state);
+	pk_client_create_transaction (state, cancellable);
 }
 
 /**
@@ -2509,10 +2761,7 @@ pk_client_get_details_async (PkClient *client, gchar **package_ids, GCancellable
 	pk_client_set_role (state, state->role);
 
 	/* get tid */
-	pk_control_get_tid_async (client->priv->control,
-				  cancellable,
-				  (GAsyncReadyCallback) pk_client_get_tid_cb,
-				  state);
+	pk_client_create_transaction (state, cancellable);
 }
 
 /**
@@ -2579,10 +2828,7 @@ pk_client_get_details_local_async (PkClient *client, gchar **files, GCancellable
 	pk_client_set_role (state, state->role);
 
 	/* get tid */
-	pk_control_get_tid_async (client->priv->control,
-				  cancellable,
-				  (GAsyncReadyCallback) pk_client_get_tid_cb,
-				  state);
+	pk_client_create_transaction (state, cancellable);
 }
 
 /**
@@ -2649,10 +2895,7 @@ pk_client_get_files_local_async (PkClient *client, gchar **files, GCancellable *
 	pk_client_set_role (state, state->role);
 
 	/* get tid */
-	pk_control_get_tid_async (client->priv->control,
-				  cancellable,
-				  (GAsyncReadyCallback) pk_client_get_tid_cb,
-				  state);
+	pk_client_create_transaction (state, cancellable);
 }
 
 /**
@@ -2715,10 +2958,7 @@ pk_client_get_update_detail_async (PkClient *client, gchar **package_ids, GCance
 	pk_client_set_role (state, state->role);
 
 	/* get tid */
-	pk_control_get_tid_async (client->priv->control,
-				  cancellable,
-				  (GAsyncReadyCallback) pk_client_get_tid_cb,
-				  state);
+	pk_client_create_transaction (state, cancellable);
 }
 
 /**
@@ -2782,10 +3022,7 @@ pk_client_download_packages_async (PkClient *client, gchar **package_ids, const
 	pk_client_set_role (state, state->role);
 
 	/* get tid */
-	pk_control_get_tid_async (client->priv->control,
-				  cancellable,
-				  (GAsyncReadyCallback) pk_client_get_tid_cb,
-				  state);
+	pk_client_create_transaction (state, cancellable);
 }
 
 /**
@@ -2846,10 +3083,7 @@ pk_client_get_updates_async (PkClient *client, PkBitfield filters, GCancellable
 	pk_client_set_role (state, state->role);
 
 	/* get tid */
-	pk_control_get_tid_async (client->priv->control,
-				  cancellable,
-				  (GAsyncReadyCallback) pk_client_get_tid_cb,
-				  state);
+	pk_client_create_transaction (state, cancellable);
 }
 
 /**
@@ -2910,10 +3144,7 @@ pk_client_get_old_transactions_async (PkClient *client, guint number, GCancellab
 	pk_client_set_role (state, state->role);
 
 	/* get tid */
-	pk_control_get_tid_async (client->priv->control,
-				  cancellable,
-				  (GAsyncReadyCallback) pk_client_get_tid_cb,
-				  state);
+	pk_client_create_transaction (state, cancellable);
 }
 
 /**
@@ -2979,10 +3210,7 @@ pk_client_depends_on_async (PkClient *client, PkBitfield filters, gchar **packag
 	pk_client_set_role (state, state->role);
 
 	/* get tid */
-	pk_control_get_tid_async (client->priv->control,
-				  cancellable,
-				  (GAsyncReadyCallback) pk_client_get_tid_cb,
-				  state);
+	pk_client_create_transaction (state, cancellable);
 }
 
 /**
@@ -3043,10 +3271,7 @@ pk_client_get_packages_async (PkClient *client, PkBitfield filters, GCancellable
 	pk_client_set_role (state, state->role);
 
 	/* get tid */
-	pk_control_get_tid_async (client->priv->control,
-				  cancellable,
-				  (GAsyncReadyCallback) pk_client_get_tid_cb,
-				  state);
+	pk_client_create_transaction (state, cancellable);
 }
 
 /**
@@ -3112,10 +3337,7 @@ pk_client_required_by_async (PkClient *client, PkBitfield filters, gchar **packa
 	pk_client_set_role (state, state->role);
 
 	/* get tid */
-	pk_control_get_tid_async (client->priv->control,
-				  cancellable,
-				  (GAsyncReadyCallback) pk_client_get_tid_cb,
-				  state);
+	pk_client_create_transaction (state, cancellable);
 }
 
 /**
@@ -3183,10 +3405,7 @@ pk_client_what_provides_async (PkClient *client,
 	pk_client_set_role (state, state->role);
 
 	/* get tid */
-	pk_control_get_tid_async (client->priv->control,
-				  cancellable,
-				  (GAsyncReadyCallback) pk_client_get_tid_cb,
-				  state);
+	pk_client_create_transaction (state, cancellable);
 }
 
 /**
@@ -3246,10 +3465,7 @@ pk_client_get_distro_upgrades_async (PkClient *client, GCancellable *cancellable
 	pk_client_set_role (state, state->role);
 
 	/* get tid */
-	pk_control_get_tid_async (client->priv->control,
-				  cancellable,
-				  (GAsyncReadyCallback) pk_client_get_tid_cb,
-				  state);
+	pk_client_create_transaction (state, cancellable);
 }
 
 /**
@@ -3311,10 +3527,7 @@ pk_client_get_files_async (PkClient *client, gchar **package_ids, GCancellable *
 	pk_client_set_role (state, state->role);
 
 	/* get tid */
-	pk_control_get_tid_async (client->priv->control,
-				  cancellable,
-				  (GAsyncReadyCallback) pk_client_get_tid_cb,
-				  state);
+	pk_client_create_transaction (state, cancellable);
 }
 
 /**
@@ -3373,10 +3586,7 @@ pk_client_get_categories_async (PkClient *client, GCancellable *cancellable,
 	pk_client_set_role (state, state->role);
 
 	/* get tid */
-	pk_control_get_tid_async (client->priv->control,
-				  cancellable,
-				  (GAsyncReadyCallback) pk_client_get_tid_cb,
-				  state);
+	pk_client_create_transaction (state, cancellable);
 }
 
 /**
@@ -3453,10 +3663,7 @@ pk_client_remove_packages_async (PkClient *client,
 	pk_client_set_role (state, state->role);
 
 	/* get tid */
-	pk_control_get_tid_async (client->priv->control,
-				  cancellable,
-				  (GAsyncReadyCallback) pk_client_get_tid_cb,
-				  state);
+	pk_client_create_transaction (state, cancellable);
 }
 
 /**
@@ -3520,10 +3727,7 @@ pk_client_refresh_cache_async (PkClient *client, gboolean force, GCancellable *c
 	pk_client_set_role (state, state->role);
 
 	/* get tid */
-	pk_control_get_tid_async (client->priv->control,
-				  cancellable,
-				  (GAsyncReadyCallback) pk_client_get_tid_cb,
-				  state);
+	pk_client_create_transaction (state, cancellable);
 }
 
 /**
@@ -3587,10 +3791,7 @@ pk_client_install_packages_async (PkClient *client, PkBitfield transaction_flags
 	pk_client_set_role (state, state->role);
 
 	/* get tid */
-	pk_control_get_tid_async (client->priv->control,
-				  cancellable,
-				  (GAsyncReadyCallback) pk_client_get_tid_cb,
-				  state);
+	pk_client_create_transaction (state, cancellable);
 }
 
 /**
@@ -3655,10 +3856,7 @@ pk_client_install_signature_async (PkClient *client, PkSigTypeEnum type, const g
 	pk_client_set_role (state, state->role);
 
 	/* get tid */
-	pk_control_get_tid_async (client->priv->control,
-				  cancellable,
-				  (GAsyncReadyCallback) pk_client_get_tid_cb,
-				  state);
+	pk_client_create_transaction (state, cancellable);
 }
 
 /**
@@ -3727,10 +3925,7 @@ pk_client_update_packages_async (PkClient *client,
 	pk_client_set_role (state, state->role);
 
 	/* get tid */
-	pk_control_get_tid_async (client->priv->control,
-				  cancellable,
-				  (GAsyncReadyCallback) pk_client_get_tid_cb,
-				  state);
+	pk_client_create_transaction (state, cancellable);
 }
 
 /**
@@ -3750,10 +3945,7 @@ pk_client_copy_native_finished_cb (GFile *file, GAsyncResult *res, PkClientState
 	/* no more copies pending? */
 	if (--state->refcount == 0) {
 		/* now get tid and continue on our merry way */
-		pk_control_get_tid_async (state->client->priv->control,
-					  state->cancellable,
-					  (GAsyncReadyCallback) pk_client_get_tid_cb,
-					  state);
+		pk_client_create_transaction (state, state->cancellable);
 	}
 }
 
@@ -3893,10 +4085,7 @@ pk_client_install_files_async (PkClient *client,
 	/* nothing to copy, common case */
 	if (state->refcount == 0) {
 		/* just get tid */
-		pk_control_get_tid_async (client->priv->control,
-					  cancellable,
-					  (GAsyncReadyCallback) pk_client_get_tid_cb,
-					  state);
+		pk_client_create_transaction (state, cancellable);
 		return;
 	}
 
@@ -3962,10 +4151,7 @@ pk_client_accept_eula_async (PkClient *client, const gchar *eula_id, GCancellabl
 	pk_client_set_role (state, state->role);
 
 	/* get tid */
-	pk_control_get_tid_async (client->priv->control,
-				  cancellable,
-				  (GAsyncReadyCallback) pk_client_get_tid_cb,
-				  state);
+	pk_client_create_transaction (state, cancellable);
 }
 
 /**
@@ -4026,10 +4212,7 @@ pk_client_get_repo_list_async (PkClient *client, PkBitfield filters, GCancellabl
 	pk_client_set_role (state, state->role);
 
 	/* get tid */
-	pk_control_get_tid_async (client->priv->control,
-				  cancellable,
-				  (GAsyncReadyCallback) pk_client_get_tid_cb,
-				  state);
+	pk_client_create_transaction (state, cancellable);
 }
 
 /**
@@ -4092,10 +4275,7 @@ pk_client_repo_enable_async (PkClient *client, const gchar *repo_id, gboolean en
 	pk_client_set_role (state, state->role);
 
 	/* get tid */
-	pk_control_get_tid_async (client->priv->control,
-				  cancellable,
-				  (GAsyncReadyCallback) pk_client_get_tid_cb,
-				  state);
+	pk_client_create_transaction (state, cancellable);
 }
 
 /**
@@ -4161,10 +4341,7 @@ pk_client_repo_set_data_async (PkClient *client, const gchar *repo_id, const gch
 	pk_client_set_role (state, state->role);
 
 	/* get tid */
-	pk_control_get_tid_async (client->priv->control,
-				  cancellable,
-				  (GAsyncReadyCallback) pk_client_get_tid_cb,
-				  state);
+	pk_client_create_transaction (state, cancellable);
 }
 
 /**
@@ -4235,10 +4412,7 @@ pk_client_repo_remove_async (PkClient *client,
 	pk_client_set_role (state, state->role);
 
 	/* get tid */
-	pk_control_get_tid_async (client->priv->control,
-				  cancellable,
-				  (GAsyncReadyCallback) pk_client_get_tid_cb,
-				  state);
+	pk_client_create_transaction (state, cancellable);
 }
 
 /**
@@ -4303,7 +4477,7 @@ pk_client_repair_system_async (PkClient *client,
 	pk_client_set_role (state, state->role);
 
 	/* get tid */
-	pk_control_get_tid_async (client->priv->control, cancellable, (GAsyncReadyCallback) pk_client_get_tid_cb, state);
+	pk_client_create_transaction (state, cancellable);
 }
 
 /**********************************************************************/
@@ -4764,6 +4938,43 @@ pk_client_get_cache_age (PkClient *client)
 	return client->priv->cache_age;
 }
 
+/**
+ * pk_client_set_results_fd:
+ * @client: a valid #PkClient instance
+ * @results_fd: if the results of queries should be read from a memfd
+ *
+ * Asks the daemon to pass the results of large queries in a sealed
+ * memfd when the transaction finishes. The Package and Packages signals
+ * are not emitted for those queries, so the packages are not streamed
+ * to the progress callback while the query runs.
+ *
+ * Since: 1.0.7
+ **/
+void
+pk_client_set_results_fd (PkClient *client, gboolean results_fd)
+{
+	g_return_if_fail (PK_IS_CLIENT (client));
+	client->priv->results_fd = results_fd;
+	g_object_notify (G_OBJECT (client), "results-fd");
+}
+
+/**
+ * pk_client_get_results_fd:
+ * @client: a valid #PkClient instance
+ *
+ * Gets if the results of queries are read from a memfd.
+ *
+ * Return value: %TRUE if pk_client_set_results_fd() enabled it
+ *
+ * Since: 1.0.7
+ **/
+gboolean
+pk_client_get_results_fd (PkClient *client)
+{
+	g_return_val_if_fail (PK_IS_CLIENT (client), FALSE);
+	return client->priv->results_fd;
+}
+
 /**
  * pk_client_class_init:
  **/
@@ -4827,6 +5038,16 @@ pk_client_class_init (PkClientClass *klass)
 				   0, G_MAXUINT, 0,
 				   G_PARAM_READWRITE);
 	g_object_class_install_property (object_class, PROP_CACHE_AGE, pspec);
+
+	/**
+	 * PkClient:results-fd:
+	 *
+	 * Since: 1.0.7
+	 */
+	pspec = g_param_spec_boolean ("results-fd", NULL, NULL,
+				      FALSE,
+				      G_PARAM_READWRITE);
+	g_object_class_install_property (object_class, PROP_RESULTS_FD, pspec);
 }
 
 /**
@@ -410,6 +410,9 @@ gboolean	 pk_client_get_idle			(PkClient		*client);
 void		 pk_client_set_cache_age		(PkClient		*client,
 							 guint			 cache_age);
 guint		 pk_client_get_cache_age		(PkClient		*client);
+void		 pk_client_set_results_fd		(PkClient		*client,
+							 gboolean		 results_fd);
+gboolean	 pk_client_get_results_fd		(PkClient		*client);
 
 G_END_DECLS
 
@@ -37,6 +37,7 @@
 #include <packagekit-glib2/pk-bitfield.h>
 #include <packagekit-glib2/pk-common.h>
 #include <packagekit-glib2/pk-control.h>
+#include <packagekit-glib2/pk-control-private.h>
 #include <packagekit-glib2/pk-version.h>
 
 static void     pk_control_finalize	(GObject     *object);
@@ -71,6 +72,7 @@ struct _PkControlPrivate
 	PkNetworkEnum		 network_state;
 	gchar			*distro_id;
 	guint			 transaction_list_changed_id;
+	gboolean		 create_with_hints_missing;
 	guint			 restart_schedule_id;
 	guint			 updates_changed_id;
 	guint			 repo_list_changed_id;
@@ -125,6 +127,7 @@ typedef struct {
 	PkNetworkEnum		 network;
 	GVariant		*parameters;
 	GDBusProxy		*proxy;
+	gchar			**hints;
 } PkControlState;
 
 /**
@@ -448,6 +451,7 @@ pk_control_get_tid_state_finish (PkControlState *state, const GError *error)
 		g_object_unref (state->cancellable);
 	}
 	g_free (state->tid);
+	g_strfreev (state->hints);
 	g_object_unref (state->res);
 	g_object_unref (state->control);
 	if (state->proxy != NULL)
@@ -455,6 +459,36 @@ pk_control_get_tid_state_finish (PkControlState *state, const GError *error)
 	g_slice_free (PkControlState, state);
 }
 
+/**
+ * pk_control_get_tid_set_hints_cb:
+ **/
+static void
+pk_control_get_tid_set_hints_cb (GObject *source_object,
+				 GAsyncResult *res,
+				 gpointer user_data)
+{
+	GDBusConnection *connection = G_DBUS_CONNECTION (source_object);
+	PkControlState *state = (PkControlState *) user_data;
+	_cleanup_error_free_ GError *error = NULL;
+	_cleanup_variant_unref_ GVariant *value = NULL;
+
+	/* get the result */
+	value = g_dbus_connection_call_finish (connection, res, &error);
+	if (value == NULL) {
+		/* fix up the D-Bus error */
+		pk_control_fixup_dbus_error (error);
+		g_free (state->tid);
+		state->tid = NULL;
+		pk_control_get_tid_state_finish (state, error);
+		return;
+	}
+
+	/* we're done */
+	pk_control_get_tid_state_finish (state, NULL);
+}
+
+static void pk_control_get_tid_internal (PkControlState *state);
+
 /**
  * pk_control_get_tid_cb:
  **/
@@ -471,6 +505,16 @@ pk_control_get_tid_cb (GObject *source_object,
 	/* get the result */
 	value = g_dbus_proxy_call_finish (proxy, res, &error);
 	if (value == NULL) {
+		/* an older daemon, so set the hints on the transaction */
+		if (state->hints != NULL &&
+		    !state->control->priv->create_with_hints_missing &&
+		    g_error_matches (error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_METHOD)) {
+			g_debug ("no CreateTransactionWithHints, using SetHints");
+			state->control->priv->create_with_hints_missing = TRUE;
+			pk_control_get_tid_internal (state);
+			return;
+		}
+
 		/* fix up the D-Bus error */
 		pk_control_fixup_dbus_error (error);
 		pk_control_get_tid_state_finish (state, error);
@@ -480,6 +524,24 @@ pk_control_get_tid_cb (GObject *source_object,
 	/* save results */
 	g_variant_get (value, "(o)", &state->tid);
 
+	/* the hints were not sent with CreateTransaction */
+	if (state->hints != NULL &&
+	    state->control->priv->create_with_hints_missing) {
+		g_dbus_connection_call (g_dbus_proxy_get_connection (proxy),
+					PK_DBUS_SERVICE,
+					state->tid,
+					PK_DBUS_INTERFACE_TRANSACTION,
+					"SetHints",
+					g_variant_new ("(^as)", state->hints),
+					NULL,
+					G_DBUS_CALL_FLAGS_NONE,
+					PK_CONTROL_DBUS_METHOD_TIMEOUT,
+					state->cancellable,
+					pk_control_get_tid_set_hints_cb,
+					state);
+		return;
+	}
+
 	/* we're done */
 	pk_control_get_tid_state_finish (state, NULL);
 }
@@ -490,6 +552,18 @@ pk_control_get_tid_cb (GObject *source_object,
 static void
 pk_control_get_tid_internal (PkControlState *state)
 {
+	if (state->hints != NULL &&
+	    !state->control->priv->create_with_hints_missing) {
+		g_dbus_proxy_call (state->control->priv->proxy,
+				   "CreateTransactionWithHints",
+				   g_variant_new ("(^as)", state->hints),
+				   G_DBUS_CALL_FLAGS_NONE,
+				   PK_CONTROL_DBUS_METHOD_TIMEOUT,
+				   state->cancellable,
+				   pk_control_get_tid_cb,
+				   state);
+		return;
+	}
 	g_dbus_proxy_call (state->control->priv->proxy,
 			   "CreateTransaction",
 			   NULL,
@@ -536,6 +610,28 @@ pk_control_get_tid_async (PkControl *control,
 			  GCancellable *cancellable,
 			  GAsyncReadyCallback callback,
 			  gpointer user_data)
+{
+	pk_control_get_tid_with_hints_async (control, NULL, cancellable,
+					     callback, user_data);
+}
+
+/**
+ * pk_control_get_tid_with_hints_async:
+ * @control: a valid #PkControl instance
+ * @hints: (allow-none): the transaction hints, e.g. "locale=en_GB.utf8"
+ * @cancellable: a #GCancellable or %NULL
+ * @callback: the function to run on completion
+ * @user_data: the data to pass to @callback
+ *
+ * Gets a transacton ID from the daemon with the hints already set on
+ * the transaction. Use pk_control_get_tid_finish() to get the result.
+ **/
+void
+pk_control_get_tid_with_hints_async (PkControl *control,
+				     gchar **hints,
+				     GCancellable *cancellable,
+				     GAsyncReadyCallback callback,
+				     gpointer user_data)
 {
 	PkControlState *state;
 	_cleanup_error_free_ GError *error = NULL;
@@ -554,6 +650,7 @@ pk_control_get_tid_async (PkControl *control,
 	state = g_slice_new0 (PkControlState);
 	state->res = g_object_ref (res);
 	state->control = g_object_ref (control);
+	state->hints = g_strdupv (hints);
 	if (cancellable != NULL)
 		state->cancellable = g_object_ref (cancellable);
 
@@ -618,6 +715,24 @@ pk_control_get_tid_finish (PkControl *control,
 	return g_strdup (g_simple_async_result_get_op_res_gpointer (simple));
 }
 
+/**
+ * pk_control_get_name_owner:
+ * @control: a valid #PkControl instance
+ *
+ * Gets the unique bus name of the running daemon, which allows proxies
+ * for its transactions to be created without asking the bus for it.
+ *
+ * Return value: the unique name, or %NULL if unknown, free with g_free()
+ **/
+gchar *
+pk_control_get_name_owner (PkControl *control)
+{
+	g_return_val_if_fail (PK_IS_CONTROL (control), NULL);
+	if (control->priv->proxy == NULL)
+		return NULL;
+	return g_dbus_proxy_get_name_owner (control->priv->proxy);
+}
+
 /**********************************************************************/
 
 
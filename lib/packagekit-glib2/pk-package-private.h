@@ -0,0 +1,43 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#if !defined (__PACKAGEKIT_H_INSIDE__) && !defined (PK_COMPILATION)
+#error "Only <packagekit.h> can be included directly."
+#endif
+
+#ifndef __PK_PACKAGE_PRIVATE_H
+#define __PK_PACKAGE_PRIVATE_H
+
+/* shared between PkPackage and the code that creates a package for
+ * every one a backend emits */
+
+#include <glib.h>
+
+#include "pk-package.h"
+
+G_BEGIN_DECLS
+
+PkPackage		*pk_package_new_from_data	(PkInfoEnum		 info,
+							 const gchar		*package_id,
+							 const gchar		*summary,
+							 GError			**error);
+
+G_END_DECLS
+
+#endif /* __PK_PACKAGE_PRIVATE_H */
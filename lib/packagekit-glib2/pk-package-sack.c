@@ -55,6 +55,10 @@ struct _PkPackageSackPrivate
 {
 	GHashTable		*table;
 	GPtrArray		*array;
+	GHashTable		*names;		/* name:GPtrArray of PkPackage */
+	GPtrArray		*infos[PK_INFO_ENUM_LAST];
+	gboolean		 infos_valid;
+	GHashTable		*watched;	/* PkPackage:times in the array */
 	PkClient		*client;
 };
 
@@ -65,6 +69,211 @@ enum {
 
 G_DEFINE_TYPE (PkPackageSack, pk_package_sack, G_TYPE_OBJECT)
 
+/**
+ * pk_package_sack_info_changed_cb:
+ **/
+static void
+pk_package_sack_info_changed_cb (PkPackage *package, GParamSpec *pspec, PkPackageSack *sack)
+{
+	/* the package is in the wrong place in the info index, and moving
+	 * it would not keep the array order */
+	sack->priv->infos_valid = FALSE;
+}
+
+/**
+ * pk_package_sack_watch:
+ *
+ * Watches the info of @package, once however many times it is added.
+ **/
+static void
+pk_package_sack_watch (PkPackageSack *sack, PkPackage *package)
+{
+	guint count;
+
+	count = GPOINTER_TO_UINT (g_hash_table_lookup (sack->priv->watched, package));
+	if (count == 0) {
+		g_signal_connect (package, "notify::info",
+				  G_CALLBACK (pk_package_sack_info_changed_cb), sack);
+	}
+	g_hash_table_insert (sack->priv->watched, package, GUINT_TO_POINTER (count + 1));
+}
+
+/**
+ * pk_package_sack_unwatch:
+ **/
+static void
+pk_package_sack_unwatch (PkPackageSack *sack, PkPackage *package)
+{
+	guint count;
+
+	count = GPOINTER_TO_UINT (g_hash_table_lookup (sack->priv->watched, package));
+	if (count > 1) {
+		g_hash_table_insert (sack->priv->watched, package, GUINT_TO_POINTER (count - 1));
+		return;
+	}
+	g_signal_handlers_disconnect_by_func (package, pk_package_sack_info_changed_cb, sack);
+	g_hash_table_remove (sack->priv->watched, package);
+}
+
+/**
+ * pk_package_sack_unwatch_all:
+ **/
+static void
+pk_package_sack_unwatch_all (PkPackageSack *sack)
+{
+	GHashTableIter iter;
+	gpointer package;
+
+	g_hash_table_iter_init (&iter, sack->priv->watched);
+	while (g_hash_table_iter_next (&iter, &package, NULL)) {
+		g_signal_handlers_disconnect_by_func (package,
+						      pk_package_sack_info_changed_cb,
+						      sack);
+	}
+	g_hash_table_remove_all (sack->priv->watched);
+}
+
+/**
+ * pk_package_sack_index_add_info:
+ **/
+static void
+pk_package_sack_index_add_info (PkPackageSack *sack, PkPackage *package)
+{
+	PkInfoEnum info;
+	PkPackageSackPrivate *priv = sack->priv;
+
+	/* the info of some package changed since it was indexed */
+	if (!priv->infos_valid)
+		return;
+	info = pk_package_get_info (package);
+	if (info >= PK_INFO_ENUM_LAST) {
+		priv->infos_valid = FALSE;
+		return;
+	}
+	if (priv->infos[info] == NULL)
+		priv->infos[info] = g_ptr_array_new ();
+	g_ptr_array_add (priv->infos[info], package);
+}
+
+/**
+ * pk_package_sack_index_add:
+ *
+ * Adds @package to the indexes, in the same order as in the array.
+ **/
+static void
+pk_package_sack_index_add (PkPackageSack *sack, PkPackage *package)
+{
+	GPtrArray *bucket;
+	const gchar *name;
+	PkPackageSackPrivate *priv = sack->priv;
+
+	name = pk_package_get_name (package);
+	if (name != NULL) {
+		bucket = g_hash_table_lookup (priv->names, name);
+		if (bucket == NULL) {
+			bucket = g_ptr_array_new ();
+			g_hash_table_insert (priv->names, (gpointer) name, bucket);
+		}
+		g_ptr_array_add (bucket, package);
+	}
+	pk_package_sack_index_add_info (sack, package);
+}
+
+/**
+ * pk_package_sack_index_remove:
+ **/
+static void
+pk_package_sack_index_remove (PkPackageSack *sack, PkPackage *package)
+{
+	GPtrArray *bucket = NULL;
+	PkInfoEnum info;
+	const gchar *name;
+	PkPackageSackPrivate *priv = sack->priv;
+
+	name = pk_package_get_name (package);
+	if (name != NULL)
+		bucket = g_hash_table_lookup (priv->names, name);
+	if (bucket != NULL) {
+		g_ptr_array_remove (bucket, package);
+		if (bucket->len == 0)
+			g_hash_table_remove (priv->names, name);
+	}
+
+	/* only an up to date index knows where the package is */
+	info = pk_package_get_info (package);
+	if (priv->infos_valid &&
+	    info < PK_INFO_ENUM_LAST &&
+	    priv->infos[info] != NULL) {
+		g_ptr_array_remove (priv->infos[info], package);
+	} else {
+		priv->infos_valid = FALSE;
+	}
+}
+
+/**
+ * pk_package_sack_index_clear_infos:
+ **/
+static void
+pk_package_sack_index_clear_infos (PkPackageSack *sack)
+{
+	guint i;
+	PkPackageSackPrivate *priv = sack->priv;
+
+	for (i = 0; i < PK_INFO_ENUM_LAST; i++) {
+		if (priv->infos[i] != NULL)
+			g_ptr_array_set_size (priv->infos[i], 0);
+	}
+	priv->infos_valid = TRUE;
+}
+
+/**
+ * pk_package_sack_index_rebuild:
+ *
+ * Indexes all the packages again, after the array was reordered.
+ **/
+static void
+pk_package_sack_index_rebuild (PkPackageSack *sack)
+{
+	guint i;
+	PkPackageSackPrivate *priv = sack->priv;
+
+	g_hash_table_remove_all (priv->names);
+	pk_package_sack_index_clear_infos (sack);
+	for (i = 0; i < priv->array->len; i++)
+		pk_package_sack_index_add (sack, g_ptr_array_index (priv->array, i));
+}
+
+/**
+ * pk_package_sack_index_get_info:
+ *
+ * Return value: (transfer none): the packages with @info, or %NULL if
+ * they have to be found without the index
+ **/
+static GPtrArray *
+pk_package_sack_index_get_info (PkPackageSack *sack, PkInfoEnum info)
+{
+	guint i;
+	PkPackageSackPrivate *priv = sack->priv;
+
+	if (info >= PK_INFO_ENUM_LAST)
+		return NULL;
+
+	/* packages were removed, or the info of some package changed */
+	if (!priv->infos_valid) {
+		g_debug ("rebuilding info index of %u packages", priv->array->len);
+		pk_package_sack_index_clear_infos (sack);
+		for (i = 0; i < priv->array->len; i++)
+			pk_package_sack_index_add_info (sack, g_ptr_array_index (priv->array, i));
+	}
+
+	/* some package has an info we don't know about */
+	if (!priv->infos_valid)
+		return NULL;
+	if (priv->infos[info] == NULL)
+		priv->infos[info] = g_ptr_array_new ();
+	return priv->infos[info];
+}
+
 /**
  * pk_package_sack_clear:
  * @sack: a valid #PkPackageSack instance
@@ -78,8 +287,11 @@ pk_package_sack_clear (PkPackageSack *sack)
 {
 	g_return_if_fail (PK_IS_PACKAGE_SACK (sack));
 
+	pk_package_sack_unwatch_all (sack);
 	g_ptr_array_set_size (sack->priv->array, 0);
 	g_hash_table_remove_all (sack->priv->table);
+	g_hash_table_remove_all (sack->priv->names);
+	pk_package_sack_index_clear_infos (sack);
 }
 
 /**
@@ -161,9 +373,9 @@ pk_package_sack_get_array (PkPackageSack *sack)
 PkPackageSack *
 pk_package_sack_filter_by_info (PkPackageSack *sack, PkInfoEnum info)
 {
+	GPtrArray *array;
 	PkPackageSack *results;
 	PkPackage *package;
-	PkInfoEnum info_tmp;
 	guint i;
 	PkPackageSackPrivate *priv = sack->priv;
 
@@ -173,13 +385,17 @@ pk_package_sack_filter_by_info (PkPackageSack *sack, PkInfoEnum info)
 	results = pk_package_sack_new ();
 
 	/* add each that matches the info enum */
+	array = pk_package_sack_index_get_info (sack, info);
+	if (array != NULL) {
+		for (i = 0; i < array->len; i++)
+			pk_package_sack_add_package (results, g_ptr_array_index (array, i));
+		return results;
+	}
 	for (i = 0; i < priv->array->len; i++) {
 		package = g_ptr_array_index (priv->array, i);
-		info_tmp = pk_package_get_info (package);
-		if (info_tmp == info)
+		if (pk_package_get_info (package) == info)
 			pk_package_sack_add_package (results, package);
 	}
-
 	return results;
 }
 
@@ -242,6 +458,8 @@ pk_package_sack_add_package (PkPackageSack *sack, PkPackage *package)
 	g_hash_table_insert (sack->priv->table,
 			     (gpointer) pk_package_get_id (package),
 			     (gpointer) package);
+	pk_package_sack_index_add (sack, package);
+	pk_package_sack_watch (sack, package);
 
 	return TRUE;
 }
@@ -413,12 +631,22 @@ pk_package_sack_to_file (PkPackageSack *sack, GFile *file, GError **error)
 gboolean
 pk_package_sack_remove_package (PkPackageSack *sack, PkPackage *package)
 {
+	guint i;
+
 	g_return_val_if_fail (PK_IS_PACKAGE_SACK (sack), FALSE);
 	g_return_val_if_fail (PK_IS_PACKAGE (package), FALSE);
 
 	/* remove from array */
 	g_hash_table_remove (sack->priv->table, pk_package_get_id (package));
-	return g_ptr_array_remove (sack->priv->array, package);
+	for (i = 0; i < sack->priv->array->len; i++) {
+		if (g_ptr_array_index (sack->priv->array, i) != package)
+			continue;
+		pk_package_sack_index_remove (sack, package);
+		pk_package_sack_unwatch (sack, package);
+		g_ptr_array_remove_index (sack->priv->array, i);
+		return TRUE;
+	}
+	return FALSE;
 }
 
 /**
@@ -444,6 +672,11 @@ pk_package_sack_remove_package_by_id (PkPackageSack *sack,
 	g_return_val_if_fail (PK_IS_PACKAGE_SACK (sack), FALSE);
 	g_return_val_if_fail (package_id != NULL, FALSE);
 
+	package = g_hash_table_lookup (sack->priv->table, package_id);
+	if (package != NULL)
+		return pk_package_sack_remove_package (sack, package);
+
+	/* a duplicate of a package that was removed */
 	array = sack->priv->array;
 	for (i = 0; i < array->len; i++) {
 		package = g_ptr_array_index (array, i);
@@ -473,26 +706,40 @@ pk_package_sack_remove_by_filter (PkPackageSack *sack,
 				  PkPackageSackFilterFunc filter_cb,
 				  gpointer user_data)
 {
-	gboolean ret = FALSE;
 	PkPackage *package;
-	gint i;
+	guint i;
+	guint len;
 	PkPackageSackPrivate *priv = sack->priv;
+	_cleanup_ptrarray_unref_ GPtrArray *removed = NULL;
 
 	g_return_val_if_fail (PK_IS_PACKAGE_SACK (sack), FALSE);
 	g_return_val_if_fail (filter_cb != NULL, FALSE);
 
-	/* add each that matches the info enum */
-	for (i = 0; i < (gint) priv->array->len; i++) {
+	/* move the packages to keep to the front in one pass, rather than
+	 * shifting the whole array down for every package removed; the info
+	 * index is rebuilt when it is next needed */
+	removed = g_ptr_array_new ();
+	len = 0;
+	priv->infos_valid = FALSE;
+	for (i = 0; i < priv->array->len; i++) {
 		package = g_ptr_array_index (priv->array, i);
-		if (!filter_cb (package, user_data)) {
-			ret = TRUE;
-			pk_package_sack_remove_package (sack, package);
-
-			/* ensure we pick up subsequent matches */
-			i--;
+		if (filter_cb (package, user_data)) {
+			priv->array->pdata[len++] = package;
+			continue;
 		}
+		g_hash_table_remove (priv->table, pk_package_get_id (package));
+		pk_package_sack_index_remove (sack, package);
+		pk_package_sack_unwatch (sack, package);
+		g_ptr_array_add (removed, package);
 	}
-	return ret;
+	if (removed->len == 0)
+		return FALSE;
+
+	/* the array drops its references to what is past the end */
+	for (i = 0; i < removed->len; i++)
+		priv->array->pdata[len + i] = g_ptr_array_index (removed, i);
+	g_ptr_array_set_size (priv->array, len);
+	return TRUE;
 }
 
 /**
@@ -537,6 +784,7 @@ pk_package_sack_find_by_id (PkPackageSack *sack, const gchar *package_id)
 PkPackage *
 pk_package_sack_find_by_id_name_arch (PkPackageSack *sack, const gchar *package_id)
 {
+	GPtrArray *bucket;
 	PkPackage *pkg_tmp;
 	guint i;
 	_cleanup_strv_free_ gchar **split = NULL;
@@ -548,11 +796,14 @@ pk_package_sack_find_by_id_name_arch (PkPackageSack *sack, const gchar *package_
 	split = pk_package_id_split (package_id);
 	if (split == NULL)
 		return NULL;
-	for (i = 0; i < sack->priv->array->len; i++) {
-		pkg_tmp = g_ptr_array_index (sack->priv->array, i);
-		if (g_strcmp0 (pk_package_get_name (pkg_tmp),
-			       split[PK_PACKAGE_ID_NAME]) == 0 &&
-		    g_strcmp0 (pk_package_get_arch (pkg_tmp),
+	bucket = g_hash_table_lookup (sack->priv->names, split[PK_PACKAGE_ID_NAME]);
+	if (bucket == NULL)
+		return NULL;
+
+	/* only the versions and arches of this name */
+	for (i = 0; i < bucket->len; i++) {
+		pkg_tmp = g_ptr_array_index (bucket, i);
+		if (g_strcmp0 (pk_package_get_arch (pkg_tmp),
 			       split[PK_PACKAGE_ID_ARCH]) == 0) {
 			return g_object_ref (pkg_tmp);
 		}
@@ -642,6 +893,9 @@ pk_package_sack_sort (PkPackageSack *sack, PkPackageSackSortType type)
 		g_ptr_array_sort (sack->priv->array, (GCompareFunc) pk_package_sack_sort_compare_summary_func);
 	else if (type == PK_PACKAGE_SACK_SORT_TYPE_INFO)
 		g_ptr_array_sort (sack->priv->array, (GCompareFunc) pk_package_sack_sort_compare_info_func);
+
+	/* the indexes are in the same order as the array */
+	pk_package_sack_index_rebuild (sack);
 }
 
 /**
@@ -1145,6 +1399,11 @@ pk_package_sack_init (PkPackageSack *sack)
 
 	priv->table = g_hash_table_new (g_str_hash, g_str_equal);
 	priv->array = g_ptr_array_new_with_free_func (g_object_unref);
+	/* the names are interned, so they outlive the packages */
+	priv->names = g_hash_table_new_full (g_str_hash, g_str_equal,
+					     NULL, (GDestroyNotify) g_ptr_array_unref);
+	priv->infos_valid = TRUE;
+	priv->watched = g_hash_table_new (g_direct_hash, g_direct_equal);
 	priv->client = pk_client_new ();
 }
 
@@ -1154,9 +1413,17 @@ pk_package_sack_init (PkPackageSack *sack)
 static void
 pk_package_sack_finalize (GObject *object)
 {
+	guint i;
 	PkPackageSack *sack = PK_PACKAGE_SACK (object);
 	PkPackageSackPrivate *priv = sack->priv;
 
+	for (i = 0; i < PK_INFO_ENUM_LAST; i++) {
+		if (priv->infos[i] != NULL)
+			g_ptr_array_unref (priv->infos[i]);
+	}
+	pk_package_sack_unwatch_all (sack);
+	g_hash_table_unref (priv->watched);
+	g_hash_table_unref (priv->names);
 	g_ptr_array_unref (priv->array);
 	g_hash_table_unref (priv->table);
 	g_object_unref (priv->client);
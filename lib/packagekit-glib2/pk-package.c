@@ -30,6 +30,7 @@
 
 #include "config.h"
 
+#include <string.h>
 #include <glib-object.h>
 
 #include "src/pk-cleanup.h"
@@ -38,6 +39,7 @@
 #include <packagekit-glib2/pk-common.h>
 #include <packagekit-glib2/pk-enum.h>
 #include <packagekit-glib2/pk-package-id.h>
+#include <packagekit-glib2/pk-package-private.h>
 
 static void     pk_package_finalize	(GObject     *object);
 
@@ -51,8 +53,7 @@ static void     pk_package_finalize	(GObject     *object);
 struct _PkPackagePrivate
 {
 	PkInfoEnum		 info;
-	gchar			*package_id;
-	gchar			*package_id_data;
+	gchar			*package_id;	/* followed by the version */
 	const gchar		*package_id_split[4];
 	gchar			*summary;
 	gchar			*license;
@@ -162,44 +163,61 @@ gboolean
 pk_package_set_id (PkPackage *package, const gchar *package_id, GError **error)
 {
 	PkPackagePrivate *priv = package->priv;
-	gboolean ret;
+	gchar *version;
+	gsize len;
 	guint cnt = 0;
 	guint i;
+	guint sep[3] = { 0, 0, 0 };
 
 	g_return_val_if_fail (PK_IS_PACKAGE (package), FALSE);
 	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
 
 	/* free old data */
 	g_free (priv->package_id);
-	g_free (priv->package_id_data);
-
-	/* copy the package-id into package_id_data, change the ';' into '\0'
-	 * and reference the pointers in the const gchar * array */
-	priv->package_id = g_strdup (package_id);
-	priv->package_id_data = g_strdup (package_id);
-	priv->package_id_split[0] = priv->package_id_data;
-	for (i = 0; priv->package_id_data[i] != '\0'; i++) {
-		if (package_id[i] == ';') {
-			if (++cnt > 3)
-				continue;
-			priv->package_id_split[cnt] = &priv->package_id_data[i+1];
-			priv->package_id_data[i] = '\0';
-		}
+	priv->package_id = NULL;
+	for (i = 0; i < 4; i++)
+		priv->package_id_split[i] = NULL;
+
+	/* find the sections */
+	for (i = 0; package_id[i] != '\0'; i++) {
+		if (package_id[i] != ';')
+			continue;
+		if (cnt < 3)
+			sep[cnt] = i;
+		cnt++;
 	}
 	if (cnt != 3) {
-		ret = FALSE;
+		priv->package_id = g_strdup (package_id);
 		g_set_error (error, 1, 0, "invalid number of sections %i", cnt);
-		goto out;
+		return FALSE;
 	}
 
 	/* name has to be valid */
-	ret = (priv->package_id_split[0][0] != '\0');
-	if (!ret) {
+	if (sep[0] == 0) {
+		priv->package_id = g_strdup (package_id);
 		g_set_error_literal (error, 1, 0, "name invalid");
-		goto out;
+		return FALSE;
 	}
-out:
-	return ret;
+
+	/* one allocation for the package-id and a copy of the version */
+	len = i;
+	priv->package_id = g_malloc (len + 1 + sep[1] - sep[0]);
+	memcpy (priv->package_id, package_id, len + 1);
+	version = priv->package_id + len + 1;
+	memcpy (version, package_id + sep[0] + 1, sep[1] - sep[0] - 1);
+	version[sep[1] - sep[0] - 1] = '\0';
+	priv->package_id_split[PK_PACKAGE_ID_VERSION] = version;
+
+	/* the names, arches and repos are the same in thousands of
+	 * packages, so they are interned rather than copied */
+	priv->package_id[sep[0]] = '\0';
+	priv->package_id_split[PK_PACKAGE_ID_NAME] = g_intern_string (priv->package_id);
+	priv->package_id[sep[0]] = ';';
+	priv->package_id[sep[2]] = '\0';
+	priv->package_id_split[PK_PACKAGE_ID_ARCH] = g_intern_string (priv->package_id + sep[1] + 1);
+	priv->package_id[sep[2]] = ';';
+	priv->package_id_split[PK_PACKAGE_ID_DATA] = g_intern_string (priv->package_id + sep[2] + 1);
+	return TRUE;
 }
 
 /**
@@ -230,7 +248,7 @@ pk_package_parse (PkPackage *package, const gchar *data, GError **error)
 	}
 
 	/* parse object */
-	package->priv->info = pk_info_enum_from_string (sections[0]);
+	pk_package_set_info (package, pk_info_enum_from_string (sections[0]));
 	if (!pk_package_set_id (package, sections[1], error))
 		return FALSE;
 	g_free (package->priv->summary);
@@ -268,7 +286,41 @@ void
 pk_package_set_info (PkPackage *package, PkInfoEnum info)
 {
 	g_return_if_fail (PK_IS_PACKAGE (package));
+	if (package->priv->info == info)
+		return;
 	package->priv->info = info;
+	g_object_notify (G_OBJECT (package), "info");
+}
+
+/**
+ * pk_package_new_from_data:
+ * @info: the %PkInfoEnum
+ * @package_id: the valid package_id
+ * @summary: the package summary
+ * @error: a %GError to put the error code and message in, or %NULL
+ *
+ * Creates a package without going through the GObject properties, for
+ * the daemon and the results that create one for every package.
+ *
+ * Return value: (transfer full): a new #PkPackage, or %NULL if @package_id is invalid
+ **/
+PkPackage *
+pk_package_new_from_data (PkInfoEnum info,
+			  const gchar *package_id,
+			  const gchar *summary,
+			  GError **error)
+{
+	PkPackage *package;
+
+	package = pk_package_new ();
+	if (!pk_package_set_id (package, package_id, error)) {
+		g_object_unref (package);
+		return NULL;
+	}
+	/* nothing can be watching it yet */
+	package->priv->info = info;
+	package->priv->summary = g_strdup (summary);
+	return package;
 }
 
 /**
@@ -844,7 +896,6 @@ pk_package_finalize (GObject *object)
 	g_free (priv->update_changelog);
 	g_free (priv->update_issued);
 	g_free (priv->update_updated);
-	g_free (priv->package_id_data);
 
 	G_OBJECT_CLASS (pk_package_parent_class)->finalize (object);
 }
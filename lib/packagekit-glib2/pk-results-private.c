@@ -0,0 +1,471 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+/* memfd_create() and the file sealing fcntl() commands */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <gio/gio.h>
+
+#include "src/pk-cleanup.h"
+
+#include "pk-details.h"
+#include "pk-files.h"
+#include "pk-package.h"
+#include "pk-package-private.h"
+#include "pk-results-private.h"
+
+/*
+ * The results are written as a header followed by the packages, the
+ * details and the files, all integers in host byte order:
+ *
+ *  header:  "PKRF", u32 version, u32 packages, u32 details, u32 files, u32 reserved
+ *  package: u32 info, str package_id, str summary
+ *  details: str package_id, str summary, str description, str license,
+ *           str url, u32 group, u64 size
+ *  files:   str package_id, u32 count, count * str
+ *
+ * Strings are a u32 length, or G_MAXUINT32 for NULL, and the bytes
+ * followed by a NUL so they can be used directly from the mapping.
+ */
+#define PK_RESULTS_FD_MAGIC		"PKRF"
+#define PK_RESULTS_FD_VERSION		1
+#define PK_RESULTS_FD_NULL_STRING	G_MAXUINT32
+
+#if defined(HAVE_MEMFD_CREATE) && defined(F_ADD_SEALS)
+#define PK_RESULTS_FD_SEALS		(F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL)
+#endif
+
+typedef struct {
+	const guint8	*data;
+	gsize		 size;
+	gsize		 pos;
+} PkResultsFdReader;
+
+/**
+ * pk_results_fd_supported:
+ *
+ * Return value: %TRUE if results can be sent using a sealed memfd
+ **/
+gboolean
+pk_results_fd_supported (void)
+{
+#ifdef PK_RESULTS_FD_SEALS
+	return TRUE;
+#else
+	return FALSE;
+#endif
+}
+
+/**
+ * pk_results_fd_role_supported:
+ *
+ * Only queries return results big enough to be worth it, the other
+ * roles need the Package signals to show the progress.
+ **/
+gboolean
+pk_results_fd_role_supported (PkRoleEnum role)
+{
+	switch (role) {
+	case PK_ROLE_ENUM_DEPENDS_ON:
+	case PK_ROLE_ENUM_GET_DETAILS:
+	case PK_ROLE_ENUM_GET_FILES:
+	case PK_ROLE_ENUM_GET_PACKAGES:
+	case PK_ROLE_ENUM_GET_UPDATES:
+	case PK_ROLE_ENUM_REQUIRED_BY:
+	case PK_ROLE_ENUM_RESOLVE:
+	case PK_ROLE_ENUM_SEARCH_DETAILS:
+	case PK_ROLE_ENUM_SEARCH_FILE:
+	case PK_ROLE_ENUM_SEARCH_GROUP:
+	case PK_ROLE_ENUM_SEARCH_NAME:
+	case PK_ROLE_ENUM_WHAT_PROVIDES:
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
+/**
+ * pk_results_fd_write_uint32:
+ **/
+static void
+pk_results_fd_write_uint32 (GByteArray *buffer, guint32 value)
+{
+	g_byte_array_append (buffer, (const guint8 *) &value, sizeof (value));
+}
+
+/**
+ * pk_results_fd_write_string:
+ **/
+static void
+pk_results_fd_write_string (GByteArray *buffer, const gchar *value)
+{
+	guint32 len;
+
+	if (value == NULL) {
+		pk_results_fd_write_uint32 (buffer, PK_RESULTS_FD_NULL_STRING);
+		return;
+	}
+	len = strlen (value);
+	pk_results_fd_write_uint32 (buffer, len);
+	g_byte_array_append (buffer, (const guint8 *) value, len + 1);
+}
+
+/**
+ * pk_results_fd_write:
+ * @results: a #PkResults
+ * @error: a #GError to put the error code in, or %NULL
+ *
+ * Writes the packages, details and files of @results into a sealed
+ * memfd that can be passed to another process.
+ *
+ * Return value: the file descriptor, or -1 on error
+ **/
+gint
+pk_results_fd_write (PkResults *results, GError **error)
+{
+#ifdef PK_RESULTS_FD_SEALS
+	const guint8 *data;
+	gint fd;
+	gsize written = 0;
+	gssize wrote;
+	guint i;
+	guint j;
+	gchar **files;
+	guint64 size;
+	_cleanup_ptrarray_unref_ GPtrArray *packages = NULL;
+	_cleanup_ptrarray_unref_ GPtrArray *details = NULL;
+	_cleanup_ptrarray_unref_ GPtrArray *files_array = NULL;
+	GByteArray *buffer;
+
+	packages = pk_results_get_package_array (results);
+	details = pk_results_get_details_array (results);
+	files_array = pk_results_get_files_array (results);
+
+	buffer = g_byte_array_new ();
+	g_byte_array_append (buffer, (const guint8 *) PK_RESULTS_FD_MAGIC, 4);
+	pk_results_fd_write_uint32 (buffer, PK_RESULTS_FD_VERSION);
+	pk_results_fd_write_uint32 (buffer, packages->len);
+	pk_results_fd_write_uint32 (buffer, details->len);
+	pk_results_fd_write_uint32 (buffer, files_array->len);
+	pk_results_fd_write_uint32 (buffer, 0);
+
+	for (i = 0; i < packages->len; i++) {
+		PkPackage *package = g_ptr_array_index (packages, i);
+		pk_results_fd_write_uint32 (buffer, pk_package_get_info (package));
+		pk_results_fd_write_string (buffer, pk_package_get_id (package));
+		pk_results_fd_write_string (buffer, pk_package_get_summary (package));
+	}
+	for (i = 0; i < details->len; i++) {
+		PkDetails *item = g_ptr_array_index (details, i);
+		pk_results_fd_write_string (buffer, pk_details_get_package_id (item));
+		pk_results_fd_write_string (buffer, pk_details_get_summary (item));
+		pk_results_fd_write_string (buffer, pk_details_get_description (item));
+		pk_results_fd_write_string (buffer, pk_details_get_license (item));
+		pk_results_fd_write_string (buffer, pk_details_get_url (item));
+		pk_results_fd_write_uint32 (buffer, pk_details_get_group (item));
+		size = pk_details_get_size (item);
+		g_byte_array_append (buffer, (const guint8 *) &size, sizeof (size));
+	}
+	for (i = 0; i < files_array->len; i++) {
+		PkFiles *item = g_ptr_array_index (files_array, i);
+		files = pk_files_get_files (item);
+		pk_results_fd_write_string (buffer, pk_files_get_package_id (item));
+		pk_results_fd_write_uint32 (buffer, files != NULL ? g_strv_length (files) : 0);
+		for (j = 0; files != NULL && files[j] != NULL; j++)
+			pk_results_fd_write_string (buffer, files[j]);
+	}
+
+	fd = memfd_create ("packagekit-results", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (fd < 0) {
+		g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+			     "failed to create memfd: %s", g_strerror (errno));
+		g_byte_array_unref (buffer);
+		return -1;
+	}
+
+	/* write it all, then make sure nobody can change it under the reader */
+	data = buffer->data;
+	while (written < buffer->len) {
+		wrote = write (fd, data + written, buffer->len - written);
+		if (wrote < 0 && errno == EINTR)
+			continue;
+		if (wrote <= 0) {
+			g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+				     "failed to write results: %s", g_strerror (errno));
+			g_byte_array_unref (buffer);
+			close (fd);
+			return -1;
+		}
+		written += wrote;
+	}
+	g_byte_array_unref (buffer);
+	if (fcntl (fd, F_ADD_SEALS, PK_RESULTS_FD_SEALS) < 0) {
+		g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+			     "failed to seal results: %s", g_strerror (errno));
+		close (fd);
+		return -1;
+	}
+	return fd;
+#else
+	g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+			     "sealed memfds are not supported");
+	return -1;
+#endif
+}
+
+/**
+ * pk_results_fd_read_uint32:
+ **/
+static gboolean
+pk_results_fd_read_uint32 (PkResultsFdReader *reader, guint32 *value)
+{
+	if (reader->size - reader->pos < sizeof (*value))
+		return FALSE;
+	memcpy (value, reader->data + reader->pos, sizeof (*value));
+	reader->pos += sizeof (*value);
+	return TRUE;
+}
+
+/**
+ * pk_results_fd_read_uint64:
+ **/
+static gboolean
+pk_results_fd_read_uint64 (PkResultsFdReader *reader, guint64 *value)
+{
+	if (reader->size - reader->pos < sizeof (*value))
+		return FALSE;
+	memcpy (value, reader->data + reader->pos, sizeof (*value));
+	reader->pos += sizeof (*value);
+	return TRUE;
+}
+
+/**
+ * pk_results_fd_read_string:
+ *
+ * The returned string points into the mapping.
+ **/
+static gboolean
+pk_results_fd_read_string (PkResultsFdReader *reader, const gchar **value)
+{
+	guint32 len;
+
+	if (!pk_results_fd_read_uint32 (reader, &len))
+		return FALSE;
+	if (len == PK_RESULTS_FD_NULL_STRING) {
+		*value = NULL;
+		return TRUE;
+	}
+	if (reader->size - reader->pos <= len ||
+	    reader->data[reader->pos + len] != '\0')
+		return FALSE;
+	*value = (const gchar *) reader->data + reader->pos;
+	reader->pos += len + 1;
+	return TRUE;
+}
+
+/**
+ * pk_results_fd_parse:
+ **/
+static gboolean
+pk_results_fd_parse (PkResults *results,
+		     PkResultsFdReader *reader,
+		     PkRoleEnum role,
+		     const gchar *transaction_id,
+		     GError **error)
+{
+	const gchar *package_id;
+	const gchar *summary;
+	const gchar *description;
+	const gchar *license;
+	const gchar *url;
+	guint32 version;
+	guint32 n_packages;
+	guint32 n_details;
+	guint32 n_files;
+	guint32 reserved;
+	guint32 info;
+	guint32 group;
+	guint32 count;
+	guint64 size;
+	guint i;
+	guint j;
+
+	if (reader->size < 4 ||
+	    memcmp (reader->data, PK_RESULTS_FD_MAGIC, 4) != 0) {
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+				     "invalid results header");
+		return FALSE;
+	}
+	reader->pos = 4;
+	if (!pk_results_fd_read_uint32 (reader, &version) ||
+	    version != PK_RESULTS_FD_VERSION) {
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+				     "unsupported results version");
+		return FALSE;
+	}
+	if (!pk_results_fd_read_uint32 (reader, &n_packages) ||
+	    !pk_results_fd_read_uint32 (reader, &n_details) ||
+	    !pk_results_fd_read_uint32 (reader, &n_files) ||
+	    !pk_results_fd_read_uint32 (reader, &reserved))
+		goto truncated;
+
+	for (i = 0; i < n_packages; i++) {
+		_cleanup_object_unref_ PkPackage *package = NULL;
+		if (!pk_results_fd_read_uint32 (reader, &info) ||
+		    !pk_results_fd_read_string (reader, &package_id) ||
+		    !pk_results_fd_read_string (reader, &summary) ||
+		    package_id == NULL)
+			goto truncated;
+		package = pk_package_new_from_data (info, package_id, summary, error);
+		if (package == NULL)
+			return FALSE;
+		g_object_set (package,
+			      "role", role,
+			      "transaction-id", transaction_id,
+			      NULL);
+		pk_results_add_package (results, package);
+	}
+	for (i = 0; i < n_details; i++) {
+		_cleanup_object_unref_ PkDetails *item = NULL;
+		if (!pk_results_fd_read_string (reader, &package_id) ||
+		    !pk_results_fd_read_string (reader, &summary) ||
+		    !pk_results_fd_read_string (reader, &description) ||
+		    !pk_results_fd_read_string (reader, &license) ||
+		    !pk_results_fd_read_string (reader, &url) ||
+		    !pk_results_fd_read_uint32 (reader, &group) ||
+		    !pk_results_fd_read_uint64 (reader, &size))
+			goto truncated;
+		item = pk_details_new ();
+		g_object_set (item,
+			      "package-id", package_id,
+			      "summary", summary,
+			      "description", description,
+			      "license", license,
+			      "url", url,
+			      "group", group,
+			      "size", size,
+			      "role", role,
+			      "transaction-id", transaction_id,
+			      NULL);
+		pk_results_add_details (results, item);
+	}
+	for (i = 0; i < n_files; i++) {
+		_cleanup_object_unref_ PkFiles *item = NULL;
+		_cleanup_free_ const gchar **files = NULL;
+		if (!pk_results_fd_read_string (reader, &package_id) ||
+		    !pk_results_fd_read_uint32 (reader, &count) ||
+		    count > (reader->size - reader->pos) / 5)
+			goto truncated;
+		files = g_new0 (const gchar *, count + 1);
+		for (j = 0; j < count; j++) {
+			if (!pk_results_fd_read_string (reader, &files[j]) ||
+			    files[j] == NULL)
+				goto truncated;
+		}
+		item = pk_files_new ();
+		g_object_set (item,
+			      "package-id", package_id,
+			      "files", files,
+			      "role", role,
+			      "transaction-id", transaction_id,
+			      NULL);
+		pk_results_add_files (results, item);
+	}
+	return TRUE;
+truncated:
+	g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+			     "truncated results");
+	return FALSE;
+}
+
+/**
+ * pk_results_fd_read:
+ * @results: a #PkResults
+ * @fd: the memfd written by pk_results_fd_write()
+ * @role: the role to set on the new items
+ * @transaction_id: the transaction ID to set on the new items
+ * @error: a #GError to put the error code in, or %NULL
+ *
+ * Maps the results in @fd and adds them to @results, the strings are
+ * copied straight from the mapping into the new objects. The caller
+ * keeps ownership of @fd.
+ *
+ * Return value: %TRUE for success
+ **/
+gboolean
+pk_results_fd_read (PkResults *results,
+		    gint fd,
+		    PkRoleEnum role,
+		    const gchar *transaction_id,
+		    GError **error)
+{
+#ifdef PK_RESULTS_FD_SEALS
+	gboolean ret;
+	gint seals;
+	gpointer map;
+	struct stat buf;
+	PkResultsFdReader reader;
+
+	/* the sender must not be able to change the data while we parse it */
+	seals = fcntl (fd, F_GET_SEALS);
+	if (seals < 0 || (seals & PK_RESULTS_FD_SEALS) != PK_RESULTS_FD_SEALS) {
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_PERMISSION_DENIED,
+				     "results fd is not sealed");
+		return FALSE;
+	}
+	if (fstat (fd, &buf) != 0) {
+		g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+			     "failed to stat results: %s", g_strerror (errno));
+		return FALSE;
+	}
+	if (buf.st_size == 0) {
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+				     "empty results");
+		return FALSE;
+	}
+	map = mmap (NULL, buf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED) {
+		g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+			     "failed to map results: %s", g_strerror (errno));
+		return FALSE;
+	}
+
+	reader.data = map;
+	reader.size = buf.st_size;
+	reader.pos = 0;
+	ret = pk_results_fd_parse (results, &reader, role, transaction_id, error);
+	munmap (map, buf.st_size);
+	return ret;
+#else
+	g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+			     "sealed memfds are not supported");
+	return FALSE;
+#endif
+}
@@ -30,6 +30,7 @@
 
 #include "pk-client.h"
 #include "pk-client-helper.h"
+#include "pk-client-sync.h"
 #include "pk-control.h"
 #include "pk-console-shared.h"
 #include "pk-offline.h"
@@ -725,6 +726,44 @@ pk_test_client_func (void)
 #endif
 }
 
+static void
+pk_test_client_resolve_latency_func (void)
+{
+	const guint loops = 20;
+	gdouble elapsed;
+	gdouble elapsed_min = G_MAXDOUBLE;
+	gdouble elapsed_total = 0.f;
+	guint i;
+	_cleanup_object_unref_ PkClient *client = NULL;
+	_cleanup_strv_free_ gchar **package_ids = NULL;
+
+	/* time the whole round trip, from creating the transaction to
+	 * having the results, as seen by a client doing a single query */
+	client = pk_client_new ();
+	package_ids = pk_package_ids_from_string ("glib2;2.14.0;i386;fedora&powertop");
+	for (i = 0; i < loops; i++) {
+		_cleanup_error_free_ GError *error = NULL;
+		_cleanup_object_unref_ PkResults *results = NULL;
+
+		g_test_timer_start ();
+		results = pk_client_resolve (client,
+					     pk_bitfield_value (PK_FILTER_ENUM_INSTALLED),
+					     package_ids, NULL, NULL, NULL, &error);
+		elapsed = g_test_timer_elapsed ();
+		g_assert_no_error (error);
+		g_assert (results != NULL);
+		g_assert_cmpint (pk_results_get_exit_code (results), ==, PK_EXIT_ENUM_SUCCESS);
+
+		/* the first one may have to start the daemon */
+		if (i == 0)
+			continue;
+		elapsed_total += elapsed;
+		elapsed_min = MIN (elapsed_min, elapsed);
+	}
+	g_debug ("resolve latency: %.2fms mean, %.2fms min",
+		 elapsed_total * 1000 / (loops - 1), elapsed_min * 1000);
+}
+
 static void
 pk_test_console_func (void)
 {
@@ -1442,6 +1481,7 @@ main (int argc, char **argv)
 	g_test_add_func ("/packagekit-glib2/transaction-list", pk_test_transaction_list_func);
 	g_test_add_func ("/packagekit-glib2/client-helper", pk_test_client_helper_func);
 	g_test_add_func ("/packagekit-glib2/client", pk_test_client_func);
+	g_test_add_func ("/packagekit-glib2/client-resolve-latency", pk_test_client_resolve_latency_func);
 	g_test_add_func ("/packagekit-glib2/package-sack", pk_test_package_sack_func);
 	g_test_add_func ("/packagekit-glib2/task", pk_test_task_func);
 	g_test_add_func ("/packagekit-glib2/task-wrapper", pk_test_task_wrapper_func);
@@ -22,6 +22,7 @@
 #include "config.h"
 
 #include <glib-object.h>
+#include <unistd.h>
 
 #include "src/pk-cleanup.h"
 
@@ -33,8 +34,11 @@
 #include "pk-package.h"
 #include "pk-package-id.h"
 #include "pk-package-ids.h"
+#include "pk-package-private.h"
+#include "pk-package-sack.h"
 #include "pk-progress-bar.h"
 #include "pk-results.h"
+#include "pk-results-private.h"
 
 static void
 pk_test_bitfield_func (void)
@@ -537,6 +541,96 @@ pk_test_results_func (void)
 	g_object_unref (results);
 }
 
+static void
+pk_test_results_fd_func (void)
+{
+	gboolean ret;
+	gdouble elapsed;
+	gint fd;
+	guint i;
+	PkPackage *item;
+	PkRoleEnum role;
+	GVariantBuilder builder;
+	_cleanup_error_free_ GError *error = NULL;
+	_cleanup_free_ gchar *transaction_id = NULL;
+	_cleanup_object_unref_ PkResults *results = NULL;
+	_cleanup_object_unref_ PkResults *results_copy = NULL;
+	_cleanup_ptrarray_unref_ GPtrArray *packages = NULL;
+	_cleanup_variant_unref_ GVariant *value = NULL;
+
+	if (!pk_results_fd_supported ()) {
+		g_debug ("sealed memfds not supported, skipping");
+		return;
+	}
+	g_assert (pk_results_fd_role_supported (PK_ROLE_ENUM_GET_PACKAGES));
+	g_assert (!pk_results_fd_role_supported (PK_ROLE_ENUM_INSTALL_PACKAGES));
+
+	/* about the size of a large repo */
+	results = pk_results_new ();
+	for (i = 0; i < 60000; i++) {
+		_cleanup_free_ gchar *package_id = NULL;
+		_cleanup_free_ gchar *summary = NULL;
+		item = pk_package_new ();
+		package_id = g_strdup_printf ("package%05u;1.2.3-4.fc22;x86_64;fedora", i);
+		summary = g_strdup_printf ("Summary of package %u", i);
+		g_object_set (item,
+			      "info", PK_INFO_ENUM_AVAILABLE,
+			      "summary", summary,
+			      NULL);
+		ret = pk_package_set_id (item, package_id, &error);
+		g_assert_no_error (error);
+		g_assert (ret);
+		pk_results_add_package (results, item);
+		g_object_unref (item);
+	}
+
+	/* round trip through a sealed memfd */
+	g_test_timer_start ();
+	fd = pk_results_fd_write (results, &error);
+	g_assert_no_error (error);
+	g_assert_cmpint (fd, >=, 0);
+	results_copy = pk_results_new ();
+	ret = pk_results_fd_read (results_copy, fd,
+				  PK_ROLE_ENUM_GET_PACKAGES,
+				  "/1_abcdef", &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	close (fd);
+	elapsed = g_test_timer_elapsed ();
+	g_debug ("memfd round trip of 60000 packages: %.1fms", elapsed * 1000);
+
+	packages = pk_results_get_package_array (results_copy);
+	g_assert_cmpint (packages->len, ==, 60000);
+	item = g_ptr_array_index (packages, 12345);
+	g_assert_cmpint (pk_package_get_info (item), ==, PK_INFO_ENUM_AVAILABLE);
+	g_assert_cmpstr (pk_package_get_id (item), ==, "package12345;1.2.3-4.fc22;x86_64;fedora");
+	g_assert_cmpstr (pk_package_get_summary (item), ==, "Summary of package 12345");
+	g_object_get (item,
+		      "role", &role,
+		      "transaction-id", &transaction_id,
+		      NULL);
+	g_assert_cmpint (role, ==, PK_ROLE_ENUM_GET_PACKAGES);
+	g_assert_cmpstr (transaction_id, ==, "/1_abcdef");
+	g_ptr_array_unref (packages);
+
+	/* compare with what the Packages signal has to marshal */
+	g_test_timer_start ();
+	packages = pk_results_get_package_array (results);
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(uss)"));
+	for (i = 0; i < packages->len; i++) {
+		item = g_ptr_array_index (packages, i);
+		g_variant_builder_add (&builder, "(uss)",
+				       pk_package_get_info (item),
+				       pk_package_get_id (item),
+				       pk_package_get_summary (item));
+	}
+	value = g_variant_ref_sink (g_variant_builder_end (&builder));
+	g_assert (g_variant_get_data (value) != NULL);
+	g_assert_cmpint (g_variant_n_children (value), ==, 60000);
+	elapsed = g_test_timer_elapsed ();
+	g_debug ("a(uss) serialization of 60000 packages: %.1fms", elapsed * 1000);
+}
+
 static void
 pk_test_package_func (void)
 {
@@ -600,6 +694,189 @@ pk_test_package_func (void)
 	g_object_unref (package);
 }
 
+/* in kB, or 0 if unknown */
+static guint
+pk_test_get_resident_size (void)
+{
+	guint64 pages;
+	_cleanup_free_ gchar *statm = NULL;
+	_cleanup_strv_free_ gchar **split = NULL;
+
+	if (!g_file_get_contents ("/proc/self/statm", &statm, NULL, NULL))
+		return 0;
+	split = g_strsplit (statm, " ", -1);
+	if (g_strv_length (split) < 2)
+		return 0;
+	pages = g_ascii_strtoull (split[1], NULL, 10);
+	return pages * sysconf (_SC_PAGESIZE) / 1024;
+}
+
+static void
+pk_test_package_new_func (void)
+{
+	gdouble elapsed;
+	guint i;
+	guint rss;
+	PkPackage *item;
+	_cleanup_error_free_ GError *error = NULL;
+	_cleanup_ptrarray_unref_ GPtrArray *array = NULL;
+
+	/* the sections are still all there */
+	item = pk_package_new_from_data (PK_INFO_ENUM_AVAILABLE,
+					 "gnome-power-manager;0.1.2;i386;fedora",
+					 "Power manager", &error);
+	g_assert_no_error (error);
+	g_assert (item != NULL);
+	g_assert_cmpstr (pk_package_get_id (item), ==, "gnome-power-manager;0.1.2;i386;fedora");
+	g_assert_cmpstr (pk_package_get_name (item), ==, "gnome-power-manager");
+	g_assert_cmpstr (pk_package_get_version (item), ==, "0.1.2");
+	g_assert_cmpstr (pk_package_get_arch (item), ==, "i386");
+	g_assert_cmpstr (pk_package_get_data (item), ==, "fedora");
+	g_assert_cmpstr (pk_package_get_summary (item), ==, "Power manager");
+	g_assert_cmpint (pk_package_get_info (item), ==, PK_INFO_ENUM_AVAILABLE);
+	g_assert (pk_package_set_id (item, "powertop;;;", &error));
+	g_assert_no_error (error);
+	g_assert_cmpstr (pk_package_get_version (item), ==, "");
+	g_assert_cmpstr (pk_package_get_data (item), ==, "");
+	g_object_unref (item);
+	item = pk_package_new_from_data (PK_INFO_ENUM_AVAILABLE, "powertop;0.1.3", NULL, &error);
+	g_assert_error (error, 1, 0);
+	g_assert (item == NULL);
+	g_clear_error (&error);
+
+	/* about the size of a large repo */
+	rss = pk_test_get_resident_size ();
+	g_test_timer_start ();
+	array = g_ptr_array_new_with_free_func (g_object_unref);
+	for (i = 0; i < 60000; i++) {
+		gchar package_id[64];
+		g_snprintf (package_id, sizeof (package_id),
+			    "package%05u;1.2.3-4.fc22;x86_64;fedora", i);
+		item = pk_package_new_from_data (PK_INFO_ENUM_AVAILABLE,
+						 package_id,
+						 "Summary of package",
+						 &error);
+		g_assert_no_error (error);
+		g_ptr_array_add (array, item);
+	}
+	elapsed = g_test_timer_elapsed ();
+	g_debug ("creating 60000 packages: %.1fms, %ikB",
+		 elapsed * 1000, (gint) (pk_test_get_resident_size () - rss));
+
+	/* the arches and repos are shared */
+	g_assert (pk_package_get_arch (g_ptr_array_index (array, 0)) ==
+		  pk_package_get_arch (g_ptr_array_index (array, 59999)));
+	g_assert (pk_package_get_data (g_ptr_array_index (array, 0)) ==
+		  pk_package_get_data (g_ptr_array_index (array, 59999)));
+	g_assert_cmpstr (pk_package_get_name (g_ptr_array_index (array, 12345)), ==, "package12345");
+}
+
+static gboolean
+pk_test_package_sack_installed_cb (PkPackage *package, gpointer user_data)
+{
+	return pk_package_get_info (package) == PK_INFO_ENUM_INSTALLED;
+}
+
+static void
+pk_test_package_sack_add (PkPackageSack *sack, guint start, guint end,
+			  const gchar *version, PkInfoEnum info)
+{
+	gboolean ret;
+	guint i;
+	_cleanup_error_free_ GError *error = NULL;
+
+	for (i = start; i < end; i++) {
+		_cleanup_free_ gchar *package_id = NULL;
+		_cleanup_object_unref_ PkPackage *item = NULL;
+		item = pk_package_new ();
+		package_id = g_strdup_printf ("package%05u;%s;x86_64;fedora", i, version);
+		ret = pk_package_set_id (item, package_id, &error);
+		g_assert_no_error (error);
+		g_assert (ret);
+		pk_package_set_info (item, info);
+		pk_package_sack_add_package (sack, item);
+	}
+}
+
+static void
+pk_test_package_sack_merge_func (void)
+{
+	gdouble elapsed;
+	guint i;
+	guint updates = 0;
+	PkPackage *item;
+	_cleanup_object_unref_ PkPackage *found = NULL;
+	_cleanup_object_unref_ PkPackageSack *available = NULL;
+	_cleanup_object_unref_ PkPackageSack *installed = NULL;
+	_cleanup_object_unref_ PkPackageSack *sack = NULL;
+	_cleanup_ptrarray_unref_ GPtrArray *array = NULL;
+
+	/* half of what is available is already installed */
+	installed = pk_package_sack_new ();
+	pk_test_package_sack_add (installed, 0, 50000, "1.0-1", PK_INFO_ENUM_INSTALLED);
+	available = pk_package_sack_new ();
+	pk_test_package_sack_add (available, 25000, 75000, "2.0-1", PK_INFO_ENUM_AVAILABLE);
+
+	/* merge like a client showing the updates would */
+	g_test_timer_start ();
+	array = pk_package_sack_get_array (available);
+	for (i = 0; i < array->len; i++) {
+		_cleanup_object_unref_ PkPackage *tmp = NULL;
+		item = g_ptr_array_index (array, i);
+		tmp = pk_package_sack_find_by_id_name_arch (installed, pk_package_get_id (item));
+		if (tmp != NULL) {
+			updates++;
+			continue;
+		}
+		pk_package_sack_add_package (installed, item);
+	}
+	for (i = 0; i < 1000; i++) {
+		_cleanup_object_unref_ PkPackageSack *tmp = NULL;
+		tmp = pk_package_sack_filter_by_info (installed, PK_INFO_ENUM_UNKNOWN);
+		g_assert_cmpint (pk_package_sack_get_size (tmp), ==, 0);
+	}
+	elapsed = g_test_timer_elapsed ();
+	g_debug ("merging two sacks of 50000 packages: %.1fms", elapsed * 1000);
+	g_assert_cmpint (updates, ==, 25000);
+	g_assert_cmpint (pk_package_sack_get_size (installed), ==, 75000);
+
+	/* the index follows the info of the packages */
+	sack = pk_package_sack_filter_by_info (installed, PK_INFO_ENUM_AVAILABLE);
+	g_assert_cmpint (pk_package_sack_get_size (sack), ==, 25000);
+	g_object_unref (sack);
+	item = g_ptr_array_index (array, array->len - 1);
+	pk_package_set_info (item, PK_INFO_ENUM_INSTALLED);
+	sack = pk_package_sack_filter_by_info (installed, PK_INFO_ENUM_AVAILABLE);
+	g_assert_cmpint (pk_package_sack_get_size (sack), ==, 24999);
+
+	/* remove what is not installed */
+	g_assert (pk_package_sack_remove_by_filter (installed, pk_test_package_sack_installed_cb, NULL));
+	g_assert_cmpint (pk_package_sack_get_size (installed), ==, 50001);
+	found = pk_package_sack_find_by_id_name_arch (installed, "package60000;;x86_64;");
+	g_assert (found == NULL);
+	found = pk_package_sack_find_by_id_name_arch (installed, "package74999;;x86_64;");
+	g_assert (found != NULL);
+	g_assert_cmpstr (pk_package_get_version (found), ==, "2.0-1");
+	g_assert (pk_package_sack_remove_package_by_id (installed, pk_package_get_id (found)));
+	g_clear_object (&found);
+	found = pk_package_sack_find_by_id_name_arch (installed, "package74999;;x86_64;");
+	g_assert (found == NULL);
+	g_assert_cmpint (pk_package_sack_get_size (installed), ==, 50000);
+
+	/* a package added twice is still watched when one is removed */
+	item = g_ptr_array_index (array, 0);
+	pk_package_sack_add_package (installed, item);
+	pk_package_sack_add_package (installed, item);
+	g_assert (pk_package_sack_remove_package (installed, item));
+	g_object_unref (sack);
+	sack = pk_package_sack_filter_by_info (installed, PK_INFO_ENUM_AVAILABLE);
+	g_assert_cmpint (pk_package_sack_get_size (sack), ==, 1);
+	pk_package_set_info (item, PK_INFO_ENUM_INSTALLED);
+	g_object_unref (sack);
+	sack = pk_package_sack_filter_by_info (installed, PK_INFO_ENUM_AVAILABLE);
+	g_assert_cmpint (pk_package_sack_get_size (sack), ==, 0);
+}
+
 static void
 pk_test_offline_func (void)
 {
@@ -828,7 +1105,10 @@ main (int argc, char **argv)
 	g_test_add_func ("/packagekit-glib2/package-ids", pk_test_package_ids_func);
 	g_test_add_func ("/packagekit-glib2/progress", pk_test_progress_func);
 	g_test_add_func ("/packagekit-glib2/results", pk_test_results_func);
+	g_test_add_func ("/packagekit-glib2/results-fd", pk_test_results_fd_func);
 	g_test_add_func ("/packagekit-glib2/package", pk_test_package_func);
+	g_test_add_func ("/packagekit-glib2/package-new", pk_test_package_new_func);
+	g_test_add_func ("/packagekit-glib2/package-sack-merge", pk_test_package_sack_merge_func);
 	g_test_add_func ("/packagekit-glib2/progress-bar", pk_test_progress_bar);
 	g_test_add_func ("/packagekit-glib2/offline", pk_test_offline_func);
 
@@ -25,6 +25,7 @@
 from __future__ import print_function
 
 import sys
+import struct
 import traceback
 import os.path
 
@@ -33,6 +34,16 @@ from .enums import *
 PACKAGE_IDS_DELIM = '&'
 FILENAME_DELIM = '|'
 
+# the command bytes of the framed output, in the order of src/pk-backend-spawn.c
+_FRAME_MARKER = b'\x1e'
+_FRAME_COMMANDS = ['package', 'details', 'finished', 'files', 'repo-detail',
+                   'updatedetail', 'percentage', 'item-progress', 'error',
+                   'requirerestart', 'status', 'speed',
+                   'download-size-remaining', 'allow-cancel',
+                   'no-percentage-updates', 'repo-signature-required',
+                   'eula-required', 'media-change-required', 'distro-upgrade',
+                   'category']
+
 def _to_unicode(txt, encoding='utf-8'):
     if isinstance(txt, str):
         if not isinstance(txt, str):
@@ -60,12 +71,19 @@ class PackageKitBaseBackend:
         installExceptionHandler(self)
         self.cmds = cmds
         self._locked = False
+        self.percentage_old = 0
+        self._read_environment()
+
+    def _read_environment(self):
+        '''
+        Get the settings of the transaction from the environment
+        '''
         self.lang = "C"
         self.has_network = False
         self.background = False
         self.interactive = False
         self.cache_age = 0
-        self.percentage_old = 0
+        self.framed = False
 
         # try to get LANG
         try:
@@ -100,6 +118,34 @@ class PackageKitBaseBackend:
         except KeyError as e:
             pass
 
+        # the daemon can read frames rather than lines
+        if os.environ.get('FRAMED_OUTPUT') == 'TRUE':
+            self.framed = True
+
+    def _write(self, line):
+        '''
+        Write a line of output, or the same fields as a frame
+        @param line: tab separated fields ending with a newline
+        '''
+        if not self.framed:
+            sys.stdout.write(line)
+            return
+        fields = line.rstrip('\n').split('\t')
+        try:
+            command = _FRAME_COMMANDS.index(fields[0]) + 1
+            fields = fields[1:]
+        except ValueError:
+            command = 0
+        payload = [struct.pack('=BB', command, len(fields))]
+        for field in fields:
+            if not isinstance(field, bytes):
+                field = field.encode('utf-8', 'replace')
+            payload.append(struct.pack('=I', len(field)) + field + b'\0')
+        payload = b''.join(payload)
+        sys.stdout.flush()
+        out = getattr(sys.stdout, 'buffer', sys.stdout)
+        out.write(_FRAME_MARKER + struct.pack('=I', len(payload)) + payload)
+
     def doLock(self):
         ''' Generic locking, overide and extend in child class'''
         self._locked = True
@@ -117,9 +163,9 @@ class PackageKitBaseBackend:
         @param percent: Progress percentage (int preferred)
         '''
         if percent == None:
-            sys.stdout.write(_to_utf8("no-percentage-updates\n"))
+            self._write(_to_utf8("no-percentage-updates\n"))
         elif percent == 0 or percent > self.percentage_old:
-            sys.stdout.write(_to_utf8("percentage\t%i\n" % percent))
+            self._write(_to_utf8("percentage\t%i\n" % percent))
             self.percentage_old = percent
         sys.stdout.flush()
 
@@ -128,7 +174,7 @@ class PackageKitBaseBackend:
         Write progress speed
         @param bps: Progress speed (int, bytes per second)
         '''
-        sys.stdout.write(_to_utf8("speed\t%i\n" % bps))
+        self._write(_to_utf8("speed\t%i\n" % bps))
         sys.stdout.flush()
 
     def item_progress(self, package_id, status, percent=None):
@@ -137,7 +183,7 @@ class PackageKitBaseBackend:
         @param package_id: The package ID name, e.g. openoffice-clipart;2.6.22;ppc64;fedora
         @param percent: percentage of the current item (int preferred)
         '''
-        sys.stdout.write(_to_utf8("item-progress\t%s\t%s\t%i\n" % (package_id, status, percent)))
+        self._write(_to_utf8("item-progress\t%s\t%s\t%i\n" % (package_id, status, percent)))
         sys.stdout.flush()
 
     def error(self, err, description, exit=True):
@@ -152,7 +198,7 @@ class PackageKitBaseBackend:
             self.unLock()
 
         # this should be fast now
-        sys.stdout.write(_to_utf8("error\t%s\t%s\n" % (err, description)))
+        self._write(_to_utf8("error\t%s\t%s\n" % (err, description)))
         sys.stdout.flush()
         if exit:
             # Paradoxically, we don't want to print "finished" to stdout here.
@@ -167,7 +213,7 @@ class PackageKitBaseBackend:
         send 'message' signal
         @param typ: MESSAGE_BROKEN_MIRROR
         '''
-        sys.stdout.write(_to_utf8("message\t%s\t%s\n" % (typ, msg)))
+        self._write(_to_utf8("message\t%s\t%s\n" % (typ, msg)))
         sys.stdout.flush()
 
     def package(self, package_id, status, summary):
@@ -177,7 +223,7 @@ class PackageKitBaseBackend:
         @param package_id: The package ID name, e.g. openoffice-clipart;2.6.22;ppc64;fedora
         @param summary: The package Summary
         '''
-        sys.stdout.write(_to_utf8("package\t%s\t%s\t%s\n" % (status, package_id, summary)))
+        self._write(_to_utf8("package\t%s\t%s\t%s\n" % (status, package_id, summary)))
         sys.stdout.flush()
 
     def media_change_required(self, mtype, id, text):
@@ -187,7 +233,7 @@ class PackageKitBaseBackend:
         @param id: the localised label of the media
         @param text: the localised text describing the media
         '''
-        sys.stdout.write(_to_utf8("media-change-required\t%s\t%s\t%s\n" % (mtype, id, text)))
+        self._write(_to_utf8("media-change-required\t%s\t%s\t%s\n" % (mtype, id, text)))
         sys.stdout.flush()
 
     def distro_upgrade(self, dtype, name, summary):
@@ -197,7 +243,7 @@ class PackageKitBaseBackend:
         @param name: The distro name, e.g. "fedora-9"
         @param summary: The localised distribution name and description
         '''
-        sys.stdout.write(_to_utf8("distro-upgrade\t%s\t%s\t%s\n" % (dtype, name, summary)))
+        self._write(_to_utf8("distro-upgrade\t%s\t%s\t%s\n" % (dtype, name, summary)))
         sys.stdout.flush()
 
     def status(self, state):
@@ -205,7 +251,7 @@ class PackageKitBaseBackend:
         send 'status' signal
         @param state: STATUS_DOWNLOAD, STATUS_INSTALL, STATUS_UPDATE, STATUS_REMOVE, STATUS_WAIT
         '''
-        sys.stdout.write(_to_utf8("status\t%s\n" % state))
+        self._write(_to_utf8("status\t%s\n" % state))
         sys.stdout.flush()
 
     def repo_detail(self, repoid, name, state):
@@ -214,7 +260,7 @@ class PackageKitBaseBackend:
         @param repoid: The repo id tag
         @param state: false is repo is disabled else true.
         '''
-        sys.stdout.write(_to_utf8("repo-detail\t%s\t%s\t%s\n" % (repoid, name, _bool_to_string(state))))
+        self._write(_to_utf8("repo-detail\t%s\t%s\t%s\n" % (repoid, name, _bool_to_string(state))))
         sys.stdout.flush()
 
     def data(self, data):
@@ -222,7 +268,7 @@ class PackageKitBaseBackend:
         send 'data' signal:
         @param data:  The current worked on package
         '''
-        sys.stdout.write(_to_utf8("data\t%s\n" % data))
+        self._write(_to_utf8("data\t%s\n" % data))
         sys.stdout.flush()
 
     def details(self, package_id, summary, package_license, group, desc, url, bytes):
@@ -235,7 +281,7 @@ class PackageKitBaseBackend:
         @param url: The upstream project homepage
         @param bytes: The size of the package, in bytes
         '''
-        sys.stdout.write(_to_utf8("details\t%s\t%s\t%s\t%s\t%s\t%s\t%ld\n" % (package_id, summary, package_license, group, desc, url, bytes)))
+        self._write(_to_utf8("details\t%s\t%s\t%s\t%s\t%s\t%s\t%ld\n" % (package_id, summary, package_license, group, desc, url, bytes)))
         sys.stdout.flush()
 
     def files(self, package_id, file_list):
@@ -243,7 +289,7 @@ class PackageKitBaseBackend:
         Send 'files' signal
         @param file_list: List of the files in the package, separated by ';'
         '''
-        sys.stdout.write(_to_utf8("files\t%s\t%s\n" % (package_id, file_list)))
+        self._write(_to_utf8("files\t%s\t%s\n" % (package_id, file_list)))
         sys.stdout.flush()
 
     def category(self, parent_id, cat_id, name, summary, icon):
@@ -255,14 +301,14 @@ class PackageKitBaseBackend:
         summery   : a summary of the category in current locale.
         icon      : an icon name to represent the category
         '''
-        sys.stdout.write(_to_utf8("category\t%s\t%s\t%s\t%s\t%s\n" % (parent_id, cat_id, name, summary, icon)))
+        self._write(_to_utf8("category\t%s\t%s\t%s\t%s\t%s\n" % (parent_id, cat_id, name, summary, icon)))
         sys.stdout.flush()
 
     def finished(self):
         '''
         Send 'finished' signal
         '''
-        sys.stdout.write(_to_utf8("finished\n"))
+        self._write(_to_utf8("finished\n"))
         sys.stdout.flush()
 
     def update_detail(self, package_id, updates, obsoletes, vendor_url, bugzilla_url, cve_url, restart, update_text, changelog, state, issued, updated):
@@ -281,7 +327,7 @@ class PackageKitBaseBackend:
         @param issued:
         @param updated:
         '''
-        sys.stdout.write(_to_utf8("updatedetail\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\n" % (package_id, updates, obsoletes, vendor_url, bugzilla_url, cve_url, restart, update_text, changelog, state, issued, updated)))
+        self._write(_to_utf8("updatedetail\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\n" % (package_id, updates, obsoletes, vendor_url, bugzilla_url, cve_url, restart, update_text, changelog, state, issued, updated)))
         sys.stdout.flush()
 
     def require_restart(self, restart_type, details):
@@ -290,7 +336,7 @@ class PackageKitBaseBackend:
         @param restart_type: RESTART_SYSTEM, RESTART_APPLICATION, RESTART_SESSION
         @param details: Optional details about the restart
         '''
-        sys.stdout.write(_to_utf8("requirerestart\t%s\t%s\n" % (restart_type, details)))
+        self._write(_to_utf8("requirerestart\t%s\t%s\n" % (restart_type, details)))
         sys.stdout.flush()
 
     def allow_cancel(self, allow):
@@ -302,7 +348,7 @@ class PackageKitBaseBackend:
             data = 'true'
         else:
             data = 'false'
-        sys.stdout.write(_to_utf8("allow-cancel\t%s\n" % data))
+        self._write(_to_utf8("allow-cancel\t%s\n" % data))
         sys.stdout.flush()
 
     def repo_signature_required(self, package_id, repo_name, key_url, key_userid, key_id, key_fingerprint, key_timestamp, sig_type):
@@ -317,7 +363,7 @@ class PackageKitBaseBackend:
         @param key_timestamp:   Key timestamp
         @param sig_type:        Key type (GPG)
         '''
-        sys.stdout.write(_to_utf8("repo-signature-required\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\n" % (
+        self._write(_to_utf8("repo-signature-required\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\n" % (
             package_id, repo_name, key_url, key_userid, key_id, key_fingerprint, key_timestamp, sig_type
             )))
         sys.stdout.flush()
@@ -330,7 +376,7 @@ class PackageKitBaseBackend:
         @param vendor_name:     Name of the vendor that wrote the EULA
         @param license_agreement: The license text
         '''
-        sys.stdout.write(_to_utf8("eula-required\t%s\t%s\t%s\t%s\n" % (
+        self._write(_to_utf8("eula-required\t%s\t%s\t%s\t%s\n" % (
             eula_id, package_id, vendor_name, license_agreement
             )))
         sys.stdout.flush()
@@ -695,7 +741,23 @@ class PackageKitBaseBackend:
             self.error(ERROR_INTERNAL_ERROR, errmsg, exit=False)
             self.finished()
 
+    def _set_environment(self, variables):
+        '''
+        Replace the environment by the one of the next transaction
+        @param variables: list of KEY=VALUE strings
+        '''
+        environ = dict(v.split('=', 1) for v in variables if '=' in v)
+        for key in list(os.environ.keys()):
+            if key not in environ:
+                del os.environ[key]
+        os.environ.update(environ)
+        self._read_environment()
+
     def dispatcher(self, args):
+        # so the daemon can send us the environment of the next
+        # transaction rather than start a new dispatcher for it
+        sys.stdout.write("dispatcher\tenvironment\n")
+        sys.stdout.flush()
         if len(args) > 0:
             self.dispatch_command(args[0], args[1:])
         while True:
@@ -708,6 +770,9 @@ class PackageKitBaseBackend:
             if not line or line == 'exit':
                 break
             args = line.split('\t')
+            if args[0] == 'environment':
+                self._set_environment(args[1:])
+                continue
             self.dispatch_command(args[0], args[1:])
 
         # unlock backend and exit with success
@@ -26,6 +26,7 @@
 #include <glib.h>
 #include <glib/gprintf.h>
 
+#include <packagekit-glib2/pk-package-private.h>
 #include <packagekit-glib2/pk-results.h>
 
 #include "pk-cleanup.h"
@@ -63,12 +64,28 @@
  */
 #define PK_BACKEND_CANCEL_ACTION_TIMEOUT	2000 /* ms */
 
+/**
+ * PK_BACKEND_PROGRESS_UPDATE_RATE:
+ *
+ * The default maximum number of times per second each kind of progress
+ * is sent to the transaction.
+ */
+#define PK_BACKEND_PROGRESS_UPDATE_RATE		20 /* Hz */
+
 typedef struct {
 	gboolean		 enabled;
 	PkBackendJobVFunc	 vfunc;
 	gpointer		 user_data;
 } PkBackendJobVFuncItem;
 
+/* only the latest value of a progress signal is sent, backends may set
+ * them from any thread at whatever rate their package manager uses */
+typedef struct {
+	gpointer		 object;	/* latest value not sent yet */
+	gint			 pending;	/* a dispatch is scheduled */
+	gint64			 last_sent;	/* main thread only */
+} PkBackendJobCoalesceItem;
+
 struct PkBackendJobPrivate
 {
 	gboolean		 finished;
@@ -98,6 +115,8 @@ struct PkBackendJobPrivate
 	GCancellable		*cancellable;
 	PkBackend		*backend;
 	PkBackendJobVFuncItem	 vfunc_items[PK_BACKEND_SIGNAL_LAST];
+	PkBackendJobCoalesceItem coalesce_items[PK_BACKEND_SIGNAL_LAST];
+	gint64			 coalesce_interval; /* us */
 	PkBitfield		 transaction_flags;
 	GKeyFile		*conf;
 	PkExitEnum		 exit;
@@ -106,6 +125,9 @@ struct PkBackendJobPrivate
 	gboolean		 interactive;
 	gboolean		 locked;
 	PkPackage		*last_package;
+	GPtrArray		*package_batch;
+	GMutex			 package_mutex;
+	GMutex			 item_progress_mutex;
 	PkErrorEnum		 last_error_code;
 	PkRoleEnum		 role;
 	PkStatusEnum		 status;
@@ -640,6 +662,8 @@ pk_backend_job_signal_to_string (PkBackendJobSignal id)
 		return "UpdateDetail";
 	if (id == PK_BACKEND_SIGNAL_CATEGORY)
 		return "Category";
+	if (id == PK_BACKEND_SIGNAL_PACKAGES)
+		return "Packages";
 	return NULL;
 }
 
@@ -655,6 +679,189 @@ pk_backend_job_vfunc_event_free (PkBackendJobVFuncHelper *helper)
 	g_free (helper);
 }
 
+/**
+ * pk_backend_job_coalesce_object_free:
+ **/
+static void
+pk_backend_job_coalesce_object_free (PkBackendJobSignal signal_kind, gpointer object)
+{
+	if (object == NULL)
+		return;
+	if (signal_kind == PK_BACKEND_SIGNAL_ITEM_PROGRESS)
+		g_ptr_array_unref (object);
+	else
+		g_free (object);
+}
+
+/**
+ * pk_backend_job_coalesce_swap:
+ *
+ * Atomically replaces the value in the slot of the signal kind.
+ *
+ * Return value: the previous value, owned by the caller
+ **/
+static gpointer
+pk_backend_job_coalesce_swap (PkBackendJob *job,
+			      PkBackendJobSignal signal_kind,
+			      gpointer object)
+{
+	PkBackendJobCoalesceItem *coalesce;
+	gpointer old;
+
+	coalesce = &job->priv->coalesce_items[signal_kind];
+	do {
+		old = g_atomic_pointer_get (&coalesce->object);
+	} while (!g_atomic_pointer_compare_and_exchange (&coalesce->object, old, object));
+	return old;
+}
+
+/**
+ * pk_backend_job_coalesce_send:
+ *
+ * Sends the latest value of the signal kind, if any.
+ **/
+static void
+pk_backend_job_coalesce_send (PkBackendJob *job, PkBackendJobSignal signal_kind)
+{
+	GPtrArray *array;
+	PkBackendJobCoalesceItem *coalesce;
+	PkBackendJobVFuncItem *item;
+	gpointer object;
+	guint i;
+
+	/* clear first so a value set from now on schedules a new dispatch */
+	coalesce = &job->priv->coalesce_items[signal_kind];
+	g_atomic_int_set (&coalesce->pending, FALSE);
+	object = pk_backend_job_coalesce_swap (job, signal_kind, NULL);
+	if (object == NULL)
+		return;
+	coalesce->last_sent = g_get_monotonic_time ();
+
+	item = &job->priv->vfunc_items[signal_kind];
+	if (item->enabled && item->vfunc != NULL) {
+		if (signal_kind == PK_BACKEND_SIGNAL_PERCENTAGE ||
+		    signal_kind == PK_BACKEND_SIGNAL_SPEED) {
+			item->vfunc (job, GUINT_TO_POINTER (*((guint *) object)), item->user_data);
+		} else if (signal_kind == PK_BACKEND_SIGNAL_ITEM_PROGRESS) {
+			/* the latest progress of each package, in order */
+			array = (GPtrArray *) object;
+			for (i = 0; i < array->len; i++)
+				item->vfunc (job, g_ptr_array_index (array, i), item->user_data);
+		} else {
+			item->vfunc (job, object, item->user_data);
+		}
+	}
+	pk_backend_job_coalesce_object_free (signal_kind, object);
+}
+
+/**
+ * pk_backend_job_coalesce_flush:
+ **/
+static void
+pk_backend_job_coalesce_flush (PkBackendJob *job)
+{
+	pk_backend_job_coalesce_send (job, PK_BACKEND_SIGNAL_PERCENTAGE);
+	pk_backend_job_coalesce_send (job, PK_BACKEND_SIGNAL_SPEED);
+	pk_backend_job_coalesce_send (job, PK_BACKEND_SIGNAL_DOWNLOAD_SIZE_REMAINING);
+	pk_backend_job_coalesce_send (job, PK_BACKEND_SIGNAL_ITEM_PROGRESS);
+}
+
+static void pk_backend_job_coalesce_schedule (PkBackendJob *job,
+					      PkBackendJobSignal signal_kind,
+					      guint delay);
+
+/**
+ * pk_backend_job_coalesce_cb:
+ **/
+static gboolean
+pk_backend_job_coalesce_cb (gpointer user_data)
+{
+	PkBackendJobVFuncHelper *helper = (PkBackendJobVFuncHelper *) user_data;
+	PkBackendJob *job = helper->job;
+	PkBackendJobCoalesceItem *coalesce;
+	gint64 next;
+	gint64 now;
+
+	/* sent too recently, so wait and send whatever is the latest then */
+	coalesce = &job->priv->coalesce_items[helper->signal_kind];
+	next = coalesce->last_sent + job->priv->coalesce_interval;
+	now = g_get_monotonic_time ();
+	if (coalesce->last_sent > 0 && now < next) {
+		pk_backend_job_coalesce_schedule (job,
+						  helper->signal_kind,
+						  (next - now + 999) / 1000);
+		return FALSE;
+	}
+	pk_backend_job_coalesce_send (job, helper->signal_kind);
+	return FALSE;
+}
+
+/**
+ * pk_backend_job_coalesce_schedule:
+ **/
+static void
+pk_backend_job_coalesce_schedule (PkBackendJob *job,
+				  PkBackendJobSignal signal_kind,
+				  guint delay)
+{
+	PkBackendJobVFuncHelper *helper;
+	_cleanup_source_unref_ GSource *source = NULL;
+
+	helper = g_new0 (PkBackendJobVFuncHelper, 1);
+	helper->job = g_object_ref (job);
+	helper->signal_kind = signal_kind;
+	if (delay > 0)
+		source = g_timeout_source_new (delay);
+	else
+		source = g_idle_source_new ();
+	g_source_set_priority (source, G_PRIORITY_DEFAULT_IDLE);
+	g_source_set_callback (source,
+			       pk_backend_job_coalesce_cb,
+			       helper,
+			       (GDestroyNotify) pk_backend_job_vfunc_event_free);
+	g_source_set_name (source, "[PkBackendJob] coalesce_cb");
+	g_source_attach (source, NULL);
+}
+
+/**
+ * pk_backend_job_call_vfunc_coalesced:
+ *
+ * Like pk_backend_job_call_vfunc(), but if the previous value was not
+ * sent yet it is replaced rather than sent as well, so at most one
+ * dispatch per signal kind is pending on the main loop.
+ *
+ * Return value: the replaced value not sent, owned by the caller
+ **/
+static gpointer
+pk_backend_job_call_vfunc_coalesced (PkBackendJob *job,
+				     PkBackendJobSignal signal_kind,
+				     gpointer object)
+{
+	PkBackendJobCoalesceItem *coalesce;
+	PkBackendJobVFuncItem *item;
+	gpointer old;
+
+	/* call transaction vfunc if not disabled and set */
+	item = &job->priv->vfunc_items[signal_kind];
+	if (!item->enabled || item->vfunc == NULL)
+		return object;
+
+	old = pk_backend_job_coalesce_swap (job, signal_kind, object);
+
+	/* already scheduled */
+	coalesce = &job->priv->coalesce_items[signal_kind];
+	if (!g_atomic_int_compare_and_exchange (&coalesce->pending, FALSE, TRUE))
+		return old;
+
+	/* packages emitted after this must not overtake it */
+	g_mutex_lock (&job->priv->package_mutex);
+	job->priv->package_batch = NULL;
+	g_mutex_unlock (&job->priv->package_mutex);
+
+	pk_backend_job_coalesce_schedule (job, signal_kind, 0);
+	return old;
+}
+
 /**
  * pk_backend_job_call_vfunc_idle_cb:
  **/
@@ -664,6 +871,10 @@ pk_backend_job_call_vfunc_idle_cb (gpointer user_data)
 	PkBackendJobVFuncHelper *helper = (PkBackendJobVFuncHelper *) user_data;
 	PkBackendJobVFuncItem *item;
 
+	/* the latest progress goes out before the transaction finishes */
+	if (helper->signal_kind == PK_BACKEND_SIGNAL_FINISHED)
+		pk_backend_job_coalesce_flush (helper->job);
+
 	/* call transaction vfunc on main thread */
 	item = &helper->job->priv->vfunc_items[helper->signal_kind];
 	if (item != NULL && item->vfunc != NULL) {
@@ -697,6 +908,11 @@ pk_backend_job_call_vfunc (PkBackendJob *job,
 	if (!item->enabled || item->vfunc == NULL)
 		return;
 
+	/* packages emitted after this must not overtake it */
+	g_mutex_lock (&job->priv->package_mutex);
+	job->priv->package_batch = NULL;
+	g_mutex_unlock (&job->priv->package_mutex);
+
 	/* order this last if others are still pending */
 	if (signal_kind == PK_BACKEND_SIGNAL_FINISHED)
 		priority = G_PRIORITY_LOW;
@@ -717,6 +933,81 @@ pk_backend_job_call_vfunc (PkBackendJob *job,
 	g_source_attach (source, NULL);
 }
 
+/**
+ * pk_backend_job_call_packages_idle_cb:
+ **/
+static gboolean
+pk_backend_job_call_packages_idle_cb (gpointer user_data)
+{
+	PkBackendJobVFuncHelper *helper = (PkBackendJobVFuncHelper *) user_data;
+	PkBackendJob *job = helper->job;
+	GPtrArray *array = (GPtrArray *) helper->object;
+	PkBackendJobVFuncItem *item;
+	guint i;
+
+	/* packages emitted from now on go into a new batch */
+	g_mutex_lock (&job->priv->package_mutex);
+	if (job->priv->package_batch == array)
+		job->priv->package_batch = NULL;
+	g_mutex_unlock (&job->priv->package_mutex);
+
+	/* prefer handling the whole batch at once */
+	item = &job->priv->vfunc_items[PK_BACKEND_SIGNAL_PACKAGES];
+	if (item->enabled && item->vfunc != NULL) {
+		item->vfunc (job, array, item->user_data);
+		return FALSE;
+	}
+	item = &job->priv->vfunc_items[PK_BACKEND_SIGNAL_PACKAGE];
+	if (!item->enabled || item->vfunc == NULL) {
+		g_warning ("tried to do signal %s when no longer connected",
+			   pk_backend_job_signal_to_string (PK_BACKEND_SIGNAL_PACKAGE));
+		return FALSE;
+	}
+	for (i = 0; i < array->len; i++)
+		item->vfunc (job, g_ptr_array_index (array, i), item->user_data);
+	return FALSE;
+}
+
+/**
+ * pk_backend_job_queue_package:
+ *
+ * This method can be called in any thread. Packages are collected until
+ * the main loop gets to run the idle handler of the batch, so thousands
+ * of packages only need one main loop iteration rather than one each.
+ **/
+static void
+pk_backend_job_queue_package (PkBackendJob *job, PkPackage *package)
+{
+	PkBackendJobVFuncHelper *helper;
+	_cleanup_source_unref_ GSource *source = NULL;
+
+	if (!job->priv->vfunc_items[PK_BACKEND_SIGNAL_PACKAGES].enabled &&
+	    !job->priv->vfunc_items[PK_BACKEND_SIGNAL_PACKAGE].enabled)
+		return;
+
+	g_mutex_lock (&job->priv->package_mutex);
+	if (job->priv->package_batch == NULL) {
+		job->priv->package_batch = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+
+		/* the idle source owns the batch */
+		helper = g_new0 (PkBackendJobVFuncHelper, 1);
+		helper->job = g_object_ref (job);
+		helper->signal_kind = PK_BACKEND_SIGNAL_PACKAGES;
+		helper->object = (GObject *) job->priv->package_batch;
+		helper->destroy_func = (GDestroyNotify) g_ptr_array_unref;
+		source = g_idle_source_new ();
+		g_source_set_priority (source, G_PRIORITY_DEFAULT_IDLE);
+		g_source_set_callback (source,
+				       pk_backend_job_call_packages_idle_cb,
+				       helper,
+				       (GDestroyNotify) pk_backend_job_vfunc_event_free);
+		g_source_set_name (source, "[PkBackendJob] packages_idle_cb");
+		g_source_attach (source, NULL);
+	}
+	g_ptr_array_add (job->priv->package_batch, g_object_ref (package));
+	g_mutex_unlock (&job->priv->package_mutex);
+}
+
 /**
  * pk_backend_job_set_vfunc:
  * @job: A valid PkBackendJob
@@ -883,6 +1174,7 @@ pk_backend_job_thread_create (PkBackendJob *job,
 void
 pk_backend_job_set_percentage (PkBackendJob *job, guint percentage)
 {
+	guint *tmp;
 	g_return_if_fail (PK_IS_BACKEND_JOB (job));
 
 	/* have we already set an error? */
@@ -912,10 +1204,11 @@ pk_backend_job_set_percentage (PkBackendJob *job, guint percentage)
 
 	/* save in case we need this from coldplug */
 	job->priv->percentage = percentage;
-	pk_backend_job_call_vfunc (job,
-				   PK_BACKEND_SIGNAL_PERCENTAGE,
-				   GUINT_TO_POINTER (percentage),
-				   NULL);
+	tmp = g_new (guint, 1);
+	*tmp = percentage;
+	g_free (pk_backend_job_call_vfunc_coalesced (job,
+						     PK_BACKEND_SIGNAL_PERCENTAGE,
+						     tmp));
 }
 
 /**
@@ -924,6 +1217,7 @@ pk_backend_job_set_percentage (PkBackendJob *job, guint percentage)
 void
 pk_backend_job_set_speed (PkBackendJob *job, guint speed)
 {
+	guint *tmp;
 	g_return_if_fail (PK_IS_BACKEND_JOB (job));
 
 	/* have we already set an error? */
@@ -938,10 +1232,11 @@ pk_backend_job_set_speed (PkBackendJob *job, guint speed)
 
 	/* set new value */
 	job->priv->speed = speed;
-	pk_backend_job_call_vfunc (job,
-				   PK_BACKEND_SIGNAL_SPEED,
-				   GUINT_TO_POINTER (speed),
-				   NULL);
+	tmp = g_new (guint, 1);
+	*tmp = speed;
+	g_free (pk_backend_job_call_vfunc_coalesced (job,
+						     PK_BACKEND_SIGNAL_SPEED,
+						     tmp));
 }
 
 /**
@@ -969,10 +1264,9 @@ pk_backend_job_set_download_size_remaining (PkBackendJob *job, guint64 download_
 	/* we can't squash a 64bit value into a pointer on a 32bit arch */
 	tmp = g_new0 (guint64, 1);
 	*tmp = download_size_remaining;
-	pk_backend_job_call_vfunc (job,
-				   PK_BACKEND_SIGNAL_DOWNLOAD_SIZE_REMAINING,
-				   tmp,
-				   g_free);
+	g_free (pk_backend_job_call_vfunc_coalesced (job,
+						     PK_BACKEND_SIGNAL_DOWNLOAD_SIZE_REMAINING,
+						     tmp));
 }
 
 /**
@@ -984,7 +1278,10 @@ pk_backend_job_set_item_progress (PkBackendJob *job,
 				  PkStatusEnum status,
 				  guint percentage)
 {
+	GPtrArray *array;
+	GPtrArray *old;
 	PkItemProgress *item;
+	PkItemProgress *last = NULL;
 	g_return_if_fail (PK_IS_BACKEND_JOB (job));
 
 	/* have we already set an error? */
@@ -1005,11 +1302,28 @@ pk_backend_job_set_item_progress (PkBackendJob *job,
 			     "status", status,
 			     "percentage", percentage,
 			     NULL);
-	pk_backend_job_call_vfunc (job,
-				   PK_BACKEND_SIGNAL_ITEM_PROGRESS,
-				   g_object_ref (item),
-				   g_object_unref);
-	g_object_unref (item);
+
+	/* only the progress of the same package is superseded, the ones of
+	 * other packages not sent yet go out first in the same dispatch */
+	g_mutex_lock (&job->priv->item_progress_mutex);
+	array = pk_backend_job_coalesce_swap (job, PK_BACKEND_SIGNAL_ITEM_PROGRESS, NULL);
+	if (array == NULL)
+		array = g_ptr_array_new_with_free_func (g_object_unref);
+	if (array->len > 0)
+		last = g_ptr_array_index (array, array->len - 1);
+	if (last != NULL &&
+	    g_strcmp0 (pk_item_progress_get_package_id (last), package_id) == 0) {
+		g_object_unref (last);
+		array->pdata[array->len - 1] = item;
+	} else {
+		g_ptr_array_add (array, item);
+	}
+	old = pk_backend_job_call_vfunc_coalesced (job,
+						   PK_BACKEND_SIGNAL_ITEM_PROGRESS,
+						   array);
+	g_mutex_unlock (&job->priv->item_progress_mutex);
+	if (old != NULL)
+		g_ptr_array_unref (old);
 }
 
 /**
@@ -1090,15 +1404,12 @@ pk_backend_job_package (PkBackendJob *job,
 	g_return_if_fail (package_id != NULL);
 
 	/* check we are valid */
-	item = pk_package_new ();
-	ret = pk_package_set_id (item, package_id, &error);
-	if (!ret) {
+	item = pk_package_new_from_data (info, package_id, summary, &error);
+	if (item == NULL) {
 		g_warning ("package_id %s invalid and cannot be processed: %s",
 			   package_id, error->message);
 		return;
 	}
-	pk_package_set_info (item, info);
-	pk_package_set_summary (item, summary);
 
 	/* is it the same? */
 	ret = (job->priv->last_package != NULL &&
@@ -1135,10 +1446,7 @@ pk_backend_job_package (PkBackendJob *job,
 	job->priv->has_sent_package = TRUE;
 
 	/* emit */
-	pk_backend_job_call_vfunc (job,
-				   PK_BACKEND_SIGNAL_PACKAGE,
-				   g_object_ref (item),
-				   g_object_unref);
+	pk_backend_job_queue_package (job, item);
 }
 
 /**
@@ -1821,6 +2129,7 @@ static void
 pk_backend_job_finalize (GObject *object)
 {
 	PkBackendJob *job;
+	guint i;
 
 	g_return_if_fail (object != NULL);
 	g_return_if_fail (PK_IS_BACKEND_JOB (object));
@@ -1848,6 +2157,11 @@ pk_backend_job_finalize (GObject *object)
 	if (job->priv->params != NULL)
 		g_variant_unref (job->priv->params);
 	g_timer_destroy (job->priv->timer);
+	g_mutex_clear (&job->priv->package_mutex);
+	g_mutex_clear (&job->priv->item_progress_mutex);
+	for (i = 0; i < PK_BACKEND_SIGNAL_LAST; i++) {
+		pk_backend_job_coalesce_object_free (i, job->priv->coalesce_items[i].object);
+	}
 	g_key_file_unref (job->priv->conf);
 	g_object_unref (job->priv->cancellable);
 
@@ -1873,6 +2187,8 @@ pk_backend_job_init (PkBackendJob *job)
 {
 	job->priv = PK_BACKEND_JOB_GET_PRIVATE (job);
 	job->priv->timer = g_timer_new ();
+	g_mutex_init (&job->priv->package_mutex);
+	g_mutex_init (&job->priv->item_progress_mutex);
 	job->priv->cancellable = g_cancellable_new ();
 	job->priv->last_error_code = PK_ERROR_ENUM_UNKNOWN;
 	job->priv->locale = g_strdup ("C");
@@ -1892,8 +2208,13 @@ PkBackendJob *
 pk_backend_job_new (GKeyFile *conf)
 {
 	PkBackendJob *job;
+	gint rate;
 	job = g_object_new (PK_TYPE_BACKEND_JOB, NULL);
 	job->priv->conf = g_key_file_ref (conf);
+	rate = g_key_file_get_integer (conf, "Daemon", "ProgressUpdateRate", NULL);
+	if (rate <= 0)
+		rate = PK_BACKEND_PROGRESS_UPDATE_RATE;
+	job->priv->coalesce_interval = G_USEC_PER_SEC / rate;
 	return PK_BACKEND_JOB (job);
 }
 
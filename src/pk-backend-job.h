@@ -60,6 +60,7 @@ typedef enum {
 	PK_BACKEND_SIGNAL_LOCKED_CHANGED,
 	PK_BACKEND_SIGNAL_UPDATE_DETAIL,
 	PK_BACKEND_SIGNAL_CATEGORY,
+	PK_BACKEND_SIGNAL_PACKAGES,
 	PK_BACKEND_SIGNAL_LAST
 } PkBackendJobSignal;
 
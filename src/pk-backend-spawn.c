@@ -54,14 +54,85 @@
 #define PK_BACKEND_SPAWN_PERCENTAGE_INVALID	101
 
 #define	PK_UNSAFE_DELIMITERS	"\\\f\r\t"
+#define PK_BACKEND_SPAWN_FRAME_FIELDS_MAX	16
+#define PK_BACKEND_SPAWN_POOL_SIZE_DEFAULT	1
+#define PK_BACKEND_SPAWN_IDLE_TIMEOUT_DEFAULT	5 /* s */
+
+#ifdef ENABLE_STRACE
+ #define PK_BACKEND_SPAWN_ARGV0		4
+#else
+ #define PK_BACKEND_SPAWN_ARGV0		0
+#endif
+
+/* these are the command bytes of the framed output, only ever append */
+typedef enum {
+	PK_BACKEND_SPAWN_COMMAND_UNKNOWN,
+	PK_BACKEND_SPAWN_COMMAND_PACKAGE,
+	PK_BACKEND_SPAWN_COMMAND_DETAILS,
+	PK_BACKEND_SPAWN_COMMAND_FINISHED,
+	PK_BACKEND_SPAWN_COMMAND_FILES,
+	PK_BACKEND_SPAWN_COMMAND_REPO_DETAIL,
+	PK_BACKEND_SPAWN_COMMAND_UPDATEDETAIL,
+	PK_BACKEND_SPAWN_COMMAND_PERCENTAGE,
+	PK_BACKEND_SPAWN_COMMAND_ITEM_PROGRESS,
+	PK_BACKEND_SPAWN_COMMAND_ERROR,
+	PK_BACKEND_SPAWN_COMMAND_REQUIRERESTART,
+	PK_BACKEND_SPAWN_COMMAND_STATUS,
+	PK_BACKEND_SPAWN_COMMAND_SPEED,
+	PK_BACKEND_SPAWN_COMMAND_DOWNLOAD_SIZE_REMAINING,
+	PK_BACKEND_SPAWN_COMMAND_ALLOW_CANCEL,
+	PK_BACKEND_SPAWN_COMMAND_NO_PERCENTAGE_UPDATES,
+	PK_BACKEND_SPAWN_COMMAND_REPO_SIGNATURE_REQUIRED,
+	PK_BACKEND_SPAWN_COMMAND_EULA_REQUIRED,
+	PK_BACKEND_SPAWN_COMMAND_MEDIA_CHANGE_REQUIRED,
+	PK_BACKEND_SPAWN_COMMAND_DISTRO_UPGRADE,
+	PK_BACKEND_SPAWN_COMMAND_CATEGORY,
+	PK_BACKEND_SPAWN_COMMAND_LAST
+} PkBackendSpawnCommand;
+
+static const gchar *pk_backend_spawn_commands[] = {
+	NULL,
+	"package",
+	"details",
+	"finished",
+	"files",
+	"repo-detail",
+	"updatedetail",
+	"percentage",
+	"item-progress",
+	"error",
+	"requirerestart",
+	"status",
+	"speed",
+	"download-size-remaining",
+	"allow-cancel",
+	"no-percentage-updates",
+	"repo-signature-required",
+	"eula-required",
+	"media-change-required",
+	"distro-upgrade",
+	"category",
+	NULL };
+
+/* a helper process kept started in the pool */
+typedef struct {
+	PkSpawn			*spawn;
+	guint			 kill_id;
+	gint64			 last_used;
+} PkBackendSpawnHelper;
 
 struct PkBackendSpawnPrivate
 {
-	PkSpawn			*spawn;
+	PkSpawn			*spawn;		/* the one running the job */
+	GPtrArray		*pool;		/* of PkBackendSpawnHelper */
+	guint			 pool_size;
+	guint			 idle_timeout;
+	gchar			**helper_argv;	/* to start more of the last helper */
+	gchar			**helper_envp;
+	PkSpawnArgvFlags	 helper_flags;
 	PkBackend		*backend;
 	PkBackendJob		*job;
 	gchar			*name;
-	guint			 kill_id;
 	GKeyFile		*conf;
 	gboolean		 finished;
 	gboolean		 allow_sigkill;
@@ -72,6 +143,8 @@ struct PkBackendSpawnPrivate
 
 G_DEFINE_TYPE (PkBackendSpawn, pk_backend_spawn, G_TYPE_OBJECT)
 
+static void pk_backend_spawn_prefork (PkBackendSpawn *backend_spawn);
+
 /**
  * pk_backend_spawn_set_filter_stdout:
  **/
@@ -98,58 +171,111 @@ pk_backend_spawn_set_filter_stderr (PkBackendSpawn *backend_spawn, PkBackendSpaw
  * pk_backend_spawn_exit_timeout_cb:
  **/
 static gboolean
-pk_backend_spawn_exit_timeout_cb (PkBackendSpawn *backend_spawn)
+pk_backend_spawn_exit_timeout_cb (PkBackendSpawnHelper *helper)
 {
-	g_return_val_if_fail (PK_IS_BACKEND_SPAWN (backend_spawn), FALSE);
-
 	/* only try to close if running */
-	if (pk_spawn_is_running (backend_spawn->priv->spawn)) {
+	if (pk_spawn_is_running (helper->spawn)) {
 		g_debug ("closing dispatcher as running and is idle");
-		pk_spawn_exit (backend_spawn->priv->spawn);
+		pk_spawn_exit (helper->spawn);
 	}
-	backend_spawn->priv->kill_id = 0;
+	helper->kill_id = 0;
 	return FALSE;
 }
 
+/**
+ * pk_backend_spawn_helper_start_kill_timer:
+ **/
+static void
+pk_backend_spawn_helper_start_kill_timer (PkBackendSpawn *backend_spawn,
+					  PkBackendSpawnHelper *helper)
+{
+	if (helper->kill_id > 0)
+		g_source_remove (helper->kill_id);
+
+	/* close down the dispatcher if it is still open after this much time */
+	helper->kill_id = g_timeout_add_seconds (backend_spawn->priv->idle_timeout,
+						 (GSourceFunc) pk_backend_spawn_exit_timeout_cb,
+						 helper);
+	g_source_set_name_by_id (helper->kill_id, "[PkBackendSpawn] exit");
+}
+
+/**
+ * pk_backend_spawn_helper_stop_kill_timer:
+ **/
+static void
+pk_backend_spawn_helper_stop_kill_timer (PkBackendSpawnHelper *helper)
+{
+	if (helper->kill_id == 0)
+		return;
+	g_source_remove (helper->kill_id);
+	helper->kill_id = 0;
+}
+
+/**
+ * pk_backend_spawn_find_helper:
+ **/
+static PkBackendSpawnHelper *
+pk_backend_spawn_find_helper (PkBackendSpawn *backend_spawn, PkSpawn *spawn)
+{
+	PkBackendSpawnHelper *helper;
+	guint i;
+
+	for (i = 0; i < backend_spawn->priv->pool->len; i++) {
+		helper = g_ptr_array_index (backend_spawn->priv->pool, i);
+		if (helper->spawn == spawn)
+			return helper;
+	}
+	return NULL;
+}
+
 /**
  * pk_backend_spawn_start_kill_timer:
  **/
 static void
 pk_backend_spawn_start_kill_timer (PkBackendSpawn *backend_spawn)
 {
-	gint timeout;
+	PkBackendSpawnHelper *helper;
 	PkBackendSpawnPrivate *priv = backend_spawn->priv;
 
 	/* we finished okay, so we don't need to emulate Finished() for a crashing script */
 	priv->finished = TRUE;
 	g_debug ("backend marked as finished, so starting kill timer");
 
-	if (priv->kill_id > 0)
-		g_source_remove (priv->kill_id);
+	helper = pk_backend_spawn_find_helper (backend_spawn, priv->spawn);
+	if (helper != NULL)
+		pk_backend_spawn_helper_start_kill_timer (backend_spawn, helper);
 
-	/* get policy timeout */
-	timeout = g_key_file_get_integer (priv->conf, "Daemon", "BackendShutdownTimeout", NULL);
-	if (timeout == 0) {
-		g_warning ("using built in default value");
-		timeout = 5;
-	}
+	/* replace the helpers that exited or were killed */
+	pk_backend_spawn_prefork (backend_spawn);
+}
 
-	/* close down the dispatcher if it is still open after this much time */
-	priv->kill_id = g_timeout_add_seconds (timeout, (GSourceFunc) pk_backend_spawn_exit_timeout_cb, backend_spawn);
-	g_source_set_name_by_id (priv->kill_id, "[PkBackendSpawn] exit");
+/**
+ * pk_backend_spawn_command_from_string:
+ **/
+static PkBackendSpawnCommand
+pk_backend_spawn_command_from_string (const gchar *command)
+{
+	guint i;
+	for (i = 1; i < PK_BACKEND_SPAWN_COMMAND_LAST; i++) {
+		if (g_strcmp0 (command, pk_backend_spawn_commands[i]) == 0)
+			return i;
+	}
+	return PK_BACKEND_SPAWN_COMMAND_UNKNOWN;
 }
 
 /**
- * pk_backend_spawn_parse_stdout:
+ * pk_backend_spawn_dispatch:
+ * @sections: the command name followed by its fields, which may be changed
  **/
 static gboolean
-pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
-			       PkBackendJob *job,
-			       const gchar *line,
-			       GError **error)
+pk_backend_spawn_dispatch (PkBackendSpawn *backend_spawn,
+			   PkBackendJob *job,
+			   PkBackendSpawnCommand command_enum,
+			   gchar **sections,
+			   guint size,
+			   GError **error)
 {
-	guint size;
-	gchar *command;
+	const gchar *command = sections[0];
 	gchar *text;
 	guint64 speed;
 	guint64 download_size_remaining;
@@ -166,22 +292,8 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 	PkMediaTypeEnum media_type_enum;
 	PkDistroUpgradeEnum distro_upgrade_enum;
 	PkBackendSpawnPrivate *priv = backend_spawn->priv;
-	_cleanup_strv_free_ gchar **sections = NULL;
-
-	g_return_val_if_fail (PK_IS_BACKEND_SPAWN (backend_spawn), FALSE);
-
-	/* check if output line */
-	if (line == NULL)
-		return FALSE;
-
-	/* split by tab */
-	sections = g_strsplit (line, "\t", 0);
-	command = sections[0];
 
-	/* get size */
-	size = g_strv_length (sections);
-
-	if (g_strcmp0 (command, "package") == 0) {
+	if (command_enum == PK_BACKEND_SPAWN_COMMAND_PACKAGE) {
 		if (size != 4) {
 			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
 			return FALSE;
@@ -203,7 +315,7 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 			return FALSE;
 		}
 		pk_backend_job_package (job, info, sections[2], sections[3]);
-	} else if (g_strcmp0 (command, "details") == 0) {
+	} else if (command_enum == PK_BACKEND_SPAWN_COMMAND_DETAILS) {
 		if (size != 7 && size != 8) {
 			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
 			return FALSE;
@@ -229,7 +341,7 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 		pk_backend_job_details (job, sections[1], size == 8 ? sections[7] : NULL, sections[2],
 					group, text, sections[5], package_size);
 		g_free (text);
-	} else if (g_strcmp0 (command, "finished") == 0) {
+	} else if (command_enum == PK_BACKEND_SPAWN_COMMAND_FINISHED) {
 		if (size != 1) {
 			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
 			return FALSE;
@@ -240,7 +352,7 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 		/* from this point on, we can start the kill timer */
 		pk_backend_spawn_start_kill_timer (backend_spawn);
 
-	} else if (g_strcmp0 (command, "files") == 0) {
+	} else if (command_enum == PK_BACKEND_SPAWN_COMMAND_FILES) {
 		_cleanup_strv_free_ gchar **tmp = NULL;
 		if (size != 3) {
 			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
@@ -248,7 +360,7 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 		}
 		tmp = g_strsplit (sections[2], ";", -1);
 		pk_backend_job_files (job, sections[1], tmp);
-	} else if (g_strcmp0 (command, "repo-detail") == 0) {
+	} else if (command_enum == PK_BACKEND_SPAWN_COMMAND_REPO_DETAIL) {
 		if (size != 4) {
 			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
 			return FALSE;
@@ -268,7 +380,7 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 			g_set_error (error, 1, 0, "invalid qualifier '%s'", sections[3]);
 			return FALSE;
 		}
-	} else if (g_strcmp0 (command, "updatedetail") == 0) {
+	} else if (command_enum == PK_BACKEND_SPAWN_COMMAND_UPDATEDETAIL) {
 		_cleanup_strv_free_ gchar **updates = NULL;
 		_cleanup_strv_free_ gchar **obsoletes = NULL;
 		_cleanup_strv_free_ gchar **vendor_urls = NULL;
@@ -312,7 +424,7 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 					  update_state_enum,
 					  sections[11],
 					  sections[12]);
-	} else if (g_strcmp0 (command, "percentage") == 0) {
+	} else if (command_enum == PK_BACKEND_SPAWN_COMMAND_PERCENTAGE) {
 		if (size != 2) {
 			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
 			return FALSE;
@@ -326,7 +438,7 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 		} else {
 			pk_backend_job_set_percentage (job, percentage);
 		}
-	} else if (g_strcmp0 (command, "item-progress") == 0) {
+	} else if (command_enum == PK_BACKEND_SPAWN_COMMAND_ITEM_PROGRESS) {
 		if (size != 4) {
 			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
 			return FALSE;
@@ -352,7 +464,7 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 						  sections[1],
 						  status_enum,
 						  percentage);
-	} else if (g_strcmp0 (command, "error") == 0) {
+	} else if (command_enum == PK_BACKEND_SPAWN_COMMAND_ERROR) {
 		if (size != 3) {
 			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
 			return FALSE;
@@ -373,7 +485,7 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 
 		pk_backend_job_error_code (job, error_enum, "%s", text);
 		g_free (text);
-	} else if (g_strcmp0 (command, "requirerestart") == 0) {
+	} else if (command_enum == PK_BACKEND_SPAWN_COMMAND_REQUIRERESTART) {
 		if (size != 3) {
 			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
 			return FALSE;
@@ -388,7 +500,7 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 			return FALSE;
 		}
 		pk_backend_job_require_restart (job, restart_enum, sections[2]);
-	} else if (g_strcmp0 (command, "status") == 0) {
+	} else if (command_enum == PK_BACKEND_SPAWN_COMMAND_STATUS) {
 		if (size != 2) {
 			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
 			return FALSE;
@@ -399,7 +511,7 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 			return FALSE;
 		}
 		pk_backend_job_set_status (job, status_enum);
-	} else if (g_strcmp0 (command, "speed") == 0) {
+	} else if (command_enum == PK_BACKEND_SPAWN_COMMAND_SPEED) {
 		if (size != 2) {
 			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
 			return FALSE;
@@ -411,7 +523,7 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 			return FALSE;
 		}
 		pk_backend_job_set_speed (job, speed);
-	} else if (g_strcmp0 (command, "download-size-remaining") == 0) {
+	} else if (command_enum == PK_BACKEND_SPAWN_COMMAND_DOWNLOAD_SIZE_REMAINING) {
 		if (size != 2) {
 			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
 			return FALSE;
@@ -423,7 +535,7 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 			return FALSE;
 		}
 		pk_backend_job_set_download_size_remaining (job, download_size_remaining);
-	} else if (g_strcmp0 (command, "allow-cancel") == 0) {
+	} else if (command_enum == PK_BACKEND_SPAWN_COMMAND_ALLOW_CANCEL) {
 		if (size != 2) {
 			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
 			return FALSE;
@@ -436,13 +548,13 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 			g_set_error (error, 1, 0, "invalid section '%s'", sections[1]);
 			return FALSE;
 		}
-	} else if (g_strcmp0 (command, "no-percentage-updates") == 0) {
+	} else if (command_enum == PK_BACKEND_SPAWN_COMMAND_NO_PERCENTAGE_UPDATES) {
 		if (size != 1) {
 			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
 			return FALSE;
 		}
 		pk_backend_job_set_percentage (job, PK_BACKEND_PERCENTAGE_INVALID);
-	} else if (g_strcmp0 (command, "repo-signature-required") == 0) {
+	} else if (command_enum == PK_BACKEND_SPAWN_COMMAND_REPO_SIGNATURE_REQUIRED) {
 
 		if (size != 9) {
 			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
@@ -467,7 +579,7 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 		pk_backend_job_repo_signature_required (job, sections[1],
 							  sections[2], sections[3], sections[4],
 							  sections[5], sections[6], sections[7], sig_type);
-	} else if (g_strcmp0 (command, "eula-required") == 0) {
+	} else if (command_enum == PK_BACKEND_SPAWN_COMMAND_EULA_REQUIRED) {
 
 		if (size != 5) {
 			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
@@ -490,7 +602,7 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 		}
 
 		pk_backend_job_eula_required (job, sections[1], sections[2], sections[3], sections[4]);
-	} else if (g_strcmp0 (command, "media-change-required") == 0) {
+	} else if (command_enum == PK_BACKEND_SPAWN_COMMAND_MEDIA_CHANGE_REQUIRED) {
 
 		if (size != 4) {
 			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
@@ -504,7 +616,7 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 		}
 
 		pk_backend_job_media_change_required (job, media_type_enum, sections[2], sections[3]);
-	} else if (g_strcmp0 (command, "distro-upgrade") == 0) {
+	} else if (command_enum == PK_BACKEND_SPAWN_COMMAND_DISTRO_UPGRADE) {
 
 		if (size != 4) {
 			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
@@ -525,7 +637,7 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 		}
 
 		pk_backend_job_distro_upgrade (job, distro_upgrade_enum, sections[2], sections[3]);
-	} else if (g_strcmp0 (command, "category") == 0) {
+	} else if (command_enum == PK_BACKEND_SPAWN_COMMAND_CATEGORY) {
 
 		if (size != 6) {
 			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
@@ -566,6 +678,103 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 	return TRUE;
 }
 
+/**
+ * pk_backend_spawn_parse_stdout:
+ **/
+static gboolean
+pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
+			       PkBackendJob *job,
+			       const gchar *line,
+			       GError **error)
+{
+	_cleanup_strv_free_ gchar **sections = NULL;
+
+	g_return_val_if_fail (PK_IS_BACKEND_SPAWN (backend_spawn), FALSE);
+
+	/* check if output line */
+	if (line == NULL)
+		return FALSE;
+
+	/* split by tab */
+	sections = g_strsplit (line, "\t", 0);
+	return pk_backend_spawn_dispatch (backend_spawn, job,
+					  pk_backend_spawn_command_from_string (sections[0]),
+					  sections,
+					  g_strv_length (sections),
+					  error);
+}
+
+/**
+ * pk_backend_spawn_parse_frame:
+ *
+ * A frame is the command as a byte, the number of fields as a byte, then
+ * each field as its length as a 32 bit integer in host order, followed
+ * by the text and a NUL byte. The fields are the same as in the lines.
+ * Commands the daemon does not know are sent as zero with their name as
+ * the first field.
+ **/
+static gboolean
+pk_backend_spawn_parse_frame (PkBackendSpawn *backend_spawn,
+			      PkBackendJob *job,
+			      guint8 *data,
+			      guint length,
+			      GError **error)
+{
+	gchar *sections[PK_BACKEND_SPAWN_FRAME_FIELDS_MAX + 2];
+	guint8 command_enum;
+	guint8 n_fields;
+	guint32 field_length;
+	guint offset = 2;
+	guint size = 0;
+	guint i;
+
+	if (length < 2) {
+		g_set_error (error, 1, 0, "invalid frame of %u bytes", length);
+		return FALSE;
+	}
+	command_enum = data[0];
+	n_fields = data[1];
+	if (command_enum >= PK_BACKEND_SPAWN_COMMAND_LAST ||
+	    n_fields > PK_BACKEND_SPAWN_FRAME_FIELDS_MAX) {
+		g_set_error (error, 1, 0, "invalid frame command %u with %u fields",
+			     command_enum, n_fields);
+		return FALSE;
+	}
+
+	/* the name of unknown commands is in the frame */
+	if (command_enum != PK_BACKEND_SPAWN_COMMAND_UNKNOWN)
+		sections[size++] = (gchar *) pk_backend_spawn_commands[command_enum];
+
+	/* the fields are used in place */
+	for (i = 0; i < n_fields; i++) {
+		if (length - offset < sizeof (field_length)) {
+			g_set_error_literal (error, 1, 0, "truncated frame");
+			return FALSE;
+		}
+		memcpy (&field_length, data + offset, sizeof (field_length));
+		offset += sizeof (field_length);
+		if (length - offset <= field_length ||
+		    data[offset + field_length] != '\0') {
+			g_set_error_literal (error, 1, 0, "truncated frame");
+			return FALSE;
+		}
+		sections[size++] = (gchar *) data + offset;
+		offset += field_length + 1;
+	}
+	if (size == 0) {
+		g_set_error_literal (error, 1, 0, "frame without command");
+		return FALSE;
+	}
+	sections[size] = NULL;
+
+	/* a helper newer than the daemon may name a command we know */
+	if (command_enum == PK_BACKEND_SPAWN_COMMAND_UNKNOWN)
+		command_enum = pk_backend_spawn_command_from_string (sections[0]);
+
+	return pk_backend_spawn_dispatch (backend_spawn, job, command_enum,
+					  sections, size, error);
+}
+
 /**
  * pk_backend_spawn_exit_cb:
  **/
@@ -575,6 +784,12 @@ pk_backend_spawn_exit_cb (PkSpawn *spawn, PkSpawnExitType exit_enum, PkBackendSp
 	gboolean ret;
 	g_return_if_fail (PK_IS_BACKEND_SPAWN (backend_spawn));
 
+	/* an idle helper of the pool */
+	if (spawn != backend_spawn->priv->spawn) {
+		g_debug ("idle helper exited");
+		return;
+	}
+
 	/* reset the busy flag */
 	backend_spawn->priv->is_busy = FALSE;
 
@@ -625,14 +840,52 @@ pk_backend_spawn_inject_data (PkBackendSpawn *backend_spawn,
 	return pk_backend_spawn_parse_stdout (backend_spawn, job, line, error);
 }
 
+/**
+ * pk_backend_spawn_inject_frame:
+ **/
+gboolean
+pk_backend_spawn_inject_frame (PkBackendSpawn *backend_spawn,
+			       PkBackendJob *job,
+			       guint8 *data,
+			       guint length,
+			       GError **error)
+{
+	g_return_val_if_fail (PK_IS_BACKEND_SPAWN (backend_spawn), FALSE);
+	return pk_backend_spawn_parse_frame (backend_spawn, job, data, length, error);
+}
+
+/**
+ * pk_backend_spawn_stdout_frame_cb:
+ **/
+static void
+pk_backend_spawn_stdout_frame_cb (PkSpawn *spawn,
+				  guint8 *data,
+				  guint length,
+				  PkBackendSpawn *backend_spawn)
+{
+	_cleanup_error_free_ GError *error = NULL;
+	if (spawn != backend_spawn->priv->spawn) {
+		g_debug ("ignoring frame of idle helper");
+		return;
+	}
+	if (!pk_backend_spawn_parse_frame (backend_spawn,
+					   backend_spawn->priv->job,
+					   data, length, &error))
+		g_warning ("failed to parse frame: %s", error->message);
+}
+
 /**
  * pk_backend_spawn_stdout_cb:
  **/
 static void
-pk_backend_spawn_stdout_cb (PkBackendSpawn *spawn, const gchar *line, PkBackendSpawn *backend_spawn)
+pk_backend_spawn_stdout_cb (PkSpawn *spawn, const gchar *line, PkBackendSpawn *backend_spawn)
 {
 	gboolean ret;
 	_cleanup_error_free_ GError *error = NULL;
+	if (spawn != backend_spawn->priv->spawn) {
+		g_debug ("ignoring output of idle helper: %s", line);
+		return;
+	}
 	ret = pk_backend_spawn_inject_data (backend_spawn,
 					    backend_spawn->priv->job,
 					    line,
@@ -645,13 +898,14 @@ pk_backend_spawn_stdout_cb (PkBackendSpawn *spawn, const gchar *line, PkBackendS
  * pk_backend_spawn_stderr_cb:
  **/
 static void
-pk_backend_spawn_stderr_cb (PkBackendSpawn *spawn, const gchar *line, PkBackendSpawn *backend_spawn)
+pk_backend_spawn_stderr_cb (PkSpawn *spawn, const gchar *line, PkBackendSpawn *backend_spawn)
 {
 	gboolean ret;
 	g_return_if_fail (PK_IS_BACKEND_SPAWN (backend_spawn));
 
 	/* do we ignore with a filter func ? */
-	if (backend_spawn->priv->stderr_func != NULL) {
+	if (backend_spawn->priv->stderr_func != NULL &&
+	    spawn == backend_spawn->priv->spawn) {
 		ret = backend_spawn->priv->stderr_func (backend_spawn->priv->job, line);
 		if (!ret)
 			return;
@@ -659,6 +913,147 @@ pk_backend_spawn_stderr_cb (PkBackendSpawn *spawn, const gchar *line, PkBackendS
 	g_warning ("STDERR: %s", line);
 }
 
+/**
+ * pk_backend_spawn_helper_free:
+ **/
+static void
+pk_backend_spawn_helper_free (PkBackendSpawnHelper *helper)
+{
+	pk_backend_spawn_helper_stop_kill_timer (helper);
+	g_object_unref (helper->spawn);
+	g_free (helper);
+}
+
+/**
+ * pk_backend_spawn_add_helper:
+ **/
+static PkBackendSpawnHelper *
+pk_backend_spawn_add_helper (PkBackendSpawn *backend_spawn)
+{
+	PkBackendSpawnHelper *helper;
+	PkBackendSpawnPrivate *priv = backend_spawn->priv;
+
+	helper = g_new0 (PkBackendSpawnHelper, 1);
+	helper->spawn = pk_spawn_new (priv->conf);
+	g_object_set (helper->spawn,
+		      "allow-sigkill", priv->allow_sigkill,
+		      NULL);
+	g_signal_connect (helper->spawn, "exit",
+			  G_CALLBACK (pk_backend_spawn_exit_cb), backend_spawn);
+	g_signal_connect (helper->spawn, "stdout",
+			  G_CALLBACK (pk_backend_spawn_stdout_cb), backend_spawn);
+	g_signal_connect (helper->spawn, "stdout-frame",
+			  G_CALLBACK (pk_backend_spawn_stdout_frame_cb), backend_spawn);
+	g_signal_connect (helper->spawn, "stderr",
+			  G_CALLBACK (pk_backend_spawn_stderr_cb), backend_spawn);
+	g_ptr_array_add (priv->pool, helper);
+	return helper;
+}
+
+/**
+ * pk_backend_spawn_get_stopped_helper:
+ *
+ * Return value: a helper that is not running, or %NULL if the pool is full
+ **/
+static PkBackendSpawnHelper *
+pk_backend_spawn_get_stopped_helper (PkBackendSpawn *backend_spawn)
+{
+	PkBackendSpawnHelper *helper;
+	PkBackendSpawnPrivate *priv = backend_spawn->priv;
+	guint i;
+
+	for (i = 0; i < priv->pool->len; i++) {
+		helper = g_ptr_array_index (priv->pool, i);
+		if (!pk_spawn_is_running (helper->spawn))
+			return helper;
+	}
+	if (priv->pool->len < priv->pool_size)
+		return pk_backend_spawn_add_helper (backend_spawn);
+	return NULL;
+}
+
+/**
+ * pk_backend_spawn_get_helper:
+ *
+ * Find the helper to run the command, which is the one used last of
+ * those which can be sent it, or else one to start it in
+ **/
+static PkBackendSpawnHelper *
+pk_backend_spawn_get_helper (PkBackendSpawn *backend_spawn,
+			     gchar **argv,
+			     gchar **envp,
+			     PkSpawnArgvFlags flags)
+{
+	PkBackendSpawnHelper *helper;
+	PkBackendSpawnHelper *oldest = NULL;
+	PkBackendSpawnHelper *reusable = NULL;
+	PkBackendSpawnPrivate *priv = backend_spawn->priv;
+	guint i;
+
+	for (i = 0; i < priv->pool->len; i++) {
+		helper = g_ptr_array_index (priv->pool, i);
+		if ((flags & PK_SPAWN_ARGV_FLAGS_NEVER_REUSE) == 0 &&
+		    pk_spawn_is_reusable (helper->spawn, argv, envp) &&
+		    (reusable == NULL || helper->last_used > reusable->last_used))
+			reusable = helper;
+		if (oldest == NULL || helper->last_used < oldest->last_used)
+			oldest = helper;
+	}
+	if (reusable != NULL) {
+		helper = reusable;
+	} else {
+		helper = pk_backend_spawn_get_stopped_helper (backend_spawn);
+		if (helper == NULL)
+			helper = oldest;
+	}
+	pk_backend_helper_started (priv->backend, reusable != NULL);
+	helper->last_used = g_get_monotonic_time ();
+	return helper;
+}
+
+/**
+ * pk_backend_spawn_prefork:
+ *
+ * Start more of the last helper until the pool is full, so that the
+ * next job does not have to wait for one to start
+ **/
+static void
+pk_backend_spawn_prefork (PkBackendSpawn *backend_spawn)
+{
+	PkBackendSpawnHelper *helper;
+	PkBackendSpawnPrivate *priv = backend_spawn->priv;
+	guint i;
+	guint running = 0;
+
+	/* only dispatchers wait for a command */
+	if (priv->helper_argv == NULL ||
+	    (priv->helper_flags & PK_SPAWN_ARGV_FLAGS_NEVER_REUSE) > 0 ||
+	    !pk_spawn_is_dispatcher (priv->spawn))
+		return;
+
+	for (i = 0; i < priv->pool->len; i++) {
+		helper = g_ptr_array_index (priv->pool, i);
+		if (pk_spawn_is_running (helper->spawn))
+			running++;
+	}
+	while (running < priv->pool_size) {
+		_cleanup_error_free_ GError *error = NULL;
+		helper = pk_backend_spawn_get_stopped_helper (backend_spawn);
+		if (helper == NULL)
+			break;
+		g_debug ("starting %s for the pool", priv->helper_argv[PK_BACKEND_SPAWN_ARGV0]);
+		g_object_set (helper->spawn, "background", FALSE, NULL);
+		if (!pk_spawn_argv (helper->spawn, priv->helper_argv,
+				    priv->helper_envp, priv->helper_flags, &error)) {
+			g_warning ("failed to start helper for the pool: %s", error->message);
+			return;
+		}
+		helper->last_used = 0;
+		pk_backend_spawn_helper_start_kill_timer (backend_spawn, helper);
+		running++;
+	}
+}
+
 /**
  * pk_backend_spawn_get_envp:
  *
@@ -779,6 +1174,10 @@ pk_backend_spawn_get_envp (PkBackendSpawn *backend_spawn)
 	ret = pk_backend_job_get_interactive (priv->job);
 	g_hash_table_replace (env_table, g_strdup ("INTERACTIVE"), g_strdup (ret ? "TRUE" : "FALSE"));
 
+	/* FRAMED_OUTPUT, the lines are needed to filter them */
+	if (priv->stdout_func == NULL)
+		g_hash_table_replace (env_table, g_strdup ("FRAMED_OUTPUT"), g_strdup ("TRUE"));
+
 	/* CACHE_AGE */
 	cache_age = pk_backend_job_get_cache_age (priv->job);
 	if (cache_age == G_MAXUINT) {
@@ -813,12 +1212,6 @@ pk_backend_spawn_get_envp (PkBackendSpawn *backend_spawn)
 	return envp;
 }
 
-#ifdef ENABLE_STRACE
- #define PK_BACKEND_SPAWN_ARGV0		4
-#else
- #define PK_BACKEND_SPAWN_ARGV0		0
-#endif
-
 /**
  * pk_backend_spawn_va_list_to_argv:
  * @string_first: the first string
@@ -871,6 +1264,8 @@ pk_backend_spawn_helper_va_list (PkBackendSpawn *backend_spawn,
 				 va_list *args)
 {
 	gboolean background;
+	guint i;
+	PkBackendSpawnHelper *helper;
 	PkBackendSpawnPrivate *priv = backend_spawn->priv;
 	PkSpawnArgvFlags flags = PK_SPAWN_ARGV_FLAGS_NONE;
 #if PK_BUILD_LOCAL
@@ -920,12 +1315,6 @@ pk_backend_spawn_helper_va_list (PkBackendSpawn *backend_spawn,
 	g_free (argv[PK_BACKEND_SPAWN_ARGV0]);
 	argv[PK_BACKEND_SPAWN_ARGV0] = g_strdup (filename);
 
-	/* copy idle setting from backend to PkSpawn instance */
-	background = pk_backend_job_get_background (job);
-	g_object_set (priv->spawn,
-		      "background", (background == TRUE),
-		      NULL);
-
 #ifdef ENABLE_STRACE
 	/* we can't reuse when using strace */
 	flags |= PK_SPAWN_ARGV_FLAGS_NEVER_REUSE;
@@ -933,6 +1322,27 @@ pk_backend_spawn_helper_va_list (PkBackendSpawn *backend_spawn,
 
 	priv->finished = FALSE;
 	envp = pk_backend_spawn_get_envp (backend_spawn);
+
+	/* use a started helper if there is one */
+	helper = pk_backend_spawn_get_helper (backend_spawn, argv, envp, flags);
+	pk_backend_spawn_helper_stop_kill_timer (helper);
+	priv->spawn = helper->spawn;
+
+	/* save these to start more of this helper */
+	g_strfreev (priv->helper_argv);
+	priv->helper_argv = g_new0 (gchar *, PK_BACKEND_SPAWN_ARGV0 + 2);
+	for (i = 0; i <= PK_BACKEND_SPAWN_ARGV0; i++)
+		priv->helper_argv[i] = g_strdup (argv[i]);
+	g_strfreev (priv->helper_envp);
+	priv->helper_envp = g_strdupv (envp);
+	priv->helper_flags = flags;
+
+	/* copy idle setting from backend to PkSpawn instance */
+	background = pk_backend_job_get_background (job);
+	g_object_set (priv->spawn,
+		      "background", (background == TRUE),
+		      NULL);
+
 	if (!pk_spawn_argv (priv->spawn, argv, envp, flags, &error)) {
 		pk_backend_job_error_code (priv->job,
 					   PK_ERROR_ENUM_INTERNAL_ERROR,
@@ -1005,8 +1415,16 @@ pk_backend_spawn_is_busy (PkBackendSpawn *backend_spawn)
 gboolean
 pk_backend_spawn_exit (PkBackendSpawn *backend_spawn)
 {
+	PkBackendSpawnHelper *helper;
+	guint i;
+
 	g_return_val_if_fail (PK_IS_BACKEND_SPAWN (backend_spawn), FALSE);
-	pk_spawn_exit (backend_spawn->priv->spawn);
+	for (i = 0; i < backend_spawn->priv->pool->len; i++) {
+		helper = g_ptr_array_index (backend_spawn->priv->pool, i);
+		pk_backend_spawn_helper_stop_kill_timer (helper);
+		if (pk_spawn_is_running (helper->spawn))
+			pk_spawn_exit (helper->spawn);
+	}
 	return TRUE;
 }
 
@@ -1030,12 +1448,6 @@ pk_backend_spawn_helper (PkBackendSpawn *backend_spawn,
 	backend_spawn->priv->job = job;
 	backend_spawn->priv->backend = g_object_ref (pk_backend_job_get_backend (job));
 
-	/* don't auto-kill this */
-	if (backend_spawn->priv->kill_id > 0) {
-		g_source_remove (backend_spawn->priv->kill_id);
-		backend_spawn->priv->kill_id = 0;
-	}
-
 	/* get the argument list */
 	va_start (args, first_element);
 	ret = pk_backend_spawn_helper_va_list (backend_spawn, job, first_element, &args);
@@ -1050,10 +1462,17 @@ pk_backend_spawn_helper (PkBackendSpawn *backend_spawn,
 void
 pk_backend_spawn_set_allow_sigkill (PkBackendSpawn *backend_spawn, gboolean allow_sigkill)
 {
+	PkBackendSpawnHelper *helper;
+	guint i;
+
 	g_return_if_fail (PK_IS_BACKEND_SPAWN (backend_spawn));
-	g_object_set (backend_spawn->priv->spawn,
-		      "allow-sigkill", allow_sigkill,
-		      NULL);
+	backend_spawn->priv->allow_sigkill = allow_sigkill;
+	for (i = 0; i < backend_spawn->priv->pool->len; i++) {
+		helper = g_ptr_array_index (backend_spawn->priv->pool, i);
+		g_object_set (helper->spawn,
+			      "allow-sigkill", allow_sigkill,
+			      NULL);
+	}
 }
 
 /**
@@ -1068,12 +1487,11 @@ pk_backend_spawn_finalize (GObject *object)
 
 	backend_spawn = PK_BACKEND_SPAWN (object);
 
-	if (backend_spawn->priv->kill_id > 0)
-		g_source_remove (backend_spawn->priv->kill_id);
-
+	g_ptr_array_unref (backend_spawn->priv->pool);
+	g_strfreev (backend_spawn->priv->helper_argv);
+	g_strfreev (backend_spawn->priv->helper_envp);
 	g_free (backend_spawn->priv->name);
 	g_key_file_unref (backend_spawn->priv->conf);
-	g_object_unref (backend_spawn->priv->spawn);
 	if (backend_spawn->priv->backend != NULL)
 		g_object_unref (backend_spawn->priv->backend);
 
@@ -1098,6 +1516,8 @@ static void
 pk_backend_spawn_init (PkBackendSpawn *backend_spawn)
 {
 	backend_spawn->priv = PK_BACKEND_SPAWN_GET_PRIVATE (backend_spawn);
+	backend_spawn->priv->pool = g_ptr_array_new_with_free_func ((GDestroyNotify) pk_backend_spawn_helper_free);
+	backend_spawn->priv->allow_sigkill = TRUE;
 }
 
 /**
@@ -1107,15 +1527,27 @@ PkBackendSpawn *
 pk_backend_spawn_new (GKeyFile *conf)
 {
 	PkBackendSpawn *backend_spawn;
+	PkBackendSpawnHelper *helper;
+	PkBackendSpawnPrivate *priv;
+	gint value;
+
 	backend_spawn = g_object_new (PK_TYPE_BACKEND_SPAWN, NULL);
-	backend_spawn->priv->conf = g_key_file_ref (conf);
-	backend_spawn->priv->spawn = pk_spawn_new (backend_spawn->priv->conf);
-	g_signal_connect (backend_spawn->priv->spawn, "exit",
-			  G_CALLBACK (pk_backend_spawn_exit_cb), backend_spawn);
-	g_signal_connect (backend_spawn->priv->spawn, "stdout",
-			  G_CALLBACK (pk_backend_spawn_stdout_cb), backend_spawn);
-	g_signal_connect (backend_spawn->priv->spawn, "stderr",
-			  G_CALLBACK (pk_backend_spawn_stderr_cb), backend_spawn);
+	priv = backend_spawn->priv;
+	priv->conf = g_key_file_ref (conf);
+
+	/* number of helpers kept started */
+	value = g_key_file_get_integer (conf, "Daemon", "BackendSpawnPoolSize", NULL);
+	priv->pool_size = value > 0 ? value : PK_BACKEND_SPAWN_POOL_SIZE_DEFAULT;
+
+	/* how long they are kept when idle */
+	value = g_key_file_get_integer (conf, "Daemon", "BackendSpawnIdleTimeout", NULL);
+	if (value <= 0)
+		value = g_key_file_get_integer (conf, "Daemon", "BackendShutdownTimeout", NULL);
+	priv->idle_timeout = value > 0 ? value : PK_BACKEND_SPAWN_IDLE_TIMEOUT_DEFAULT;
+
+	/* there is always a helper to kill or send exit to */
+	helper = pk_backend_spawn_add_helper (backend_spawn);
+	priv->spawn = helper->spawn;
 	return PK_BACKEND_SPAWN (backend_spawn);
 }
 
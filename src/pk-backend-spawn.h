@@ -68,6 +68,11 @@ gboolean	 pk_backend_spawn_inject_data		(PkBackendSpawn *backend_spawn,
 							 PkBackendJob	*job,
 							 const gchar	*line,
 							 GError		**error);
+gboolean	 pk_backend_spawn_inject_frame		(PkBackendSpawn *backend_spawn,
+							 PkBackendJob	*job,
+							 guint8		*data,
+							 guint		 length,
+							 GError		**error);
 
 /* filtering */
 typedef gboolean (*PkBackendSpawnFilterFunc)		(PkBackendJob	*job,
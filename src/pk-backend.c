@@ -210,6 +210,9 @@ struct PkBackendPrivate
 	guint			 repo_list_changed_id;
 	guint			 installed_db_changed_id;
 	guint			 updates_changed_id;
+	PkResultsCache		*results_cache;
+	guint			 helpers_reused;	/* atomic */
+	guint			 helpers_started;	/* atomic */
 };
 
 G_DEFINE_TYPE (PkBackend, pk_backend, G_TYPE_OBJECT)
@@ -643,6 +646,7 @@ pk_backend_repo_list_changed_cb (gpointer user_data)
 	PkBackend *backend = PK_BACKEND (user_data);
 
 	g_debug ("emitting repo-list-changed");
+	pk_results_cache_invalidate (backend->priv->results_cache);
 	g_signal_emit (backend, signals [SIGNAL_REPO_LIST_CHANGED], 0);
 	backend->priv->repo_list_changed_id = 0;
 	return FALSE;
@@ -678,6 +682,7 @@ pk_backend_updates_changed (PkBackend *backend)
 	g_return_val_if_fail (pk_is_thread_default (), FALSE);
 
 	g_debug ("emitting updates-changed");
+	pk_results_cache_invalidate (backend->priv->results_cache);
 	g_signal_emit (backend, signals [SIGNAL_UPDATES_CHANGED], 0);
 	return TRUE;
 }
@@ -727,6 +732,9 @@ pk_backend_installed_db_changed_cb (gpointer user_data)
 	PkBackend *backend = PK_BACKEND (user_data);
 	_cleanup_error_free_ GError *error = NULL;
 
+	/* the results of queries are out of date */
+	pk_results_cache_invalidate (backend->priv->results_cache);
+
 	if (!backend->priv->transaction_in_progress) {
 		g_debug ("invalidating offline updates");
 		if (!pk_offline_auth_invalidate (&error))
@@ -766,6 +774,50 @@ pk_backend_installed_db_changed (PkBackend *backend)
 		g_idle_add (pk_backend_installed_db_changed_cb, backend);
 }
 
+/**
+ * pk_backend_get_results_cache:
+ *
+ * Return value: (transfer none): the results of recent queries, which are
+ * dropped when the package database or the repo list changes
+ **/
+PkResultsCache *
+pk_backend_get_results_cache (PkBackend *backend)
+{
+	g_return_val_if_fail (PK_IS_BACKEND (backend), NULL);
+	return backend->priv->results_cache;
+}
+
+/**
+ * pk_backend_helper_started:
+ * @reused: if a helper that was already running was given the command
+ *
+ * Records how often spawned backends could reuse a running helper.
+ **/
+void
+pk_backend_helper_started (PkBackend *backend, gboolean reused)
+{
+	g_return_if_fail (PK_IS_BACKEND (backend));
+	if (reused)
+		g_atomic_int_inc (&backend->priv->helpers_reused);
+	else
+		g_atomic_int_inc (&backend->priv->helpers_started);
+}
+
+/**
+ * pk_backend_get_helper_stats:
+ * @reused: the number of commands given to a running helper
+ * @started: the number of helpers which had to be started
+ **/
+void
+pk_backend_get_helper_stats (PkBackend *backend, guint *reused, guint *started)
+{
+	g_return_if_fail (PK_IS_BACKEND (backend));
+	if (reused != NULL)
+		*reused = g_atomic_int_get (&backend->priv->helpers_reused);
+	if (started != NULL)
+		*started = g_atomic_int_get (&backend->priv->helpers_started);
+}
+
 /**
  * pk_backend_transaction_inhibit_start:
  *
@@ -1157,6 +1209,7 @@ pk_backend_finalize (GObject *object)
 #endif
 	g_key_file_unref (backend->priv->conf);
 	g_hash_table_destroy (backend->priv->eulas);
+	g_object_unref (backend->priv->results_cache);
 
 	g_mutex_clear (&backend->priv->thread_hash_mutex);
 	g_hash_table_unref (backend->priv->thread_hash);
@@ -1873,6 +1926,7 @@ pk_backend_init (PkBackend *backend)
 							    NULL,
 							    g_free);
 	g_mutex_init (&backend->priv->thread_hash_mutex);
+	backend->priv->results_cache = pk_results_cache_new ();
 }
 
 /**
@@ -37,6 +37,7 @@
 #include "pk-backend.h"
 #include "pk-backend-job.h"
 #include "pk-cleanup.h"
+#include "pk-results-cache.h"
 
 G_BEGIN_DECLS
 
@@ -82,6 +83,12 @@ gboolean	 pk_backend_is_implemented		(PkBackend	*backend,
 gchar		*pk_backend_get_accepted_eula_string	(PkBackend	*backend);
 void		 pk_backend_repo_list_changed		(PkBackend      *backend);
 void		 pk_backend_installed_db_changed	(PkBackend      *backend);
+PkResultsCache	*pk_backend_get_results_cache		(PkBackend	*backend);
+void		 pk_backend_helper_started		(PkBackend	*backend,
+							 gboolean	 reused);
+void		 pk_backend_get_helper_stats		(PkBackend	*backend,
+							 guint		*reused,
+							 guint		*started);
 
 
 gboolean	 pk_backend_updates_changed		(PkBackend	*backend);
@@ -1076,63 +1076,28 @@ pk_engine_daemon_get_property (GDBusConnection *connection_, const gchar *sender
 }
 
 /**
- * pk_engine_package_name_in_strv:
- **/
-static gboolean
-pk_engine_package_name_in_strv (gchar **strv, PkPackage *pkg)
-{
-	guint i;
-	for (i = 0; strv[i] != NULL; i++) {
-		if (g_strcmp0 (strv[i], pk_package_get_name (pkg)) == 0)
-			return TRUE;
-	}
-	return FALSE;
-}
-
-/**
- * pk_engine_get_package_history_pkg:
+ * pk_engine_get_package_history_item:
  *
- * Create a 'a{sv}' GVariant instance from all the PkTransactionPast data
+ * Create a 'a{sv}' GVariant instance from a history item
  **/
 static GVariant *
-pk_engine_get_package_history_pkg (PkTransactionPast *item, PkPackage *pkg)
+pk_engine_get_package_history_item (PkTransactionDbHistoryItem *item)
 {
 	GVariantBuilder builder;
 	g_variant_builder_init (&builder, G_VARIANT_TYPE_ARRAY);
 	g_variant_builder_add (&builder, "{sv}", "info",
-			       g_variant_new_uint32 (pk_package_get_info (pkg)));
+			       g_variant_new_uint32 (item->info));
 	g_variant_builder_add (&builder, "{sv}", "source",
-			       g_variant_new_string (pk_package_get_data (pkg)));
+			       g_variant_new_string (item->data != NULL ? item->data : ""));
 	g_variant_builder_add (&builder, "{sv}", "version",
-			       g_variant_new_string (pk_package_get_version (pkg)));
+			       g_variant_new_string (item->version != NULL ? item->version : ""));
 	g_variant_builder_add (&builder, "{sv}", "timestamp",
-			       g_variant_new_uint64 (pk_transaction_past_get_timestamp (item)));
+			       g_variant_new_uint64 (item->timestamp));
 	g_variant_builder_add (&builder, "{sv}", "user-id",
-			       g_variant_new_uint32 (pk_transaction_past_get_uid (item)));
+			       g_variant_new_uint32 (item->uid));
 	return g_variant_builder_end (&builder);
 }
 
-/**
- * pk_engine_is_package_history_interesing:
- **/
-static gboolean
-pk_engine_is_package_history_interesing (PkPackage *package)
-{
-	gboolean ret;
-
-	switch (pk_package_get_info (package)) {
-	case PK_INFO_ENUM_INSTALLING:
-	case PK_INFO_ENUM_REMOVING:
-	case PK_INFO_ENUM_UPDATING:
-		ret = TRUE;
-		break;
-	default:
-		ret = FALSE;
-		break;
-	}
-	return ret;
-}
-
 /**
  * pk_engine_get_package_history:
  **/
@@ -1142,113 +1107,41 @@ pk_engine_get_package_history (PkEngine *engine,
 			       guint max_size,
 			       GError **error)
 {
-	const gchar *data;
-	const gchar *pkgname;
-	gboolean ret;
-	gchar *key;
-	gint64 timestamp;
-	GList *l;
-	GList *list;
-	GPtrArray *array = NULL;
 	guint i;
+	guint j;
 	GVariantBuilder builder;
-	GVariant *value = NULL;
-	PkTransactionPast *item;
-	_cleanup_hashtable_unref_ GHashTable *deduplicate_hash = NULL;
+	GVariantBuilder builder_pkg;
 	_cleanup_hashtable_unref_ GHashTable *pkgname_hash = NULL;
-	_cleanup_list_free_ GList *keys = NULL;
-	_cleanup_object_unref_ PkPackage *package_tmp = NULL;
 
-	list = pk_transaction_db_get_list (engine->priv->transaction_db, max_size);
-
-	/* simplify the loop */
-	if (max_size == 0)
-		max_size = G_MAXUINT;
-
-	pkgname_hash = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) g_ptr_array_unref);
-	deduplicate_hash = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
-	package_tmp = pk_package_new ();
-	for (l = list; l != NULL; l = l->next) {
-		_cleanup_strv_free_ gchar **package_lines = NULL;
-		item = PK_TRANSACTION_PAST (l->data);
+	/* no history returns an empty array */
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{saa{sv}}"));
+	pkgname_hash = g_hash_table_new (g_str_hash, g_str_equal);
+	for (i = 0; package_names[i] != NULL; i++) {
+		_cleanup_ptrarray_unref_ GPtrArray *history = NULL;
 
-		/* ignore anything that failed */
-		if (!pk_transaction_past_get_succeeded (item))
+		/* only report each package once */
+		if (g_hash_table_lookup (pkgname_hash, package_names[i]) != NULL)
 			continue;
+		g_hash_table_insert (pkgname_hash, package_names[i], package_names[i]);
 
-		/* split up data */
-		data = pk_transaction_past_get_data (item);
-		if (data == NULL)
+		/* this uses the index on the package name */
+		history = pk_transaction_db_get_package_history (engine->priv->transaction_db,
+								 package_names[i],
+								 max_size);
+		if (history->len == 0)
 			continue;
-		package_lines = g_strsplit (data, "\n", -1);
-		for (i = 0; package_lines[i] != NULL; i++) {
-			ret = pk_package_parse (package_tmp, package_lines[i], error);
-			g_assert (ret);
-
-			/* not the package we care about */
-			if (!pk_engine_package_name_in_strv (package_names, package_tmp))
-				continue;
-
-			/* not a state we care about */
-			if (!pk_engine_is_package_history_interesing (package_tmp))
-				continue;
-
-			/* transactions without a timestamp are not interesting */
-			timestamp = pk_transaction_past_get_timestamp (item);
-			if (timestamp == 0)
-				continue;
-
-			/* de-duplicate the entry, in the case of multiarch */
-			key = g_strdup_printf ("%s-%" G_GINT64_FORMAT,
-					       pk_package_get_name (package_tmp),
-					       timestamp);
-			if (g_hash_table_lookup (deduplicate_hash, key) != NULL) {
-				g_free (key);
-				continue;
-			}
-			g_hash_table_insert (deduplicate_hash, key, package_lines[i]);
-
-			/* get the blob for this data item */
-			value = pk_engine_get_package_history_pkg (item, package_tmp);
-			if (value == NULL)
-				continue;
-
-			/* find the array */
-			pkgname = pk_package_get_name (package_tmp);
-			array = g_hash_table_lookup (pkgname_hash, pkgname);
-			if (array == NULL) {
-				array = g_ptr_array_new ();
-				g_hash_table_insert (pkgname_hash,
-						     g_strdup (pkgname),
-						     array);
-			}
-			g_ptr_array_add (array, value);
-		}
-	}
-
-	/* no history returns an empty array */
-	if (g_hash_table_size (pkgname_hash) == 0) {
-		value = g_variant_new_array (G_VARIANT_TYPE ("{saa{sv}}"), NULL, 0);
-		goto out;
-	}
 
-	/* we have a hash of pkgname:GPtrArray where the GPtrArray is an array
-	 * of GVariants of type a{sv} */
-	g_variant_builder_init (&builder, G_VARIANT_TYPE_ARRAY);
-	keys = g_hash_table_get_keys (pkgname_hash);
-	for (l = keys; l != NULL; l = l->next) {
-		pkgname = l->data;
-		array = g_hash_table_lookup (pkgname_hash, pkgname);
 		/* create aa{sv} */
-		value = g_variant_new_array (NULL,
-					     (GVariant * const *) array->pdata,
-					     MIN (array->len, max_size));
-		g_variant_builder_add (&builder, "{s@aa{sv}}", pkgname, value);
+		g_variant_builder_init (&builder_pkg, G_VARIANT_TYPE ("aa{sv}"));
+		for (j = 0; j < history->len; j++) {
+			g_variant_builder_add_value (&builder_pkg,
+						     pk_engine_get_package_history_item (g_ptr_array_index (history, j)));
+		}
+		g_variant_builder_add (&builder, "{s@aa{sv}}",
+				       package_names[i],
+				       g_variant_builder_end (&builder_pkg));
 	}
-	value = g_variant_builder_end (&builder);
-out:
-	g_list_free_full (list, (GDestroyNotify) g_object_unref);
-	return value;
+	return g_variant_builder_end (&builder);
 }
 
 /**
@@ -1292,7 +1185,20 @@ pk_engine_daemon_method_call (GDBusConnection *connection_, const gchar *sender,
 	}
 
 	if (g_strcmp0 (method_name, "GetDaemonState") == 0) {
-		data = pk_scheduler_get_state (engine->priv->scheduler);
+		PkResultsCache *cache;
+		guint reused;
+		guint started;
+		_cleanup_free_ gchar *state = NULL;
+		cache = pk_backend_get_results_cache (engine->priv->backend);
+		state = pk_scheduler_get_state (engine->priv->scheduler);
+		pk_backend_get_helper_stats (engine->priv->backend, &reused, &started);
+		data = g_strdup_printf ("%sResults cache: %u entries, %u hits, %u misses\n"
+					"Backend helpers: %u reused, %u started\n",
+					state,
+					pk_results_cache_get_size (cache),
+					pk_results_cache_get_hits (cache),
+					pk_results_cache_get_misses (cache),
+					reused, started);
 		value = g_variant_new ("(s)", data);
 		g_dbus_method_invocation_return_value (invocation, value);
 		return;
@@ -1345,6 +1251,54 @@ pk_engine_daemon_method_call (GDBusConnection *connection_, const gchar *sender,
 		return;
 	}
 
+	if (g_strcmp0 (method_name, "CreateTransactionWithHints") == 0) {
+		PkTransaction *transaction;
+		_cleanup_free_ const gchar **hints = NULL;
+
+		g_debug ("CreateTransactionWithHints method called");
+		g_variant_get (parameters, "(^a&s)", &hints);
+		data = pk_transaction_db_generate_id (engine->priv->transaction_db);
+		g_assert (data != NULL);
+		ret = pk_scheduler_create (engine->priv->scheduler,
+					   data, sender, &error);
+		if (!ret) {
+			g_dbus_method_invocation_return_error (invocation,
+							       PK_ENGINE_ERROR,
+							       PK_ENGINE_ERROR_CANNOT_CHECK_AUTH,
+							       "could not create transaction %s: %s",
+							       data,
+							       error->message);
+			return;
+		}
+
+		/* the client does not need a SetHints round trip */
+		transaction = pk_scheduler_get_transaction (engine->priv->scheduler,
+							    data);
+		ret = pk_transaction_apply_hints (transaction, hints, &error);
+		if (!ret) {
+			pk_scheduler_remove (engine->priv->scheduler, data);
+			g_dbus_method_invocation_return_error (invocation,
+							       PK_ENGINE_ERROR,
+							       PK_ENGINE_ERROR_INVALID_STATE,
+							       "could not set hints on %s: %s",
+							       data,
+							       error->message);
+			return;
+		}
+
+		g_debug ("sending object path: '%s'", data);
+		value = g_variant_new ("(o)", data);
+		g_dbus_method_invocation_return_value (invocation, value);
+		return;
+	}
+
+	if (g_strcmp0 (method_name, "GetSchedulerStats") == 0) {
+		value = pk_scheduler_get_stats (engine->priv->scheduler);
+		tuple = g_variant_new_tuple (&value, 1);
+		g_dbus_method_invocation_return_value (invocation, tuple);
+		return;
+	}
+
 	if (g_strcmp0 (method_name, "GetTransactionList") == 0) {
 		transaction_list = pk_scheduler_get_array (engine->priv->scheduler);
 		value = g_variant_new ("(^a&o)", transaction_list);
@@ -1377,6 +1331,11 @@ pk_engine_daemon_method_call (GDBusConnection *connection_, const gchar *sender,
 
 	if (g_strcmp0 (method_name, "StateHasChanged") == 0) {
 
+		/* something outside the daemon changed the package database,
+		 * so drop the cached results now rather than when the network
+		 * is next online */
+		pk_results_cache_invalidate (pk_backend_get_results_cache (engine->priv->backend));
+
 		/* have we already scheduled priority? */
 		if (engine->priv->timeout_priority_id != 0) {
 			g_debug ("Already asked to refresh priority state less than %i seconds ago",
@@ -0,0 +1,280 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+
+#include <glib.h>
+
+#include "pk-results-cache.h"
+
+static void	 pk_results_cache_finalize	(GObject	*object);
+
+#define PK_RESULTS_CACHE_GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), PK_TYPE_RESULTS_CACHE, PkResultsCachePrivate))
+
+/* the least recently used results are dropped after this */
+#define PK_RESULTS_CACHE_MAX_ENTRIES	32
+
+/* results are never returned after this, in seconds, as not every tool
+ * that changes the package database tells us about it */
+#define PK_RESULTS_CACHE_MAX_AGE	300
+
+typedef struct {
+	gchar			*key;
+	PkResults		*results;
+	gint64			 created;
+	GList			*link;
+} PkResultsCacheEntry;
+
+/**
+ * _PkResultsCachePrivate:
+ *
+ * Private #PkResultsCache data
+ **/
+struct _PkResultsCachePrivate
+{
+	GHashTable		*entries;	/* key:PkResultsCacheEntry */
+	GQueue			*lru;		/* most recently used first */
+	guint			 generation;
+	guint			 hits;
+	guint			 misses;
+};
+
+G_DEFINE_TYPE (PkResultsCache, pk_results_cache, G_TYPE_OBJECT)
+
+/**
+ * pk_results_cache_entry_free:
+ **/
+static void
+pk_results_cache_entry_free (PkResultsCacheEntry *entry)
+{
+	g_free (entry->key);
+	g_object_unref (entry->results);
+	g_free (entry);
+}
+
+/**
+ * pk_results_cache_remove_entry:
+ **/
+static void
+pk_results_cache_remove_entry (PkResultsCache *cache, PkResultsCacheEntry *entry)
+{
+	g_queue_delete_link (cache->priv->lru, entry->link);
+	g_hash_table_remove (cache->priv->entries, entry->key);
+}
+
+/**
+ * pk_results_cache_lookup:
+ * @cache: a #PkResultsCache
+ * @key: the query, see pk_transaction_get_results_cache_key()
+ *
+ * Return value: (transfer full): the results of the query, or %NULL
+ **/
+PkResults *
+pk_results_cache_lookup (PkResultsCache *cache, const gchar *key)
+{
+	PkResultsCacheEntry *entry;
+	PkResultsCachePrivate *priv = cache->priv;
+
+	g_return_val_if_fail (PK_IS_RESULTS_CACHE (cache), NULL);
+	g_return_val_if_fail (key != NULL, NULL);
+
+	entry = g_hash_table_lookup (priv->entries, key);
+	if (entry == NULL) {
+		priv->misses++;
+		return NULL;
+	}
+
+	/* the package database may have changed without us knowing */
+	if (g_get_monotonic_time () - entry->created > (gint64) PK_RESULTS_CACHE_MAX_AGE * G_USEC_PER_SEC) {
+		g_debug ("cached results for %s are too old", key);
+		pk_results_cache_remove_entry (cache, entry);
+		priv->misses++;
+		return NULL;
+	}
+
+	/* keep it around for longer */
+	g_queue_unlink (priv->lru, entry->link);
+	g_queue_push_head_link (priv->lru, entry->link);
+	priv->hits++;
+	return g_object_ref (entry->results);
+}
+
+/**
+ * pk_results_cache_add:
+ * @cache: a #PkResultsCache
+ * @key: the query, see pk_transaction_get_results_cache_key()
+ * @generation: the generation when the query was started
+ * @results: the results of the query
+ *
+ * Keeps @results unless the cache was invalidated since @generation.
+ **/
+void
+pk_results_cache_add (PkResultsCache *cache,
+		      const gchar *key,
+		      guint generation,
+		      PkResults *results)
+{
+	PkResultsCacheEntry *entry;
+	PkResultsCachePrivate *priv = cache->priv;
+
+	g_return_if_fail (PK_IS_RESULTS_CACHE (cache));
+	g_return_if_fail (key != NULL);
+	g_return_if_fail (PK_IS_RESULTS (results));
+
+	/* the package database changed while the query was running */
+	if (generation != priv->generation) {
+		g_debug ("not caching results for %s from generation %u",
+			 key, generation);
+		return;
+	}
+
+	/* replace any older results */
+	entry = g_hash_table_lookup (priv->entries, key);
+	if (entry != NULL)
+		pk_results_cache_remove_entry (cache, entry);
+
+	/* make space */
+	if (g_queue_get_length (priv->lru) >= PK_RESULTS_CACHE_MAX_ENTRIES) {
+		entry = g_queue_peek_tail (priv->lru);
+		pk_results_cache_remove_entry (cache, entry);
+	}
+
+	entry = g_new0 (PkResultsCacheEntry, 1);
+	entry->key = g_strdup (key);
+	entry->results = g_object_ref (results);
+	entry->created = g_get_monotonic_time ();
+	g_queue_push_head (priv->lru, entry);
+	entry->link = priv->lru->head;
+	g_hash_table_insert (priv->entries, entry->key, entry);
+}
+
+/**
+ * pk_results_cache_invalidate:
+ *
+ * Drops all the results, and any that are added later for the queries
+ * already running.
+ **/
+void
+pk_results_cache_invalidate (PkResultsCache *cache)
+{
+	g_return_if_fail (PK_IS_RESULTS_CACHE (cache));
+
+	cache->priv->generation++;
+	if (g_queue_get_length (cache->priv->lru) == 0)
+		return;
+	g_debug ("dropping %u cached results",
+		 g_queue_get_length (cache->priv->lru));
+	g_queue_clear (cache->priv->lru);
+	g_hash_table_remove_all (cache->priv->entries);
+}
+
+/**
+ * pk_results_cache_get_generation:
+ *
+ * Return value: the number of times the cache was invalidated
+ **/
+guint
+pk_results_cache_get_generation (PkResultsCache *cache)
+{
+	g_return_val_if_fail (PK_IS_RESULTS_CACHE (cache), 0);
+	return cache->priv->generation;
+}
+
+/**
+ * pk_results_cache_get_size:
+ **/
+guint
+pk_results_cache_get_size (PkResultsCache *cache)
+{
+	g_return_val_if_fail (PK_IS_RESULTS_CACHE (cache), 0);
+	return g_queue_get_length (cache->priv->lru);
+}
+
+/**
+ * pk_results_cache_get_hits:
+ **/
+guint
+pk_results_cache_get_hits (PkResultsCache *cache)
+{
+	g_return_val_if_fail (PK_IS_RESULTS_CACHE (cache), 0);
+	return cache->priv->hits;
+}
+
+/**
+ * pk_results_cache_get_misses:
+ **/
+guint
+pk_results_cache_get_misses (PkResultsCache *cache)
+{
+	g_return_val_if_fail (PK_IS_RESULTS_CACHE (cache), 0);
+	return cache->priv->misses;
+}
+
+/**
+ * pk_results_cache_class_init:
+ **/
+static void
+pk_results_cache_class_init (PkResultsCacheClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+	object_class->finalize = pk_results_cache_finalize;
+	g_type_class_add_private (klass, sizeof (PkResultsCachePrivate));
+}
+
+/**
+ * pk_results_cache_init:
+ **/
+static void
+pk_results_cache_init (PkResultsCache *cache)
+{
+	cache->priv = PK_RESULTS_CACHE_GET_PRIVATE (cache);
+	cache->priv->entries = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+						      (GDestroyNotify) pk_results_cache_entry_free);
+	cache->priv->lru = g_queue_new ();
+}
+
+/**
+ * pk_results_cache_finalize:
+ **/
+static void
+pk_results_cache_finalize (GObject *object)
+{
+	PkResultsCache *cache;
+
+	g_return_if_fail (PK_IS_RESULTS_CACHE (object));
+	cache = PK_RESULTS_CACHE (object);
+
+	g_queue_free (cache->priv->lru);
+	g_hash_table_unref (cache->priv->entries);
+
+	G_OBJECT_CLASS (pk_results_cache_parent_class)->finalize (object);
+}
+
+/**
+ * pk_results_cache_new:
+ *
+ * Return value: a new #PkResultsCache object.
+ **/
+PkResultsCache *
+pk_results_cache_new (void)
+{
+	PkResultsCache *cache;
+	cache = g_object_new (PK_TYPE_RESULTS_CACHE, NULL);
+	return PK_RESULTS_CACHE (cache);
+}
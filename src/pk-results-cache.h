@@ -0,0 +1,72 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/**
+ * SECTION:pk-results-cache
+ * @short_description: Keeps the results of recent queries
+ *
+ * The results of queries are kept until the package database changes,
+ * so that identical queries can be answered without running the backend.
+ */
+
+#ifndef __PK_RESULTS_CACHE_H
+#define __PK_RESULTS_CACHE_H
+
+#include <glib-object.h>
+#include <packagekit-glib2/pk-results.h>
+
+G_BEGIN_DECLS
+
+#define PK_TYPE_RESULTS_CACHE		(pk_results_cache_get_type ())
+#define PK_RESULTS_CACHE(o)		(G_TYPE_CHECK_INSTANCE_CAST ((o), PK_TYPE_RESULTS_CACHE, PkResultsCache))
+#define PK_RESULTS_CACHE_CLASS(k)	(G_TYPE_CHECK_CLASS_CAST((k), PK_TYPE_RESULTS_CACHE, PkResultsCacheClass))
+#define PK_IS_RESULTS_CACHE(o)		(G_TYPE_CHECK_INSTANCE_TYPE ((o), PK_TYPE_RESULTS_CACHE))
+
+typedef struct _PkResultsCachePrivate	PkResultsCachePrivate;
+typedef struct _PkResultsCache		PkResultsCache;
+typedef struct _PkResultsCacheClass	PkResultsCacheClass;
+
+struct _PkResultsCache
+{
+	 GObject		 parent;
+	 PkResultsCachePrivate	*priv;
+};
+
+struct _PkResultsCacheClass
+{
+	GObjectClass	parent_class;
+};
+
+GType		 pk_results_cache_get_type		(void);
+PkResultsCache	*pk_results_cache_new			(void);
+PkResults	*pk_results_cache_lookup		(PkResultsCache	*cache,
+							 const gchar	*key);
+void		 pk_results_cache_add			(PkResultsCache	*cache,
+							 const gchar	*key,
+							 guint		 generation,
+							 PkResults	*results);
+void		 pk_results_cache_invalidate		(PkResultsCache	*cache);
+guint		 pk_results_cache_get_generation	(PkResultsCache	*cache);
+guint		 pk_results_cache_get_size		(PkResultsCache	*cache);
+guint		 pk_results_cache_get_hits		(PkResultsCache	*cache);
+guint		 pk_results_cache_get_misses		(PkResultsCache	*cache);
+
+G_END_DECLS
+
+#endif /* __PK_RESULTS_CACHE_H */
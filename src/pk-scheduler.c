@@ -42,6 +42,11 @@
  * 		ELSE
  * 			Do nothing
  * 		Transaction.Destroy()
+ *
+ * Transactions that have to wait are queued by class: interactive queries
+ * run first, then the transactions changing the system, then background
+ * queries. A transaction waiting longer than PK_SCHEDULER_AGING_TIMEOUT is
+ * run before any other class, so background work is not starved.
 **/
 
 #include "config.h"
@@ -87,9 +92,27 @@ static void     pk_scheduler_finalize	(GObject	*object);
 /* maximum number of requests a given user is able to request and queue */
 #define PK_SCHEDULER_SIMULTANEOUS_TRANSACTIONS_FOR_UID	500
 
+/* how long a transaction waits before it is run ahead of its class */
+#define PK_SCHEDULER_AGING_TIMEOUT			30 /* s */
+
+typedef enum {
+	PK_SCHEDULER_QUEUE_INTERACTIVE,
+	PK_SCHEDULER_QUEUE_EXCLUSIVE,
+	PK_SCHEDULER_QUEUE_BACKGROUND,
+	PK_SCHEDULER_QUEUE_LAST
+} PkSchedulerQueue;
+
+typedef struct {
+	GQueue			*items;
+	guint			 started;
+	guint64			 wait_total;	/* ms */
+	guint64			 wait_max;	/* ms */
+} PkSchedulerQueueData;
+
 struct PkSchedulerPrivate
 {
 	GPtrArray		*array;
+	PkSchedulerQueueData	 queues[PK_SCHEDULER_QUEUE_LAST];
 	guint			 unwedge_id;
 	GKeyFile		*conf;
 	PkBackend		*backend;
@@ -108,6 +131,8 @@ typedef struct {
 	gulong			 allow_cancel_changed_id;
 	guint			 uid;
 	guint			 tries;
+	PkSchedulerQueue	 queue;
+	gint64			 ready_time;
 } PkSchedulerItem;
 
 enum {
@@ -236,6 +261,7 @@ pk_scheduler_remove_internal (PkScheduler *scheduler, PkSchedulerItem *item)
 		g_warning ("could not remove %p as not present in list", item);
 		return FALSE;
 	}
+	g_queue_remove (scheduler->priv->queues[item->queue].items, item);
 	pk_scheduler_item_free (item);
 
 	return TRUE;
@@ -321,6 +347,17 @@ pk_scheduler_run_idle_cb (PkSchedulerItem *item)
 static void
 pk_scheduler_run_item (PkScheduler *scheduler, PkSchedulerItem *item)
 {
+	PkSchedulerQueueData *queue;
+	guint64 wait;
+
+	/* how long it waited since it was committed */
+	queue = &scheduler->priv->queues[item->queue];
+	g_queue_remove (queue->items, item);
+	wait = (g_get_monotonic_time () - item->ready_time) / 1000;
+	queue->started++;
+	queue->wait_total += wait;
+	queue->wait_max = MAX (queue->wait_max, wait);
+
 	/* we set this here so that we don't try starting more than one */
 	pk_transaction_set_state (item->transaction, PK_TRANSACTION_STATE_RUNNING);
 
@@ -419,59 +456,130 @@ pk_scheduler_get_background_running (PkScheduler *scheduler)
 	return FALSE;
 }
 
+/**
+ * pk_scheduler_role_is_query:
+ *
+ * Return value: %TRUE if the role only reads the package database
+ **/
+static gboolean
+pk_scheduler_role_is_query (PkRoleEnum role)
+{
+	switch (role) {
+	case PK_ROLE_ENUM_DEPENDS_ON:
+	case PK_ROLE_ENUM_GET_CATEGORIES:
+	case PK_ROLE_ENUM_GET_DETAILS:
+	case PK_ROLE_ENUM_GET_DETAILS_LOCAL:
+	case PK_ROLE_ENUM_GET_DISTRO_UPGRADES:
+	case PK_ROLE_ENUM_GET_FILES:
+	case PK_ROLE_ENUM_GET_FILES_LOCAL:
+	case PK_ROLE_ENUM_GET_OLD_TRANSACTIONS:
+	case PK_ROLE_ENUM_GET_PACKAGES:
+	case PK_ROLE_ENUM_GET_REPO_LIST:
+	case PK_ROLE_ENUM_GET_UPDATE_DETAIL:
+	case PK_ROLE_ENUM_GET_UPDATES:
+	case PK_ROLE_ENUM_REQUIRED_BY:
+	case PK_ROLE_ENUM_RESOLVE:
+	case PK_ROLE_ENUM_SEARCH_DETAILS:
+	case PK_ROLE_ENUM_SEARCH_FILE:
+	case PK_ROLE_ENUM_SEARCH_GROUP:
+	case PK_ROLE_ENUM_SEARCH_NAME:
+	case PK_ROLE_ENUM_WHAT_PROVIDES:
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
+/**
+ * pk_scheduler_get_queue_for_item:
+ **/
+static PkSchedulerQueue
+pk_scheduler_get_queue_for_item (PkSchedulerItem *item)
+{
+	if (!pk_scheduler_role_is_query (pk_transaction_get_role (item->transaction)))
+		return PK_SCHEDULER_QUEUE_EXCLUSIVE;
+	if (pk_transaction_get_background (item->transaction))
+		return PK_SCHEDULER_QUEUE_BACKGROUND;
+	return PK_SCHEDULER_QUEUE_INTERACTIVE;
+}
+
+/**
+ * pk_scheduler_queue_to_string:
+ **/
+static const gchar *
+pk_scheduler_queue_to_string (PkSchedulerQueue queue)
+{
+	if (queue == PK_SCHEDULER_QUEUE_INTERACTIVE)
+		return "interactive";
+	if (queue == PK_SCHEDULER_QUEUE_EXCLUSIVE)
+		return "exclusive";
+	if (queue == PK_SCHEDULER_QUEUE_BACKGROUND)
+		return "background";
+	return NULL;
+}
+
+/**
+ * pk_scheduler_get_queue_head:
+ *
+ * Return value: the first transaction of the queue that can run now
+ **/
+static PkSchedulerItem *
+pk_scheduler_get_queue_head (PkScheduler *scheduler,
+			     PkSchedulerQueue queue,
+			     gboolean exclusive_running)
+{
+	GList *l;
+	PkSchedulerItem *item;
+
+	for (l = scheduler->priv->queues[queue].items->head; l != NULL; l = l->next) {
+		item = (PkSchedulerItem *) l->data;
+		if (pk_transaction_get_state (item->transaction) != PK_TRANSACTION_STATE_READY)
+			continue;
+		if (exclusive_running && pk_transaction_is_exclusive (item->transaction))
+			continue;
+		return item;
+	}
+	return NULL;
+}
+
 /**
  * pk_scheduler_get_next_item:
  **/
 static PkSchedulerItem *
 pk_scheduler_get_next_item (PkScheduler *scheduler)
 {
-	PkSchedulerItem *item = NULL;
-	GPtrArray *array;
-	guint i;
-	PkTransactionState state;
+	PkSchedulerItem *item;
+	PkSchedulerItem *heads[PK_SCHEDULER_QUEUE_LAST];
+	PkSchedulerItem *oldest = NULL;
 	gboolean exclusive_running;
-
-	array = scheduler->priv->array;
+	gint64 aged;
+	guint i;
 
 	/* check for running exclusive transaction */
 	exclusive_running = pk_scheduler_get_exclusive_running (scheduler) > 0;
-
-	/* first try the waiting non-background transactions */
-	for (i = 0; i < array->len; i++) {
-		item = (PkSchedulerItem *) g_ptr_array_index (array, i);
-		state = pk_transaction_get_state (item->transaction);
-
-		if ((state == PK_TRANSACTION_STATE_READY) && (!pk_transaction_get_background (item->transaction))) {
-			/* check if we can run the transaction now or if we need to wait for lock release */
-			if (pk_transaction_is_exclusive (item->transaction)) {
-				if (!exclusive_running)
-					goto out;
-			} else {
-				goto out;
-			}
-		}
+	for (i = 0; i < PK_SCHEDULER_QUEUE_LAST; i++)
+		heads[i] = pk_scheduler_get_queue_head (scheduler, i, exclusive_running);
+
+	/* anything waiting for too long goes first, oldest first */
+	aged = g_get_monotonic_time () - PK_SCHEDULER_AGING_TIMEOUT * G_USEC_PER_SEC;
+	for (i = 0; i < PK_SCHEDULER_QUEUE_LAST; i++) {
+		item = heads[i];
+		if (item == NULL || item->ready_time > aged)
+			continue;
+		if (oldest == NULL || item->ready_time < oldest->ready_time)
+			oldest = item;
 	}
+	if (oldest != NULL)
+		return oldest;
 
-	/* then try the other waiting transactions (background tasks) */
-	for (i = 0; i < array->len; i++) {
-		item = (PkSchedulerItem *) g_ptr_array_index (array, i);
-		state = pk_transaction_get_state (item->transaction);
-
-		if (state == PK_TRANSACTION_STATE_READY) {
-			/* check if we can run the transaction now or if we need to wait for lock release */
-			if (pk_transaction_is_exclusive (item->transaction)) {
-				if (!exclusive_running)
-					goto out;
-			} else {
-				goto out;
-			}
-		}
+	/* then by class */
+	for (i = 0; i < PK_SCHEDULER_QUEUE_LAST; i++) {
+		if (heads[i] != NULL)
+			return heads[i];
 	}
 
 	/* nothing to run */
-	item = NULL;
-out:
-	return item;
+	return NULL;
 }
 
 /**
@@ -495,6 +603,11 @@ pk_scheduler_commit (PkScheduler *scheduler, const gchar *tid)
 	if (!pk_backend_supports_parallelization (scheduler->priv->backend))
 		pk_transaction_make_exclusive (item->transaction);
 
+	/* the class it waits in if it cannot run now */
+	g_queue_remove (scheduler->priv->queues[item->queue].items, item);
+	item->queue = pk_scheduler_get_queue_for_item (item);
+	item->ready_time = g_get_monotonic_time ();
+
 	/* we've been 'used' */
 	if (item->commit_id != 0) {
 		g_source_remove (item->commit_id);
@@ -515,8 +628,13 @@ pk_scheduler_commit (PkScheduler *scheduler, const gchar *tid)
 
 	/* do the transaction now, if possible */
 	if (pk_transaction_is_exclusive (item->transaction) == FALSE ||
-	    pk_scheduler_get_exclusive_running (scheduler) == 0)
+	    pk_scheduler_get_exclusive_running (scheduler) == 0) {
 		pk_scheduler_run_item (scheduler, item);
+		return;
+	}
+	g_debug ("queueing %s as %s", item->tid,
+		 pk_scheduler_queue_to_string (item->queue));
+	g_queue_push_tail (scheduler->priv->queues[item->queue].items, item);
 }
 
 /**
@@ -603,6 +721,7 @@ pk_scheduler_transaction_finished_cb (PkTransaction *transaction,
 			item->commit_id = 0;
 		}
 		pk_transaction_set_state (item->transaction, PK_TRANSACTION_STATE_FINISHED);
+		g_queue_remove (scheduler->priv->queues[item->queue].items, item);
 
 		/* give the client a few seconds to still query the runner */
 		item->remove_id = g_timeout_add_seconds (PK_TRANSACTION_KEEP_FINISHED_TIMOUT,
@@ -948,11 +1067,12 @@ pk_scheduler_get_state (PkScheduler *scheduler)
 
 		role = pk_transaction_get_role (item->transaction);
 		g_string_append_printf (string, "%0i\t%s\t%s\tstate[%s] "
-					"exclusive[%i] background[%i]\n", i,
+					"exclusive[%i] background[%i] queue[%s]\n", i,
 					pk_role_enum_to_string (role), item->tid,
 					pk_transaction_state_to_string (state),
 					pk_transaction_is_exclusive (item->transaction),
-					pk_transaction_get_background (item->transaction));
+					pk_transaction_get_background (item->transaction),
+					pk_scheduler_queue_to_string (item->queue));
 	}
 
 	/* nothing running */
@@ -962,6 +1082,35 @@ out:
 	return g_string_free (string, FALSE);
 }
 
+/**
+ * pk_scheduler_get_stats:
+ *
+ * Return value: for each class of transactions, the name, the number of
+ * transactions waiting, the number started, and the mean and maximum
+ * time in ms they waited before they started, as a(suuuu)
+ **/
+GVariant *
+pk_scheduler_get_stats (PkScheduler *scheduler)
+{
+	GVariantBuilder builder;
+	PkSchedulerQueueData *queue;
+	guint i;
+
+	g_return_val_if_fail (PK_IS_SCHEDULER (scheduler), NULL);
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(suuuu)"));
+	for (i = 0; i < PK_SCHEDULER_QUEUE_LAST; i++) {
+		queue = &scheduler->priv->queues[i];
+		g_variant_builder_add (&builder, "(suuuu)",
+				       pk_scheduler_queue_to_string (i),
+				       g_queue_get_length (queue->items),
+				       queue->started,
+				       queue->started > 0 ? (guint) (queue->wait_total / queue->started) : 0,
+				       (guint) MIN (queue->wait_max, G_MAXUINT));
+	}
+	return g_variant_builder_end (&builder);
+}
+
 /**
  * pk_scheduler_print:
  **/
@@ -1107,8 +1256,12 @@ pk_scheduler_class_init (PkSchedulerClass *klass)
 static void
 pk_scheduler_init (PkScheduler *scheduler)
 {
+	guint i;
+
 	scheduler->priv = PK_SCHEDULER_GET_PRIVATE (scheduler);
 	scheduler->priv->array = g_ptr_array_new ();
+	for (i = 0; i < PK_SCHEDULER_QUEUE_LAST; i++)
+		scheduler->priv->queues[i].items = g_queue_new ();
 	scheduler->priv->introspection = pk_load_introspection (PK_DBUS_INTERFACE_TRANSACTION ".xml",
 							    NULL);
 	scheduler->priv->unwedge_id = g_timeout_add_seconds (PK_TRANSACTION_WEDGE_CHECK,
@@ -1124,6 +1277,7 @@ static void
 pk_scheduler_finalize (GObject *object)
 {
 	PkScheduler *scheduler;
+	guint i;
 
 	g_return_if_fail (PK_IS_SCHEDULER (object));
 
@@ -1136,6 +1290,8 @@ pk_scheduler_finalize (GObject *object)
 
 	g_ptr_array_foreach (scheduler->priv->array, (GFunc) pk_scheduler_item_free, NULL);
 	g_ptr_array_free (scheduler->priv->array, TRUE);
+	for (i = 0; i < PK_SCHEDULER_QUEUE_LAST; i++)
+		g_queue_free (scheduler->priv->queues[i].items);
 	g_dbus_node_info_unref (scheduler->priv->introspection);
 	g_key_file_unref (scheduler->priv->conf);
 	if (scheduler->priv->backend != NULL)
@@ -24,6 +24,7 @@
 #include <glib.h>
 #include <glib-object.h>
 #include <glib/gstdio.h>
+#include <string.h>
 
 #include "pk-cleanup.h"
 #include "pk-backend.h"
@@ -325,6 +326,76 @@ pk_test_backend_spawn_package_cb (PkBackend *backend, PkInfoEnum info,
 	_backend_spawn_number_packages++;
 }
 
+/**
+ * pk_test_backend_spawn_frame:
+ **/
+static GByteArray *
+pk_test_backend_spawn_frame (guint8 command, const gchar *first_field, ...)
+{
+	GByteArray *frame;
+	const gchar *field;
+	guint32 length;
+	va_list args;
+
+	frame = g_byte_array_new ();
+	g_byte_array_append (frame, &command, 1);
+	g_byte_array_append (frame, (const guint8 *) "", 1);
+	va_start (args, first_field);
+	for (field = first_field; field != NULL; field = va_arg (args, const gchar *)) {
+		length = strlen (field);
+		g_byte_array_append (frame, (const guint8 *) &length, sizeof (length));
+		g_byte_array_append (frame, (const guint8 *) field, length + 1);
+		frame->data[1]++;
+	}
+	va_end (args);
+	return frame;
+}
+
+static void
+pk_test_backend_spawn_throughput_func (void)
+{
+	gboolean ret;
+	gdouble elapsed;
+	guint i;
+	GByteArray *frame;
+	_cleanup_keyfile_unref_ GKeyFile *conf = NULL;
+	_cleanup_object_unref_ PkBackend *backend = NULL;
+	_cleanup_object_unref_ PkBackendJob *job = NULL;
+	_cleanup_object_unref_ PkBackendSpawn *backend_spawn = NULL;
+
+	conf = g_key_file_new ();
+	g_key_file_set_string (conf, "Daemon", "DefaultBackend", "test_spawn");
+	backend_spawn = pk_backend_spawn_new (conf);
+	ret = pk_backend_spawn_set_name (backend_spawn, "test_spawn");
+	g_assert (ret);
+	backend = pk_backend_new (conf);
+	job = pk_backend_job_new (conf);
+	pk_backend_job_set_backend (job, backend);
+	ret = pk_backend_load (backend, NULL);
+	g_assert (ret);
+
+	/* compare the throughput of lines and frames */
+	frame = pk_test_backend_spawn_frame (1, "available",
+					     "gnome-power-manager;0.0.1;i386;data",
+					     "More useless software", NULL);
+	g_test_timer_start ();
+	for (i = 0; i < 100000; i++) {
+		pk_backend_spawn_inject_data (backend_spawn, job,
+			"package\tavailable\tgnome-power-manager;0.0.1;i386;data\tMore useless software", NULL);
+	}
+	elapsed = g_test_timer_elapsed ();
+	g_debug ("lines: %.0f/sec", 100000 / elapsed);
+	g_test_timer_start ();
+	for (i = 0; i < 100000; i++)
+		pk_backend_spawn_inject_frame (backend_spawn, job, frame->data, frame->len, NULL);
+	elapsed = g_test_timer_elapsed ();
+	g_debug ("frames: %.0f/sec", 100000 / elapsed);
+	g_byte_array_unref (frame);
+
+	ret = pk_backend_unload (backend);
+	g_assert (ret);
+}
+
 static void
 pk_test_backend_spawn_func (void)
 {
@@ -332,6 +403,9 @@ pk_test_backend_spawn_func (void)
 	const gchar *text;
 	gboolean ret;
 	gchar *uri;
+	guint reused;
+	guint started;
+	GByteArray *frame;
 	GError *error = NULL;
 	_cleanup_keyfile_unref_ GKeyFile *conf = NULL;
 	_cleanup_object_unref_ PkBackend *backend = NULL;
@@ -437,6 +511,31 @@ pk_test_backend_spawn_func (void)
 		"package\tinstalled\tgnome-power-manager;0.0.1;i386;data\tMore useless software", NULL);
 	g_assert (ret);
 
+	/* test pk_backend_spawn_inject_frame Package */
+	frame = pk_test_backend_spawn_frame (1, "installed",
+					     "gnome-power-manager;0.0.1;i386;data",
+					     "More useless software", NULL);
+	ret = pk_backend_spawn_inject_frame (backend_spawn, job, frame->data, frame->len, NULL);
+	g_assert (ret);
+
+	/* test pk_backend_spawn_inject_frame truncated */
+	ret = pk_backend_spawn_inject_frame (backend_spawn, job, frame->data, frame->len - 1, NULL);
+	g_assert (!ret);
+	g_byte_array_unref (frame);
+
+	/* test pk_backend_spawn_inject_frame invalid PackageId */
+	frame = pk_test_backend_spawn_frame (1, "installed", "gnome-power-manager",
+					     "More useless software", NULL);
+	ret = pk_backend_spawn_inject_frame (backend_spawn, job, frame->data, frame->len, NULL);
+	g_assert (!ret);
+	g_byte_array_unref (frame);
+
+	/* test pk_backend_spawn_inject_frame unknown command by name */
+	frame = pk_test_backend_spawn_frame (0, "status", "query", NULL);
+	ret = pk_backend_spawn_inject_frame (backend_spawn, job, frame->data, frame->len, NULL);
+	g_assert (ret);
+	g_byte_array_unref (frame);
+
 	/* manually unlock as we have no engine */
 	ret = pk_backend_unload (backend);
 	g_assert (ret);
@@ -477,6 +576,11 @@ pk_test_backend_spawn_func (void)
 	/* test number of packages */
 	g_assert_cmpint (_backend_spawn_number_packages, ==, 2);
 
+	/* the script is not a dispatcher, so it had to be started */
+	pk_backend_get_helper_stats (backend, &reused, &started);
+	g_assert_cmpint (reused, ==, 0);
+	g_assert_cmpint (started, ==, 1);
+
 	/* manually unlock as we have no engine */
 	ret = pk_backend_unload (backend);
 	g_assert (ret);
@@ -694,6 +798,12 @@ pk_test_spawn_func (void)
 
 	/* dispatcher still alive? */
 	g_assert (pk_spawn_is_running (spawn));
+	g_assert (pk_spawn_is_dispatcher (spawn));
+
+	/* the new locale is sent rather than starting a new instance */
+	g_strfreev (envp);
+	envp = g_strsplit ("NETWORK=TRUE LANG=en_GB.UTF-8 BACKGROUND=TRUE INTERACTIVE=TRUE", " ", 0);
+	g_assert (pk_spawn_is_reusable (spawn, argv, envp));
 
 	/* run the dispatcher with new input */
 	ret = pk_spawn_argv (spawn, argv, envp, PK_SPAWN_ARGV_FLAGS_NONE, &error);
@@ -731,6 +841,50 @@ pk_test_spawn_func (void)
 	g_assert (!ret);
 }
 
+static gdouble first_line_elapsed = 0.f;
+
+/**
+ * pk_test_spawn_latency_stdout_cb:
+ **/
+static void
+pk_test_spawn_latency_stdout_cb (PkSpawn *spawn, const gchar *line, gpointer user_data)
+{
+	if (first_line_elapsed == 0.f)
+		first_line_elapsed = g_test_timer_elapsed ();
+}
+
+static void
+pk_test_spawn_latency_func (void)
+{
+	gboolean ret;
+	gdouble elapsed;
+	_cleanup_error_free_ GError *error = NULL;
+	_cleanup_object_unref_ PkSpawn *spawn = NULL;
+	_cleanup_strv_free_ gchar **argv = NULL;
+
+	new_spawn_object (&spawn);
+	g_signal_connect (spawn, "stdout",
+			  G_CALLBACK (pk_test_spawn_latency_stdout_cb), NULL);
+
+	/* one line, then 100k packages as fast as the helper can write */
+	mexit = PK_SPAWN_EXIT_TYPE_UNKNOWN;
+	first_line_elapsed = 0.f;
+	argv = g_strsplit (TESTDATADIR "/pk-spawn-test-latency.sh", " ", 0);
+	g_test_timer_start ();
+	ret = pk_spawn_argv (spawn, argv, NULL, PK_SPAWN_ARGV_FLAGS_NONE, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	_g_test_loop_run_with_timeout (10000);
+	elapsed = g_test_timer_elapsed ();
+	g_assert_cmpint (mexit, ==, PK_SPAWN_EXIT_TYPE_SUCCESS);
+	g_assert_cmpint (stdout_count, ==, 1 + 100000);
+
+	/* the first line does not wait for a poll, nor for the packages */
+	g_debug ("first line after %.1fms, all lines after %.1fms",
+		 first_line_elapsed * 1000, elapsed * 1000);
+	g_assert_cmpfloat (first_line_elapsed, >, 0.f);
+}
+
 static void
 pk_test_transaction_func (void)
 {
@@ -763,9 +917,166 @@ pk_test_transaction_func (void)
 	g_dbus_node_info_unref (introspection);
 }
 
+/**
+ * pk_test_backend_job_packages_cb:
+ **/
+static void
+pk_test_backend_job_packages_cb (PkBackendJob *job, GPtrArray *array, GString *events)
+{
+	g_string_append_printf (events, "packages:%i;", array->len);
+}
+
+/**
+ * pk_test_backend_job_percentage_cb:
+ **/
+static void
+pk_test_backend_job_percentage_cb (PkBackendJob *job, gpointer object, GString *events)
+{
+	g_string_append_printf (events, "percentage:%i;", GPOINTER_TO_UINT (object));
+}
+
+static void
+pk_test_backend_job_packages_func (void)
+{
+	guint i;
+	gdouble ms;
+	_cleanup_keyfile_unref_ GKeyFile *conf = NULL;
+	_cleanup_object_unref_ PkBackendJob *job = NULL;
+	GString *events;
+
+	conf = g_key_file_new ();
+	job = pk_backend_job_new (conf);
+	events = g_string_new ("");
+	pk_backend_job_set_vfunc (job,
+				  PK_BACKEND_SIGNAL_PACKAGES,
+				  (PkBackendJobVFunc) pk_test_backend_job_packages_cb,
+				  events);
+	pk_backend_job_set_vfunc (job,
+				  PK_BACKEND_SIGNAL_PERCENTAGE,
+				  (PkBackendJobVFunc) pk_test_backend_job_percentage_cb,
+				  events);
+
+	/* all the packages emitted before the main loop runs are sent at once */
+	g_test_timer_start ();
+	for (i = 0; i < 10000; i++) {
+		_cleanup_free_ gchar *package_id = NULL;
+		package_id = g_strdup_printf ("pkg%i;1.0;noarch;repo", i);
+		pk_backend_job_package (job, PK_INFO_ENUM_AVAILABLE, package_id, "summary");
+	}
+	_g_test_loop_wait (50);
+	ms = g_test_timer_elapsed ();
+	g_assert_cmpstr (events->str, ==, "packages:10000;");
+	g_assert_cmpfloat (ms, <, 1.0);
+	g_string_truncate (events, 0);
+
+	/* other signals keep their place between the batches */
+	pk_backend_job_package (job, PK_INFO_ENUM_AVAILABLE, "foo;1.0;noarch;repo", "summary");
+	pk_backend_job_package (job, PK_INFO_ENUM_AVAILABLE, "bar;1.0;noarch;repo", "summary");
+	pk_backend_job_set_percentage (job, 50);
+	pk_backend_job_package (job, PK_INFO_ENUM_AVAILABLE, "baz;1.0;noarch;repo", "summary");
+	_g_test_loop_wait (50);
+	g_assert_cmpstr (events->str, ==, "packages:2;percentage:50;packages:1;");
+
+	g_string_free (events, TRUE);
+}
+
+#define PK_TEST_BACKEND_JOB_PROGRESS_UPDATES	1000000
+
+/**
+ * pk_test_backend_job_speed_cb:
+ **/
+static void
+pk_test_backend_job_speed_cb (PkBackendJob *job, gpointer object, guint *calls)
+{
+	(*calls)++;
+	if (GPOINTER_TO_UINT (object) == PK_TEST_BACKEND_JOB_PROGRESS_UPDATES)
+		_g_test_loop_quit ();
+}
+
+/**
+ * pk_test_backend_job_progress_thread:
+ **/
+static gpointer
+pk_test_backend_job_progress_thread (gpointer user_data)
+{
+	PkBackendJob *job = PK_BACKEND_JOB (user_data);
+	guint i;
+
+	/* like a package manager reporting every block it downloads */
+	for (i = 1; i <= PK_TEST_BACKEND_JOB_PROGRESS_UPDATES; i++)
+		pk_backend_job_set_speed (job, i);
+	return NULL;
+}
+
+static void
+pk_test_backend_job_progress_func (void)
+{
+	GThread *thread;
+	gdouble elapsed;
+	guint calls = 0;
+	_cleanup_keyfile_unref_ GKeyFile *conf = NULL;
+	_cleanup_object_unref_ PkBackendJob *job = NULL;
+
+	conf = g_key_file_new ();
+	g_key_file_set_integer (conf, "Daemon", "ProgressUpdateRate", 20);
+	job = pk_backend_job_new (conf);
+	pk_backend_job_set_vfunc (job,
+				  PK_BACKEND_SIGNAL_SPEED,
+				  (PkBackendJobVFunc) pk_test_backend_job_speed_cb,
+				  &calls);
+
+	/* only the latest value is sent, at most 20 times a second */
+	g_test_timer_start ();
+	thread = g_thread_new ("pk-self-test", pk_test_backend_job_progress_thread, job);
+	_g_test_loop_run_with_timeout (30000);
+	elapsed = g_test_timer_elapsed ();
+	g_thread_join (thread);
+	g_debug ("%i progress updates sent %u times in %.0fms",
+		 PK_TEST_BACKEND_JOB_PROGRESS_UPDATES, calls, elapsed * 1000);
+	g_assert_cmpint (calls, >, 0);
+	g_assert_cmpint (calls, <=, elapsed * 20 + 2);
+}
+
+/**
+ * pk_test_backend_job_item_progress_cb:
+ **/
+static void
+pk_test_backend_job_item_progress_cb (PkBackendJob *job, PkItemProgress *item, GString *str)
+{
+	g_string_append_printf (str, "%s:%u;",
+				pk_item_progress_get_package_id (item),
+				pk_item_progress_get_percentage (item));
+}
+
+static void
+pk_test_backend_job_item_progress_func (void)
+{
+	_cleanup_keyfile_unref_ GKeyFile *conf = NULL;
+	_cleanup_object_unref_ PkBackendJob *job = NULL;
+	_cleanup_string_free_ GString *str = g_string_new ("");
+
+	conf = g_key_file_new ();
+	job = pk_backend_job_new (conf);
+	pk_backend_job_set_vfunc (job,
+				  PK_BACKEND_SIGNAL_ITEM_PROGRESS,
+				  (PkBackendJobVFunc) pk_test_backend_job_item_progress_cb,
+				  str);
+
+	/* only the latest of each package, but still in order */
+	pk_backend_job_set_item_progress (job, "a;0.1;i386;data", PK_STATUS_ENUM_DOWNLOAD, 10);
+	pk_backend_job_set_item_progress (job, "a;0.1;i386;data", PK_STATUS_ENUM_DOWNLOAD, 100);
+	pk_backend_job_set_item_progress (job, "b;0.1;i386;data", PK_STATUS_ENUM_DOWNLOAD, 10);
+	while (g_main_context_iteration (NULL, FALSE));
+	g_assert_cmpstr (str->str, ==, "a;0.1;i386;data:100;b;0.1;i386;data:10;");
+}
+
+#define PK_TEST_TRANSACTION_DB_RECORDS	10000
+
 static void
 pk_test_transaction_db_func (void)
 {
+	GList *list;
+	gint i;
 	guint value;
 	gchar *tid;
 	gboolean ret;
@@ -783,6 +1094,8 @@ pk_test_transaction_db_func (void)
 		value = g_unlink ("./transactions.db");
 		g_assert (value == 0);
 	}
+	g_unlink ("./transactions.db-wal");
+	g_unlink ("./transactions.db-shm");
 #endif
 	/* check we created quickly */
 	g_test_timer_start ();
@@ -889,6 +1202,132 @@ pk_test_transaction_db_func (void)
 	g_assert (ret);
 	g_assert_cmpstr (proxy_http, ==, "127.0.0.1:80");
 	g_assert_cmpstr (proxy_ftp, ==, "127.0.0.1:21");
+
+	/* record lots of transactions, as the daemon does */
+	g_test_timer_start ();
+	for (i = 0; i < PK_TEST_TRANSACTION_DB_RECORDS; i++) {
+		_cleanup_free_ gchar *tid_tmp = NULL;
+		tid_tmp = pk_transaction_db_generate_id (db);
+		pk_transaction_db_begin (db);
+		pk_transaction_db_add (db, tid_tmp);
+		pk_transaction_db_set_role (db, tid_tmp, PK_ROLE_ENUM_INSTALL_PACKAGES);
+		pk_transaction_db_set_uid (db, tid_tmp, 500);
+		pk_transaction_db_set_cmdline (db, tid_tmp, "pk-self-test");
+		pk_transaction_db_commit (db);
+		pk_transaction_db_begin (db);
+		pk_transaction_db_set_data (db, tid_tmp, "installing\tglib2;2.14.0;i386;fedora");
+		pk_transaction_db_action_time_reset (db, PK_ROLE_ENUM_INSTALL_PACKAGES);
+		pk_transaction_db_set_finished (db, tid_tmp, TRUE, 1000);
+		pk_transaction_db_commit (db);
+	}
+	ms = g_test_timer_elapsed ();
+	g_debug ("recorded %i transactions in %.0fms",
+		 PK_TEST_TRANSACTION_DB_RECORDS, ms * 1000);
+	g_assert_cmpfloat (ms, <, 10.0);
+
+	/* get the most recent ones back */
+	g_test_timer_start ();
+	list = pk_transaction_db_get_list (db, 10);
+	ms = g_test_timer_elapsed ();
+	g_assert_cmpint (g_list_length (list), ==, 10);
+	g_assert_cmpfloat (ms, <, 0.1);
+	g_assert_cmpint (pk_transaction_past_get_role (list->data), ==, PK_ROLE_ENUM_INSTALL_PACKAGES);
+	g_assert (pk_transaction_past_get_succeeded (list->data));
+	g_list_free_full (list, (GDestroyNotify) g_object_unref);
+}
+
+/* five years of daily updates, of a few packages each */
+#define PK_TEST_TRANSACTION_DB_HISTORY_DAYS		(5 * 365)
+#define PK_TEST_TRANSACTION_DB_HISTORY_UPDATES		20
+#define PK_TEST_TRANSACTION_DB_HISTORY_PACKAGES		500
+
+static void
+pk_test_transaction_db_history_func (void)
+{
+	gboolean ret;
+	gdouble elapsed;
+	gint64 timestamp = 1262304000;
+	guint i;
+	guint j;
+	GError *error = NULL;
+	PkTransactionDbHistoryItem *item;
+	_cleanup_object_unref_ PkTransactionDb *tdb = NULL;
+	_cleanup_ptrarray_unref_ GPtrArray *history = NULL;
+
+	tdb = pk_transaction_db_new ();
+	ret = pk_transaction_db_load (tdb, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+
+	/* each package is updated once every 25 days */
+	g_test_timer_start ();
+	for (i = 0; i < PK_TEST_TRANSACTION_DB_HISTORY_DAYS; i++) {
+		_cleanup_free_ gchar *tid = NULL;
+		_cleanup_ptrarray_unref_ GPtrArray *packages = NULL;
+
+		packages = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+		for (j = 0; j < PK_TEST_TRANSACTION_DB_HISTORY_UPDATES; j++) {
+			PkPackage *package;
+			_cleanup_free_ gchar *package_id = NULL;
+			package_id = g_strdup_printf ("pk-self-test-%u;1.%u;x86_64;fedora",
+						      (i * PK_TEST_TRANSACTION_DB_HISTORY_UPDATES + j) %
+						      PK_TEST_TRANSACTION_DB_HISTORY_PACKAGES, i);
+			package = pk_package_new ();
+			ret = pk_package_set_id (package, package_id, &error);
+			g_assert_no_error (error);
+			g_assert (ret);
+			pk_package_set_info (package, PK_INFO_ENUM_UPDATING);
+			g_ptr_array_add (packages, package);
+		}
+		tid = pk_transaction_db_generate_id (tdb);
+		if (i >= PK_TEST_TRANSACTION_DB_HISTORY_DAYS - 50)
+			pk_transaction_db_add (tdb, tid);
+		ret = pk_transaction_db_add_history (tdb, tid, 500,
+						     timestamp + i * 24 * 60 * 60,
+						     packages);
+		g_assert (ret);
+	}
+	elapsed = g_test_timer_elapsed ();
+	g_debug ("recorded %i days of history in %.0fms",
+		 PK_TEST_TRANSACTION_DB_HISTORY_DAYS, elapsed * 1000);
+
+	/* get all the history of one package */
+	g_test_timer_start ();
+	history = pk_transaction_db_get_package_history (tdb, "pk-self-test-7", 0);
+	elapsed = g_test_timer_elapsed ();
+	g_debug ("got history of %u updates in %.1fms", history->len, elapsed * 1000);
+	g_assert_cmpint (history->len, ==, PK_TEST_TRANSACTION_DB_HISTORY_DAYS / 25);
+	g_assert_cmpfloat (elapsed, <, 0.05);
+	item = g_ptr_array_index (history, 0);
+	g_assert_cmpint (item->info, ==, PK_INFO_ENUM_UPDATING);
+	g_assert_cmpstr (item->version, ==, "1.0");
+	g_assert_cmpstr (item->data, ==, "fedora");
+	g_assert_cmpint (item->timestamp, ==, timestamp);
+	g_assert_cmpint (item->uid, ==, 500);
+	g_ptr_array_unref (history);
+
+	/* only the last 50 transactions are searched, still oldest first */
+	history = pk_transaction_db_get_package_history (tdb, "pk-self-test-7", 50);
+	g_assert_cmpint (history->len, ==, 2);
+	item = g_ptr_array_index (history, 1);
+	g_assert_cmpstr (item->version, ==, "1.1800");
+	item = g_ptr_array_index (history, 0);
+	g_assert_cmpstr (item->version, ==, "1.1775");
+	g_ptr_array_unref (history);
+
+	/* not changed in the last two transactions */
+	history = pk_transaction_db_get_package_history (tdb, "pk-self-test-7", 2);
+	g_assert_cmpint (history->len, ==, 0);
+	g_ptr_array_unref (history);
+	history = pk_transaction_db_get_package_history (tdb, "pk-self-test-480", 2);
+	g_assert_cmpint (history->len, ==, 1);
+	item = g_ptr_array_index (history, 0);
+	g_assert_cmpstr (item->version, ==, "1.1824");
+	g_ptr_array_unref (history);
+
+	/* unknown package */
+	history = pk_transaction_db_get_package_history (tdb, "pk-self-test-none", 0);
+	g_assert_cmpint (history->len, ==, 0);
 }
 
 static PkTransactionDb *db = NULL;
@@ -930,6 +1369,10 @@ pk_test_scheduler_func (void)
 	gchar *tid;
 	guint size;
 	gchar **array;
+	const gchar *queue;
+	guint depth;
+	guint started;
+	GVariant *stats;
 	PkTransaction *transaction;
 	GError *error = NULL;
 	_cleanup_free_ gchar *tid_item1 = NULL;
@@ -1139,6 +1582,18 @@ pk_test_scheduler_func (void)
 	g_assert_cmpint (size, ==, 3);
 	g_strfreev (array);
 
+	/* the two waiting foreground queries are in the interactive queue */
+	stats = pk_scheduler_get_stats (tlist);
+	g_assert_cmpint (g_variant_n_children (stats), ==, 3);
+	g_variant_get_child (stats, 0, "(&suuuu)", &queue, &depth, &started, NULL, NULL);
+	g_assert_cmpstr (queue, ==, "interactive");
+	g_assert_cmpint (depth, ==, 2);
+	g_assert_cmpint (started, ==, 2);
+	g_variant_get_child (stats, 1, "(&suuuu)", &queue, &depth, NULL, NULL, NULL);
+	g_assert_cmpstr (queue, ==, "exclusive");
+	g_assert_cmpint (depth, ==, 0);
+	g_variant_unref (stats);
+
 	/* wait for first action */
 	_g_test_loop_run_with_timeout (10000);
 
@@ -1214,6 +1669,13 @@ pk_test_scheduler_func (void)
 	transaction = pk_scheduler_get_transaction (tlist, tid_item3);
 	g_assert_cmpint (pk_transaction_get_state (transaction), ==, PK_TRANSACTION_STATE_FINISHED);
 
+	/* all of them started from the interactive queue, after GetUpdates */
+	stats = pk_scheduler_get_stats (tlist);
+	g_variant_get_child (stats, 0, "(&suuuu)", &queue, &depth, &started, NULL, NULL);
+	g_assert_cmpint (depth, ==, 0);
+	g_assert_cmpint (started, ==, 4);
+	g_variant_unref (stats);
+
 	/* wait for Cleanup */
 	_g_test_loop_wait (10000);
 
@@ -1438,6 +1900,110 @@ pk_test_scheduler_parallel_func (void)
 	g_object_unref (db);
 }
 
+/**
+ * pk_test_results_cache_run:
+ *
+ * Return value: how long the transaction took in seconds
+ **/
+static gdouble
+pk_test_results_cache_run (PkScheduler *tlist, const gchar *search)
+{
+	PkTransaction *transaction;
+	_cleanup_free_ gchar *tid = NULL;
+	_cleanup_strv_free_ gchar **array = NULL;
+
+	tid = pk_test_scheduler_create_transaction (tlist);
+	transaction = pk_scheduler_get_transaction (tlist, tid);
+	g_signal_connect (transaction, "finished",
+			  G_CALLBACK (pk_test_scheduler_finished_cb), NULL);
+
+	g_test_timer_start ();
+	if (search == NULL) {
+		pk_transaction_get_updates (transaction,
+					    g_variant_new ("(t)",
+							   pk_bitfield_value (PK_FILTER_ENUM_NONE)),
+					    NULL);
+	} else {
+		array = g_strsplit (search, " ", -1);
+		pk_transaction_search_names (transaction,
+					     g_variant_new ("(t^as)",
+							    pk_bitfield_value (PK_FILTER_ENUM_NONE),
+							    array),
+					     NULL);
+	}
+	_g_test_loop_run_with_timeout (10000);
+	g_assert_cmpint (pk_transaction_get_state (transaction), ==, PK_TRANSACTION_STATE_FINISHED);
+	return g_test_timer_elapsed ();
+}
+
+static void
+pk_test_results_cache_func (void)
+{
+	gboolean ret;
+	gdouble elapsed;
+	gdouble elapsed_first;
+	guint i;
+	PkResultsCache *cache;
+	GError *error = NULL;
+	_cleanup_keyfile_unref_ GKeyFile *conf = NULL;
+	_cleanup_object_unref_ PkBackend *backend = NULL;
+	_cleanup_object_unref_ PkScheduler *tlist = NULL;
+
+	db = pk_transaction_db_new ();
+	ret = pk_transaction_db_load (db, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+
+	conf = g_key_file_new ();
+	g_key_file_set_string (conf, "Daemon", "DefaultBackend", "dummy");
+	backend = pk_backend_new (conf);
+	ret = pk_backend_load (backend, NULL);
+	g_assert (ret);
+	tlist = pk_scheduler_new (conf);
+	pk_scheduler_set_backend (tlist, backend);
+	cache = pk_backend_get_results_cache (backend);
+
+	/* the first search runs the backend */
+	elapsed_first = pk_test_results_cache_run (tlist, "power");
+	g_assert_cmpint (pk_results_cache_get_misses (cache), ==, 1);
+	g_assert_cmpint (pk_results_cache_get_hits (cache), ==, 0);
+	g_assert_cmpint (pk_results_cache_get_size (cache), ==, 1);
+
+	/* the same search is answered from the cache */
+	elapsed = pk_test_results_cache_run (tlist, "power");
+	g_assert_cmpint (pk_results_cache_get_hits (cache), ==, 1);
+	g_assert_cmpfloat (elapsed, <, elapsed_first);
+
+	/* but not a different one */
+	pk_test_results_cache_run (tlist, "paul");
+	g_assert_cmpint (pk_results_cache_get_misses (cache), ==, 2);
+	g_assert_cmpint (pk_results_cache_get_size (cache), ==, 2);
+
+	/* the package database changed */
+	pk_backend_updates_changed (backend);
+	g_assert_cmpint (pk_results_cache_get_size (cache), ==, 0);
+	pk_test_results_cache_run (tlist, "power");
+	g_assert_cmpint (pk_results_cache_get_misses (cache), ==, 3);
+
+	/* the dummy backend does not check for updates when offline */
+	if (!pk_backend_is_online (backend)) {
+		g_object_unref (db);
+		return;
+	}
+
+	/* benchmark repeated GetUpdates */
+	elapsed_first = pk_test_results_cache_run (tlist, NULL);
+	elapsed = 0.f;
+	for (i = 0; i < 10; i++)
+		elapsed += pk_test_results_cache_run (tlist, NULL);
+	g_debug ("GetUpdates took %.1fms, then %.1fms on average from the cache",
+		 elapsed_first * 1000, elapsed * 100);
+	g_assert_cmpint (pk_results_cache_get_hits (cache), ==, 11);
+	g_assert_cmpfloat (elapsed / 10, <, elapsed_first);
+
+	g_object_unref (db);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -1461,11 +2027,20 @@ main (int argc, char **argv)
 	g_test_add_func ("/packagekit/transaction", pk_test_transaction_func);
 	g_test_add_func ("/packagekit/scheduler", pk_test_scheduler_func);
 	g_test_add_func ("/packagekit/scheduler-parallel", pk_test_scheduler_parallel_func);
+	g_test_add_func ("/packagekit/results-cache", pk_test_results_cache_func);
 	g_test_add_func ("/packagekit/transaction-db", pk_test_transaction_db_func);
+	g_test_add_func ("/packagekit/transaction-db-history", pk_test_transaction_db_history_func);
 
 	/* backend stuff */
 	g_test_add_func ("/packagekit/backend", pk_test_backend_func);
+	g_test_add_func ("/packagekit/backend-job-packages", pk_test_backend_job_packages_func);
+	g_test_add_func ("/packagekit/backend-job-progress", pk_test_backend_job_progress_func);
+	g_test_add_func ("/packagekit/backend-job-item-progress", pk_test_backend_job_item_progress_func);
 	g_test_add_func ("/packagekit/backend_spawn", pk_test_backend_spawn_func);
+	if (g_test_perf ()) {
+		g_test_add_func ("/packagekit/spawn-latency", pk_test_spawn_latency_func);
+		g_test_add_func ("/packagekit/backend_spawn-throughput", pk_test_backend_spawn_throughput_func);
+	}
 
 	return g_test_run ();
 }
@@ -38,6 +38,10 @@
 #include <sys/wait.h>
 #include <fcntl.h>
 
+#ifdef linux
+  #include <sys/syscall.h>
+#endif
+
 #include <glib/gi18n.h>
 
 #include "pk-cleanup.h"
@@ -47,8 +51,13 @@
 static void     pk_spawn_finalize	(GObject       *object);
 
 #define PK_SPAWN_GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), PK_TYPE_SPAWN, PkSpawnPrivate))
-#define PK_SPAWN_POLL_DELAY	50 /* ms */
+#define PK_SPAWN_POLL_DELAY	50 /* ms, only without pidfd */
 #define PK_SPAWN_SIGKILL_DELAY	2500 /* ms */
+#define PK_SPAWN_FRAME_MARKER	'\x1e'
+#define PK_SPAWN_FRAME_MAX	(16 * 1024 * 1024) /* bytes */
+
+/* written by dispatchers that take the environment on stdin */
+#define PK_SPAWN_DISPATCHER_ENVIRONMENT	"dispatcher\tenvironment"
 
 struct PkSpawnPrivate
 {
@@ -56,13 +65,19 @@ struct PkSpawnPrivate
 	gint			 stdin_fd;
 	gint			 stdout_fd;
 	gint			 stderr_fd;
+	gint			 pid_fd;
 	guint			 poll_id;
+	guint			 stdout_id;
+	guint			 stderr_id;
+	guint			 child_id;
 	guint			 kill_id;
 	gboolean		 finished;
 	gboolean		 background;
 	gboolean		 is_sending_exit;
 	gboolean		 is_changing_dispatcher;
+	gboolean		 is_emitting_stdout;
 	gboolean		 allow_sigkill;
+	gboolean		 stdin_environment;
 	PkSpawnExitType		 exit;
 	GString			*stdout_buf;
 	GString			*stderr_buf;
@@ -74,6 +89,7 @@ struct PkSpawnPrivate
 enum {
 	SIGNAL_EXIT,
 	SIGNAL_STDOUT,
+	SIGNAL_STDOUT_FRAME,
 	SIGNAL_STDERR,
 	SIGNAL_LAST
 };
@@ -91,19 +107,51 @@ G_DEFINE_TYPE (PkSpawn, pk_spawn, G_TYPE_OBJECT)
 
 /**
  * pk_spawn_read_fd_into_buffer:
+ *
+ * Return value: %FALSE if the other end was closed
  **/
 static gboolean
 pk_spawn_read_fd_into_buffer (gint fd, GString *string)
 {
-	gint bytes_read;
+	gssize bytes_read;
 	gchar buffer[BUFSIZ];
 
-	/* ITS4: ignore, we manually NULL terminate and GString cannot overflow */
-	while ((bytes_read = read (fd, buffer, BUFSIZ-1)) > 0) {
-		buffer[bytes_read] = '\0';
-		g_string_append (string, buffer);
-	}
+	while ((bytes_read = read (fd, buffer, BUFSIZ)) > 0)
+		g_string_append_len (string, buffer, bytes_read);
+	if (bytes_read == 0)
+		return FALSE;
+	return errno == EAGAIN || errno == EINTR;
+}
 
+/**
+ * pk_spawn_emit_frame:
+ *
+ * A frame is the marker byte, which never starts a line, the length of
+ * the payload as a 32 bit integer in host order, then the payload.
+ *
+ * Return value: %FALSE if the frame is not complete yet
+ **/
+static gboolean
+pk_spawn_emit_frame (PkSpawn *spawn, GString *string, gsize *offset)
+{
+	guint32 length;
+	gsize header = 1 + sizeof (length);
+
+	if (string->len - *offset < header)
+		return FALSE;
+	memcpy (&length, string->str + *offset + 1, sizeof (length));
+	if (length > PK_SPAWN_FRAME_MAX) {
+		/* not a frame, so read on as lines */
+		g_warning ("ignoring frame of %u bytes", length);
+		*offset += 1;
+		return TRUE;
+	}
+	if (string->len - *offset - header < length)
+		return FALSE;
+	*offset += header;
+	g_signal_emit (spawn, signals [SIGNAL_STDOUT_FRAME], 0,
+		       string->str + *offset, length);
+	*offset += length;
 	return TRUE;
 }
 
@@ -113,36 +161,144 @@ pk_spawn_read_fd_into_buffer (gint fd, GString *string)
 static gboolean
 pk_spawn_emit_whole_lines (PkSpawn *spawn, GString *string)
 {
-	guint i;
-	guint size;
-	guint bytes_processed;
-	_cleanup_strv_free_ gchar **lines = NULL;
+	gchar *end;
+	gsize bytes_processed = 0;
 
 	/* if nothing then don't emit */
-	if (pk_strzero (string->str))
+	if (string->len == 0)
 		return FALSE;
 
-	/* split into lines - the last line may be incomplete */
-	lines = g_strsplit (string->str, "\n", 0);
-	if (lines == NULL)
+	/* a handler may make us read more into the buffer, which can
+	 * move it, so the nested call leaves the lines to this one */
+	if (spawn->priv->is_emitting_stdout)
 		return FALSE;
+	spawn->priv->is_emitting_stdout = TRUE;
+
+	/* only the last line or frame may be incomplete, so there is
+	 * nothing to look at again but that one when more data arrives */
+	while (bytes_processed < string->len) {
+		gsize line = bytes_processed;
+
+		/* helpers may send frames rather than lines */
+		if (string->str[line] == PK_SPAWN_FRAME_MARKER) {
+			if (!pk_spawn_emit_frame (spawn, string, &bytes_processed))
+				break;
+			continue;
+		}
 
-	/* find size */
-	size = g_strv_length (lines);
-
-	bytes_processed = 0;
-	/* we only emit n-1 strings */
-	for (i = 0; i < (size-1); i++) {
-		g_signal_emit (spawn, signals [SIGNAL_STDOUT], 0, lines[i]);
-		/* ITS4: ignore, g_strsplit always NULL terminates */
-		bytes_processed += strlen (lines[i]) + 1;
+		end = memchr (string->str + line, '\n', string->len - line);
+		if (end == NULL)
+			break;
+		*end = '\0';
+		bytes_processed = end - string->str + 1;
+
+		/* this is for us rather than for the backend */
+		if (g_strcmp0 (string->str + line, PK_SPAWN_DISPATCHER_ENVIRONMENT) == 0) {
+			g_debug ("dispatcher takes the environment on stdin");
+			spawn->priv->stdin_environment = TRUE;
+			continue;
+		}
+		g_signal_emit (spawn, signals [SIGNAL_STDOUT], 0, string->str + line);
 	}
+	spawn->priv->is_emitting_stdout = FALSE;
 
 	/* remove the text we've processed */
+	if (bytes_processed == 0)
+		return FALSE;
 	g_string_erase (string, 0, bytes_processed);
 	return TRUE;
 }
 
+/**
+ * pk_spawn_emit_stderr:
+ **/
+static void
+pk_spawn_emit_stderr (PkSpawn *spawn)
+{
+	/* emit all lines on standard error in one callback, as it's all
+	 * probably related to the error that just happened */
+	if (spawn->priv->stderr_buf->len == 0)
+		return;
+	g_signal_emit (spawn, signals [SIGNAL_STDERR], 0, spawn->priv->stderr_buf->str);
+	g_string_set_size (spawn->priv->stderr_buf, 0);
+}
+
+/**
+ * pk_spawn_stdout_cb:
+ **/
+static gboolean
+pk_spawn_stdout_cb (GIOChannel *source, GIOCondition condition, PkSpawn *spawn)
+{
+	gboolean ret;
+
+	/* all usual output goes on standard out, only bad libraries bitch to stderr */
+	ret = pk_spawn_read_fd_into_buffer (spawn->priv->stdout_fd, spawn->priv->stdout_buf);
+	pk_spawn_emit_whole_lines (spawn, spawn->priv->stdout_buf);
+	if (!ret)
+		spawn->priv->stdout_id = 0;
+	return ret;
+}
+
+/**
+ * pk_spawn_stderr_cb:
+ **/
+static gboolean
+pk_spawn_stderr_cb (GIOChannel *source, GIOCondition condition, PkSpawn *spawn)
+{
+	gboolean ret;
+
+	ret = pk_spawn_read_fd_into_buffer (spawn->priv->stderr_fd, spawn->priv->stderr_buf);
+	pk_spawn_emit_stderr (spawn);
+	if (!ret)
+		spawn->priv->stderr_id = 0;
+	return ret;
+}
+
+/**
+ * pk_spawn_add_watch:
+ **/
+static guint
+pk_spawn_add_watch (PkSpawn *spawn, gint fd, GIOFunc func, const gchar *name)
+{
+	guint id;
+	GIOChannel *channel;
+
+	/* the channel does not own the fd */
+	channel = g_io_channel_unix_new (fd);
+	id = g_io_add_watch (channel, G_IO_IN | G_IO_HUP | G_IO_ERR, func, spawn);
+	g_source_set_name_by_id (id, name);
+	g_io_channel_unref (channel);
+	return id;
+}
+
+/**
+ * pk_spawn_remove_sources:
+ **/
+static void
+pk_spawn_remove_sources (PkSpawn *spawn)
+{
+	if (spawn->priv->poll_id != 0) {
+		g_source_remove (spawn->priv->poll_id);
+		spawn->priv->poll_id = 0;
+	}
+	if (spawn->priv->stdout_id != 0) {
+		g_source_remove (spawn->priv->stdout_id);
+		spawn->priv->stdout_id = 0;
+	}
+	if (spawn->priv->stderr_id != 0) {
+		g_source_remove (spawn->priv->stderr_id);
+		spawn->priv->stderr_id = 0;
+	}
+	if (spawn->priv->child_id != 0) {
+		g_source_remove (spawn->priv->child_id);
+		spawn->priv->child_id = 0;
+	}
+	if (spawn->priv->pid_fd != -1) {
+		close (spawn->priv->pid_fd);
+		spawn->priv->pid_fd = -1;
+	}
+}
+
 /**
  * pk_spawn_exit_type_enum_to_string:
  **/
@@ -173,7 +329,6 @@ pk_spawn_check_child (PkSpawn *spawn)
 	pid_t pid;
 	int status;
 	gint retval;
-	static guint limit_printing = 0;
 
 	/* this shouldn't happen */
 	if (spawn->priv->finished) {
@@ -182,23 +337,12 @@ pk_spawn_check_child (PkSpawn *spawn)
 		return FALSE;
 	}
 
+	/* the output may not have been dispatched yet */
 	pk_spawn_read_fd_into_buffer (spawn->priv->stdout_fd, spawn->priv->stdout_buf);
 	pk_spawn_read_fd_into_buffer (spawn->priv->stderr_fd, spawn->priv->stderr_buf);
-
-	/* emit all lines on standard out in one callback, as it's all probably
-	* related to the error that just happened */
-	if (spawn->priv->stderr_buf->len != 0) {
-		g_signal_emit (spawn, signals [SIGNAL_STDERR], 0, spawn->priv->stderr_buf->str);
-		g_string_set_size (spawn->priv->stderr_buf, 0);
-	}
-
-	/* all usual output goes on standard out, only bad libraries bitch to stderr */
+	pk_spawn_emit_stderr (spawn);
 	pk_spawn_emit_whole_lines (spawn, spawn->priv->stdout_buf);
 
-	/* Only print one in twenty times to avoid filling the screen */
-	if (limit_printing++ % 20 == 0)
-		g_debug ("polling child_pid=%ld (1/20)", (long)spawn->priv->child_pid);
-
 	/* check if the child exited */
 	pid = waitpid (spawn->priv->child_pid, &status, WNOHANG);
 	if (pid == -1) {
@@ -215,11 +359,8 @@ pk_spawn_check_child (PkSpawn *spawn)
 		return TRUE;
 	}
 
-	/* disconnect the poll as there will be no more updates */
-	if (spawn->priv->poll_id > 0) {
-		g_source_remove (spawn->priv->poll_id);
-		spawn->priv->poll_id = 0;
-	}
+	/* disconnect the watches as there will be no more updates */
+	pk_spawn_remove_sources (spawn);
 
 	/* child exited, close resources */
 	close (spawn->priv->stdin_fd);
@@ -285,10 +426,41 @@ pk_spawn_check_child (PkSpawn *spawn)
 	g_debug ("emitting exit %s", pk_spawn_exit_type_enum_to_string (spawn->priv->exit));
 	g_signal_emit (spawn, signals [SIGNAL_EXIT], 0, spawn->priv->exit);
 
-	spawn->priv->poll_id = 0;
 	return FALSE;
 }
 
+/**
+ * pk_spawn_child_exited_cb:
+ **/
+static gboolean
+pk_spawn_child_exited_cb (GIOChannel *source, GIOCondition condition, PkSpawn *spawn)
+{
+	/* the pidfd stays readable, so never watch it again */
+	spawn->priv->child_id = 0;
+	if (!pk_spawn_check_child (spawn))
+		return FALSE;
+
+	/* not reaped yet, which should not happen */
+	g_warning ("child %ld not reaped when exited, polling",
+		   (long) spawn->priv->child_pid);
+	spawn->priv->poll_id = g_timeout_add (PK_SPAWN_POLL_DELAY, (GSourceFunc) pk_spawn_check_child, spawn);
+	g_source_set_name_by_id (spawn->priv->poll_id, "[PkSpawn] main poll");
+	return FALSE;
+}
+
+/**
+ * pk_spawn_pidfd_open:
+ **/
+static gint
+pk_spawn_pidfd_open (pid_t pid)
+{
+#ifdef SYS_pidfd_open
+	return syscall (SYS_pidfd_open, pid, 0);
+#else
+	return -1;
+#endif
+}
+
 /**
  * pk_spawn_sigkill_cb:
  **/
@@ -333,6 +505,18 @@ pk_spawn_is_running (PkSpawn *spawn)
 	return (spawn->priv->child_pid != -1);
 }
 
+/**
+ * pk_spawn_is_dispatcher:
+ *
+ * Is the script waiting for commands on stdin when idle?
+ **/
+gboolean
+pk_spawn_is_dispatcher (PkSpawn *spawn)
+{
+	g_return_val_if_fail (PK_IS_SPAWN (spawn), FALSE);
+	return spawn->priv->child_pid != -1 && spawn->priv->stdin_environment;
+}
+
 /**
  * pk_spawn_kill:
  *
@@ -383,20 +567,18 @@ pk_spawn_kill (PkSpawn *spawn)
 }
 
 /**
- * pk_spawn_send_stdin:
- *
- * Send new comands to a running (but idle) dispatcher script
+ * pk_spawn_write_stdin:
  *
+ * Write a line to a running (but idle) dispatcher script without logging
+ * it, as it may contain credentials
  **/
 static gboolean
-pk_spawn_send_stdin (PkSpawn *spawn, const gchar *command)
+pk_spawn_write_stdin (PkSpawn *spawn, const gchar *command)
 {
 	gint wrote;
 	gint length;
 	_cleanup_free_ gchar *buffer = NULL;
 
-	g_return_val_if_fail (PK_IS_SPAWN (spawn), FALSE);
-
 	/* check if process has already gone */
 	if (spawn->priv->finished) {
 		g_debug ("already finished, ignoring");
@@ -410,7 +592,6 @@ pk_spawn_send_stdin (PkSpawn *spawn, const gchar *command)
 	}
 
 	/* buffer always has to have trailing newline */
-	g_debug ("sending '%s'", command);
 	buffer = g_strdup_printf ("%s\n", command);
 
 	/* ITS4: ignore, we generated this */
@@ -426,6 +607,21 @@ pk_spawn_send_stdin (PkSpawn *spawn, const gchar *command)
 	return TRUE;
 }
 
+/**
+ * pk_spawn_send_stdin:
+ *
+ * Send new comands to a running (but idle) dispatcher script
+ *
+ **/
+static gboolean
+pk_spawn_send_stdin (PkSpawn *spawn, const gchar *command)
+{
+	g_return_val_if_fail (PK_IS_SPAWN (spawn), FALSE);
+
+	g_debug ("sending '%s'", command);
+	return pk_spawn_write_stdin (spawn, command);
+}
+
 /**
  * pk_spawn_exit:
  *
@@ -508,6 +704,84 @@ pk_strvequal (gchar **id1, gchar **id2)
 	return TRUE;
 }
 
+/**
+ * pk_spawn_can_send_environment:
+ **/
+static gboolean
+pk_spawn_can_send_environment (PkSpawn *spawn, gchar **envp)
+{
+	guint i;
+
+	if (!spawn->priv->stdin_environment)
+		return FALSE;
+
+	/* the variables are separated by tabs on a single line */
+	for (i = 0; envp != NULL && envp[i] != NULL; i++) {
+		if (strpbrk (envp[i], "\t\n") != NULL)
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * pk_spawn_send_environment:
+ *
+ * Replace the environment of a running dispatcher for the next command
+ **/
+static gboolean
+pk_spawn_send_environment (PkSpawn *spawn, gchar **envp)
+{
+	guint i;
+	_cleanup_free_ gchar *command = NULL;
+	_cleanup_free_ gchar *variables = NULL;
+	_cleanup_string_free_ GString *names = NULL;
+
+	if (!pk_spawn_can_send_environment (spawn, envp))
+		return FALSE;
+
+	if (envp != NULL && envp[0] != NULL) {
+		variables = g_strjoinv ("\t", envp);
+		command = g_strdup_printf ("environment\t%s", variables);
+	} else {
+		command = g_strdup ("environment");
+	}
+
+	/* the values may be proxy credentials, so only log the names */
+	names = g_string_new ("");
+	for (i = 0; envp != NULL && envp[i] != NULL; i++) {
+		g_string_append_len (names, envp[i], strcspn (envp[i], "="));
+		g_string_append_c (names, ' ');
+	}
+	g_debug ("sending environment [%s]", names->str);
+	if (!pk_spawn_write_stdin (spawn, command))
+		return FALSE;
+
+	g_strfreev (spawn->priv->last_envp);
+	spawn->priv->last_envp = g_strdupv (envp);
+	return TRUE;
+}
+
+/**
+ * pk_spawn_is_reusable:
+ *
+ * Can the running dispatcher be given this command, rather than having
+ * to start a new instance?
+ **/
+gboolean
+pk_spawn_is_reusable (PkSpawn *spawn, gchar **argv, gchar **envp)
+{
+	g_return_val_if_fail (PK_IS_SPAWN (spawn), FALSE);
+	g_return_val_if_fail (argv != NULL, FALSE);
+
+	if (spawn->priv->stdin_fd == -1 || spawn->priv->is_sending_exit)
+		return FALSE;
+	if (g_strcmp0 (spawn->priv->last_argv0, argv[0]) != 0)
+		return FALSE;
+	if (pk_strvequal (spawn->priv->last_envp, envp))
+		return TRUE;
+	return pk_spawn_can_send_environment (spawn, envp);
+}
+
 /**
  * pk_spawn_argv:
  * @argv: Can be generated using g_strsplit (command, " ", 0)
@@ -548,14 +822,20 @@ pk_spawn_argv (PkSpawn *spawn, gchar **argv, gchar **envp,
 	/* we can reuse the dispatcher if:
 	 *  - it's still running
 	 *  - argv[0] (executable name is the same)
-	 *  - all of envp are the same (proxy and locale settings) */
+	 *  - all of envp are the same (proxy and locale settings), or
+	 *    the dispatcher can be sent the new ones on stdin */
 	if (spawn->priv->stdin_fd != -1) {
 		if (g_strcmp0 (spawn->priv->last_argv0, argv[0]) != 0) {
 			g_debug ("argv did not match, not reusing");
-		} else if (!pk_strvequal (spawn->priv->last_envp, envp)) {
-			g_debug ("envp did not match, not reusing");
 		} else if ((flags & PK_SPAWN_ARGV_FLAGS_NEVER_REUSE) > 0) {
 			g_debug ("not re-using instance due to policy");
+		} else if (!pk_strvequal (spawn->priv->last_envp, envp) &&
+			   !pk_spawn_send_environment (spawn, envp)) {
+			g_debug ("envp did not match, not reusing");
+		} else if (argv[1] == NULL) {
+			/* already started, and no command to send */
+			g_debug ("reusing instance");
+			goto out;
 		} else {
 			/* join with tabs, as spaces could be in file name */
 			_cleanup_free_ gchar *command = g_strjoinv ("\t", &argv[1]);
@@ -576,17 +856,16 @@ pk_spawn_argv (PkSpawn *spawn, gchar **argv, gchar **envp,
 		ret = pk_spawn_exit (spawn);
 		if (!ret) {
 			g_warning ("failed to exit previous instance");
-			/* remove poll, as we can't reply on pk_spawn_check_child() */
-			if (spawn->priv->poll_id != 0) {
-				g_source_remove (spawn->priv->poll_id);
-				spawn->priv->poll_id = 0;
-			}
+			/* remove watches, as we can't reply on pk_spawn_check_child() */
+			pk_spawn_remove_sources (spawn);
 		}
 		spawn->priv->is_changing_dispatcher = FALSE;
 	}
 
 	/* create spawned object for tracking */
 	spawn->priv->finished = FALSE;
+	spawn->priv->stdin_environment = FALSE;
+
 	g_debug ("creating new instance of %s", argv[0]);
 	ret = g_spawn_async_with_pipes (NULL, argv, envp,
 				 G_SPAWN_DO_NOT_REAP_CHILD | G_SPAWN_SEARCH_PATH,
@@ -642,14 +921,30 @@ pk_spawn_argv (PkSpawn *spawn, gchar **argv, gchar **envp,
 	}
 
 	/* sanity check */
-	if (spawn->priv->poll_id != 0) {
-		g_warning ("trying to set timeout when already set");
-		g_source_remove (spawn->priv->poll_id);
+	if (spawn->priv->poll_id != 0 || spawn->priv->child_id != 0) {
+		g_warning ("trying to watch child when already watched");
+		pk_spawn_remove_sources (spawn);
 	}
 
-	/* poll quickly */
-	spawn->priv->poll_id = g_timeout_add (PK_SPAWN_POLL_DELAY, (GSourceFunc) pk_spawn_check_child, spawn);
-	g_source_set_name_by_id (spawn->priv->poll_id, "[PkSpawn] main poll");
+	/* read the output as soon as it arrives */
+	spawn->priv->stdout_id = pk_spawn_add_watch (spawn, spawn->priv->stdout_fd,
+						     (GIOFunc) pk_spawn_stdout_cb,
+						     "[PkSpawn] stdout");
+	spawn->priv->stderr_id = pk_spawn_add_watch (spawn, spawn->priv->stderr_fd,
+						     (GIOFunc) pk_spawn_stderr_cb,
+						     "[PkSpawn] stderr");
+
+	/* the pidfd gets readable when the child exits, older kernels
+	 * do not have it, so poll for the exit there */
+	spawn->priv->pid_fd = pk_spawn_pidfd_open (spawn->priv->child_pid);
+	if (spawn->priv->pid_fd != -1) {
+		spawn->priv->child_id = pk_spawn_add_watch (spawn, spawn->priv->pid_fd,
+							    (GIOFunc) pk_spawn_child_exited_cb,
+							    "[PkSpawn] child");
+	} else {
+		spawn->priv->poll_id = g_timeout_add (PK_SPAWN_POLL_DELAY, (GSourceFunc) pk_spawn_check_child, spawn);
+		g_source_set_name_by_id (spawn->priv->poll_id, "[PkSpawn] main poll");
+	}
 out:
 	return ret;
 }
@@ -741,6 +1036,11 @@ pk_spawn_class_init (PkSpawnClass *klass)
 			      G_TYPE_FROM_CLASS (object_class), G_SIGNAL_RUN_LAST,
 			      0, NULL, NULL, g_cclosure_marshal_VOID__STRING,
 			      G_TYPE_NONE, 1, G_TYPE_STRING);
+	signals [SIGNAL_STDOUT_FRAME] =
+		g_signal_new ("stdout-frame",
+			      G_TYPE_FROM_CLASS (object_class), G_SIGNAL_RUN_LAST,
+			      0, NULL, NULL, g_cclosure_marshal_generic,
+			      G_TYPE_NONE, 2, G_TYPE_POINTER, G_TYPE_UINT);
 	signals [SIGNAL_STDERR] =
 		g_signal_new ("stderr",
 			      G_TYPE_FROM_CLASS (object_class), G_SIGNAL_RUN_LAST,
@@ -763,12 +1063,18 @@ pk_spawn_init (PkSpawn *spawn)
 	spawn->priv->stdout_fd = -1;
 	spawn->priv->stderr_fd = -1;
 	spawn->priv->stdin_fd = -1;
+	spawn->priv->pid_fd = -1;
 	spawn->priv->poll_id = 0;
+	spawn->priv->stdout_id = 0;
+	spawn->priv->stderr_id = 0;
+	spawn->priv->child_id = 0;
 	spawn->priv->kill_id = 0;
 	spawn->priv->finished = FALSE;
 	spawn->priv->is_sending_exit = FALSE;
 	spawn->priv->is_changing_dispatcher = FALSE;
+	spawn->priv->is_emitting_stdout = FALSE;
 	spawn->priv->allow_sigkill = TRUE;
+	spawn->priv->stdin_environment = FALSE;
 	spawn->priv->last_argv0 = NULL;
 	spawn->priv->last_envp = NULL;
 	spawn->priv->background = FALSE;
@@ -794,11 +1100,8 @@ pk_spawn_finalize (GObject *object)
 
 	g_return_if_fail (spawn->priv != NULL);
 
-	/* disconnect the poll in case we were cancelled before completion */
-	if (spawn->priv->poll_id != 0) {
-		g_source_remove (spawn->priv->poll_id);
-		spawn->priv->poll_id = 0;
-	}
+	/* disconnect the watches in case we were cancelled before completion */
+	pk_spawn_remove_sources (spawn);
 
 	/* disconnect the SIGKILL check */
 	if (spawn->priv->kill_id != 0) {
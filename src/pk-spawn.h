@@ -79,6 +79,10 @@ gboolean	 pk_spawn_argv				(PkSpawn	*spawn,
 							 GError		**error)
 							 G_GNUC_WARN_UNUSED_RESULT;
 gboolean	 pk_spawn_is_running			(PkSpawn	*spawn);
+gboolean	 pk_spawn_is_dispatcher			(PkSpawn	*spawn);
+gboolean	 pk_spawn_is_reusable			(PkSpawn	*spawn,
+							 gchar		**argv,
+							 gchar		**envp);
 gboolean	 pk_spawn_kill				(PkSpawn	*spawn);
 gboolean	 pk_spawn_exit				(PkSpawn	*spawn);
 
@@ -49,85 +49,180 @@ static void     pk_transaction_db_finalize	(GObject        *object);
 
 #define PK_TRANSACTION_DB_GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), PK_TYPE_TRANSACTION_DB, PkTransactionDbPrivate))
 
+/* job IDs are reserved this many at a time, so that the job count only
+ * has to be forced to disk once in a while */
+#define PK_TRANSACTION_DB_JOB_COUNT_RESERVE	100
+
+typedef enum {
+	PK_TRANSACTION_DB_STATEMENT_BEGIN,
+	PK_TRANSACTION_DB_STATEMENT_COMMIT,
+	PK_TRANSACTION_DB_STATEMENT_ADD,
+	PK_TRANSACTION_DB_STATEMENT_SET_ROLE,
+	PK_TRANSACTION_DB_STATEMENT_SET_UID,
+	PK_TRANSACTION_DB_STATEMENT_SET_CMDLINE,
+	PK_TRANSACTION_DB_STATEMENT_SET_DATA,
+	PK_TRANSACTION_DB_STATEMENT_SET_FINISHED,
+	PK_TRANSACTION_DB_STATEMENT_GET_LIST,
+	PK_TRANSACTION_DB_STATEMENT_ACTION_TIME_SINCE,
+	PK_TRANSACTION_DB_STATEMENT_ACTION_TIME_RESET,
+	PK_TRANSACTION_DB_STATEMENT_SET_JOB_COUNT,
+	PK_TRANSACTION_DB_STATEMENT_GET_PROXY,
+	PK_TRANSACTION_DB_STATEMENT_HISTORY_ADD,
+	PK_TRANSACTION_DB_STATEMENT_HISTORY_GET,
+	PK_TRANSACTION_DB_STATEMENT_LAST
+} PkTransactionDbStatement;
+
+/* prepared the first time they are used, and kept until the database is closed */
+static const gchar *pk_transaction_db_statements[] = {
+	"BEGIN",
+	"COMMIT",
+	"INSERT INTO transactions (timespec, transaction_id) VALUES (?, ?)",
+	"UPDATE transactions SET role = ? WHERE transaction_id = ?",
+	"UPDATE transactions SET uid = ? WHERE transaction_id = ?",
+	"UPDATE transactions SET cmdline = ? WHERE transaction_id = ?",
+	"UPDATE transactions SET data = ? WHERE transaction_id = ?",
+	"UPDATE transactions SET succeeded = ?, duration = ? WHERE transaction_id = ?",
+	"SELECT transaction_id, timespec, succeeded, duration, role, data, uid, cmdline "
+	"FROM transactions ORDER BY timespec DESC LIMIT ?",
+	"SELECT timespec FROM last_action WHERE role = ?",
+	"INSERT OR REPLACE INTO last_action (role, timespec) VALUES (?, ?)",
+	"UPDATE config SET value = ? WHERE key = 'job_count'",
+	"SELECT proxy_http, proxy_https, proxy_ftp, proxy_socks, no_proxy, pac "
+	"FROM proxy WHERE uid = ? AND session = ? LIMIT 1",
+	"INSERT INTO history (transaction_id, name, arch, version, data, info, timestamp, uid) "
+	"VALUES (?, ?, ?, ?, ?, ?, ?, ?)",
+	"SELECT info, version, data, timestamp, uid FROM history "
+	"WHERE name = ?1 AND (?2 < 0 OR transaction_id IN "
+	"(SELECT transaction_id FROM transactions ORDER BY timespec DESC LIMIT ?2)) "
+	"ORDER BY timestamp DESC, rowid DESC",
+	NULL
+};
+
 struct PkTransactionDbPrivate
 {
 	gboolean		 loaded;
 	sqlite3			*db;
+	sqlite3_stmt		*statements[PK_TRANSACTION_DB_STATEMENT_LAST];
+	guint			 batch_depth;
+	gboolean		 batch_open;	/* the outermost BEGIN worked */
 	guint			 job_count;
+	guint			 job_count_reserved;
 	guint			 database_save_id;
 };
 
 G_DEFINE_TYPE (PkTransactionDb, pk_transaction_db, G_TYPE_OBJECT)
 
-typedef struct {
-	gchar		*proxy_http;
-	gchar		*proxy_https;
-	gchar		*proxy_ftp;
-	gchar		*proxy_socks;
-	gchar		*no_proxy;
-	gchar		*pac;
-	gboolean	set;
-} PkTransactionDbProxyItem;
+/**
+ * pk_transaction_db_get_statement:
+ *
+ * Return value: (transfer none): the prepared statement, ready to be bound
+ **/
+static sqlite3_stmt *
+pk_transaction_db_get_statement (PkTransactionDb *tdb, PkTransactionDbStatement id)
+{
+	gint rc;
+	sqlite3_stmt **statement = &tdb->priv->statements[id];
+
+	g_return_val_if_fail (tdb->priv->db != NULL, NULL);
+
+	if (*statement != NULL)
+		return *statement;
+	rc = sqlite3_prepare_v2 (tdb->priv->db,
+				 pk_transaction_db_statements[id],
+				 -1, statement, NULL);
+	if (rc != SQLITE_OK) {
+		g_warning ("failed to prepare statement: %s",
+			   sqlite3_errmsg (tdb->priv->db));
+		*statement = NULL;
+	}
+	return *statement;
+}
 
 /**
- * pk_transaction_sqlite_transaction_cb:
+ * pk_transaction_db_statement_done:
+ *
+ * Makes the statement ready for the next time, and ends the implicit
+ * read transaction a SELECT keeps open until then.
  **/
-static gint
-pk_transaction_db_add_transaction_cb (void *data,
-				      gint argc,
-				      gchar **argv,
-				      gchar **col_name)
+static void
+pk_transaction_db_statement_done (sqlite3_stmt *statement)
 {
-	PkTransactionPast *item;
-	GList **list = (GList **) data;
-	gint i;
-	gchar *col;
-	gchar *value;
-	guint temp;
+	sqlite3_reset (statement);
+	sqlite3_clear_bindings (statement);
+}
 
-	item = pk_transaction_past_new ();
-	for (i = 0; i < argc; i++) {
-		col = col_name[i];
-		value = argv[i];
-		if (g_strcmp0 (col, "succeeded") == 0) {
-			if (!pk_strtouint (value, &temp)) {
-				g_warning ("failed to parse succeeded: %s", value);
-				continue;
-			}
-			if (temp == 1)
-				g_object_set (item, "succeeded", TRUE, NULL);
-			else
-				g_object_set (item, "succeeded", FALSE, NULL);
-		} else if (g_strcmp0 (col, "role") == 0) {
-			if (value != NULL)
-				g_object_set (item, "role", pk_role_enum_from_string (value), NULL);
-		} else if (g_strcmp0 (col, "transaction_id") == 0) {
-			if (value != NULL)
-				g_object_set (item, "tid", value, NULL);
-		} else if (g_strcmp0 (col, "timespec") == 0) {
-			if (value != NULL)
-				g_object_set (item, "timespec", value, NULL);
-		} else if (g_strcmp0 (col, "cmdline") == 0) {
-			if (value != NULL)
-				g_object_set (item, "cmdline", value, NULL);
-		} else if (g_strcmp0 (col, "data") == 0) {
-			if (value != NULL)
-				g_object_set (item, "data", value, NULL);
-		} else if (g_strcmp0 (col, "uid") == 0) {
-			if (pk_strtouint (value, &temp))
-				g_object_set (item, "uid", temp, NULL);
-		} else if (g_strcmp0 (col, "duration") == 0) {
-			if (pk_strtouint (value, &temp))
-				g_object_set (item, "duration", temp, NULL);
-		} else {
-			g_warning ("%s = %s", col, value);
-		}
+/**
+ * pk_transaction_db_step:
+ *
+ * Runs a statement that returns no rows.
+ **/
+static gboolean
+pk_transaction_db_step (PkTransactionDb *tdb, sqlite3_stmt *statement)
+{
+	gint rc;
+
+	rc = sqlite3_step (statement);
+	pk_transaction_db_statement_done (statement);
+	if (rc != SQLITE_DONE) {
+		g_warning ("failed to execute statement: %s",
+			   sqlite3_errmsg (tdb->priv->db));
+		return FALSE;
 	}
+	return TRUE;
+}
 
-	/* add to start of the list */
-	*list = g_list_prepend (*list, item);
+/**
+ * pk_transaction_db_update_text:
+ **/
+static gboolean
+pk_transaction_db_update_text (PkTransactionDb *tdb,
+			       PkTransactionDbStatement id,
+			       const gchar *tid,
+			       const gchar *value)
+{
+	sqlite3_stmt *statement;
 
-	return 0;
+	statement = pk_transaction_db_get_statement (tdb, id);
+	if (statement == NULL)
+		return FALSE;
+	sqlite3_bind_text (statement, 1, value, -1, SQLITE_STATIC);
+	sqlite3_bind_text (statement, 2, tid, -1, SQLITE_STATIC);
+	return pk_transaction_db_step (tdb, statement);
+}
+
+/**
+ * pk_transaction_db_column_text:
+ **/
+static const gchar *
+pk_transaction_db_column_text (sqlite3_stmt *statement, gint column)
+{
+	return (const gchar *) sqlite3_column_text (statement, column);
+}
+
+/**
+ * pk_transaction_db_get_past:
+ *
+ * Return value: the transaction in the current row of a GET_LIST statement
+ **/
+static PkTransactionPast *
+pk_transaction_db_get_past (sqlite3_stmt *statement)
+{
+	PkTransactionPast *item;
+	const gchar *role;
+
+	item = pk_transaction_past_new ();
+	role = pk_transaction_db_column_text (statement, 4);
+	g_object_set (item,
+		      "tid", pk_transaction_db_column_text (statement, 0),
+		      "timespec", pk_transaction_db_column_text (statement, 1),
+		      "succeeded", sqlite3_column_int (statement, 2) == 1,
+		      "duration", (guint) sqlite3_column_int (statement, 3),
+		      "role", role != NULL ? pk_role_enum_from_string (role) : PK_ROLE_ENUM_UNKNOWN,
+		      "data", pk_transaction_db_column_text (statement, 5),
+		      "uid", (guint) sqlite3_column_int (statement, 6),
+		      "cmdline", pk_transaction_db_column_text (statement, 7),
+		      NULL);
+	return item;
 }
 
 /**
@@ -152,28 +247,6 @@ pk_transaction_db_sql_statement (PkTransactionDb *tdb, const gchar *sql)
 	return TRUE;
 }
 
-/**
- * pk_time_action_sqlite_callback:
- **/
-static gint
-pk_time_action_sqlite_callback (void *data, gint argc, gchar **argv, gchar **col_name)
-{
-	gint i;
-	gchar *col;
-	gchar *value;
-	gchar **timespec = (gchar**) data;
-
-	for (i = 0; i < argc; i++) {
-		col = col_name[i];
-		value = argv[i];
-		if (g_strcmp0 (col, "timespec") == 0)
-			*timespec = g_strdup (value);
-		else
-			g_warning ("%s = %s", col, value);
-	}
-	return 0;
-}
-
 /**
  * pk_transaction_db_iso8601_difference:
  * @isodate: The ISO8601 date to compare
@@ -210,25 +283,23 @@ pk_transaction_db_iso8601_difference (const gchar *isodate)
 guint
 pk_transaction_db_action_time_since (PkTransactionDb *tdb, PkRoleEnum role)
 {
-	gchar *error_msg = NULL;
 	gint rc;
-	const gchar *role_text;
-	_cleanup_free_ gchar *statement = NULL;
+	sqlite3_stmt *statement;
 	_cleanup_free_ gchar *timespec = NULL;
 
 	g_return_val_if_fail (PK_IS_TRANSACTION_DB (tdb), 0);
 	g_return_val_if_fail (tdb->priv->db != NULL, 0);
 
-	role_text = pk_role_enum_to_string (role);
-
-	statement = g_strdup_printf ("SELECT timespec FROM last_action WHERE role = '%s'", role_text);
-	rc = sqlite3_exec (tdb->priv->db, statement,
-			   pk_time_action_sqlite_callback, &timespec, &error_msg);
-	if (rc != SQLITE_OK) {
-		g_warning ("SQL error: %s", error_msg);
-		sqlite3_free (error_msg);
+	statement = pk_transaction_db_get_statement (tdb, PK_TRANSACTION_DB_STATEMENT_ACTION_TIME_SINCE);
+	if (statement == NULL)
 		return G_MAXUINT;
-	}
+	sqlite3_bind_text (statement, 1, pk_role_enum_to_string (role), -1, SQLITE_STATIC);
+	rc = sqlite3_step (statement);
+	if (rc == SQLITE_ROW)
+		timespec = g_strdup (pk_transaction_db_column_text (statement, 0));
+	else if (rc != SQLITE_DONE)
+		g_warning ("SQL error: %s", sqlite3_errmsg (tdb->priv->db));
+	pk_transaction_db_statement_done (statement);
 	if (timespec == NULL)
 		return G_MAXUINT;
 
@@ -242,35 +313,20 @@ pk_transaction_db_action_time_since (PkTransactionDb *tdb, PkRoleEnum role)
 gboolean
 pk_transaction_db_action_time_reset (PkTransactionDb *tdb, PkRoleEnum role)
 {
-	gchar *error_msg = NULL;
-	gint rc;
-	const gchar *role_text;
-	guint since;
-	_cleanup_free_ gchar *statement = NULL;
+	sqlite3_stmt *statement;
 	_cleanup_free_ gchar *timespec = NULL;
 
 	g_return_val_if_fail (PK_IS_TRANSACTION_DB (tdb), FALSE);
 	g_return_val_if_fail (tdb->priv->db != NULL, FALSE);
 
-	timespec = pk_iso8601_present ();
-	role_text = pk_role_enum_to_string (role);
-
-	/* get the previous entry */
-	since = pk_transaction_db_action_time_since (tdb, role);
-	if (since == G_MAXUINT) {
-		statement = g_strdup_printf ("INSERT INTO last_action (role, timespec) VALUES ('%s', '%s')", role_text, timespec);
-	} else {
-		statement = g_strdup_printf ("UPDATE last_action SET timespec = '%s' WHERE role = '%s'", timespec, role_text);
-	}
-
 	/* update or insert the entry */
-	rc = sqlite3_exec (tdb->priv->db, statement, NULL, NULL, &error_msg);
-	if (rc != SQLITE_OK) {
-		g_warning ("SQL error: %s", error_msg);
-		sqlite3_free (error_msg);
+	statement = pk_transaction_db_get_statement (tdb, PK_TRANSACTION_DB_STATEMENT_ACTION_TIME_RESET);
+	if (statement == NULL)
 		return FALSE;
-	}
-	return TRUE;
+	timespec = pk_iso8601_present ();
+	sqlite3_bind_text (statement, 1, pk_role_enum_to_string (role), -1, SQLITE_STATIC);
+	sqlite3_bind_text (statement, 2, timespec, -1, SQLITE_STATIC);
+	return pk_transaction_db_step (tdb, statement);
 }
 
 /**
@@ -279,32 +335,270 @@ pk_transaction_db_action_time_reset (PkTransactionDb *tdb, PkRoleEnum role)
 GList *
 pk_transaction_db_get_list (PkTransactionDb *tdb, guint limit)
 {
-	gchar *error_msg = NULL;
 	gint rc;
 	GList *list = NULL;
-	_cleanup_free_ gchar *statement = NULL;
+	sqlite3_stmt *statement;
 
 	g_return_val_if_fail (PK_IS_TRANSACTION_DB (tdb), NULL);
 
-	if (limit == 0) {
-		statement = g_strdup ("SELECT transaction_id, timespec, succeeded, duration, role, data, uid, cmdline "
-				      "FROM transactions ORDER BY timespec DESC");
-	} else {
-		statement = g_strdup_printf ("SELECT transaction_id, timespec, succeeded, duration, role, data, uid, cmdline "
-					     "FROM transactions ORDER BY timespec DESC LIMIT %i", limit);
+	statement = pk_transaction_db_get_statement (tdb, PK_TRANSACTION_DB_STATEMENT_GET_LIST);
+	if (statement == NULL)
+		return NULL;
+
+	/* a negative limit is no limit */
+	sqlite3_bind_int64 (statement, 1, limit == 0 ? -1 : (gint64) limit);
+	while ((rc = sqlite3_step (statement)) == SQLITE_ROW) {
+		/* add to start of the list */
+		list = g_list_prepend (list, pk_transaction_db_get_past (statement));
 	}
-	rc = sqlite3_exec (tdb->priv->db,
-			   statement,
-			   pk_transaction_db_add_transaction_cb,
-			   &list,
-			   &error_msg);
+	if (rc != SQLITE_DONE)
+		g_warning ("SQL error: %s", sqlite3_errmsg (tdb->priv->db));
+	pk_transaction_db_statement_done (statement);
+	return list;
+}
+
+/**
+ * pk_transaction_db_execute:
+ **/
+static gboolean
+pk_transaction_db_execute (PkTransactionDb *tdb,
+			   const gchar *statement,
+			   GError **error)
+{
+	gboolean ret = TRUE;
+	gint rc;
+
+	/* wrap this up */
+	rc = sqlite3_exec (tdb->priv->db, statement, NULL, NULL, NULL);
 	if (rc != SQLITE_OK) {
-		g_warning ("SQL error: %s", error_msg);
-		sqlite3_free (error_msg);
-		goto out;
+		ret = FALSE;
+		g_set_error (error,
+			     1, 0,
+			     "Failed to execute statement '%s': %s",
+			     statement,
+			     sqlite3_errmsg (tdb->priv->db));
 	}
-out:
-	return list;
+	return ret;
+}
+
+/**
+ * pk_transaction_db_begin:
+ *
+ * Batches the following writes into one commit, until
+ * pk_transaction_db_commit() is called. Calls can be nested, and each
+ * one needs a pk_transaction_db_commit() even if it fails, in which
+ * case the writes are committed one by one.
+ *
+ * Return value: %TRUE if the writes are batched
+ **/
+gboolean
+pk_transaction_db_begin (PkTransactionDb *tdb)
+{
+	sqlite3_stmt *statement;
+
+	g_return_val_if_fail (PK_IS_TRANSACTION_DB (tdb), FALSE);
+
+	if (tdb->priv->batch_depth++ > 0)
+		return tdb->priv->batch_open;
+	statement = pk_transaction_db_get_statement (tdb, PK_TRANSACTION_DB_STATEMENT_BEGIN);
+	tdb->priv->batch_open = statement != NULL &&
+				pk_transaction_db_step (tdb, statement);
+	return tdb->priv->batch_open;
+}
+
+/**
+ * pk_transaction_db_rollback:
+ *
+ * Drops all the writes of the batch, however deeply nested.
+ **/
+static void
+pk_transaction_db_rollback (PkTransactionDb *tdb)
+{
+	if (tdb->priv->batch_open)
+		pk_transaction_db_execute (tdb, "ROLLBACK", NULL);
+	tdb->priv->batch_open = FALSE;
+	tdb->priv->batch_depth = 0;
+}
+
+/**
+ * pk_transaction_db_commit:
+ *
+ * Return value: %TRUE if the batch was written, or is still open as
+ * this call was nested
+ **/
+gboolean
+pk_transaction_db_commit (PkTransactionDb *tdb)
+{
+	sqlite3_stmt *statement;
+
+	g_return_val_if_fail (PK_IS_TRANSACTION_DB (tdb), FALSE);
+	g_return_val_if_fail (tdb->priv->batch_depth > 0, FALSE);
+
+	if (--tdb->priv->batch_depth > 0)
+		return tdb->priv->batch_open;
+	if (!tdb->priv->batch_open)
+		return FALSE;
+
+	/* don't leave the transaction open on the connection, or every
+	 * later write would stay uncommitted too */
+	statement = pk_transaction_db_get_statement (tdb, PK_TRANSACTION_DB_STATEMENT_COMMIT);
+	if (statement == NULL || !pk_transaction_db_step (tdb, statement)) {
+		pk_transaction_db_rollback (tdb);
+		return FALSE;
+	}
+	tdb->priv->batch_open = FALSE;
+	return TRUE;
+}
+
+/**
+ * pk_transaction_db_history_add_package:
+ * @names: the package names already added for this transaction
+ **/
+static gboolean
+pk_transaction_db_history_add_package (PkTransactionDb *tdb,
+				       const gchar *tid,
+				       guint uid,
+				       gint64 timestamp,
+				       PkPackage *package,
+				       GHashTable *names)
+{
+	const gchar *name;
+	sqlite3_stmt *statement;
+
+	/* not a state we care about */
+	switch (pk_package_get_info (package)) {
+	case PK_INFO_ENUM_INSTALLING:
+	case PK_INFO_ENUM_REMOVING:
+	case PK_INFO_ENUM_UPDATING:
+		break;
+	default:
+		return TRUE;
+	}
+
+	/* only record the package once, in the case of multiarch */
+	name = pk_package_get_name (package);
+	if (g_hash_table_lookup (names, name) != NULL)
+		return TRUE;
+	g_hash_table_insert (names, g_strdup (name), GINT_TO_POINTER (1));
+
+	statement = pk_transaction_db_get_statement (tdb, PK_TRANSACTION_DB_STATEMENT_HISTORY_ADD);
+	if (statement == NULL)
+		return FALSE;
+	sqlite3_bind_text (statement, 1, tid, -1, SQLITE_STATIC);
+	sqlite3_bind_text (statement, 2, name, -1, SQLITE_STATIC);
+	sqlite3_bind_text (statement, 3, pk_package_get_arch (package), -1, SQLITE_STATIC);
+	sqlite3_bind_text (statement, 4, pk_package_get_version (package), -1, SQLITE_STATIC);
+	sqlite3_bind_text (statement, 5, pk_package_get_data (package), -1, SQLITE_STATIC);
+	sqlite3_bind_int (statement, 6, pk_package_get_info (package));
+	sqlite3_bind_int64 (statement, 7, timestamp);
+	sqlite3_bind_int64 (statement, 8, uid);
+	return pk_transaction_db_step (tdb, statement);
+}
+
+/**
+ * pk_transaction_db_add_history:
+ * @timestamp: when the packages were changed, in seconds since the epoch
+ * @packages: the #PkPackage's emitted by the transaction
+ *
+ * Records the packages that were installed, removed or updated, so
+ * that pk_transaction_db_get_package_history() does not have to parse
+ * the data of every past transaction.
+ **/
+gboolean
+pk_transaction_db_add_history (PkTransactionDb *tdb,
+			       const gchar *tid,
+			       guint uid,
+			       gint64 timestamp,
+			       GPtrArray *packages)
+{
+	gboolean ret = TRUE;
+	guint i;
+	_cleanup_hashtable_unref_ GHashTable *names = NULL;
+
+	g_return_val_if_fail (PK_IS_TRANSACTION_DB (tdb), FALSE);
+	g_return_val_if_fail (tid != NULL, FALSE);
+
+	names = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	pk_transaction_db_begin (tdb);
+
+	/* if a package can't be recorded drop the history of the others,
+	 * but not the rest of a batch this is nested in; this also works
+	 * if the batch could not be started */
+	ret = pk_transaction_db_execute (tdb, "SAVEPOINT history", NULL);
+	for (i = 0; i < packages->len && ret; i++) {
+		ret = pk_transaction_db_history_add_package (tdb, tid, uid, timestamp,
+							     g_ptr_array_index (packages, i),
+							     names);
+	}
+	if (!ret)
+		pk_transaction_db_execute (tdb, "ROLLBACK TO history", NULL);
+	pk_transaction_db_execute (tdb, "RELEASE history", NULL);
+
+	if (!pk_transaction_db_commit (tdb))
+		return FALSE;
+	return ret;
+}
+
+/**
+ * pk_transaction_db_history_item_free:
+ **/
+static void
+pk_transaction_db_history_item_free (PkTransactionDbHistoryItem *item)
+{
+	g_free (item->version);
+	g_free (item->data);
+	g_free (item);
+}
+
+/**
+ * pk_transaction_db_get_package_history:
+ * @name: the package name, e.g. "colord"
+ * @limit: the number of past transactions to search, or 0 for no limit
+ *
+ * Return value: (element-type PkTransactionDbHistoryItem): the changes
+ * to the package in the last @limit transactions, oldest first
+ **/
+GPtrArray *
+pk_transaction_db_get_package_history (PkTransactionDb *tdb,
+				       const gchar *name,
+				       guint limit)
+{
+	gint rc;
+	gpointer tmp;
+	guint i;
+	GPtrArray *array;
+	PkTransactionDbHistoryItem *item;
+	sqlite3_stmt *statement;
+
+	g_return_val_if_fail (PK_IS_TRANSACTION_DB (tdb), NULL);
+	g_return_val_if_fail (name != NULL, NULL);
+
+	array = g_ptr_array_new_with_free_func ((GDestroyNotify) pk_transaction_db_history_item_free);
+	statement = pk_transaction_db_get_statement (tdb, PK_TRANSACTION_DB_STATEMENT_HISTORY_GET);
+	if (statement == NULL)
+		return array;
+	sqlite3_bind_text (statement, 1, name, -1, SQLITE_STATIC);
+	sqlite3_bind_int64 (statement, 2, limit == 0 ? -1 : (gint64) limit);
+	while ((rc = sqlite3_step (statement)) == SQLITE_ROW) {
+		item = g_new0 (PkTransactionDbHistoryItem, 1);
+		item->info = sqlite3_column_int (statement, 0);
+		item->version = g_strdup (pk_transaction_db_column_text (statement, 1));
+		item->data = g_strdup (pk_transaction_db_column_text (statement, 2));
+		item->timestamp = sqlite3_column_int64 (statement, 3);
+		item->uid = sqlite3_column_int (statement, 4);
+		g_ptr_array_add (array, item);
+	}
+	if (rc != SQLITE_DONE)
+		g_warning ("SQL error: %s", sqlite3_errmsg (tdb->priv->db));
+	pk_transaction_db_statement_done (statement);
+
+	/* the newest were fetched first */
+	for (i = 0; i < array->len / 2; i++) {
+		tmp = array->pdata[i];
+		array->pdata[i] = array->pdata[array->len - i - 1];
+		array->pdata[array->len - i - 1] = tmp;
+	}
+	return array;
 }
 
 /**
@@ -314,13 +608,11 @@ gboolean
 pk_transaction_db_add (PkTransactionDb *tdb, const gchar *tid)
 {
 	_cleanup_free_ gchar *timespec = NULL;
-	_cleanup_free_ gchar *statement = NULL;
 
 	g_return_val_if_fail (PK_IS_TRANSACTION_DB (tdb), FALSE);
 
 	timespec = pk_iso8601_present ();
-	statement = g_strdup_printf ("INSERT INTO transactions (transaction_id, timespec) VALUES ('%s', '%s')", tid, timespec);
-	pk_transaction_db_sql_statement (tdb, statement);
+	pk_transaction_db_update_text (tdb, PK_TRANSACTION_DB_STATEMENT_ADD, tid, timespec);
 	return TRUE;
 }
 
@@ -330,14 +622,10 @@ pk_transaction_db_add (PkTransactionDb *tdb, const gchar *tid)
 gboolean
 pk_transaction_db_set_role (PkTransactionDb *tdb, const gchar *tid, PkRoleEnum role)
 {
-	const gchar *role_text;
-	_cleanup_free_ gchar *statement = NULL;
-
 	g_return_val_if_fail (PK_IS_TRANSACTION_DB (tdb), FALSE);
 
-	role_text = pk_role_enum_to_string (role);
-	statement = g_strdup_printf ("UPDATE transactions SET role = '%s' WHERE transaction_id = '%s'", role_text, tid);
-	pk_transaction_db_sql_statement (tdb, statement);
+	pk_transaction_db_update_text (tdb, PK_TRANSACTION_DB_STATEMENT_SET_ROLE,
+				       tid, pk_role_enum_to_string (role));
 	return TRUE;
 }
 
@@ -347,12 +635,16 @@ pk_transaction_db_set_role (PkTransactionDb *tdb, const gchar *tid, PkRoleEnum r
 gboolean
 pk_transaction_db_set_uid (PkTransactionDb *tdb, const gchar *tid, guint uid)
 {
-	_cleanup_free_ gchar *statement = NULL;
+	sqlite3_stmt *statement;
 
 	g_return_val_if_fail (PK_IS_TRANSACTION_DB (tdb), FALSE);
 
-	statement = g_strdup_printf ("UPDATE transactions SET uid = '%i' WHERE transaction_id = '%s'", uid, tid);
-	pk_transaction_db_sql_statement (tdb, statement);
+	statement = pk_transaction_db_get_statement (tdb, PK_TRANSACTION_DB_STATEMENT_SET_UID);
+	if (statement == NULL)
+		return TRUE;
+	sqlite3_bind_int64 (statement, 1, uid);
+	sqlite3_bind_text (statement, 2, tid, -1, SQLITE_STATIC);
+	pk_transaction_db_step (tdb, statement);
 	return TRUE;
 }
 
@@ -362,12 +654,10 @@ pk_transaction_db_set_uid (PkTransactionDb *tdb, const gchar *tid, guint uid)
 gboolean
 pk_transaction_db_set_cmdline (PkTransactionDb *tdb, const gchar *tid, const gchar *cmdline)
 {
-	_cleanup_free_ gchar *statement = NULL;
-
 	g_return_val_if_fail (PK_IS_TRANSACTION_DB (tdb), FALSE);
 
-	statement = g_strdup_printf ("UPDATE transactions SET cmdline = '%s' WHERE transaction_id = '%s'", cmdline, tid);
-	pk_transaction_db_sql_statement (tdb, statement);
+	pk_transaction_db_update_text (tdb, PK_TRANSACTION_DB_STATEMENT_SET_CMDLINE,
+				       tid, cmdline);
 	return TRUE;
 }
 
@@ -377,14 +667,10 @@ pk_transaction_db_set_cmdline (PkTransactionDb *tdb, const gchar *tid, const gch
 gboolean
 pk_transaction_db_set_data (PkTransactionDb *tdb, const gchar *tid, const gchar *data)
 {
-	_cleanup_free_ gchar *statement = NULL;
-
 	g_return_val_if_fail (PK_IS_TRANSACTION_DB (tdb), FALSE);
 
-	/* TODO: we have to be careful of SQL injection attacks */
-	statement = g_strdup_printf ("UPDATE transactions SET data = \"%s\" WHERE transaction_id = '%s'",
-				     data, tid);
-	pk_transaction_db_sql_statement (tdb, statement);
+	pk_transaction_db_update_text (tdb, PK_TRANSACTION_DB_STATEMENT_SET_DATA,
+				       tid, data);
 	return TRUE;
 }
 
@@ -396,13 +682,17 @@ pk_transaction_db_set_data (PkTransactionDb *tdb, const gchar *tid, const gchar
 gboolean
 pk_transaction_db_set_finished (PkTransactionDb *tdb, const gchar *tid, gboolean success, guint runtime)
 {
-	_cleanup_free_ gchar *statement = NULL;
+	sqlite3_stmt *statement;
 
 	g_return_val_if_fail (PK_IS_TRANSACTION_DB (tdb), FALSE);
 
-	statement = g_strdup_printf ("UPDATE transactions SET succeeded = %i, duration = %i WHERE transaction_id = '%s'",
-				     success, runtime, tid);
-	pk_transaction_db_sql_statement (tdb, statement);
+	statement = pk_transaction_db_get_statement (tdb, PK_TRANSACTION_DB_STATEMENT_SET_FINISHED);
+	if (statement == NULL)
+		return TRUE;
+	sqlite3_bind_int (statement, 1, success);
+	sqlite3_bind_int64 (statement, 2, runtime);
+	sqlite3_bind_text (statement, 3, tid, -1, SQLITE_STATIC);
+	pk_transaction_db_step (tdb, statement);
 	return TRUE;
 }
 
@@ -450,6 +740,7 @@ pk_transaction_sqlite_job_id_cb (void *data, gint argc, gchar **argv, gchar **co
 		return 0;
 	}
 	pk_strtouint (argv[0], &tdb->priv->job_count);
+	tdb->priv->job_count_reserved = tdb->priv->job_count;
 	return 0;
 }
 
@@ -483,33 +774,38 @@ pk_transaction_db_get_random_hex_string (guint length)
 static gboolean
 pk_transaction_db_defer_write_job_count_cb (PkTransactionDb *tdb)
 {
-	gchar *error_msg = NULL;
 	gint rc;
-	_cleanup_free_ gchar *statement = NULL;
+	guint job_count_reserved;
+	sqlite3_stmt *statement;
+
+	tdb->priv->database_save_id = 0;
 
 	/* not loaded! */
 	if (tdb->priv->db == NULL) {
 		g_warning ("PkTransactionDb not loaded");
-		goto out;
+		return FALSE;
 	}
 
-	/* force fsync as we don't want to repeat this number */
-	sqlite3_exec (tdb->priv->db, "PRAGMA synchronous=ON", NULL, NULL, NULL);
+	/* save the highest job count we might use before the next write */
+	job_count_reserved = tdb->priv->job_count + PK_TRANSACTION_DB_JOB_COUNT_RESERVE;
+	statement = pk_transaction_db_get_statement (tdb, PK_TRANSACTION_DB_STATEMENT_SET_JOB_COUNT);
+	if (statement == NULL)
+		return FALSE;
+	sqlite3_bind_int64 (statement, 1, job_count_reserved);
+	if (!pk_transaction_db_step (tdb, statement))
+		return FALSE;
 
-	/* save the job count */
-	statement = g_strdup_printf ("UPDATE config SET value = '%i' WHERE key = 'job_count'",
-				     tdb->priv->job_count);
-	rc = sqlite3_exec (tdb->priv->db, statement, NULL, NULL, &error_msg);
+	/* a commit is only synced to disk at the next WAL checkpoint, and
+	 * we don't want to repeat this number after a power failure */
+	rc = sqlite3_wal_checkpoint_v2 (tdb->priv->db, NULL,
+					SQLITE_CHECKPOINT_PASSIVE,
+					NULL, NULL);
 	if (rc != SQLITE_OK) {
-		g_warning ("failed to set job id: %s", error_msg);
-		sqlite3_free (error_msg);
-		goto out;
+		g_warning ("failed to sync job count: %s",
+			   sqlite3_errmsg (tdb->priv->db));
+		return FALSE;
 	}
-
-	/* turn off fsync */
-	sqlite3_exec (tdb->priv->db, "PRAGMA synchronous=OFF", NULL, NULL, NULL);
-out:
-	tdb->priv->database_save_id = 0;
+	tdb->priv->job_count_reserved = job_count_reserved;
 	return FALSE;
 }
 
@@ -528,7 +824,8 @@ pk_transaction_db_generate_id (PkTransactionDb *tdb)
 
 	/* we don't need to wait for the database write, just do this the
 	 * next time we are idle (but ensure we do this on shutdown) */
-	if (tdb->priv->database_save_id == 0) {
+	if (tdb->priv->job_count >= tdb->priv->job_count_reserved &&
+	    tdb->priv->database_save_id == 0) {
 		tdb->priv->database_save_id =
 			g_idle_add_full (G_PRIORITY_LOW, (GSourceFunc)
 					 pk_transaction_db_defer_write_job_count_cb, tdb, NULL);
@@ -541,60 +838,6 @@ pk_transaction_db_generate_id (PkTransactionDb *tdb)
 	return tid;
 }
 
-/**
- * pk_transaction_sqlite_proxy_cb:
- **/
-static gint
-pk_transaction_sqlite_proxy_cb (void *data, gint argc, gchar **argv, gchar **col_name)
-{
-	PkTransactionDbProxyItem *item = (PkTransactionDbProxyItem *) data;
-	gint i;
-
-	g_return_val_if_fail (item != NULL, 0);
-
-	for (i = 0; i < argc; i++) {
-		if (g_strcmp0 (col_name[i], "proxy_http") == 0) {
-			item->proxy_http = g_strdup (argv[i]);
-			item->set = TRUE;
-		} else if (g_strcmp0 (col_name[i], "proxy_https") == 0) {
-			item->proxy_https = g_strdup (argv[i]);
-			item->set = TRUE;
-		} else if (g_strcmp0 (col_name[i], "proxy_ftp") == 0) {
-			item->proxy_ftp = g_strdup (argv[i]);
-			item->set = TRUE;
-		} else if (g_strcmp0 (col_name[i], "proxy_socks") == 0) {
-			item->proxy_socks = g_strdup (argv[i]);
-			item->set = TRUE;
-		} else if (g_strcmp0 (col_name[i], "no_proxy") == 0) {
-			item->no_proxy = g_strdup (argv[i]);
-			item->set = TRUE;
-		} else if (g_strcmp0 (col_name[i], "pac") == 0) {
-			item->pac = g_strdup (argv[i]);
-			item->set = TRUE;
-		} else {
-			g_warning ("%s = %s", col_name[i], argv[i]);
-		}
-	}
-	return 0;
-}
-
-/**
- * pk_transaction_db_proxy_item_free:
- **/
-static void
-pk_transaction_db_proxy_item_free (PkTransactionDbProxyItem *item)
-{
-	if (item == NULL)
-		return;
-	g_free (item->proxy_http);
-	g_free (item->proxy_https);
-	g_free (item->proxy_ftp);
-	g_free (item->proxy_socks);
-	g_free (item->no_proxy);
-	g_free (item->pac);
-	g_free (item);
-}
-
 /**
  * pk_transaction_db_get_proxy:
  * @tdb: the #PkTransactionDb instance
@@ -616,52 +859,44 @@ pk_transaction_db_get_proxy (PkTransactionDb *tdb, guint uid, const gchar *sessi
 			     gchar **no_proxy,
 			     gchar **pac)
 {
-	gchar *error_msg = NULL;
-	gboolean ret = FALSE;
 	gint rc;
-	PkTransactionDbProxyItem *item;
-	_cleanup_free_ gchar *statement = NULL;
+	sqlite3_stmt *statement;
 
 	g_return_val_if_fail (PK_IS_TRANSACTION_DB (tdb), FALSE);
 	g_return_val_if_fail (uid != G_MAXUINT, FALSE);
 
 	/* get existing data */
-	item = g_new0 (PkTransactionDbProxyItem, 1);
-	statement = g_strdup_printf ("SELECT proxy_http, proxy_https, proxy_ftp, proxy_socks, no_proxy, pac FROM proxy WHERE uid = '%i' AND session = '%s' LIMIT 1",
-				     uid, session);
-	rc = sqlite3_exec (tdb->priv->db, statement,
-			   pk_transaction_sqlite_proxy_cb,
-			   item,
-			   &error_msg);
-	if (rc != SQLITE_OK) {
-		g_warning ("SQL error: %s", error_msg);
-		sqlite3_free (error_msg);
-		goto out;
+	statement = pk_transaction_db_get_statement (tdb, PK_TRANSACTION_DB_STATEMENT_GET_PROXY);
+	if (statement == NULL)
+		return FALSE;
+	sqlite3_bind_int (statement, 1, uid);
+	sqlite3_bind_text (statement, 2, session, -1, SQLITE_STATIC);
+	rc = sqlite3_step (statement);
+	if (rc != SQLITE_ROW) {
+		/* nothing matched */
+		if (rc != SQLITE_DONE)
+			g_warning ("SQL error: %s", sqlite3_errmsg (tdb->priv->db));
+		pk_transaction_db_statement_done (statement);
+		return FALSE;
 	}
 
-	/* nothing matched */
-	if (!item->set)
-		goto out;
-
-	/* success, even if we got no data */
-	ret = TRUE;
-
 	/* copy data */
 	if (proxy_http != NULL)
-		*proxy_http = g_strdup (item->proxy_http);
+		*proxy_http = g_strdup (pk_transaction_db_column_text (statement, 0));
 	if (proxy_https != NULL)
-		*proxy_https = g_strdup (item->proxy_https);
+		*proxy_https = g_strdup (pk_transaction_db_column_text (statement, 1));
 	if (proxy_ftp != NULL)
-		*proxy_ftp = g_strdup (item->proxy_ftp);
+		*proxy_ftp = g_strdup (pk_transaction_db_column_text (statement, 2));
 	if (proxy_socks != NULL)
-		*proxy_socks = g_strdup (item->proxy_socks);
+		*proxy_socks = g_strdup (pk_transaction_db_column_text (statement, 3));
 	if (no_proxy != NULL)
-		*no_proxy = g_strdup (item->no_proxy);
+		*no_proxy = g_strdup (pk_transaction_db_column_text (statement, 4));
 	if (pac != NULL)
-		*pac = g_strdup (item->pac);
-out:
-	pk_transaction_db_proxy_item_free (item);
-	return ret;
+		*pac = g_strdup (pk_transaction_db_column_text (statement, 5));
+	pk_transaction_db_statement_done (statement);
+
+	/* success, even if we got no data */
+	return TRUE;
 }
 
 /**
@@ -812,26 +1047,74 @@ pk_transaction_db_ensure_file_directory (const gchar *path)
 }
 
 /**
- * pk_transaction_db_execute:
+ * pk_transaction_db_migrate_history:
+ *
+ * Fills the history table from the data of the transactions recorded
+ * before it existed.
  **/
 static gboolean
-pk_transaction_db_execute (PkTransactionDb *tdb,
-			   const gchar *statement,
-			   GError **error)
+pk_transaction_db_migrate_history (PkTransactionDb *tdb, GError **error)
 {
+	const gchar *data;
 	gboolean ret = TRUE;
 	gint rc;
+	guint cnt = 0;
+	guint i;
+	sqlite3_stmt *statement = NULL;
+	_cleanup_object_unref_ PkPackage *package = NULL;
 
-	/* wrap this up */
-	rc = sqlite3_exec (tdb->priv->db, statement, NULL, NULL, NULL);
+	rc = sqlite3_prepare_v2 (tdb->priv->db,
+				 "SELECT transaction_id, timespec, uid, data FROM transactions "
+				 "WHERE succeeded = 1 AND data IS NOT NULL",
+				 -1, &statement, NULL);
 	if (rc != SQLITE_OK) {
-		ret = FALSE;
-		g_set_error (error,
-			     1, 0,
-			     "Failed to execute statement '%s': %s",
-			     statement,
+		g_set_error (error, 1, 0,
+			     "failed to prepare statement: %s",
+			     sqlite3_errmsg (tdb->priv->db));
+		return FALSE;
+	}
+
+	package = pk_package_new ();
+	while (ret && (rc = sqlite3_step (statement)) == SQLITE_ROW) {
+		const gchar *tid;
+		GDateTime *datetime;
+		gint64 timestamp;
+		_cleanup_hashtable_unref_ GHashTable *names = NULL;
+		_cleanup_strv_free_ gchar **package_lines = NULL;
+
+		/* transactions without a timestamp are not interesting */
+		datetime = pk_iso8601_to_datetime (pk_transaction_db_column_text (statement, 1));
+		if (datetime == NULL)
+			continue;
+		timestamp = g_date_time_to_unix (datetime);
+		g_date_time_unref (datetime);
+
+		tid = pk_transaction_db_column_text (statement, 0);
+		data = pk_transaction_db_column_text (statement, 3);
+		names = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+		package_lines = g_strsplit (data, "\n", -1);
+		for (i = 0; package_lines[i] != NULL && ret; i++) {
+			_cleanup_error_free_ GError *error_local = NULL;
+			if (!pk_package_parse (package, package_lines[i], &error_local)) {
+				g_warning ("ignoring history for %s: %s",
+					   tid, error_local->message);
+				continue;
+			}
+			ret = pk_transaction_db_history_add_package (tdb, tid,
+								     sqlite3_column_int (statement, 2),
+								     timestamp, package, names);
+		}
+		cnt++;
+	}
+	if (ret && rc != SQLITE_DONE) {
+		g_set_error (error, 1, 0, "failed to read transactions: %s",
 			     sqlite3_errmsg (tdb->priv->db));
+		ret = FALSE;
+	} else if (!ret) {
+		g_set_error_literal (error, 1, 0, "failed to add history");
 	}
+	sqlite3_finalize (statement);
+	g_debug ("migrated history of %u transactions", cnt);
 	return ret;
 }
 
@@ -865,8 +1148,11 @@ pk_transaction_db_load (PkTransactionDb *tdb, GError **error)
 		return FALSE;
 	}
 
-	/* we don't need to keep doing fsync */
-	if (!pk_transaction_db_execute (tdb, "PRAGMA synchronous=OFF", error))
+	/* with a write-ahead log we only need to fsync at checkpoints, and
+	 * readers don't block the writer */
+	if (!pk_transaction_db_execute (tdb, "PRAGMA journal_mode=WAL", error))
+		return FALSE;
+	if (!pk_transaction_db_execute (tdb, "PRAGMA synchronous=NORMAL", error))
 		return FALSE;
 
 	/* check transactions */
@@ -887,6 +1173,12 @@ pk_transaction_db_load (PkTransactionDb *tdb, GError **error)
 			return FALSE;
 	}
 
+	/* GetOldTransactions sorts by time, and the history is looked up by role */
+	statement = "CREATE INDEX IF NOT EXISTS transactions_timespec ON transactions (timespec);"
+		    "CREATE INDEX IF NOT EXISTS transactions_role ON transactions (role);";
+	if (!pk_transaction_db_execute (tdb, statement, error))
+		return FALSE;
+
 	/* check last_action (since 0.3.10) */
 	if (!pk_transaction_db_execute (tdb, "SELECT * FROM last_action LIMIT 1", &error_local)) {
 		g_debug ("adding last action details: %s", error_local->message);
@@ -932,6 +1224,29 @@ pk_transaction_db_load (PkTransactionDb *tdb, GError **error)
 			return FALSE;
 	}
 
+	/* package history, split out of the transaction data (since 1.0.7) */
+	if (!pk_transaction_db_execute (tdb, "SELECT * FROM history LIMIT 1", &error_local)) {
+		g_debug ("adding table history: %s", error_local->message);
+		g_clear_error (&error_local);
+		if (!pk_transaction_db_begin (tdb)) {
+			pk_transaction_db_commit (tdb);
+			g_set_error_literal (error, 1, 0, "failed to begin migration");
+			return FALSE;
+		}
+		statement = "CREATE TABLE history (transaction_id TEXT, name TEXT, arch TEXT, "
+			    "version TEXT, data TEXT, info INTEGER, timestamp INTEGER, uid INTEGER);"
+			    "CREATE INDEX history_name ON history (name, timestamp);";
+		if (!pk_transaction_db_execute (tdb, statement, error) ||
+		    !pk_transaction_db_migrate_history (tdb, error)) {
+			pk_transaction_db_rollback (tdb);
+			return FALSE;
+		}
+		if (!pk_transaction_db_commit (tdb)) {
+			g_set_error_literal (error, 1, 0, "failed to commit migration");
+			return FALSE;
+		}
+	}
+
 	/* try to set correct permissions */
 	g_chmod (PK_DB_DIR "/transactions.db", 0644);
 
@@ -957,14 +1272,21 @@ static void
 pk_transaction_db_finalize (GObject *object)
 {
 	PkTransactionDb *tdb;
+	guint i;
 	g_return_if_fail (PK_IS_TRANSACTION_DB (object));
 	tdb = PK_TRANSACTION_DB (object);
 	g_return_if_fail (tdb->priv != NULL);
 
 	/* if we shutdown with a deferred database write, then enforce it here */
 	if (tdb->priv->database_save_id != 0) {
-		pk_transaction_db_defer_write_job_count_cb (tdb);
 		g_source_remove (tdb->priv->database_save_id);
+		pk_transaction_db_defer_write_job_count_cb (tdb);
+	}
+
+	/* the database cannot be closed with statements still prepared */
+	for (i = 0; i < PK_TRANSACTION_DB_STATEMENT_LAST; i++) {
+		if (tdb->priv->statements[i] != NULL)
+			sqlite3_finalize (tdb->priv->statements[i]);
 	}
 
 	/* close the database */
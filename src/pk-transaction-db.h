@@ -47,6 +47,15 @@ typedef struct
 	GObjectClass	parent_class;
 } PkTransactionDbClass;
 
+typedef struct
+{
+	PkInfoEnum		 info;
+	gchar			*version;
+	gchar			*data;
+	gint64			 timestamp;
+	guint			 uid;
+} PkTransactionDbHistoryItem;
+
 GType		 pk_transaction_db_get_type		(void);
 PkTransactionDb	*pk_transaction_db_new			(void);
 gboolean	 pk_transaction_db_load			(PkTransactionDb	*tdb,
@@ -54,6 +63,8 @@ gboolean	 pk_transaction_db_load			(PkTransactionDb	*tdb,
 gboolean	 pk_transaction_db_empty		(PkTransactionDb	*tdb);
 gboolean	 pk_transaction_db_add			(PkTransactionDb	*tdb,
 							 const gchar		*tid);
+gboolean	 pk_transaction_db_begin		(PkTransactionDb	*tdb);
+gboolean	 pk_transaction_db_commit		(PkTransactionDb	*tdb);
 gboolean	 pk_transaction_db_print		(PkTransactionDb	*tdb);
 gboolean	 pk_transaction_db_set_role		(PkTransactionDb	*tdb,
 							 const gchar		*tid,
@@ -73,6 +84,14 @@ gboolean	 pk_transaction_db_set_data		(PkTransactionDb	*tdb,
 							 const gchar		*data);
 GList		*pk_transaction_db_get_list		(PkTransactionDb	*tdb,
 							 guint			 limit);
+gboolean	 pk_transaction_db_add_history		(PkTransactionDb	*tdb,
+							 const gchar		*tid,
+							 guint			 uid,
+							 gint64			 timestamp,
+							 GPtrArray		*packages);
+GPtrArray	*pk_transaction_db_get_package_history	(PkTransactionDb	*tdb,
+							 const gchar		*name,
+							 guint			 limit);
 gboolean	 pk_transaction_db_action_time_reset	(PkTransactionDb	*tdb,
 							 PkRoleEnum		 role);
 guint		 pk_transaction_db_action_time_since	(PkTransactionDb	*tdb,
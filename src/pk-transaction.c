@@ -40,9 +40,11 @@
 #include <glib/gstdio.h>
 #include <glib/gi18n.h>
 #include <gio/gio.h>
+#include <gio/gunixfdlist.h>
 #include <packagekit-glib2/pk-common.h>
 #include <packagekit-glib2/pk-enum.h>
 #include <packagekit-glib2/pk-offline-private.h>
+#include <packagekit-glib2/pk-results-private.h>
 #include <packagekit-glib2/pk-package-id.h>
 #include <packagekit-glib2/pk-package-ids.h>
 #include <packagekit-glib2/pk-results.h>
@@ -91,6 +93,14 @@ struct PkTransactionPrivate
 	gboolean		 emit_media_change_required;
 	gboolean		 caller_active;
 	gboolean		 exclusive;
+	gboolean		 emit_packages;
+	gboolean		 results_fd_enabled;
+	gint			 results_fd;
+	gchar			*results_cache_key;
+	guint			 results_cache_generation;
+	gboolean		 results_from_cache;
+	PkResults		*cached_results;
+	guint			 replay_id;
 	guint			 uid;
 	guint			 watch_id;
 	PkBackend		*backend;
@@ -489,24 +499,28 @@ pk_transaction_locked_changed_cb (PkBackendJob *job,
 }
 
 /**
- * pk_transaction_details_cb:
+ * pk_transaction_results_fd_active:
+ *
+ * Return value: %TRUE if the results are sent in a memfd when finished
+ **/
+static gboolean
+pk_transaction_results_fd_active (PkTransaction *transaction)
+{
+	return transaction->priv->results_fd_enabled &&
+	       pk_results_fd_role_supported (transaction->priv->role);
+}
+
+/**
+ * pk_transaction_emit_details:
  **/
 static void
-pk_transaction_details_cb (PkBackendJob *job,
-			   PkDetails *item,
-			   PkTransaction *transaction)
+pk_transaction_emit_details (PkTransaction *transaction, PkDetails *item)
 {
 	GVariantBuilder builder;
 	PkGroupEnum group;
 	const gchar *tmp;
 	guint64 size;
 
-	g_return_if_fail (PK_IS_TRANSACTION (transaction));
-	g_return_if_fail (transaction->priv->tid != NULL);
-
-	/* add to results */
-	pk_results_add_details (transaction->priv->results, item);
-
 	/* emit */
 	g_debug ("emitting details");
 	g_variant_builder_init (&builder, G_VARIANT_TYPE("a{sv}"));
@@ -546,6 +560,49 @@ pk_transaction_details_cb (PkBackendJob *job,
 				       NULL);
 }
 
+/**
+ * pk_transaction_emit_package:
+ **/
+static void
+pk_transaction_emit_package (PkTransaction *transaction, PkPackage *item)
+{
+	const gchar *summary;
+
+	/* emit */
+	summary = pk_package_get_summary (item);
+	g_dbus_connection_emit_signal (transaction->priv->connection,
+				       NULL,
+				       transaction->priv->tid,
+				       PK_DBUS_INTERFACE_TRANSACTION,
+				       "Package",
+				       g_variant_new ("(uss)",
+						      pk_package_get_info (item),
+						      pk_package_get_id (item),
+						      summary ? summary : ""),
+				       NULL);
+}
+
+/**
+ * pk_transaction_details_cb:
+ **/
+static void
+pk_transaction_details_cb (PkBackendJob *job,
+			   PkDetails *item,
+			   PkTransaction *transaction)
+{
+	g_return_if_fail (PK_IS_TRANSACTION (transaction));
+	g_return_if_fail (transaction->priv->tid != NULL);
+
+	/* add to results */
+	pk_results_add_details (transaction->priv->results, item);
+
+	/* sent with the other results when finished */
+	if (pk_transaction_results_fd_active (transaction))
+		return;
+
+	pk_transaction_emit_details (transaction, item);
+}
+
 /**
  * pk_transaction_error_code_cb:
  **/
@@ -584,6 +641,30 @@ pk_transaction_error_code_cb (PkBackendJob *job,
 	}
 }
 
+/**
+ * pk_transaction_emit_files:
+ **/
+static void
+pk_transaction_emit_files (PkTransaction *transaction, PkFiles *item)
+{
+	const gchar *package_id;
+	gchar **files;
+
+	/* emit */
+	package_id = pk_files_get_package_id (item);
+	files = pk_files_get_files (item);
+	g_debug ("emitting files %s", package_id);
+	g_dbus_connection_emit_signal (transaction->priv->connection,
+				       NULL,
+				       transaction->priv->tid,
+				       PK_DBUS_INTERFACE_TRANSACTION,
+				       "Files",
+				       g_variant_new ("(s^as)",
+						      package_id != NULL ? package_id : "",
+						      files),
+				       NULL);
+}
+
 /**
  * pk_transaction_files_cb:
  **/
@@ -620,17 +701,11 @@ pk_transaction_files_cb (PkBackendJob *job,
 	/* add to results */
 	pk_results_add_files (transaction->priv->results, item);
 
-	/* emit */
-	g_debug ("emitting files %s", package_id);
-	g_dbus_connection_emit_signal (transaction->priv->connection,
-				       NULL,
-				       transaction->priv->tid,
-				       PK_DBUS_INTERFACE_TRANSACTION,
-				       "Files",
-				       g_variant_new ("(s^as)",
-						      package_id != NULL ? package_id : "",
-						      files),
-				       NULL);
+	/* sent with the other results when finished */
+	if (pk_transaction_results_fd_active (transaction))
+		return;
+
+	pk_transaction_emit_files (transaction, item);
 }
 
 /**
@@ -829,7 +904,9 @@ pk_transaction_set_state (PkTransaction *transaction, PkTransactionState state)
 	     priv->role == PK_ROLE_ENUM_INSTALL_PACKAGES ||
 	     priv->role == PK_ROLE_ENUM_UPDATE_PACKAGES)) {
 
-		/* add to database */
+		/* add to database, with the details in the same commit if
+		 * possible; the commit is needed even if this fails */
+		pk_transaction_db_begin (priv->transaction_db);
 		pk_transaction_db_add (priv->transaction_db, priv->tid);
 
 		/* save role in the database */
@@ -841,6 +918,8 @@ pk_transaction_set_state (PkTransaction *transaction, PkTransactionState state)
 		/* save cmdline in db */
 		if (priv->cmdline != NULL)
 			pk_transaction_db_set_cmdline (priv->transaction_db, priv->tid, priv->cmdline);
+		if (!pk_transaction_db_commit (priv->transaction_db))
+			g_warning ("failed to write new transaction %s in one commit", priv->tid);
 
 		/* report to syslog */
 		syslog (LOG_DAEMON | LOG_DEBUG,
@@ -1058,6 +1137,70 @@ pk_transaction_offline_finished (PkTransaction *transaction)
 	}
 }
 
+/**
+ * pk_transaction_results_fd_finish:
+ *
+ * Writes the results kept back from the client into a sealed memfd it
+ * gets with GetResultsFd, or emits them as usual if that is not possible.
+ **/
+static void
+pk_transaction_results_fd_finish (PkTransaction *transaction, PkExitEnum exit_enum)
+{
+	guint i;
+	_cleanup_error_free_ GError *error = NULL;
+	_cleanup_ptrarray_unref_ GPtrArray *packages = NULL;
+	_cleanup_ptrarray_unref_ GPtrArray *details = NULL;
+	_cleanup_ptrarray_unref_ GPtrArray *files = NULL;
+
+	if (exit_enum == PK_EXIT_ENUM_SUCCESS) {
+		transaction->priv->results_fd = pk_results_fd_write (transaction->priv->results, &error);
+		if (transaction->priv->results_fd >= 0)
+			return;
+		g_warning ("failed to write results: %s", error->message);
+	}
+
+	packages = pk_results_get_package_array (transaction->priv->results);
+	for (i = 0; i < packages->len; i++)
+		pk_transaction_emit_package (transaction, g_ptr_array_index (packages, i));
+	details = pk_results_get_details_array (transaction->priv->results);
+	for (i = 0; i < details->len; i++)
+		pk_transaction_emit_details (transaction, g_ptr_array_index (details, i));
+	files = pk_results_get_files_array (transaction->priv->results);
+	for (i = 0; i < files->len; i++)
+		pk_transaction_emit_files (transaction, g_ptr_array_index (files, i));
+}
+
+/**
+ * pk_transaction_role_changes_system:
+ *
+ * Return value: %TRUE if the transaction may change the packages or repos
+ **/
+static gboolean
+pk_transaction_role_changes_system (PkTransaction *transaction)
+{
+	PkBitfield transaction_flags = transaction->priv->cached_transaction_flags;
+
+	if (pk_bitfield_contain (transaction_flags, PK_TRANSACTION_FLAG_ENUM_SIMULATE) ||
+	    pk_bitfield_contain (transaction_flags, PK_TRANSACTION_FLAG_ENUM_ONLY_DOWNLOAD))
+		return FALSE;
+
+	switch (transaction->priv->role) {
+	case PK_ROLE_ENUM_INSTALL_FILES:
+	case PK_ROLE_ENUM_INSTALL_PACKAGES:
+	case PK_ROLE_ENUM_INSTALL_SIGNATURE:
+	case PK_ROLE_ENUM_REFRESH_CACHE:
+	case PK_ROLE_ENUM_REMOVE_PACKAGES:
+	case PK_ROLE_ENUM_REPAIR_SYSTEM:
+	case PK_ROLE_ENUM_REPO_ENABLE:
+	case PK_ROLE_ENUM_REPO_REMOVE:
+	case PK_ROLE_ENUM_REPO_SET_DATA:
+	case PK_ROLE_ENUM_UPDATE_PACKAGES:
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
 /**
  * pk_transaction_finished_cb:
  **/
@@ -1111,10 +1254,33 @@ pk_transaction_finished_cb (PkBackendJob *job, PkExitEnum exit_enum, PkTransacti
 	if (exit_enum == PK_EXIT_ENUM_SUCCESS)
 		pk_transaction_finish_invalidate_caches (transaction);
 
+	/* the results of earlier queries may be out of date now, even if
+	 * the transaction failed half way through */
+	if (pk_transaction_role_changes_system (transaction))
+		pk_results_cache_invalidate (pk_backend_get_results_cache (transaction->priv->backend));
+
+	/* keep the results for identical queries */
+	if (transaction->priv->results_cache_key != NULL &&
+	    !transaction->priv->results_from_cache &&
+	    exit_enum == PK_EXIT_ENUM_SUCCESS) {
+		_cleanup_object_unref_ PkError *error_code = NULL;
+		error_code = pk_results_get_error_code (transaction->priv->results);
+		if (error_code == NULL) {
+			pk_results_cache_add (pk_backend_get_results_cache (transaction->priv->backend),
+					      transaction->priv->results_cache_key,
+					      transaction->priv->results_cache_generation,
+					      transaction->priv->results);
+		}
+	}
+
 	/* find the length of time we have been running */
 	time_ms = pk_transaction_get_runtime (transaction);
 	g_debug ("backend was running for %i ms", time_ms);
 
+	/* write everything about the finished transaction in one commit if
+	 * possible; the commit is needed even if this fails */
+	pk_transaction_db_begin (transaction->priv->transaction_db);
+
 	/* add to the database if we are going to log it */
 	if (transaction->priv->role == PK_ROLE_ENUM_UPDATE_PACKAGES ||
 	    transaction->priv->role == PK_ROLE_ENUM_INSTALL_PACKAGES ||
@@ -1129,6 +1295,15 @@ pk_transaction_finished_cb (PkBackendJob *job, PkExitEnum exit_enum, PkTransacti
 		if (!pk_strzero (packages))
 			pk_transaction_db_set_data (transaction->priv->transaction_db, transaction->priv->tid, packages);
 
+		/* index the changed packages for GetPackageHistory */
+		if (exit_enum == PK_EXIT_ENUM_SUCCESS) {
+			pk_transaction_db_add_history (transaction->priv->transaction_db,
+						       transaction->priv->tid,
+						       transaction->priv->uid,
+						       g_get_real_time () / G_USEC_PER_SEC,
+						       array);
+		}
+
 		/* report to syslog */
 		for (i = 0; i < array->len; i++) {
 			item = g_ptr_array_index (array, i);
@@ -1163,6 +1338,10 @@ pk_transaction_finished_cb (PkBackendJob *job, PkExitEnum exit_enum, PkTransacti
 		pk_transaction_db_set_finished (transaction->priv->transaction_db, transaction->priv->tid, TRUE, time_ms);
 	else
 		pk_transaction_db_set_finished (transaction->priv->transaction_db, transaction->priv->tid, FALSE, time_ms);
+	if (!pk_transaction_db_commit (transaction->priv->transaction_db)) {
+		g_warning ("failed to write finished transaction %s in one commit",
+			   transaction->priv->tid);
+	}
 
 	/* remove any inhibit */
 	//TODO: on main interface
@@ -1188,33 +1367,36 @@ pk_transaction_finished_cb (PkBackendJob *job, PkExitEnum exit_enum, PkTransacti
 	/* this disconnects any pending signals */
 	pk_backend_job_disconnect_vfuncs (transaction->priv->job);
 
-	/* destroy the job */
-	pk_backend_stop_job (transaction->priv->backend, transaction->priv->job);
+	/* destroy the job, unless the results were replayed without one */
+	if (!transaction->priv->results_from_cache)
+		pk_backend_stop_job (transaction->priv->backend, transaction->priv->job);
+
+	/* hand over the results that were kept back */
+	if (pk_transaction_results_fd_active (transaction))
+		pk_transaction_results_fd_finish (transaction, exit_enum);
 
 	/* we emit last, as other backends will be running very soon after us, and we don't want to be notified */
 	pk_transaction_finished_emit (transaction, exit_enum, time_ms);
 }
 
 /**
- * pk_transaction_package_cb:
+ * pk_transaction_package_add:
+ *
+ * Checks the package the backend emitted and adds it to the results.
+ *
+ * Return value: %FALSE if the package should not be sent to the client
  **/
-static void
-pk_transaction_package_cb (PkBackend *backend,
-			   PkPackage *item,
-			   PkTransaction *transaction)
+static gboolean
+pk_transaction_package_add (PkTransaction *transaction, PkPackage *item)
 {
 	const gchar *role_text;
 	PkInfoEnum info;
 	const gchar *package_id;
-	const gchar *summary = NULL;
-
-	g_return_if_fail (PK_IS_TRANSACTION (transaction));
-	g_return_if_fail (transaction->priv->tid != NULL);
 
 	/* have we already been marked as finished? */
 	if (transaction->priv->finished) {
 		g_warning ("Already finished");
-		return;
+		return FALSE;
 	}
 
 	/* check the backend is doing the right thing */
@@ -1225,7 +1407,7 @@ pk_transaction_package_cb (PkBackend *backend,
 			role_text = pk_role_enum_to_string (transaction->priv->role);
 			g_warning ("%s emitted 'installed' rather than 'installing'",
 				   role_text);
-			return;
+			return FALSE;
 		}
 	}
 
@@ -1237,7 +1419,7 @@ pk_transaction_package_cb (PkBackend *backend,
 			g_warning ("%s emitted package that was installed when "
 				   "the ~installed filter is in place",
 				   role_text);
-			return;
+			return FALSE;
 		}
 	}
 	if (pk_bitfield_contain (transaction->priv->cached_filters,
@@ -1247,7 +1429,7 @@ pk_transaction_package_cb (PkBackend *backend,
 			g_warning ("%s emitted package that was ~installed when "
 				   "the installed filter is in place",
 				   role_text);
-			return;
+			return FALSE;
 		}
 	}
 
@@ -1255,26 +1437,99 @@ pk_transaction_package_cb (PkBackend *backend,
 	if (info != PK_INFO_ENUM_FINISHED)
 		pk_results_add_package (transaction->priv->results, item);
 
-	/* emit */
 	package_id = pk_package_get_id (item);
 	g_free (transaction->priv->last_package_id);
 	transaction->priv->last_package_id = g_strdup (package_id);
-	summary = pk_package_get_summary (item);
 	if (transaction->priv->role != PK_ROLE_ENUM_GET_PACKAGES) {
 		g_debug ("emit package %s, %s, %s",
 			 pk_info_enum_to_string (info),
 			 package_id,
-			 summary);
+			 pk_package_get_summary (item));
 	}
+	return TRUE;
+}
+
+/**
+ * pk_transaction_package_cb:
+ **/
+static void
+pk_transaction_package_cb (PkBackend *backend,
+			   PkPackage *item,
+			   PkTransaction *transaction)
+{
+	g_return_if_fail (PK_IS_TRANSACTION (transaction));
+	g_return_if_fail (transaction->priv->tid != NULL);
+
+	if (!pk_transaction_package_add (transaction, item))
+		return;
+
+	/* sent with the other results when finished */
+	if (pk_transaction_results_fd_active (transaction))
+		return;
+
+	pk_transaction_emit_package (transaction, item);
+}
+
+/**
+ * pk_transaction_packages_cb:
+ *
+ * Sends all the packages the backend emitted since the last main loop
+ * iteration in one Packages signal if the client asked for it.
+ **/
+static void
+pk_transaction_packages_cb (PkBackend *backend,
+			    GPtrArray *array,
+			    PkTransaction *transaction)
+{
+	GVariantBuilder builder;
+	PkPackage *item;
+	const gchar *summary;
+	guint i;
+	guint len = 0;
+
+	g_return_if_fail (PK_IS_TRANSACTION (transaction));
+	g_return_if_fail (transaction->priv->tid != NULL);
+
+	/* sent with the other results when finished */
+	if (pk_transaction_results_fd_active (transaction)) {
+		for (i = 0; i < array->len; i++)
+			pk_transaction_package_add (transaction, g_ptr_array_index (array, i));
+		return;
+	}
+
+	/* the client only understands the Package signal */
+	if (!transaction->priv->emit_packages) {
+		for (i = 0; i < array->len; i++) {
+			item = g_ptr_array_index (array, i);
+			pk_transaction_package_cb (backend, item, transaction);
+		}
+		return;
+	}
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(uss)"));
+	for (i = 0; i < array->len; i++) {
+		item = g_ptr_array_index (array, i);
+		if (!pk_transaction_package_add (transaction, item))
+			continue;
+		summary = pk_package_get_summary (item);
+		g_variant_builder_add (&builder, "(uss)",
+				       pk_package_get_info (item),
+				       pk_package_get_id (item),
+				       summary ? summary : "");
+		len++;
+	}
+	if (len == 0) {
+		g_variant_builder_clear (&builder);
+		return;
+	}
+
+	/* emit */
 	g_dbus_connection_emit_signal (transaction->priv->connection,
 				       NULL,
 				       transaction->priv->tid,
 				       PK_DBUS_INTERFACE_TRANSACTION,
-				       "Package",
-				       g_variant_new ("(uss)",
-						      info,
-						      package_id,
-						      summary ? summary : ""),
+				       "Packages",
+				       g_variant_new ("(a(uss))", &builder),
 				       NULL);
 }
 
@@ -1715,6 +1970,131 @@ pk_transaction_percentage_cb (PkBackendJob *job,
 					      g_variant_new_uint32 (percentage));
 }
 
+/**
+ * pk_transaction_get_results_cache_key:
+ *
+ * Return value: a string describing the query, or %NULL if the results
+ * of the role cannot be cached
+ **/
+static gchar *
+pk_transaction_get_results_cache_key (PkTransaction *transaction)
+{
+	PkTransactionPrivate *priv = transaction->priv;
+	gchar *empty[] = { NULL };
+	gchar **values;
+	_cleanup_free_ gchar *locale = NULL;
+	_cleanup_variant_unref_ GVariant *key = NULL;
+
+	switch (priv->role) {
+	case PK_ROLE_ENUM_DEPENDS_ON:
+	case PK_ROLE_ENUM_GET_DETAILS:
+	case PK_ROLE_ENUM_GET_FILES:
+	case PK_ROLE_ENUM_GET_UPDATE_DETAIL:
+	case PK_ROLE_ENUM_REQUIRED_BY:
+	case PK_ROLE_ENUM_RESOLVE:
+		values = priv->cached_package_ids;
+		break;
+	case PK_ROLE_ENUM_SEARCH_DETAILS:
+	case PK_ROLE_ENUM_SEARCH_FILE:
+	case PK_ROLE_ENUM_SEARCH_GROUP:
+	case PK_ROLE_ENUM_SEARCH_NAME:
+	case PK_ROLE_ENUM_WHAT_PROVIDES:
+		values = priv->cached_values;
+		break;
+	case PK_ROLE_ENUM_GET_PACKAGES:
+	case PK_ROLE_ENUM_GET_UPDATES:
+		values = NULL;
+		break;
+	default:
+		return NULL;
+	}
+
+	locale = pk_backend_job_get_locale (priv->job);
+	key = g_variant_new ("(st^asbs)",
+			     pk_role_enum_to_string (priv->role),
+			     priv->cached_filters,
+			     values != NULL ? values : empty,
+			     priv->cached_force,
+			     locale != NULL ? locale : "");
+	g_variant_ref_sink (key);
+	return g_variant_print (key, FALSE);
+}
+
+/**
+ * pk_transaction_replay_cached_results_cb:
+ **/
+static gboolean
+pk_transaction_replay_cached_results_cb (PkTransaction *transaction)
+{
+	PkTransactionPrivate *priv = transaction->priv;
+	guint i;
+	_cleanup_object_unref_ PkResults *results = NULL;
+	_cleanup_ptrarray_unref_ GPtrArray *details = NULL;
+	_cleanup_ptrarray_unref_ GPtrArray *files = NULL;
+	_cleanup_ptrarray_unref_ GPtrArray *packages = NULL;
+	_cleanup_ptrarray_unref_ GPtrArray *update_details = NULL;
+
+	priv->replay_id = 0;
+	results = priv->cached_results;
+	priv->cached_results = NULL;
+
+	/* cancelled before the results were sent */
+	if (priv->finished)
+		return FALSE;
+
+	g_debug ("replaying cached results for %s", priv->tid);
+	packages = pk_results_get_package_array (results);
+	if (packages->len > 0)
+		pk_transaction_packages_cb (priv->backend, packages, transaction);
+	details = pk_results_get_details_array (results);
+	for (i = 0; i < details->len; i++)
+		pk_transaction_details_cb (priv->job, g_ptr_array_index (details, i), transaction);
+	update_details = pk_results_get_update_detail_array (results);
+	for (i = 0; i < update_details->len; i++)
+		pk_transaction_update_detail_cb (priv->backend, g_ptr_array_index (update_details, i), transaction);
+	files = pk_results_get_files_array (results);
+	for (i = 0; i < files->len; i++)
+		pk_transaction_files_cb (priv->job, g_ptr_array_index (files, i), transaction);
+	pk_transaction_finished_cb (priv->job, PK_EXIT_ENUM_SUCCESS, transaction);
+	return FALSE;
+}
+
+/**
+ * pk_transaction_replay_cached_results:
+ *
+ * Looks for the results of an identical query that ran since the package
+ * database last changed, and if found sends them from an idle handler so the
+ * caller sees the transaction running before it finishes, without a backend
+ * job.
+ *
+ * Return value: %TRUE if the results will be replayed
+ **/
+static gboolean
+pk_transaction_replay_cached_results (PkTransaction *transaction)
+{
+	PkResultsCache *cache;
+	PkTransactionPrivate *priv = transaction->priv;
+
+	g_free (priv->results_cache_key);
+	priv->results_cache_key = pk_transaction_get_results_cache_key (transaction);
+	if (priv->results_cache_key == NULL)
+		return FALSE;
+
+	/* the results are only kept if nothing changed while running */
+	cache = pk_backend_get_results_cache (priv->backend);
+	priv->results_cache_generation = pk_results_cache_get_generation (cache);
+	priv->cached_results = pk_results_cache_lookup (cache, priv->results_cache_key);
+	if (priv->cached_results == NULL)
+		return FALSE;
+
+	priv->results_from_cache = TRUE;
+	pk_transaction_status_changed_emit (transaction, PK_STATUS_ENUM_QUERY);
+	priv->replay_id = g_idle_add ((GSourceFunc) pk_transaction_replay_cached_results_cb,
+				      transaction);
+	g_source_set_name_by_id (priv->replay_id, "[PkTransaction] replay cached results");
+	return TRUE;
+}
+
 /**
  * pk_transaction_run:
  */
@@ -1746,6 +2126,10 @@ pk_transaction_run (PkTransaction *transaction)
 		return TRUE;
 	}
 
+	/* answer identical queries without running the backend */
+	if (pk_transaction_replay_cached_results (transaction))
+		return TRUE;
+
 	/* run the job */
 	pk_backend_start_job (priv->backend, priv->job);
 
@@ -1804,6 +2188,10 @@ pk_transaction_run (PkTransaction *transaction)
 				  PK_BACKEND_SIGNAL_PACKAGE,
 				  (PkBackendJobVFunc) pk_transaction_package_cb,
 				  transaction);
+	pk_backend_job_set_vfunc (priv->job,
+				  PK_BACKEND_SIGNAL_PACKAGES,
+				  (PkBackendJobVFunc) pk_transaction_packages_cb,
+				  transaction);
 	pk_backend_job_set_vfunc (priv->job,
 				  PK_BACKEND_SIGNAL_ITEM_PROGRESS,
 				  (PkBackendJobVFunc) pk_transaction_item_progress_cb,
@@ -2888,6 +3276,17 @@ skip_uid:
 		goto out;
 	}
 
+	/* the cached results have not been sent yet, and there is no job */
+	if (transaction->priv->replay_id > 0) {
+		g_source_remove (transaction->priv->replay_id);
+		transaction->priv->replay_id = 0;
+		pk_transaction_error_code_emit (transaction,
+						PK_ERROR_ENUM_TRANSACTION_CANCELLED,
+						"The task was stopped successfully");
+		pk_transaction_finished_emit (transaction, PK_EXIT_ENUM_CANCELLED, 0);
+		goto out;
+	}
+
 	/* set the state, as cancelling might take a few seconds */
 	pk_backend_job_set_status (transaction->priv->job, PK_STATUS_ENUM_CANCEL);
 
@@ -4809,6 +5208,39 @@ pk_transaction_set_hint (PkTransaction *transaction,
 		return TRUE;
 	}
 
+	/* packages-signal=true */
+	if (g_strcmp0 (key, "packages-signal") == 0) {
+		if (g_strcmp0 (value, "true") == 0) {
+			priv->emit_packages = TRUE;
+		} else if (g_strcmp0 (value, "false") == 0) {
+			priv->emit_packages = FALSE;
+		} else {
+			g_set_error (error,
+				     PK_TRANSACTION_ERROR,
+				     PK_TRANSACTION_ERROR_NOT_SUPPORTED,
+				      "packages-signal hint expects true or false, not %s", value);
+			return FALSE;
+		}
+		return TRUE;
+	}
+
+	/* results-fd=true */
+	if (g_strcmp0 (key, "results-fd") == 0) {
+		if (g_strcmp0 (value, "true") == 0) {
+			/* the client copes with getting signals instead */
+			priv->results_fd_enabled = pk_results_fd_supported ();
+		} else if (g_strcmp0 (value, "false") == 0) {
+			priv->results_fd_enabled = FALSE;
+		} else {
+			g_set_error (error,
+				     PK_TRANSACTION_ERROR,
+				     PK_TRANSACTION_ERROR_NOT_SUPPORTED,
+				      "results-fd hint expects true or false, not %s", value);
+			return FALSE;
+		}
+		return TRUE;
+	}
+
 	/* cache-age=<time-in-seconds> */
 	if (g_strcmp0 (key, "cache-age") == 0) {
 		guint cache_age;
@@ -4837,48 +5269,97 @@ pk_transaction_set_hint (PkTransaction *transaction,
 }
 
 /**
- * pk_transaction_set_hints:
+ * pk_transaction_apply_hints:
+ *
+ * Applies hints of the form key=value, as passed to SetHints or
+ * to CreateTransactionWithHints.
  */
-static void
-pk_transaction_set_hints (PkTransaction *transaction,
-			  GVariant *params,
-			  GDBusMethodInvocation *context)
+gboolean
+pk_transaction_apply_hints (PkTransaction *transaction,
+			    const gchar **hints,
+			    GError **error)
 {
-	gboolean ret;
 	guint i;
-	const gchar **hints = NULL;
-	_cleanup_error_free_ GError *error = NULL;
 	_cleanup_free_ gchar *dbg = NULL;
 
-	g_return_if_fail (PK_IS_TRANSACTION (transaction));
-	g_return_if_fail (transaction->priv->tid != NULL);
+	g_return_val_if_fail (PK_IS_TRANSACTION (transaction), FALSE);
 
-	g_variant_get (params, "(^a&s)", &hints);
 	dbg = g_strjoinv (", ", (gchar**) hints);
-	g_debug ("SetHints method called: %s", dbg);
+	g_debug ("applying hints: %s", dbg);
 
 	/* parse */
 	for (i = 0; hints[i] != NULL; i++) {
 		_cleanup_strv_free_ gchar **sections = NULL;
 		sections = g_strsplit (hints[i], "=", 2);
-		if (g_strv_length (sections) == 2) {
-			ret = pk_transaction_set_hint (transaction,
-						       sections[0],
-						       sections[1],
-						       &error);
-			if (!ret)
-				goto out;
-		} else {
-			g_set_error (&error, PK_TRANSACTION_ERROR,
-					     PK_TRANSACTION_ERROR_NOT_SUPPORTED,
-					     "Could not parse hint '%s'", hints[i]);
-			goto out;
+		if (g_strv_length (sections) != 2) {
+			g_set_error (error, PK_TRANSACTION_ERROR,
+				     PK_TRANSACTION_ERROR_NOT_SUPPORTED,
+				     "Could not parse hint '%s'", hints[i]);
+			return FALSE;
 		}
+		if (!pk_transaction_set_hint (transaction,
+					      sections[0],
+					      sections[1],
+					      error))
+			return FALSE;
 	}
-out:
+	return TRUE;
+}
+
+/**
+ * pk_transaction_set_hints:
+ */
+static void
+pk_transaction_set_hints (PkTransaction *transaction,
+			  GVariant *params,
+			  GDBusMethodInvocation *context)
+{
+	_cleanup_error_free_ GError *error = NULL;
+	_cleanup_free_ const gchar **hints = NULL;
+
+	g_return_if_fail (PK_IS_TRANSACTION (transaction));
+	g_return_if_fail (transaction->priv->tid != NULL);
+
+	g_debug ("SetHints method called");
+	g_variant_get (params, "(^a&s)", &hints);
+	pk_transaction_apply_hints (transaction, hints, &error);
 	pk_transaction_dbus_return (context, error);
 }
 
+/**
+ * pk_transaction_get_results_fd:
+ **/
+static void
+pk_transaction_get_results_fd (PkTransaction *transaction,
+			       GVariant *params,
+			       GDBusMethodInvocation *context)
+{
+	_cleanup_object_unref_ GUnixFDList *fd_list = NULL;
+	_cleanup_error_free_ GError *error = NULL;
+
+	g_return_if_fail (PK_IS_TRANSACTION (transaction));
+	g_return_if_fail (transaction->priv->tid != NULL);
+
+	if (transaction->priv->results_fd < 0) {
+		g_set_error_literal (&error,
+				     PK_TRANSACTION_ERROR,
+				     PK_TRANSACTION_ERROR_NOT_SUPPORTED,
+				     "No results were written for this transaction");
+		pk_transaction_dbus_return (context, error);
+		return;
+	}
+
+	/* the fd list takes a duplicate, so the results can be fetched again */
+	fd_list = g_unix_fd_list_new ();
+	if (g_unix_fd_list_append (fd_list, transaction->priv->results_fd, &error) < 0) {
+		pk_transaction_dbus_return (context, error);
+		return;
+	}
+	g_dbus_method_invocation_return_value_with_unix_fd_list (context,
+								 g_variant_new ("(h)", 0),
+								 fd_list);
+}
+
 /**
  * pk_transaction_update_packages:
  **/
@@ -5143,6 +5624,10 @@ pk_transaction_method_call (GDBusConnection *connection_, const gchar *sender,
 		pk_transaction_set_hints (transaction, parameters, invocation);
 		return;
 	}
+	if (g_strcmp0 (method_name, "GetResultsFd") == 0) {
+		pk_transaction_get_results_fd (transaction, parameters, invocation);
+		return;
+	}
 	if (g_strcmp0 (method_name, "AcceptEula") == 0) {
 		pk_transaction_accept_eula (transaction, parameters, invocation);
 		return;
@@ -5385,6 +5870,7 @@ pk_transaction_init (PkTransaction *transaction)
 	transaction->priv->state = PK_TRANSACTION_STATE_UNKNOWN;
 	transaction->priv->dbus = pk_dbus_new ();
 	transaction->priv->results = pk_results_new ();
+	transaction->priv->results_fd = -1;
 	transaction->priv->supported_content_types = g_ptr_array_new_with_free_func (g_free);
 	transaction->priv->authority = polkit_authority_get_sync (NULL, &error);
 	if (transaction->priv->authority == NULL)
@@ -5467,6 +5953,11 @@ pk_transaction_finalize (GObject *object)
 	g_free (transaction->priv->tid);
 	g_free (transaction->priv->sender);
 	g_free (transaction->priv->cmdline);
+	g_free (transaction->priv->results_cache_key);
+	if (transaction->priv->replay_id > 0)
+		g_source_remove (transaction->priv->replay_id);
+	if (transaction->priv->cached_results != NULL)
+		g_object_unref (transaction->priv->cached_results);
 	g_ptr_array_unref (transaction->priv->supported_content_types);
 
 	if (transaction->priv->connection != NULL)
@@ -5481,6 +5972,8 @@ pk_transaction_finalize (GObject *object)
 	g_object_unref (transaction->priv->job);
 	g_object_unref (transaction->priv->transaction_db);
 	g_object_unref (transaction->priv->results);
+	if (transaction->priv->results_fd >= 0)
+		close (transaction->priv->results_fd);
 //	g_object_unref (transaction->priv->authority);
 	g_object_unref (transaction->priv->cancellable);
 
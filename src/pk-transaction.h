@@ -88,6 +88,9 @@ void		 pk_transaction_reset_after_lock_error		(PkTransaction *transaction);
 void		 pk_transaction_make_exclusive			(PkTransaction *transaction);
 void		 pk_transaction_skip_auth_checks		(PkTransaction *transaction,
 								 gboolean skip_checks);
+gboolean	 pk_transaction_apply_hints			(PkTransaction	*transaction,
+								 const gchar	**hints,
+								 GError		**error);
 
 G_END_DECLS
 